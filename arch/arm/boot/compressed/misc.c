@@ -185,16 +185,48 @@ static inline __ptr_t memcpy(__ptr_t __dest, __const __ptr_t __src,
 	return __dest;
 }
 
-/*
- * gzip delarations
- */
-#define OF(args)  args
 #define STATIC static
 
 typedef unsigned char  uch;
 typedef unsigned short ush;
 typedef unsigned long  ulg;
 
+static void error(char *m);
+
+extern char input_data[];
+extern char input_data_end[];
+
+static uch *output_data;
+static ulg output_ptr;
+
+static void putstr(const char *);
+
+extern int end;
+static ulg free_mem_ptr;
+static ulg free_mem_end_ptr;
+
+#ifdef CONFIG_KERNEL_LZO
+
+/*
+ * The image is decompressed straight to output_data; the uncompressed
+ * size is appended to piggy.lzo by the build.
+ */
+#include "../../../../lib/decompress_unlzo.c"
+
+static void do_decompress(void)
+{
+	decompress((unsigned char *)input_data, input_data_end - input_data,
+		   NULL, NULL, output_data, NULL, error);
+	output_ptr = get_unaligned_le32(input_data_end - 4);
+}
+
+#else
+
+/*
+ * gzip delarations
+ */
+#define OF(args)  args
+
 #define WSIZE 0x8000		/* Window size must be at least 32k, */
 				/* and a power of two */
 
@@ -235,23 +267,9 @@ static unsigned outcnt;		/* bytes in output buffer */
 
 static int  fill_inbuf(void);
 static void flush_window(void);
-static void error(char *m);
-
-extern char input_data[];
-extern char input_data_end[];
 
-static uch *output_data;
-static ulg output_ptr;
 static ulg bytes_out;
 
-static void error(char *m);
-
-static void putstr(const char *);
-
-extern int end;
-static ulg free_mem_ptr;
-static ulg free_mem_end_ptr;
-
 #ifdef STANDALONE_DEBUG
 #define NO_INFLATE_MALLOC
 #endif
@@ -299,6 +317,14 @@ void flush_window(void)
 	putstr(".");
 }
 
+static void do_decompress(void)
+{
+	makecrc();
+	gunzip();
+}
+
+#endif /* CONFIG_KERNEL_LZO */
+
 #ifndef arch_error
 #define arch_error(x)
 #endif
@@ -327,9 +353,8 @@ decompress_kernel(ulg output_start, ulg free_mem_ptr_p, ulg free_mem_ptr_end_p,
 
 	arch_decomp_setup();
 
-	makecrc();
 	putstr("Uncompressing Linux...");
-	gunzip();
+	do_decompress();
 	putstr(" done, booting the kernel.\n");
 	return output_ptr;
 }
@@ -341,9 +366,8 @@ int main()
 {
 	output_data = output_buffer;
 
-	makecrc();
 	putstr("Uncompressing Linux...");
-	gunzip();
+	do_decompress();
 	putstr("done.\n");
 	return 0;
 }
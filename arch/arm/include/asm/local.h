@@ -1 +1,67 @@
+/*
+ *  arch/arm/include/asm/local.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_LOCAL_H
+#define __ASM_ARM_LOCAL_H
+
 #include <asm-generic/local.h>
+
+#if __LINUX_ARM_ARCH__ >= 6
+
+/*
+ * A local_t is only ever modified by the CPU owning it, so unlike the
+ * atomic_t versions these need no smp_mb() around the exclusive access.
+ * This is the reserve and commit path of the lockless LTTng relay.
+ */
+#undef local_add_return
+#undef local_sub_return
+#undef local_inc_return
+#undef local_cmpxchg
+
+static inline long local_add_return(long i, local_t *l)
+{
+	unsigned long tmp;
+	long result;
+
+	__asm__ __volatile__("@ local_add_return\n"
+"1:	ldrex	%0, [%2]\n"
+"	add	%0, %0, %3\n"
+"	strex	%1, %0, [%2]\n"
+"	teq	%1, #0\n"
+"	bne	1b"
+	: "=&r" (result), "=&r" (tmp)
+	: "r" (&l->a.counter), "Ir" (i)
+	: "cc", "memory");
+
+	return result;
+}
+
+#define local_sub_return(i, l)	local_add_return(-(i), (l))
+#define local_inc_return(l)	local_add_return(1, (l))
+
+static inline long local_cmpxchg(local_t *l, long old, long new)
+{
+	unsigned long res;
+	long oldval;
+
+	do {
+		__asm__ __volatile__("@ local_cmpxchg\n"
+		"ldrex	%1, [%2]\n"
+		"mov	%0, #0\n"
+		"teq	%1, %3\n"
+		"strexeq %0, %4, [%2]\n"
+		    : "=&r" (res), "=&r" (oldval)
+		    : "r" (&l->a.counter), "Ir" (old), "r" (new)
+		    : "cc", "memory");
+	} while (res);
+
+	return oldval;
+}
+
+#endif /* __LINUX_ARM_ARCH__ >= 6 */
+
+#endif /* __ASM_ARM_LOCAL_H */
@@ -0,0 +1,29 @@
+/*
+ * arch/arm/include/asm/neon.h
+ *
+ * Use of the VFP/NEON registers by kernel code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+/*
+ * NEON code in the kernel must sit between these two calls, in process
+ * or softirq context, and must check cpu_has_neon() first.  Preemption
+ * is disabled in between, so keep the sections short.  Only code built
+ * from assembler should touch the registers: C built with -mfpu=neon is
+ * free to use them anywhere, outside the section too.
+ */
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+#endif
+
+#endif /* __ASM_ARM_NEON_H */
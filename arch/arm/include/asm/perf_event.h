@@ -0,0 +1,23 @@
+/*
+ *  linux/arch/arm/include/asm/perf_event.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __ARM_PERF_EVENT_H__
+#define __ARM_PERF_EVENT_H__
+
+/*
+ * The performance counter overflow is a regular interrupt rather than
+ * an NMI, so the interrupt handler runs the pending work itself with
+ * perf_event_do_pending() and there is nothing to kick here.
+ */
+static inline void set_perf_event_pending(void)
+{
+}
+
+#define PERF_EVENT_INDEX_OFFSET	0
+
+#endif /* __ARM_PERF_EVENT_H__ */
@@ -26,6 +26,15 @@ extern void * memset(void *, int, __kernel_size_t);
 
 extern void __memzero(void *ptr, __kernel_size_t n);
 
+#ifdef CONFIG_CPU_CORTEX_A8_STRING
+/*
+ * Sizes from which memcpy() and memset()/__memzero() use the Cortex-A8
+ * loops in arch/arm/lib/string-a8.S; ~0 when the CPU is not an A8.
+ * copy_page() follows memcpy().
+ */
+extern unsigned int __memcpy_a8_min, __memset_a8_min;
+#endif
+
 #define memset(p,v,n)							\
 	({								\
 	 	void *__p = (p); size_t __n = n;			\
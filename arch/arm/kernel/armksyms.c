@@ -50,6 +50,10 @@ extern void __aeabi_ulcmp(void);
 extern void fpundefinstr(void);
 extern void fp_enter(void);
 
+/* slice by 8 loop for lib/crc32.c */
+extern u32 arch_crc32_sliceby8(u32 crc, unsigned char const *buf, size_t len,
+			       const u32 (*tab)[256]);
+
 /*
  * This has a special calling convention; it doesn't
  * modify any of the usual registers, except for LR.
@@ -135,6 +139,10 @@ EXPORT_SYMBOL(__put_user_8);
 	/* crypto hash */
 EXPORT_SYMBOL(sha_transform);
 
+#ifdef CONFIG_ARCH_HAS_CRC32_SLICEBY8
+EXPORT_SYMBOL(arch_crc32_sliceby8);
+#endif
+
 	/* gcc lib functions */
 EXPORT_SYMBOL(__ashldi3);
 EXPORT_SYMBOL(__ashrdi3);
@@ -0,0 +1,1078 @@
+/*
+ *  linux/arch/arm/kernel/perf_event.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * ARM performance counter support.
+ *
+ * The counters are driven from the ARMv7 PMU (PMNC) as found on the
+ * Cortex-A8: a cycle counter plus four configurable event counters,
+ * each of which can raise the PMU interrupt when it overflows.  The
+ * counters are shared with oprofile through reserve_pmu(), and are only
+ * claimed while at least one hardware event exists.
+ *
+ * Callchains are available for every event, hardware or software:
+ * kernel frames are walked with the ARM unwinder (or frame pointers,
+ * whichever the kernel was built with) and user frames by following the
+ * APCS frame pointer chain.
+ */
+#define pr_fmt(fmt) "hw perfevents: " fmt
+
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/perf_event.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+
+#include <asm/cputype.h>
+#include <asm/irq.h>
+#include <asm/irq_regs.h>
+#include <asm/pmu.h>
+#include <asm/stacktrace.h>
+
+#ifdef CONFIG_HW_PERF_EVENTS
+
+/*
+ * Counter indexes as used in hw_perf_event.idx: the cycle counter comes
+ * first, followed by the event counters.
+ */
+#define ARMV7_CYCLE_COUNTER	0
+#define ARMV7_COUNTER0		1
+#define ARMV7_MAX_COUNTERS	5
+
+#define ARMV7_IDX_TO_COUNTER(idx)	((idx) - ARMV7_COUNTER0)
+
+/* The counters are 32 bits wide */
+#define ARMV7_MAX_PERIOD	((1LLU << 32) - 1)
+
+/* PMNC register bits */
+#define ARMV7_PMNC_E		(1 << 0) /* Enable all counters */
+#define ARMV7_PMNC_P		(1 << 1) /* Reset all counters */
+#define ARMV7_PMNC_C		(1 << 2) /* Cycle counter reset */
+#define ARMV7_PMNC_D		(1 << 3) /* CCNT counts every 64th cpu cycle */
+#define ARMV7_PMNC_MASK		0x3f	 /* Mask for writable bits */
+#define ARMV7_PMNC_N_SHIFT	11	 /* Number of counters supported */
+#define ARMV7_PMNC_N_MASK	0x1f
+
+/*
+ * The enable, interrupt enable and overflow flag registers all use the
+ * same layout: one bit per event counter and bit 31 for the cycle counter.
+ */
+#define ARMV7_CCNT_BIT		(1 << 31)
+#define ARMV7_COUNTERS_MASK	0x8000000f
+
+#define ARMV7_EVTSEL_MASK	0xff
+
+/* Common ARMv7 event types */
+enum armv7_perf_types {
+	ARMV7_PERFCTR_PMNC_SW_INCR		= 0x00,
+	ARMV7_PERFCTR_IFETCH_MISS		= 0x01,
+	ARMV7_PERFCTR_ITLB_MISS			= 0x02,
+	ARMV7_PERFCTR_DCACHE_REFILL		= 0x03,
+	ARMV7_PERFCTR_DCACHE_ACCESS		= 0x04,
+	ARMV7_PERFCTR_DTLB_REFILL		= 0x05,
+	ARMV7_PERFCTR_DREAD			= 0x06,
+	ARMV7_PERFCTR_DWRITE			= 0x07,
+	ARMV7_PERFCTR_INSTR_EXECUTED		= 0x08,
+	ARMV7_PERFCTR_EXC_TAKEN			= 0x09,
+	ARMV7_PERFCTR_EXC_EXECUTED		= 0x0A,
+	ARMV7_PERFCTR_CID_WRITE			= 0x0B,
+	ARMV7_PERFCTR_PC_WRITE			= 0x0C,
+	ARMV7_PERFCTR_PC_IMM_BRANCH		= 0x0D,
+	ARMV7_PERFCTR_PC_PROC_RETURN		= 0x0E,
+	ARMV7_PERFCTR_UNALIGNED_ACCESS		= 0x0F,
+	ARMV7_PERFCTR_PC_BRANCH_MIS_PRED	= 0x10,
+	ARMV7_PERFCTR_CLOCK_CYCLES		= 0x11,
+
+	/* Not a real event: selects the cycle counter */
+	ARMV7_PERFCTR_CPU_CYCLES		= 0xFF,
+};
+
+/* Cortex-A8 specific event types */
+enum armv7_a8_perf_types {
+	ARMV7_PERFCTR_WRITE_BUFFER_FULL		= 0x40,
+	ARMV7_PERFCTR_L2_STORE_MERGED		= 0x41,
+	ARMV7_PERFCTR_L2_STORE_BUFF		= 0x42,
+	ARMV7_PERFCTR_L2_ACCESS			= 0x43,
+	ARMV7_PERFCTR_L2_CACH_MISS		= 0x44,
+	ARMV7_PERFCTR_AXI_READ_CYCLES		= 0x45,
+	ARMV7_PERFCTR_AXI_WRITE_CYCLES		= 0x46,
+	ARMV7_PERFCTR_MEMORY_REPLAY		= 0x47,
+	ARMV7_PERFCTR_UNALIGNED_ACCESS_REPLAY	= 0x48,
+	ARMV7_PERFCTR_L1_DATA_MISS		= 0x49,
+	ARMV7_PERFCTR_L1_INST_MISS		= 0x4A,
+	ARMV7_PERFCTR_L1_DATA_COLORING		= 0x4B,
+	ARMV7_PERFCTR_L1_NEON_DATA		= 0x4C,
+	ARMV7_PERFCTR_L1_NEON_CACH_DATA		= 0x4D,
+	ARMV7_PERFCTR_L2_NEON			= 0x4E,
+	ARMV7_PERFCTR_L2_NEON_HIT		= 0x4F,
+	ARMV7_PERFCTR_L1_INST			= 0x50,
+	ARMV7_PERFCTR_PC_RETURN_MIS_PRED	= 0x51,
+	ARMV7_PERFCTR_PC_BRANCH_FAILED		= 0x52,
+	ARMV7_PERFCTR_PC_BRANCH_TAKEN		= 0x53,
+	ARMV7_PERFCTR_PC_BRANCH_EXECUTED	= 0x54,
+	ARMV7_PERFCTR_OP_EXECUTED		= 0x55,
+	ARMV7_PERFCTR_CYCLES_INST_STALL		= 0x56,
+	ARMV7_PERFCTR_CYCLES_INST		= 0x57,
+	ARMV7_PERFCTR_CYCLES_NEON_DATA_STALL	= 0x58,
+	ARMV7_PERFCTR_CYCLES_NEON_INST_STALL	= 0x59,
+	ARMV7_PERFCTR_NEON_CYCLES		= 0x5A,
+};
+
+#define HW_OP_UNSUPPORTED		0xFFFF
+
+#define C(_x) \
+	PERF_COUNT_HW_CACHE_##_x
+
+#define CACHE_OP_UNSUPPORTED		0xFFFF
+
+static const unsigned armv7_a8_perf_map[PERF_COUNT_HW_MAX] = {
+	[PERF_COUNT_HW_CPU_CYCLES]	    = ARMV7_PERFCTR_CPU_CYCLES,
+	[PERF_COUNT_HW_INSTRUCTIONS]	    = ARMV7_PERFCTR_INSTR_EXECUTED,
+	[PERF_COUNT_HW_CACHE_REFERENCES]    = HW_OP_UNSUPPORTED,
+	[PERF_COUNT_HW_CACHE_MISSES]	    = HW_OP_UNSUPPORTED,
+	[PERF_COUNT_HW_BRANCH_INSTRUCTIONS] = ARMV7_PERFCTR_PC_WRITE,
+	[PERF_COUNT_HW_BRANCH_MISSES]	    = ARMV7_PERFCTR_PC_BRANCH_MIS_PRED,
+	[PERF_COUNT_HW_BUS_CYCLES]	    = ARMV7_PERFCTR_CLOCK_CYCLES,
+};
+
+/*
+ * The Cortex-A8 counts reads and writes together, so both ops map to
+ * the same event.
+ */
+static const unsigned armv7_a8_perf_cache_map[PERF_COUNT_HW_CACHE_MAX]
+					  [PERF_COUNT_HW_CACHE_OP_MAX]
+					  [PERF_COUNT_HW_CACHE_RESULT_MAX] = {
+	[C(L1D)] = {
+		[C(OP_READ)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_DCACHE_ACCESS,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_DCACHE_REFILL,
+		},
+		[C(OP_WRITE)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_DCACHE_ACCESS,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_DCACHE_REFILL,
+		},
+		[C(OP_PREFETCH)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= CACHE_OP_UNSUPPORTED,
+		},
+	},
+	[C(L1I)] = {
+		[C(OP_READ)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_L1_INST,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_L1_INST_MISS,
+		},
+		[C(OP_WRITE)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_L1_INST,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_L1_INST_MISS,
+		},
+		[C(OP_PREFETCH)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= CACHE_OP_UNSUPPORTED,
+		},
+	},
+	[C(LL)] = {
+		[C(OP_READ)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_L2_ACCESS,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_L2_CACH_MISS,
+		},
+		[C(OP_WRITE)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_L2_ACCESS,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_L2_CACH_MISS,
+		},
+		[C(OP_PREFETCH)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= CACHE_OP_UNSUPPORTED,
+		},
+	},
+	[C(DTLB)] = {
+		[C(OP_READ)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_DTLB_REFILL,
+		},
+		[C(OP_WRITE)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_DTLB_REFILL,
+		},
+		[C(OP_PREFETCH)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= CACHE_OP_UNSUPPORTED,
+		},
+	},
+	[C(ITLB)] = {
+		[C(OP_READ)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_ITLB_MISS,
+		},
+		[C(OP_WRITE)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_ITLB_MISS,
+		},
+		[C(OP_PREFETCH)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= CACHE_OP_UNSUPPORTED,
+		},
+	},
+	[C(BPU)] = {
+		[C(OP_READ)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_PC_WRITE,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_PC_BRANCH_MIS_PRED,
+		},
+		[C(OP_WRITE)] = {
+			[C(RESULT_ACCESS)]	= ARMV7_PERFCTR_PC_WRITE,
+			[C(RESULT_MISS)]	= ARMV7_PERFCTR_PC_BRANCH_MIS_PRED,
+		},
+		[C(OP_PREFETCH)] = {
+			[C(RESULT_ACCESS)]	= CACHE_OP_UNSUPPORTED,
+			[C(RESULT_MISS)]	= CACHE_OP_UNSUPPORTED,
+		},
+	},
+};
+
+struct cpu_hw_events {
+	/* The events that are active on the PMU for the given index */
+	struct perf_event	*events[ARMV7_MAX_COUNTERS];
+
+	/* Counters that have been allocated to an event */
+	unsigned long		used_mask[BITS_TO_LONGS(ARMV7_MAX_COUNTERS)];
+
+	/* Counters that are currently counting and may raise an overflow */
+	unsigned long		active_mask[BITS_TO_LONGS(ARMV7_MAX_COUNTERS)];
+};
+static DEFINE_PER_CPU(struct cpu_hw_events, cpu_hw_events);
+
+/* Number of counters, including the cycle counter; 0 without a PMU */
+static int armpmu_num_counters;
+
+static const struct pmu_irqs *pmu_irqs;
+
+static atomic_t active_events = ATOMIC_INIT(0);
+static DEFINE_MUTEX(pmu_reserve_mutex);
+
+/*
+ * Selecting an event counter and then accessing it takes two cp15
+ * operations, which must not be split by the overflow interrupt.
+ */
+static DEFINE_SPINLOCK(pmu_lock);
+
+static inline u32 armv7_pmnc_read(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (val));
+	return val;
+}
+
+static inline void armv7_pmnc_write(u32 val)
+{
+	val &= ARMV7_PMNC_MASK;
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (val));
+}
+
+static inline u32 armv7_counter_bit(int idx)
+{
+	if (idx == ARMV7_CYCLE_COUNTER)
+		return ARMV7_CCNT_BIT;
+	return 1 << ARMV7_IDX_TO_COUNTER(idx);
+}
+
+static inline void armv7_pmnc_select_counter(int idx)
+{
+	u32 val = ARMV7_IDX_TO_COUNTER(idx);
+
+	asm volatile("mcr p15, 0, %0, c9, c12, 5" : : "r" (val));
+}
+
+static inline void armv7_pmnc_enable_counter(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 1"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_pmnc_disable_counter(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 2"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_pmnc_enable_intens(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c14, 1"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_pmnc_disable_intens(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c14, 2"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline u32 armv7_pmnc_getreset_flags(void)
+{
+	u32 val;
+
+	/* Read */
+	asm volatile("mrc p15, 0, %0, c9, c12, 3" : "=r" (val));
+
+	/* Write to clear flags */
+	val &= ARMV7_COUNTERS_MASK;
+	asm volatile("mcr p15, 0, %0, c9, c12, 3" : : "r" (val));
+
+	return val;
+}
+
+static u32 armv7pmu_read_counter(int idx)
+{
+	unsigned long flags;
+	u32 val;
+
+	if (idx == ARMV7_CYCLE_COUNTER) {
+		asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (val));
+		return val;
+	}
+
+	spin_lock_irqsave(&pmu_lock, flags);
+	armv7_pmnc_select_counter(idx);
+	asm volatile("mrc p15, 0, %0, c9, c13, 2" : "=r" (val));
+	spin_unlock_irqrestore(&pmu_lock, flags);
+
+	return val;
+}
+
+static void armv7pmu_write_counter(int idx, u32 val)
+{
+	unsigned long flags;
+
+	if (idx == ARMV7_CYCLE_COUNTER) {
+		asm volatile("mcr p15, 0, %0, c9, c13, 0" : : "r" (val));
+		return;
+	}
+
+	spin_lock_irqsave(&pmu_lock, flags);
+	armv7_pmnc_select_counter(idx);
+	asm volatile("mcr p15, 0, %0, c9, c13, 2" : : "r" (val));
+	spin_unlock_irqrestore(&pmu_lock, flags);
+}
+
+static void armv7pmu_enable_event(struct hw_perf_event *hwc, int idx)
+{
+	unsigned long flags;
+	u32 val;
+
+	spin_lock_irqsave(&pmu_lock, flags);
+
+	armv7_pmnc_disable_counter(idx);
+
+	/* The cycle counter has no event type to set */
+	if (idx != ARMV7_CYCLE_COUNTER) {
+		val = hwc->config_base & ARMV7_EVTSEL_MASK;
+		armv7_pmnc_select_counter(idx);
+		asm volatile("mcr p15, 0, %0, c9, c13, 1" : : "r" (val));
+	}
+
+	armv7_pmnc_enable_intens(idx);
+	armv7_pmnc_enable_counter(idx);
+
+	spin_unlock_irqrestore(&pmu_lock, flags);
+}
+
+static void armv7pmu_disable_event(struct hw_perf_event *hwc, int idx)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pmu_lock, flags);
+	armv7_pmnc_disable_counter(idx);
+	armv7_pmnc_disable_intens(idx);
+	spin_unlock_irqrestore(&pmu_lock, flags);
+}
+
+static void armv7pmu_start(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pmu_lock, flags);
+	armv7_pmnc_write(armv7_pmnc_read() | ARMV7_PMNC_E);
+	spin_unlock_irqrestore(&pmu_lock, flags);
+}
+
+static void armv7pmu_stop(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pmu_lock, flags);
+	armv7_pmnc_write(armv7_pmnc_read() & ~ARMV7_PMNC_E);
+	spin_unlock_irqrestore(&pmu_lock, flags);
+}
+
+/*
+ * Put the PMU in a known state when we take it over: everything
+ * disabled, counters zeroed and the cycle counter counting every cycle
+ * (oprofile uses the divide by 64 mode).
+ */
+static void armv7pmu_reset(void)
+{
+	int idx;
+
+	for (idx = 0; idx < armpmu_num_counters; idx++) {
+		armv7_pmnc_disable_counter(idx);
+		armv7_pmnc_disable_intens(idx);
+	}
+	armv7_pmnc_getreset_flags();
+	armv7_pmnc_write(ARMV7_PMNC_P | ARMV7_PMNC_C);
+}
+
+static int armv7pmu_get_event_idx(struct cpu_hw_events *cpuc,
+				  struct hw_perf_event *hwc)
+{
+	int idx;
+
+	/* Always place a cycle count event on the cycle counter */
+	if (hwc->config_base == ARMV7_PERFCTR_CPU_CYCLES) {
+		if (test_and_set_bit(ARMV7_CYCLE_COUNTER, cpuc->used_mask))
+			return -EAGAIN;
+		return ARMV7_CYCLE_COUNTER;
+	}
+
+	for (idx = ARMV7_COUNTER0; idx < armpmu_num_counters; idx++)
+		if (!test_and_set_bit(idx, cpuc->used_mask))
+			return idx;
+
+	/* The counters are all in use */
+	return -EAGAIN;
+}
+
+static u64 armpmu_event_update(struct perf_event *event,
+			       struct hw_perf_event *hwc, int idx)
+{
+	u64 prev_raw_count, new_raw_count, delta;
+
+again:
+	prev_raw_count = atomic64_read(&hwc->prev_count);
+	new_raw_count = armv7pmu_read_counter(idx);
+
+	if (atomic64_cmpxchg(&hwc->prev_count, prev_raw_count,
+			     new_raw_count) != prev_raw_count)
+		goto again;
+
+	/* the counters wrap at 32 bits */
+	delta = (new_raw_count - prev_raw_count) & 0xffffffff;
+
+	atomic64_add(delta, &event->count);
+	atomic64_sub(delta, &hwc->period_left);
+
+	return new_raw_count;
+}
+
+static int armpmu_event_set_period(struct perf_event *event,
+				   struct hw_perf_event *hwc, int idx)
+{
+	s64 left = atomic64_read(&hwc->period_left);
+	s64 period = hwc->sample_period;
+	int ret = 0;
+
+	if (unlikely(left <= -period)) {
+		left = period;
+		atomic64_set(&hwc->period_left, left);
+		hwc->last_period = period;
+		ret = 1;
+	}
+
+	if (unlikely(left <= 0)) {
+		left += period;
+		atomic64_set(&hwc->period_left, left);
+		hwc->last_period = period;
+		ret = 1;
+	}
+
+	if (left > (s64)ARMV7_MAX_PERIOD)
+		left = ARMV7_MAX_PERIOD;
+
+	atomic64_set(&hwc->prev_count, (u64)-left & 0xffffffff);
+
+	armv7pmu_write_counter(idx, (u64)-left & 0xffffffff);
+
+	perf_event_update_userpage(event);
+
+	return ret;
+}
+
+static int armpmu_enable(struct perf_event *event)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+	struct hw_perf_event *hwc = &event->hw;
+	int idx;
+
+	idx = armv7pmu_get_event_idx(cpuc, hwc);
+	if (idx < 0)
+		return idx;
+
+	/*
+	 * If there is an event in the counter we are going to use then
+	 * make sure it is disabled.
+	 */
+	hwc->idx = idx;
+	armv7pmu_disable_event(hwc, idx);
+	cpuc->events[idx] = event;
+	set_bit(idx, cpuc->active_mask);
+
+	/* Set the period for the event */
+	armpmu_event_set_period(event, hwc, idx);
+
+	/* Enable the event */
+	armv7pmu_enable_event(hwc, idx);
+
+	/* Propagate our changes to the userspace mapping */
+	perf_event_update_userpage(event);
+
+	return 0;
+}
+
+static void armpmu_disable(struct perf_event *event)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+	struct hw_perf_event *hwc = &event->hw;
+	int idx = hwc->idx;
+
+	WARN_ON(idx < 0);
+
+	clear_bit(idx, cpuc->active_mask);
+	armv7pmu_disable_event(hwc, idx);
+
+	barrier();
+
+	armpmu_event_update(event, hwc, idx);
+	cpuc->events[idx] = NULL;
+	clear_bit(idx, cpuc->used_mask);
+
+	perf_event_update_userpage(event);
+}
+
+static void armpmu_read(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	/* Don't read disabled counters! */
+	if (hwc->idx < 0)
+		return;
+
+	armpmu_event_update(event, hwc, hwc->idx);
+}
+
+static void armpmu_unthrottle(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	/*
+	 * Set the period again. Some counters can't be stopped, so when we
+	 * were throttled we simply disabled the IRQ source and the counter
+	 * may have been left counting. If we don't do this step then we may
+	 * get an interrupt too soon or *way* too late if the overflow has
+	 * happened since disabling.
+	 */
+	armpmu_event_set_period(event, hwc, hwc->idx);
+	armv7pmu_enable_event(hwc, hwc->idx);
+}
+
+static irqreturn_t armv7pmu_handle_irq(int irq_num, void *dev)
+{
+	struct perf_sample_data data;
+	struct cpu_hw_events *cpuc;
+	struct pt_regs *regs;
+	u32 flags;
+	int idx;
+
+	/* Get and reset the IRQ flags */
+	flags = armv7_pmnc_getreset_flags();
+	if (!flags)
+		return IRQ_NONE;
+
+	regs = get_irq_regs();
+
+	data.addr = 0;
+
+	cpuc = &__get_cpu_var(cpu_hw_events);
+	for (idx = 0; idx < armpmu_num_counters; idx++) {
+		struct perf_event *event = cpuc->events[idx];
+		struct hw_perf_event *hwc;
+
+		if (!test_bit(idx, cpuc->active_mask))
+			continue;
+
+		/* We have a single interrupt for all counters */
+		if (!(flags & armv7_counter_bit(idx)))
+			continue;
+
+		hwc = &event->hw;
+		armpmu_event_update(event, hwc, idx);
+		data.period = event->hw.last_period;
+		if (!armpmu_event_set_period(event, hwc, idx))
+			continue;
+
+		if (perf_event_overflow(event, 0, &data, regs))
+			armv7pmu_disable_event(hwc, idx);
+	}
+
+	/*
+	 * The overflow is an ordinary interrupt, so run the pending work
+	 * now rather than leaving it for the next timer tick.
+	 */
+	perf_event_do_pending();
+
+	return IRQ_HANDLED;
+}
+
+static int armpmu_reserve_hardware(void)
+{
+	int i;
+	int err = 0;
+
+	pmu_irqs = reserve_pmu();
+	if (IS_ERR(pmu_irqs)) {
+		pr_warning("unable to reserve pmu\n");
+		return PTR_ERR(pmu_irqs);
+	}
+
+	if (pmu_irqs->num_irqs < 1) {
+		pr_err("no irqs for PMUs defined\n");
+		release_pmu(pmu_irqs);
+		pmu_irqs = NULL;
+		return -ENODEV;
+	}
+
+	armv7pmu_reset();
+
+	for (i = 0; i < pmu_irqs->num_irqs; i++) {
+		err = request_irq(pmu_irqs->irqs[i], armv7pmu_handle_irq,
+				  IRQF_DISABLED, "armpmu", NULL);
+		if (err) {
+			pr_warning("unable to request IRQ%d for ARM perf "
+				"counters\n", pmu_irqs->irqs[i]);
+			break;
+		}
+	}
+
+	if (err) {
+		while (i--)
+			free_irq(pmu_irqs->irqs[i], NULL);
+		release_pmu(pmu_irqs);
+		pmu_irqs = NULL;
+	}
+
+	return err;
+}
+
+static void armpmu_release_hardware(void)
+{
+	int i;
+
+	armv7pmu_stop();
+	for (i = pmu_irqs->num_irqs - 1; i >= 0; i--)
+		free_irq(pmu_irqs->irqs[i], NULL);
+
+	release_pmu(pmu_irqs);
+	pmu_irqs = NULL;
+}
+
+static void hw_perf_event_destroy(struct perf_event *event)
+{
+	if (atomic_dec_and_mutex_lock(&active_events, &pmu_reserve_mutex)) {
+		armpmu_release_hardware();
+		mutex_unlock(&pmu_reserve_mutex);
+	}
+}
+
+static int armpmu_map_cache_event(u64 config)
+{
+	unsigned int cache_type, cache_op, cache_result, ret;
+
+	cache_type = (config >>  0) & 0xff;
+	if (cache_type >= PERF_COUNT_HW_CACHE_MAX)
+		return -EINVAL;
+
+	cache_op = (config >>  8) & 0xff;
+	if (cache_op >= PERF_COUNT_HW_CACHE_OP_MAX)
+		return -EINVAL;
+
+	cache_result = (config >> 16) & 0xff;
+	if (cache_result >= PERF_COUNT_HW_CACHE_RESULT_MAX)
+		return -EINVAL;
+
+	ret = armv7_a8_perf_cache_map[cache_type][cache_op][cache_result];
+
+	if (ret == CACHE_OP_UNSUPPORTED)
+		return -ENOENT;
+
+	return ret;
+}
+
+static int armpmu_map_event(u64 config)
+{
+	int mapping;
+
+	if (config >= PERF_COUNT_HW_MAX)
+		return -EINVAL;
+
+	mapping = armv7_a8_perf_map[config];
+	return mapping == HW_OP_UNSUPPORTED ? -EOPNOTSUPP : mapping;
+}
+
+static int armpmu_map_raw_event(u64 config)
+{
+	return (int)(config & ARMV7_EVTSEL_MASK);
+}
+
+/*
+ * Check that the group the event joins can be on the PMU all at once:
+ * at most one cycle count event, since only the cycle counter can count
+ * cycles, and no more other events than there are event counters.
+ */
+static int validate_group(struct perf_event *event)
+{
+	struct perf_event *sibling, *leader = event->group_leader;
+	int cycles = 0, others = 0;
+
+	if (event->hw.config_base == ARMV7_PERFCTR_CPU_CYCLES)
+		cycles++;
+	else
+		others++;
+
+	if (leader != event) {
+		if (!is_software_event(leader)) {
+			if (leader->hw.config_base == ARMV7_PERFCTR_CPU_CYCLES)
+				cycles++;
+			else
+				others++;
+		}
+
+		list_for_each_entry(sibling, &leader->sibling_list,
+				    group_entry) {
+			if (is_software_event(sibling) ||
+			    sibling->state == PERF_EVENT_STATE_OFF)
+				continue;
+			if (sibling->hw.config_base ==
+			    ARMV7_PERFCTR_CPU_CYCLES)
+				cycles++;
+			else
+				others++;
+		}
+	}
+
+	if (cycles > 1 || others > armpmu_num_counters - ARMV7_COUNTER0)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int __hw_perf_event_init(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+	int mapping, err;
+
+	/* Decode the generic type into an ARM event identifier. */
+	if (PERF_TYPE_HARDWARE == event->attr.type) {
+		mapping = armpmu_map_event(event->attr.config);
+	} else if (PERF_TYPE_HW_CACHE == event->attr.type) {
+		mapping = armpmu_map_cache_event(event->attr.config);
+	} else if (PERF_TYPE_RAW == event->attr.type) {
+		mapping = armpmu_map_raw_event(event->attr.config);
+	} else {
+		pr_debug("event type %x not supported\n", event->attr.type);
+		return -EOPNOTSUPP;
+	}
+
+	if (mapping < 0) {
+		pr_debug("event %x:%llx not supported\n", event->attr.type,
+			 event->attr.config);
+		return mapping;
+	}
+
+	/*
+	 * Check whether we need to exclude the counter from certain modes.
+	 * The ARM performance counters are on all of the time so if someone
+	 * has asked us for some excludes then we have to fail.
+	 */
+	if (event->attr.exclude_kernel || event->attr.exclude_user ||
+	    event->attr.exclude_hv || event->attr.exclude_idle) {
+		pr_debug("ARM performance counters do not support "
+			 "mode exclusion\n");
+		return -EPERM;
+	}
+
+	/*
+	 * We don't assign an index until we actually place the event onto
+	 * hardware. Use -1 to signify that we haven't decided where to put it
+	 * yet.
+	 */
+	hwc->idx = -1;
+
+	/* Store the event encoding into the config_base field. */
+	hwc->config_base = mapping;
+	hwc->config = 0;
+	hwc->event_base = 0;
+
+	err = validate_group(event);
+	if (err)
+		return err;
+
+	/*
+	 * Counting events still get an overflow interrupt at the maximum
+	 * period, so that the 32 bit counters never wrap unnoticed.
+	 */
+	if (!hwc->sample_period) {
+		hwc->sample_period = ARMV7_MAX_PERIOD;
+		hwc->last_period = hwc->sample_period;
+		atomic64_set(&hwc->period_left, hwc->sample_period);
+	}
+
+	return 0;
+}
+
+static const struct pmu pmu = {
+	.enable		= armpmu_enable,
+	.disable	= armpmu_disable,
+	.unthrottle	= armpmu_unthrottle,
+	.read		= armpmu_read,
+};
+
+const struct pmu *hw_perf_event_init(struct perf_event *event)
+{
+	int err = 0;
+
+	if (!armpmu_num_counters)
+		return ERR_PTR(-ENODEV);
+
+	err = __hw_perf_event_init(event);
+	if (err)
+		return ERR_PTR(err);
+
+	/* Claim the PMU (and its interrupt) for the first hardware event */
+	if (!atomic_inc_not_zero(&active_events)) {
+		mutex_lock(&pmu_reserve_mutex);
+		if (atomic_read(&active_events) == 0)
+			err = armpmu_reserve_hardware();
+
+		if (!err)
+			atomic_inc(&active_events);
+		mutex_unlock(&pmu_reserve_mutex);
+	}
+
+	if (err)
+		return ERR_PTR(err);
+
+	event->destroy = hw_perf_event_destroy;
+
+	return &pmu;
+}
+
+void hw_perf_enable(void)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+
+	/* oprofile may be driving the counters */
+	if (!atomic_read(&active_events))
+		return;
+
+	if (!bitmap_empty(cpuc->used_mask, ARMV7_MAX_COUNTERS))
+		armv7pmu_start();
+}
+
+void hw_perf_disable(void)
+{
+	if (atomic_read(&active_events))
+		armv7pmu_stop();
+}
+
+void perf_event_print_debug(void)
+{
+	unsigned long flags;
+	u32 pmnc, cntens, intens, ovsr;
+
+	if (!armpmu_num_counters)
+		return;
+
+	local_irq_save(flags);
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (pmnc));
+	asm volatile("mrc p15, 0, %0, c9, c12, 1" : "=r" (cntens));
+	asm volatile("mrc p15, 0, %0, c9, c14, 1" : "=r" (intens));
+	asm volatile("mrc p15, 0, %0, c9, c12, 3" : "=r" (ovsr));
+
+	pr_info("CPU#%d: PMNC[%08x] CNTENS[%08x] INTENS[%08x] FLAGS[%08x]\n",
+		smp_processor_id(), pmnc, cntens, intens, ovsr);
+
+	local_irq_restore(flags);
+}
+
+static int __init init_hw_perf_events(void)
+{
+	unsigned long cpuid = read_cpuid_id();
+	unsigned long implementor = (cpuid & 0xFF000000) >> 24;
+	unsigned long part_number = (cpuid & 0xFFF0);
+	int num_events;
+
+	/* ARM Ltd CPUs. */
+	if (0x41 == implementor && 0xC080 == part_number) {
+		/*
+		 * The PMNC says how many event counters there are; we
+		 * have room for the Cortex-A8's four.
+		 */
+		num_events = (armv7_pmnc_read() >> ARMV7_PMNC_N_SHIFT) &
+			ARMV7_PMNC_N_MASK;
+		num_events = min(num_events,
+				 ARMV7_MAX_COUNTERS - ARMV7_COUNTER0);
+		armpmu_num_counters = ARMV7_COUNTER0 + num_events;
+		perf_max_events = armpmu_num_counters;
+
+		pr_info("enabled with ARMv7 Cortex-A8 PMU driver, "
+			"%d counters available\n", armpmu_num_counters);
+	} else {
+		pr_info("no hardware support available\n");
+	}
+
+	return 0;
+}
+arch_initcall(init_hw_perf_events);
+
+#endif /* CONFIG_HW_PERF_EVENTS */
+
+/*
+ * Callchain handling code.
+ */
+static inline void
+callchain_store(struct perf_callchain_entry *entry,
+		u64 ip)
+{
+	if (entry->nr < PERF_MAX_STACK_DEPTH)
+		entry->ip[entry->nr++] = ip;
+}
+
+/*
+ * The registers we're interested in are at the end of the variable
+ * length saved register structure. The fp points at the end of this
+ * structure so the address of this struct is:
+ * (struct frame_tail *)(xxx->fp)-1
+ *
+ * This code has been adapted from the ARM OProfile support.
+ */
+struct frame_tail {
+	struct frame_tail   *fp;
+	unsigned long	    sp;
+	unsigned long	    lr;
+} __attribute__((packed));
+
+/*
+ * Get the return address for a single stackframe and return a pointer to the
+ * next frame tail.
+ */
+static struct frame_tail *
+user_backtrace(struct frame_tail *tail,
+	       struct perf_callchain_entry *entry)
+{
+	struct frame_tail buftail;
+
+	/* Also check accessibility of one struct frame_tail beyond */
+	if (!access_ok(VERIFY_READ, tail, sizeof(buftail)))
+		return NULL;
+	if (__copy_from_user_inatomic(&buftail, tail, sizeof(buftail)))
+		return NULL;
+
+	callchain_store(entry, buftail.lr);
+
+	/*
+	 * Frame pointers should strictly progress back up the stack
+	 * (towards higher addresses).
+	 */
+	if (tail >= buftail.fp)
+		return NULL;
+
+	return buftail.fp - 1;
+}
+
+static void
+perf_callchain_user(struct pt_regs *regs,
+		    struct perf_callchain_entry *entry)
+{
+	struct frame_tail *tail;
+
+	callchain_store(entry, PERF_CONTEXT_USER);
+
+	if (!user_mode(regs))
+		regs = task_pt_regs(current);
+
+	callchain_store(entry, regs->ARM_pc);
+
+	tail = (struct frame_tail *)regs->ARM_fp - 1;
+
+	while (tail && !((unsigned long)tail & 0x3) &&
+	       entry->nr < PERF_MAX_STACK_DEPTH)
+		tail = user_backtrace(tail, entry);
+}
+
+/*
+ * Gets called by walk_stackframe() for every stackframe. This will be called
+ * whilst unwinding the stackframe and is like a subroutine return so we use
+ * the PC.
+ */
+static int
+callchain_trace(struct stackframe *fr,
+		void *data)
+{
+	struct perf_callchain_entry *entry = data;
+
+	callchain_store(entry, fr->pc);
+	return entry->nr >= PERF_MAX_STACK_DEPTH;
+}
+
+static void
+perf_callchain_kernel(struct pt_regs *regs,
+		      struct perf_callchain_entry *entry)
+{
+	struct stackframe fr;
+
+	callchain_store(entry, PERF_CONTEXT_KERNEL);
+	fr.fp = regs->ARM_fp;
+	fr.sp = regs->ARM_sp;
+	fr.lr = regs->ARM_lr;
+	fr.pc = regs->ARM_pc;
+	walk_stackframe(&fr, callchain_trace, entry);
+}
+
+static void
+perf_do_callchain(struct pt_regs *regs,
+		  struct perf_callchain_entry *entry)
+{
+	int is_user;
+
+	if (!regs)
+		return;
+
+	is_user = user_mode(regs);
+
+	if (!current || !current->pid)
+		return;
+
+	if (is_user && current->state != TASK_RUNNING)
+		return;
+
+	if (!is_user)
+		perf_callchain_kernel(regs, entry);
+
+	if (current->mm)
+		perf_callchain_user(regs, entry);
+}
+
+static DEFINE_PER_CPU(struct perf_callchain_entry, pmc_irq_entry);
+
+struct perf_callchain_entry *
+perf_callchain(struct pt_regs *regs)
+{
+	struct perf_callchain_entry *entry = &__get_cpu_var(pmc_irq_entry);
+
+	entry->nr = 0;
+	perf_do_callchain(regs, entry);
+	return entry;
+}
@@ -269,6 +269,26 @@ static void __init cacheid_init(void)
 		cache_is_vipt_nonaliasing() ? "VIPT nonaliasing" : "unknown");
 }
 
+#ifdef CONFIG_CPU_CORTEX_A8_STRING
+unsigned int __memcpy_a8_min __read_mostly = ~0;
+unsigned int __memset_a8_min __read_mostly = ~0;
+
+/*
+ * Below these sizes the generic string code is as fast and the branch
+ * to the tuned loops would only cost; they must not go below 128.
+ */
+static void __init string_fns_init(void)
+{
+	/* ARM Ltd. Cortex-A8, any variant and revision */
+	if ((read_cpuid_id() & 0xff0ffff0) == 0x410fc080) {
+		__memcpy_a8_min = 256;
+		__memset_a8_min = 256;
+	}
+}
+#else
+static inline void string_fns_init(void) { }
+#endif
+
 /*
  * These functions re-use the assembly code in head.S, which
  * already provide the required functionality.
@@ -319,6 +339,7 @@ static void __init setup_processor(void)
 #endif
 
 	cacheid_init();
+	string_fns_init();
 	cpu_proc_init();
 }
 
@@ -0,0 +1,59 @@
+/*
+ *  linux/arch/arm/lib/bench.h
+ *
+ *  Buffers and timing shared by the boot time library benchmarks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ARM_LIB_BENCH_H
+#define __ARM_LIB_BENCH_H
+
+#include <linux/gfp.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+
+#define BENCH_MAX	(64 * 1024)	/* largest buffer, plus a page */
+#define BENCH_BYTES	(4 << 20)	/* handled per timing run */
+
+#define BENCH_ORDER	get_order(BENCH_MAX + PAGE_SIZE)
+
+static inline void __init bench_free(u8 *src, u8 *dst)
+{
+	free_pages((unsigned long)src, BENCH_ORDER);
+	free_pages((unsigned long)dst, BENCH_ORDER);
+}
+
+static inline int __init bench_alloc(u8 **src, u8 **dst)
+{
+	*src = (u8 *)__get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	*dst = (u8 *)__get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	if (!*src || !*dst) {
+		bench_free(*src, *dst);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * MB/s for running op on len bytes BENCH_BYTES / len times; op may use
+ * i, the number of the run.  A macro so that op is inlined in the loop.
+ */
+#define bench_rate(len, op)						\
+({									\
+	unsigned int i, __loops = BENCH_BYTES / (len);			\
+	ktime_t __start;						\
+	u64 __ns;							\
+									\
+	__start = ktime_get();						\
+	for (i = 0; i < __loops; i++)					\
+		op;							\
+	__ns = ktime_to_ns(ktime_sub(ktime_get(), __start));		\
+									\
+	(unsigned int)div64_u64((u64)__loops * (len) * 1000,		\
+				__ns ? __ns : 1);			\
+})
+
+#endif	/* __ARM_LIB_BENCH_H */
@@ -0,0 +1,155 @@
+/*
+ *  linux/arch/arm/lib/string_bench.c
+ *
+ *  Boot time check and benchmark of the Cortex-A8 string functions
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *  memcpy(), memset() and copy_page() are run with the tuned loops in
+ *  string-a8.S disabled and then enabled from their lowest threshold,
+ *  for 16 byte to 64k buffers with the source and destination mutually
+ *  aligned and not, so the thresholds set in setup.c can be checked
+ *  against the numbers.  The tuned loops are also checked byte for byte
+ *  around every alignment, before they are benchmarked.  Both settings
+ *  are safe at any time, so the rest of the system simply runs with
+ *  whichever is current.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <asm/page.h>
+
+#include "bench.h"
+
+#define TUNED_MIN	128		/* lowest threshold string-a8.S takes */
+
+static const size_t bench_sizes[] __initconst = {
+	16, 64, 256, 1024, 4096, 16384, 65536,
+};
+
+static u8 *src, *dst;
+
+static void __init set_thresholds(unsigned int min)
+{
+	__memcpy_a8_min = min;
+	__memset_a8_min = min;
+}
+
+static int __init check_one(size_t doff, size_t soff, size_t len)
+{
+	size_t i;
+
+	memset(dst, 0xa5, len + 16);
+	memcpy(dst + doff, src + soff, len);
+	for (i = 0; i < len + 16; i++) {
+		u8 want = (i >= doff && i < doff + len) ?
+			  src[soff + i - doff] : 0xa5;
+		if (dst[i] != want)
+			return 1;
+	}
+
+	memset(dst + doff, soff, len);
+	for (i = 0; i < len + 16; i++) {
+		u8 want = (i >= doff && i < doff + len) ? soff : 0xa5;
+		if (dst[i] != want)
+			return 1;
+	}
+
+	memset(dst + doff, 0, len);
+	for (i = 0; i < len + 16; i++) {
+		u8 want = (i >= doff && i < doff + len) ? 0 : 0xa5;
+		if (dst[i] != want)
+			return 1;
+	}
+	return 0;
+}
+
+static int __init check_page(void)
+{
+	memset(dst, 0, PAGE_SIZE);
+	copy_page(dst, src);
+	return memcmp(dst, src, PAGE_SIZE) != 0;
+}
+
+/* MB/s for copies of len bytes at the given offsets */
+static unsigned int __init bench_memcpy(size_t doff, size_t soff, size_t len)
+{
+	return bench_rate(len, memcpy(dst + doff, src + soff, len));
+}
+
+static unsigned int __init bench_memset(size_t doff, size_t len)
+{
+	return bench_rate(len, memset(dst + doff, i, len));
+}
+
+static unsigned int __init bench_copy_page(void)
+{
+	return bench_rate(PAGE_SIZE, copy_page(dst, src));
+}
+
+static void __init bench(const char *name, unsigned int min)
+{
+	size_t len;
+	int i;
+
+	set_thresholds(min);
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+		len = bench_sizes[i];
+		printk(KERN_INFO "string: %s %5zu bytes: memcpy %u MB/s, "
+		       "unaligned %u MB/s, memset %u MB/s\n", name, len,
+		       bench_memcpy(0, 0, len), bench_memcpy(0, 1, len),
+		       bench_memset(0, len));
+	}
+	printk(KERN_INFO "string: %s copy_page %u MB/s\n", name,
+	       bench_copy_page());
+}
+
+static int __init string_bench(void)
+{
+	unsigned int memcpy_min = __memcpy_a8_min;
+	unsigned int memset_min = __memset_a8_min;
+	size_t doff, soff, len;
+	int errors = 0;
+
+	if (bench_alloc(&src, &dst))
+		return -ENOMEM;
+	for (len = 0; len < BENCH_MAX + PAGE_SIZE; len++)
+		src[len] = len * 7 + (len >> 8);
+
+	/*
+	 * Everything else in the kernel uses the tuned loops while they
+	 * are checked, so they are turned off again at the first error.
+	 */
+	set_thresholds(TUNED_MIN);
+	for (doff = 0; doff < 8 && !errors; doff++)
+		for (soff = 0; soff < 8 && !errors; soff++)
+			for (len = TUNED_MIN; len < 2 * TUNED_MIN + 64 &&
+			     !errors; len++)
+				errors += check_one(doff, soff, len);
+	if (!errors)
+		errors += check_page();
+	if (errors) {
+		set_thresholds(~0);
+		bench_free(src, dst);
+		printk(KERN_ERR "string: tuned loops failed a check, "
+		       "disabled\n");
+		return -EINVAL;
+	}
+
+	bench("generic", ~0);
+	bench("tuned  ", TUNED_MIN);
+
+	bench_free(src, dst);
+
+	__memcpy_a8_min = memcpy_min;
+	__memset_a8_min = memset_min;
+	if (memcpy_min == ~0)
+		printk(KERN_INFO "string: tuned loops not used on this CPU\n");
+	else
+		printk(KERN_INFO "string: tuned loops used from memcpy %u and "
+		       "memset %u bytes\n", memcpy_min, memset_min);
+	return 0;
+}
+late_initcall(string_bench);
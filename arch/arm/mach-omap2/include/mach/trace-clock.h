@@ -130,8 +130,11 @@ static inline u64 trace_clock_read64(void)
 	pm_count = &per_cpu(pm_save_count, smp_processor_id());
 	if (likely(pm_count->fast_clock_ready)) {
 		cf = &pm_count->cf[ACCESS_ONCE(pm_count->index)];
-		val = max((((trace_clock_read_synthetic_tsc() - cf->hw_base)
-		      * cf->mul_fact) >> 10) + cf->virt_base, cf->floor);
+		val = trace_clock_read_synthetic_tsc() - cf->hw_base;
+		/* no 64-bit multiply while running at the top frequency */
+		if (unlikely(cf->mul_fact != 1 << 10))
+			val = (val * cf->mul_fact) >> 10;
+		val = max(val + cf->virt_base, cf->floor);
 	} else
 		val = _trace_clock_read_slow();
 	trace_clock_debug(val);
@@ -0,0 +1,161 @@
+/*
+ *  linux/arch/arm/vfp/neon_stress.c
+ *
+ *  Stress test for kernel_neon_begin() and kernel_neon_end()
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *  A kernel thread bound to each CPU fills the NEON registers with a
+ *  pattern and checks it is still there after a long busy loop, while an
+ *  hrtimer raises a tasklet doing the same with a shorter loop, so that
+ *  softirq sections land in the middle of the thread's and of the user
+ *  state being switched.  Userspace VFP/NEON code checking its own
+ *  results should be run alongside to see that its registers survive.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <asm/atomic.h>
+#include <asm/neon.h>
+
+#define THREAD_LOOPS	20000	/* a few hundred microseconds */
+#define SOFTIRQ_LOOPS	200
+#define SOFTIRQ_PERIOD	(NSEC_PER_MSEC / 4)
+
+extern int neon_stress_pattern(u32 seed, unsigned int loops);
+
+static unsigned int seconds = 60;
+module_param(seconds, uint, 0444);
+MODULE_PARM_DESC(seconds, "How long to run for");
+
+static struct task_struct *threads[NR_CPUS];
+static struct hrtimer timer;
+static unsigned long end;
+static atomic_t thread_passes, softirq_passes, errors;
+
+static int neon_stress_pass(unsigned int loops)
+{
+	int bad;
+
+	kernel_neon_begin();
+	bad = neon_stress_pattern(random32(), loops);
+	kernel_neon_end();
+
+	if (bad) {
+		printk(KERN_ERR "neon_stress: %d registers corrupted on cpu %d "
+		       "in %s context\n", bad, raw_smp_processor_id(),
+		       in_interrupt() ? "softirq" : "process");
+		atomic_inc(&errors);
+	}
+	return bad;
+}
+
+static void neon_stress_softirq(unsigned long data)
+{
+	neon_stress_pass(SOFTIRQ_LOOPS);
+	atomic_inc(&softirq_passes);
+}
+
+static DECLARE_TASKLET(neon_stress_tasklet, neon_stress_softirq, 0);
+
+static enum hrtimer_restart neon_stress_timer(struct hrtimer *t)
+{
+	if (time_after(jiffies, end))
+		return HRTIMER_NORESTART;
+
+	tasklet_schedule(&neon_stress_tasklet);
+	hrtimer_forward_now(t, ktime_set(0, SOFTIRQ_PERIOD));
+	return HRTIMER_RESTART;
+}
+
+static int neon_stress_thread(void *data)
+{
+	while (!kthread_should_stop()) {
+		if (time_before(jiffies, end)) {
+			neon_stress_pass(THREAD_LOOPS);
+			atomic_inc(&thread_passes);
+			cond_resched();
+			continue;
+		}
+
+		/* done, wait for kthread_stop() */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+	return 0;
+}
+
+static void neon_stress_report(struct work_struct *work)
+{
+	printk(KERN_INFO "neon_stress: %d process and %d softirq passes, "
+	       "%d failed\n", atomic_read(&thread_passes),
+	       atomic_read(&softirq_passes), atomic_read(&errors));
+}
+
+static DECLARE_DELAYED_WORK(neon_stress_work, neon_stress_report);
+
+static void neon_stress_stop(void)
+{
+	int cpu;
+
+	hrtimer_cancel(&timer);
+	tasklet_kill(&neon_stress_tasklet);
+	for_each_possible_cpu(cpu)
+		if (threads[cpu])
+			kthread_stop(threads[cpu]);
+}
+
+static int __init neon_stress_init(void)
+{
+	struct task_struct *p;
+	int cpu;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	end = jiffies + seconds * HZ;
+	hrtimer_init(&timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	timer.function = neon_stress_timer;
+
+	for_each_online_cpu(cpu) {
+		p = kthread_create(neon_stress_thread, NULL, "neon_stress/%d",
+				   cpu);
+		if (IS_ERR(p)) {
+			neon_stress_stop();
+			return PTR_ERR(p);
+		}
+		kthread_bind(p, cpu);
+		threads[cpu] = p;
+		wake_up_process(p);
+	}
+
+	hrtimer_start(&timer, ktime_set(0, SOFTIRQ_PERIOD), HRTIMER_MODE_REL);
+
+	schedule_delayed_work(&neon_stress_work, seconds * HZ + HZ / 10);
+	printk(KERN_INFO "neon_stress: running for %u seconds\n", seconds);
+	return 0;
+}
+module_init(neon_stress_init);
+
+static void __exit neon_stress_exit(void)
+{
+	int running = cancel_delayed_work_sync(&neon_stress_work);
+
+	neon_stress_stop();
+	if (running)
+		neon_stress_report(NULL);
+}
+module_exit(neon_stress_exit);
+
+MODULE_DESCRIPTION("Kernel mode NEON stress test");
+MODULE_LICENSE("GPL");
@@ -14,7 +14,10 @@
 #include <linux/signal.h>
 #include <linux/sched.h>
 #include <linux/init.h>
+#include <linux/hardirq.h>
+#include <linux/percpu.h>
 
+#include <asm/neon.h>
 #include <asm/thread_notify.h>
 #include <asm/vfp.h>
 
@@ -442,6 +445,68 @@ out:
 }
 #endif
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+/*
+ * Where softirqs keep the registers of the code they interrupted.
+ */
+static DEFINE_PER_CPU(union vfp_state, kernel_neon_state);
+
+/*
+ * Claim the VFP/NEON registers for kernel code, until kernel_neon_end().
+ *
+ * In process context the owner of the hardware state, which is current
+ * on SMP and may be any thread on UP, is saved to its thread_info and
+ * last_VFP_context cleared, so that it is reloaded lazily the next time
+ * it touches the VFP, just as after a context switch.  Preemption stays
+ * disabled until kernel_neon_end().
+ *
+ * A softirq may interrupt a kernel NEON section, or the undef handler in
+ * the middle of switching the user state, so in softirq context (or with
+ * bottom halves disabled) all the registers are saved to a per-cpu area
+ * instead and put back as they were by kernel_neon_end().  Sections do
+ * not nest and must not be used from hard interrupts.
+ */
+void kernel_neon_begin(void)
+{
+	unsigned int cpu;
+	u32 fpexc;
+
+	BUG_ON(in_irq());
+	cpu = get_cpu();
+
+	fpexc = fmrx(FPEXC);
+	fmxr(FPEXC, (fpexc | FPEXC_EN) & ~FPEXC_EX);
+
+	if (in_interrupt()) {
+		vfp_save_state(&per_cpu(kernel_neon_state, cpu), fpexc);
+		return;
+	}
+
+#ifdef CONFIG_SMP
+	/*
+	 * With VFP disabled the state was already saved at the last
+	 * context switch.
+	 */
+	if ((fpexc & FPEXC_EN) && last_VFP_context[cpu])
+#else
+	if (last_VFP_context[cpu])
+#endif
+		vfp_save_state(last_VFP_context[cpu], fpexc);
+	last_VFP_context[cpu] = NULL;
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	if (in_interrupt())
+		vfp_load_state(&__get_cpu_var(kernel_neon_state));
+	else
+		fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+#endif /* CONFIG_KERNEL_MODE_NEON */
+
 #include <linux/smp.h>
 
 /*
@@ -0,0 +1,231 @@
+/*
+ * Block IO controller
+ *
+ * Gives each cgroup a weight, 100 to 1000, for the io schedulers to share
+ * the disk by, and counts the requests of its tasks, their bytes and how
+ * long they took from being queued to completing.  The hierarchy is flat:
+ * cgroups can only be made directly below the root.
+ *
+ * See Documentation/cgroups/blkio-controller.txt
+ */
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/jiffies.h>
+#include <linux/blkdev.h>
+#include "blk-cgroup.h"
+
+static struct blkio_cgroup blkio_root_cgroup = {
+	.weight	= BLKIO_WEIGHT_DEFAULT,
+	.lock	= __SPIN_LOCK_UNLOCKED(blkio_root_cgroup.lock),
+};
+
+static inline struct blkio_cgroup *cgroup_to_blkio_cgroup(struct cgroup *cgrp)
+{
+	return container_of(cgroup_subsys_state(cgrp, blkio_subsys_id),
+			    struct blkio_cgroup, css);
+}
+
+/*
+ * Called when a request is allocated, in the context of the task that
+ * will queue it.  If the task is being moved out of a cgroup that is then
+ * removed, the reference can't be had and the new cgroup is looked up.
+ */
+void blkiocg_get_current(struct request *rq)
+{
+	struct cgroup_subsys_state *css;
+
+	rcu_read_lock();
+	do {
+		css = task_subsys_state(current, blkio_subsys_id);
+	} while (!css_tryget(css));
+	rcu_read_unlock();
+
+	rq->blkcg = container_of(css, struct blkio_cgroup, css);
+}
+
+void blkiocg_put(struct request *rq)
+{
+	if (rq->blkcg) {
+		css_put(&rq->blkcg->css);
+		rq->blkcg = NULL;
+	}
+}
+
+void blkiocg_account_bytes(struct request *rq, unsigned int bytes)
+{
+	struct blkio_cgroup *blkcg = rq->blkcg;
+	unsigned long flags;
+
+	if (!blkcg)
+		return;
+
+	spin_lock_irqsave(&blkcg->lock, flags);
+	blkcg->service_bytes[rq_data_dir(rq)] += bytes;
+	blkcg->service_bytes[rq_is_sync(rq) ? BLKIO_STAT_SYNC
+					    : BLKIO_STAT_ASYNC] += bytes;
+	spin_unlock_irqrestore(&blkcg->lock, flags);
+}
+
+static inline void blkio_add_time(struct blkio_cgroup *blkcg, int stat,
+				  unsigned long ms)
+{
+	blkcg->serviced[stat]++;
+	blkcg->time[stat] += ms;
+	if (ms > blkcg->time_max[stat])
+		blkcg->time_max[stat] = ms;
+}
+
+/* duration is in jiffies, from when rq was queued */
+void blkiocg_account_done(struct request *rq, unsigned long duration)
+{
+	struct blkio_cgroup *blkcg = rq->blkcg;
+	unsigned long ms = jiffies_to_msecs(duration);
+	unsigned long flags;
+
+	if (!blkcg)
+		return;
+
+	spin_lock_irqsave(&blkcg->lock, flags);
+	blkio_add_time(blkcg, rq_data_dir(rq), ms);
+	blkio_add_time(blkcg, rq_is_sync(rq) ? BLKIO_STAT_SYNC
+					     : BLKIO_STAT_ASYNC, ms);
+	spin_unlock_irqrestore(&blkcg->lock, flags);
+}
+
+static u64 blkiocg_weight_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	return cgroup_to_blkio_cgroup(cgrp)->weight;
+}
+
+static int blkiocg_weight_write(struct cgroup *cgrp, struct cftype *cft,
+				u64 val)
+{
+	if (val < BLKIO_WEIGHT_MIN || val > BLKIO_WEIGHT_MAX)
+		return -EINVAL;
+
+	cgroup_to_blkio_cgroup(cgrp)->weight = val;
+	return 0;
+}
+
+static const char *blkio_stat_desc[] = {
+	[BLKIO_STAT_READ] = "Read",
+	[BLKIO_STAT_WRITE] = "Write",
+	[BLKIO_STAT_SYNC] = "Sync",
+	[BLKIO_STAT_ASYNC] = "Async",
+};
+
+/*
+ * The statistics files show one of the arrays in blkio_cgroup, chosen by
+ * the offset in cft->private, and a Total of its Read and Write entries.
+ */
+static int blkiocg_stat_show(struct cgroup *cgrp, struct cftype *cft,
+			     struct cgroup_map_cb *cb)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio_cgroup(cgrp);
+	u64 v[BLKIO_STAT_NR];
+	int i;
+
+	spin_lock_irq(&blkcg->lock);
+	memcpy(v, (void *)blkcg + cft->private, sizeof(v));
+	spin_unlock_irq(&blkcg->lock);
+
+	for (i = 0; i < BLKIO_STAT_NR; i++)
+		cb->fill(cb, blkio_stat_desc[i], v[i]);
+	if (cft->private == offsetof(struct blkio_cgroup, time_max))
+		cb->fill(cb, "Total", max(v[BLKIO_STAT_READ],
+					  v[BLKIO_STAT_WRITE]));
+	else
+		cb->fill(cb, "Total", v[BLKIO_STAT_READ] +
+				      v[BLKIO_STAT_WRITE]);
+	return 0;
+}
+
+static int blkiocg_reset_stats(struct cgroup *cgrp, struct cftype *cft,
+			       u64 val)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio_cgroup(cgrp);
+
+	spin_lock_irq(&blkcg->lock);
+	memset(blkcg->serviced, 0, sizeof(blkcg->serviced));
+	memset(blkcg->service_bytes, 0, sizeof(blkcg->service_bytes));
+	memset(blkcg->time, 0, sizeof(blkcg->time));
+	memset(blkcg->time_max, 0, sizeof(blkcg->time_max));
+	spin_unlock_irq(&blkcg->lock);
+
+	return 0;
+}
+
+static struct cftype blkio_files[] = {
+	{
+		.name = "weight",
+		.read_u64 = blkiocg_weight_read,
+		.write_u64 = blkiocg_weight_write,
+	},
+	{
+		.name = "io_serviced",
+		.read_map = blkiocg_stat_show,
+		.private = offsetof(struct blkio_cgroup, serviced),
+	},
+	{
+		.name = "io_service_bytes",
+		.read_map = blkiocg_stat_show,
+		.private = offsetof(struct blkio_cgroup, service_bytes),
+	},
+	{
+		.name = "io_time",
+		.read_map = blkiocg_stat_show,
+		.private = offsetof(struct blkio_cgroup, time),
+	},
+	{
+		.name = "io_time_max",
+		.read_map = blkiocg_stat_show,
+		.private = offsetof(struct blkio_cgroup, time_max),
+	},
+	{
+		.name = "reset_stats",
+		.write_u64 = blkiocg_reset_stats,
+	},
+};
+
+static int blkiocg_populate(struct cgroup_subsys *ss, struct cgroup *cgrp)
+{
+	return cgroup_add_files(cgrp, ss, blkio_files, ARRAY_SIZE(blkio_files));
+}
+
+static struct cgroup_subsys_state *
+blkiocg_create(struct cgroup_subsys *ss, struct cgroup *cgrp)
+{
+	struct blkio_cgroup *blkcg;
+
+	if (!cgrp->parent)
+		return &blkio_root_cgroup.css;
+
+	/* weights are only compared between siblings of the root */
+	if (cgrp->parent->parent)
+		return ERR_PTR(-EINVAL);
+
+	blkcg = kzalloc(sizeof(*blkcg), GFP_KERNEL);
+	if (!blkcg)
+		return ERR_PTR(-ENOMEM);
+
+	blkcg->weight = BLKIO_WEIGHT_DEFAULT;
+	spin_lock_init(&blkcg->lock);
+	return &blkcg->css;
+}
+
+static void blkiocg_destroy(struct cgroup_subsys *ss, struct cgroup *cgrp)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio_cgroup(cgrp);
+
+	if (blkcg != &blkio_root_cgroup)
+		kfree(blkcg);
+}
+
+struct cgroup_subsys blkio_subsys = {
+	.name = "blkio",
+	.create = blkiocg_create,
+	.destroy = blkiocg_destroy,
+	.populate = blkiocg_populate,
+	.subsys_id = blkio_subsys_id,
+};
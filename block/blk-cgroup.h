@@ -0,0 +1,71 @@
+#ifndef _BLK_CGROUP_H
+#define _BLK_CGROUP_H
+/*
+ * Block IO controller: a weight per cgroup, which the io schedulers turn
+ * into a share of the disk, and statistics of the requests of its tasks.
+ *
+ * Requests hold a reference to the cgroup of the task that allocated
+ * them, in rq->blkcg, until they are freed.
+ */
+
+#include <linux/blkdev.h>
+
+#define BLKIO_WEIGHT_MIN	100
+#define BLKIO_WEIGHT_MAX	1000
+#define BLKIO_WEIGHT_DEFAULT	500
+
+#ifdef CONFIG_BLK_CGROUP
+
+#include <linux/cgroup.h>
+
+enum blkio_stat {
+	BLKIO_STAT_READ,
+	BLKIO_STAT_WRITE,
+	BLKIO_STAT_SYNC,
+	BLKIO_STAT_ASYNC,
+	BLKIO_STAT_NR,
+};
+
+struct blkio_cgroup {
+	struct cgroup_subsys_state css;
+	unsigned int weight;
+
+	/* protects the statistics below */
+	spinlock_t lock;
+	u64 serviced[BLKIO_STAT_NR];		/* requests */
+	u64 service_bytes[BLKIO_STAT_NR];
+	u64 time[BLKIO_STAT_NR];		/* ms from queueing to completion */
+	u64 time_max[BLKIO_STAT_NR];		/* ms, the longest of those */
+};
+
+extern void blkiocg_get_current(struct request *rq);
+extern void blkiocg_put(struct request *rq);
+extern void blkiocg_account_bytes(struct request *rq, unsigned int bytes);
+extern void blkiocg_account_done(struct request *rq, unsigned long duration);
+
+/*
+ * The weight of the cgroup a request was allocated in; a change of the
+ * weight is seen by the next request.
+ */
+static inline unsigned int blkiocg_rq_weight(struct request *rq)
+{
+	return rq->blkcg ? rq->blkcg->weight : BLKIO_WEIGHT_DEFAULT;
+}
+
+#else
+
+static inline void blkiocg_get_current(struct request *rq) { }
+static inline void blkiocg_put(struct request *rq) { }
+static inline void blkiocg_account_bytes(struct request *rq,
+					 unsigned int bytes) { }
+static inline void blkiocg_account_done(struct request *rq,
+					unsigned long duration) { }
+
+static inline unsigned int blkiocg_rq_weight(struct request *rq)
+{
+	return BLKIO_WEIGHT_DEFAULT;
+}
+
+#endif	/* CONFIG_BLK_CGROUP */
+
+#endif	/* _BLK_CGROUP_H */
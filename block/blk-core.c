@@ -32,6 +32,7 @@
 #include <trace/events/block.h>
 
 #include "blk.h"
+#include "blk-cgroup.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -617,6 +618,7 @@ static inline void blk_free_request(struct request_queue *q, struct request *rq)
 {
 	if (rq->cmd_flags & REQ_ELVPRIV)
 		elv_put_request(q, rq);
+	blkiocg_put(rq);
 	mempool_free(rq, q->rq.rq_pool);
 }
 
@@ -631,9 +633,11 @@ blk_alloc_request(struct request_queue *q, int flags, int priv, gfp_t gfp_mask)
 	blk_rq_init(q, rq);
 
 	rq->cmd_flags = flags | REQ_ALLOCED;
+	blkiocg_get_current(rq);
 
 	if (priv) {
 		if (unlikely(elv_set_request(q, rq, gfp_mask))) {
+			blkiocg_put(rq);
 			mempool_free(rq, q->rq.rq_pool);
 			return NULL;
 		}
@@ -1718,6 +1722,8 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 		part = disk_map_sector_rcu(req->rq_disk, blk_rq_pos(req));
 		part_stat_add(cpu, part, sectors[rw], bytes >> 9);
 		part_stat_unlock();
+
+		blkiocg_account_bytes(req, bytes);
 	}
 }
 
@@ -1743,6 +1749,8 @@ static void blk_account_io_done(struct request *req)
 		part_dec_in_flight(part, rw);
 
 		part_stat_unlock();
+
+		blkiocg_account_done(req, duration);
 	}
 }
 
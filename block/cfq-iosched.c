@@ -13,6 +13,8 @@
 #include <linux/ioprio.h>
 #include <linux/blktrace_api.h>
 
+#include "blk-cgroup.h"
+
 /*
  * tunables
  */
@@ -112,6 +114,9 @@ struct cfq_queue {
 	unsigned short ioprio, org_ioprio;
 	unsigned short ioprio_class, org_ioprio_class;
 
+	/* blkio cgroup weight of the last sync request */
+	unsigned int weight;
+
 	pid_t pid;
 };
 
@@ -297,10 +302,16 @@ static inline int cfq_prio_slice(struct cfq_data *cfqd, bool sync,
 	return base_slice + (base_slice/CFQ_SLICE_SCALE * (4 - prio));
 }
 
+/*
+ * And scale that by the blkio cgroup weight, so that busy queues get disk
+ * time in proportion to the weights of their cgroups.
+ */
 static inline int
 cfq_prio_to_slice(struct cfq_data *cfqd, struct cfq_queue *cfqq)
 {
-	return cfq_prio_slice(cfqd, cfq_cfqq_sync(cfqq), cfqq->ioprio);
+	int slice = cfq_prio_slice(cfqd, cfq_cfqq_sync(cfqq), cfqq->ioprio);
+
+	return max_t(int, slice * cfqq->weight / BLKIO_WEIGHT_DEFAULT, 1);
 }
 
 static inline void
@@ -477,11 +488,15 @@ cfq_find_next_rq(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 static unsigned long cfq_slice_offset(struct cfq_data *cfqd,
 				      struct cfq_queue *cfqq)
 {
+	const int max_slice = cfq_prio_slice(cfqd, 1, 0);
+	const int slice = cfq_prio_to_slice(cfqd, cfqq);
+
 	/*
 	 * just an approximation, should be ok.
 	 */
-	return (cfqd->busy_queues - 1) * (cfq_prio_slice(cfqd, 1, 0) -
-		       cfq_prio_slice(cfqd, cfq_cfqq_sync(cfqq), cfqq->ioprio));
+	if (slice >= max_slice)
+		return 0;
+	return (cfqd->busy_queues - 1) * (max_slice - slice);
 }
 
 /*
@@ -1692,6 +1707,7 @@ static void cfq_init_cfqq(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 
 	atomic_set(&cfqq->ref, 0);
 	cfqq->cfqd = cfqd;
+	cfqq->weight = BLKIO_WEIGHT_DEFAULT;
 
 	cfq_mark_cfqq_prio_changed(cfqq);
 
@@ -2369,6 +2385,13 @@ cfq_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
 	cfqq->allocated[rw]++;
 	atomic_inc(&cfqq->ref);
 
+	/*
+	 * async queues are shared by everyone of the same io priority, so
+	 * only sync ones follow the cgroup of their task
+	 */
+	if (is_sync)
+		cfqq->weight = blkiocg_rq_weight(rq);
+
 	spin_unlock_irqrestore(q->queue_lock, flags);
 
 	rq->elevator_private = cic;
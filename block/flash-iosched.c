@@ -0,0 +1,589 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Based on the deadline i/o scheduler, Copyright (C) 2002 Jens Axboe.
+ *
+ *  For devices without seek costs, such as eMMC: reads are served in
+ *  arrival order without idling, reads of foreground tasks before those
+ *  of background ones, and writes go out in batches that cover whole
+ *  erase blocks in sector order.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/sched.h>
+#include <linux/ioprio.h>
+#include <linux/log2.h>
+
+#include "blk-cgroup.h"
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int bg_read_expire = HZ / 4; /* max time background reads wait */
+static const int write_expire = HZ;	/* ditto for writes, these are SOFT! */
+static const int writes_starved = 4;	/* max read batches while writes wait */
+static const int read_batch = 16;	/* # of reads dispatched in a row */
+static const int write_batch = 16;	/* # of writes, if reads are waiting */
+static const int erase_block_kb = 512;	/* erase group of a typical eMMC */
+
+enum {
+	FLASH_FG_READ,
+	FLASH_BG_READ,
+	FLASH_WRITE,
+	FLASH_IDLE,
+};
+
+struct flash_data {
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * reads wait on read_fifo[FLASH_FG_READ or FLASH_BG_READ], writes
+	 * on write_fifo; both are also on sort_list, by sector
+	 */
+	struct list_head read_fifo[2];
+	struct list_head write_fifo;
+	struct rb_root sort_list[2];
+
+	int batch;			/* what is being dispatched */
+	unsigned int batching;		/* number of requests in this batch */
+	unsigned int batch_reads;	/* reads allowed in this batch */
+	unsigned int starved;		/* read batches while writes waited */
+	struct request *next_write;	/* next in sort order */
+	sector_t write_block;		/* erase block of the last write */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int bg_read_expire;
+	int write_expire;
+	int writes_starved;
+	int read_batch;
+	int write_batch;
+	int erase_shift;		/* log2 of erase block, in sectors */
+	int front_merges;
+};
+
+static void flash_move_request(struct flash_data *, struct request *);
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+static inline sector_t flash_erase_block(struct flash_data *fd,
+					 struct request *rq)
+{
+	return blk_rq_pos(rq) >> fd->erase_shift;
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static inline struct request *
+flash_former_request(struct request *rq)
+{
+	struct rb_node *node = rb_prev(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void
+flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = flash_rb_root(fd, rq);
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		flash_move_request(fd, __alias);
+}
+
+static inline void
+flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+/*
+ * Reads from a blkio cgroup of less than the default weight are background
+ * reads, and those from one of more are foreground reads.  Otherwise, reads
+ * of tasks in the idle class, or of lower than normal best effort priority,
+ * are background reads.  Without an explicit io priority that follows the
+ * nice level, which is how Android marks background apps.
+ */
+static int flash_rq_background(struct request *rq)
+{
+	struct io_context *ioc = current->io_context;
+	int ioprio = req_get_ioprio(rq);
+	unsigned int weight = blkiocg_rq_weight(rq);
+
+	if (weight != BLKIO_WEIGHT_DEFAULT)
+		return weight < BLKIO_WEIGHT_DEFAULT;
+
+	if (!ioprio_valid(ioprio) && ioc)
+		ioprio = ioc->ioprio;
+
+	if (!ioprio_valid(ioprio))
+		return task_nice_ioprio(current) > IOPRIO_NORM;
+
+	switch (IOPRIO_PRIO_CLASS(ioprio)) {
+	case IOPRIO_CLASS_IDLE:
+		return 1;
+	case IOPRIO_CLASS_BE:
+		return IOPRIO_PRIO_DATA(ioprio) > IOPRIO_NORM;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	flash_add_rq_rb(fd, rq);
+
+	/*
+	 * set expire time and add to fifo list; foreground reads are
+	 * always first, so they don't need one
+	 */
+	if (rq_data_dir(rq) == WRITE) {
+		rq_set_fifo_time(rq, jiffies + fd->write_expire);
+		list_add_tail(&rq->queuelist, &fd->write_fifo);
+	} else if (flash_rq_background(rq)) {
+		rq_set_fifo_time(rq, jiffies + fd->bg_read_expire);
+		list_add_tail(&rq->queuelist, &fd->read_fifo[FLASH_BG_READ]);
+	} else {
+		rq_set_fifo_time(rq, jiffies);
+		list_add_tail(&rq->queuelist, &fd->read_fifo[FLASH_FG_READ]);
+	}
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	flash_del_rq_rb(fd, rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq and move
+	 * into next position (next will be deleted) in fifo; this also
+	 * makes a background read merged with a foreground one foreground
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move an entry to dispatch queue
+ */
+static void
+flash_move_request(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (rq_data_dir(rq) == WRITE) {
+		fd->next_write = flash_latter_request(rq);
+		fd->write_block = flash_erase_block(fd, rq);
+	}
+
+	/*
+	 * take it off the sort and fifo list, move
+	 * to dispatch queue
+	 */
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * flash_check_fifo returns 1 if the oldest request on fifo has expired.
+ * Requires !list_empty(fifo)
+ */
+static inline int flash_check_fifo(struct list_head *fifo)
+{
+	struct request *rq = rq_entry_fifo(fifo->next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * A write batch starts at the beginning of the erase block of the oldest
+ * write, so that the writes to that block go out together and in order.
+ */
+static struct request *flash_first_write(struct flash_data *fd)
+{
+	struct request *rq = rq_entry_fifo(fd->write_fifo.next);
+	sector_t block = flash_erase_block(fd, rq);
+	struct request *prev;
+
+	while ((prev = flash_former_request(rq)) &&
+	       flash_erase_block(fd, prev) == block)
+		rq = prev;
+
+	return rq;
+}
+
+/*
+ * Carry on with a write batch: up to write_batch requests, or to the end
+ * of the erase block being written once that many have gone out.  If
+ * foreground reads are waiting, and the writes aren't late, a batch
+ * ends at the first erase block boundary instead.
+ */
+static struct request *flash_next_write(struct flash_data *fd, int reads)
+{
+	struct request *rq = fd->next_write;
+	int same_block;
+
+	if (!rq)
+		return NULL;
+
+	if (reads && flash_check_fifo(&fd->write_fifo))
+		reads = 0;
+
+	same_block = flash_erase_block(fd, rq) == fd->write_block;
+	if (same_block)
+		return (fd->batching < fd->write_batch || !reads) ? rq : NULL;
+
+	return (fd->batching < fd->write_batch && !reads) ? rq : NULL;
+}
+
+/*
+ * flash_dispatch_requests selects the next request: there is no head
+ * position or anticipation to account for, so it never waits and force
+ * makes no difference
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int fg = !list_empty(&fd->read_fifo[FLASH_FG_READ]);
+	const int bg = !list_empty(&fd->read_fifo[FLASH_BG_READ]);
+	const int writes = !list_empty(&fd->write_fifo);
+	struct request *rq;
+
+	/*
+	 * carry on with the current batch; a background one stops as
+	 * soon as there are foreground reads
+	 */
+	switch (fd->batch) {
+	case FLASH_WRITE:
+		rq = flash_next_write(fd, fg);
+		if (rq)
+			goto dispatch_request;
+		break;
+	case FLASH_BG_READ:
+		if (fg)
+			break;
+		/* FALLTHROUGH */
+	case FLASH_FG_READ:
+		if (!list_empty(&fd->read_fifo[fd->batch]) &&
+		    fd->batching < fd->batch_reads) {
+			rq = rq_entry_fifo(fd->read_fifo[fd->batch].next);
+			goto dispatch_request;
+		}
+		break;
+	}
+
+	/*
+	 * start a new batch: writes if they are late, have been starved
+	 * or are all there is, then background reads if they are late,
+	 * then foreground reads
+	 */
+	if (writes && ((!fg && !bg) || fd->starved >= fd->writes_starved ||
+		       flash_check_fifo(&fd->write_fifo))) {
+		fd->batch = FLASH_WRITE;
+		fd->starved = 0;
+		rq = flash_first_write(fd);
+	} else if (bg && (!fg ||
+			  flash_check_fifo(&fd->read_fifo[FLASH_BG_READ]))) {
+		fd->batch = FLASH_BG_READ;
+		rq = rq_entry_fifo(fd->read_fifo[FLASH_BG_READ].next);
+	} else if (fg) {
+		fd->batch = FLASH_FG_READ;
+		rq = rq_entry_fifo(fd->read_fifo[FLASH_FG_READ].next);
+	} else {
+		fd->batch = FLASH_IDLE;
+		return 0;
+	}
+
+	/*
+	 * read batches are longer or shorter by the blkio cgroup weight of
+	 * the read that starts them
+	 */
+	if (fd->batch != FLASH_WRITE) {
+		fd->batch_reads = max_t(unsigned int, 1, fd->read_batch *
+				blkiocg_rq_weight(rq) / BLKIO_WEIGHT_DEFAULT);
+		if (writes)
+			fd->starved++;
+	}
+	fd->batching = 0;
+
+dispatch_request:
+	/*
+	 * rq is the selected appropriate request.
+	 */
+	fd->batching++;
+	flash_move_request(fd, rq);
+
+	return 1;
+}
+
+static int flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return list_empty(&fd->write_fifo)
+		&& list_empty(&fd->read_fifo[FLASH_FG_READ])
+		&& list_empty(&fd->read_fifo[FLASH_BG_READ]);
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(!list_empty(&fd->read_fifo[FLASH_FG_READ]));
+	BUG_ON(!list_empty(&fd->read_fifo[FLASH_BG_READ]));
+	BUG_ON(!list_empty(&fd->write_fifo));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	INIT_LIST_HEAD(&fd->read_fifo[FLASH_FG_READ]);
+	INIT_LIST_HEAD(&fd->read_fifo[FLASH_BG_READ]);
+	INIT_LIST_HEAD(&fd->write_fifo);
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	fd->batch = FLASH_IDLE;
+	fd->bg_read_expire = bg_read_expire;
+	fd->write_expire = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->read_batch = read_batch;
+	fd->write_batch = write_batch;
+	fd->erase_shift = ilog2(erase_block_kb) + 1;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_bg_read_expire_show, fd->bg_read_expire, 1);
+SHOW_FUNCTION(flash_write_expire_show, fd->write_expire, 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_read_batch_show, fd->read_batch, 0);
+SHOW_FUNCTION(flash_write_batch_show, fd->write_batch, 0);
+SHOW_FUNCTION(flash_erase_block_kb_show, 1 << (fd->erase_shift - 1), 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_bg_read_expire_store, &fd->bg_read_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_expire_store, &fd->write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_read_batch_store, &fd->read_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_store, &fd->write_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+/* rounded down to a power of two, from 4KiB to 64MiB */
+static ssize_t flash_erase_block_kb_store(struct elevator_queue *e,
+					  const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+	int kb;
+	int ret = flash_var_store(&kb, page, count);
+
+	kb = clamp(kb, 4, 65536);
+	fd->erase_shift = ilog2(kb) + 1;
+	return ret;
+}
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(bg_read_expire),
+	FD_ATTR(write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(read_batch),
+	FD_ATTR(write_batch),
+	FD_ATTR(erase_block_kb),
+	FD_ATTR(front_merges),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
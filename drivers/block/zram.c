@@ -0,0 +1,593 @@
+/*
+ * Compressed RAM block device driver.
+ *
+ * Pages written to the device are compressed with LZO and kept in size
+ * class caches, so that the device can be used as a swap device that
+ * costs a fraction of the memory it holds.  Zero filled pages take no
+ * memory at all, and slots are dropped as soon as swap frees them.
+ *
+ * Only whole page, page aligned I/O is supported, which is all swap
+ * ever does.
+ *
+ * Derived from drivers/block/brd.c.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/highmem.h>
+#include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/lzo.h>
+#include <linux/swap.h>
+
+#define SECTOR_SHIFT		9
+#define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+#define PAGE_SECTORS		(1 << PAGE_SECTORS_SHIFT)
+
+/*
+ * Compressed pages are kept in caches of objects ZRAM_CLASS_SIZE apart.
+ * Pages that do not compress below ZRAM_MAX_ZPAGE_SIZE are kept as they
+ * are in a page of their own.
+ */
+#define ZRAM_CLASS_SHIFT	6
+#define ZRAM_CLASS_SIZE		(1 << ZRAM_CLASS_SHIFT)
+#define ZRAM_MAX_ZPAGE_SIZE	(PAGE_SIZE / 4 * 3)
+#define ZRAM_NR_CLASSES		(ZRAM_MAX_ZPAGE_SIZE >> ZRAM_CLASS_SHIFT)
+
+#define ZRAM_CLASS(size)	(((size) - 1) >> ZRAM_CLASS_SHIFT)
+
+static struct kmem_cache *zram_classes[ZRAM_NR_CLASSES];
+static char zram_class_names[ZRAM_NR_CLASSES][16];
+
+/* Slot flags */
+#define ZRAM_ZERO		(1 << 0)	/* zero filled, nothing stored */
+#define ZRAM_HUGE		(1 << 1)	/* stored uncompressed in a page */
+
+struct zram_slot {
+	void		*obj;		/* class object, or struct page */
+	u16		size;		/* compressed size */
+	u16		flags;
+};
+
+struct zram_stats {
+	u64		compr_size;	/* bytes of compressed data */
+	u64		obj_size;	/* bytes of the objects holding data */
+	unsigned long	pages_stored;	/* pages holding data */
+	unsigned long	pages_zero;	/* zero filled pages */
+	unsigned long	pages_huge;	/* incompressible pages */
+	atomic_long_t	num_reads;
+	atomic_long_t	num_writes;
+	atomic_long_t	invalid_io;
+	unsigned long	notify_free;
+	unsigned long	discards;
+};
+
+struct zram_device {
+	int			zram_number;
+	unsigned long		zram_pages;
+
+	struct request_queue	*zram_queue;
+	struct gendisk		*zram_disk;
+
+	/*
+	 * The slot table and the statistics.  Readers decompress under
+	 * the read lock; writers compress outside it and only take the
+	 * write lock to swap the new object in.
+	 */
+	rwlock_t		zram_lock;
+	struct zram_slot	*zram_table;
+	struct zram_stats	zram_stats;
+
+	/* Compression scratch space, serialised by zram_mutex */
+	struct mutex		zram_mutex;
+	void			*zram_workmem;
+	unsigned char		*zram_buffer;
+};
+
+static int zram_major;
+static int num_devices = 1;
+static unsigned long disksize_kb;
+static struct zram_device *zram_devices;
+
+module_param(num_devices, int, 0);
+MODULE_PARM_DESC(num_devices, "Number of zram devices");
+module_param(disksize_kb, ulong, 0);
+MODULE_PARM_DESC(disksize_kb, "Size of each zram device in kbytes, "
+		 "default a quarter of RAM");
+
+static int page_zero_filled(void *ptr)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page); pos++)
+		if (page[pos])
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Drop whatever is stored in slot index.  Called with the write lock
+ * held; frees to the slab and page allocators, which never sleep.
+ */
+static void zram_free_slot(struct zram_device *zram, unsigned long index)
+{
+	struct zram_slot *slot = &zram->zram_table[index];
+	struct zram_stats *stats = &zram->zram_stats;
+
+	if (slot->flags & ZRAM_ZERO) {
+		stats->pages_zero--;
+	} else if (slot->flags & ZRAM_HUGE) {
+		__free_page(slot->obj);
+		stats->pages_huge--;
+		stats->pages_stored--;
+		stats->compr_size -= PAGE_SIZE;
+		stats->obj_size -= PAGE_SIZE;
+	} else if (slot->obj) {
+		kmem_cache_free(zram_classes[ZRAM_CLASS(slot->size)],
+				slot->obj);
+		stats->pages_stored--;
+		stats->compr_size -= slot->size;
+		stats->obj_size -=
+			(ZRAM_CLASS(slot->size) + 1) << ZRAM_CLASS_SHIFT;
+	}
+
+	slot->obj = NULL;
+	slot->size = 0;
+	slot->flags = 0;
+}
+
+static int zram_read(struct zram_device *zram, struct page *page,
+		     unsigned long index)
+{
+	struct zram_slot *slot;
+	unsigned char *mem;
+	size_t len = PAGE_SIZE;
+	int ret = LZO_E_OK;
+
+	read_lock(&zram->zram_lock);
+	slot = &zram->zram_table[index];
+
+	if (slot->flags & ZRAM_HUGE) {
+		copy_highpage(page, slot->obj);
+	} else if (slot->obj) {
+		mem = kmap_atomic(page, KM_USER0);
+		ret = lzo1x_decompress_safe(slot->obj, slot->size, mem, &len);
+		kunmap_atomic(mem, KM_USER0);
+	} else {
+		/* zero filled, or never written */
+		clear_highpage(page);
+	}
+	read_unlock(&zram->zram_lock);
+
+	if (unlikely(ret != LZO_E_OK || len != PAGE_SIZE)) {
+		printk(KERN_ERR "zram%d: decompression of page %lu failed "
+		       "(%d)\n", zram->zram_number, index, ret);
+		return -EIO;
+	}
+
+	flush_dcache_page(page);
+	return 0;
+}
+
+static int zram_write(struct zram_device *zram, struct page *page,
+		      unsigned long index)
+{
+	struct zram_stats *stats = &zram->zram_stats;
+	struct zram_slot new = { NULL, 0, 0 };
+	unsigned char *mem;
+	size_t clen = 0;
+	int ret;
+
+	mutex_lock(&zram->zram_mutex);
+
+	mem = kmap_atomic(page, KM_USER0);
+	if (page_zero_filled(mem)) {
+		new.flags = ZRAM_ZERO;
+		ret = LZO_E_OK;
+	} else {
+		ret = lzo1x_1_compress(mem, PAGE_SIZE, zram->zram_buffer,
+				       &clen, zram->zram_workmem);
+	}
+	kunmap_atomic(mem, KM_USER0);
+
+	if (unlikely(ret != LZO_E_OK)) {
+		mutex_unlock(&zram->zram_mutex);
+		printk(KERN_ERR "zram%d: compression of page %lu failed (%d)\n",
+		       zram->zram_number, index, ret);
+		return -EIO;
+	}
+
+	/* allocate with the scratch buffer still ours, it may sleep */
+	if (new.flags & ZRAM_ZERO) {
+		/* nothing to store */
+	} else if (clen > ZRAM_MAX_ZPAGE_SIZE) {
+		new.obj = alloc_page(GFP_NOIO | __GFP_HIGHMEM | __GFP_NOWARN);
+		if (new.obj)
+			copy_highpage(new.obj, page);
+		new.size = PAGE_SIZE;
+		new.flags = ZRAM_HUGE;
+	} else {
+		new.obj = kmem_cache_alloc(zram_classes[ZRAM_CLASS(clen)],
+					   GFP_NOIO | __GFP_NOWARN);
+		if (new.obj)
+			memcpy(new.obj, zram->zram_buffer, clen);
+		new.size = clen;
+	}
+
+	mutex_unlock(&zram->zram_mutex);
+
+	if (!new.obj && !(new.flags & ZRAM_ZERO))
+		return -ENOMEM;
+
+	write_lock(&zram->zram_lock);
+	zram_free_slot(zram, index);
+	zram->zram_table[index] = new;
+
+	if (new.flags & ZRAM_ZERO) {
+		stats->pages_zero++;
+	} else if (new.flags & ZRAM_HUGE) {
+		stats->pages_huge++;
+		stats->pages_stored++;
+		stats->compr_size += PAGE_SIZE;
+		stats->obj_size += PAGE_SIZE;
+	} else {
+		stats->pages_stored++;
+		stats->compr_size += new.size;
+		stats->obj_size += (ZRAM_CLASS(new.size) + 1) << ZRAM_CLASS_SHIFT;
+	}
+	write_unlock(&zram->zram_lock);
+
+	return 0;
+}
+
+/*
+ * Drop the pages wholly inside a discarded range.
+ */
+static void zram_discard(struct zram_device *zram, sector_t sector,
+			 unsigned int size)
+{
+	unsigned long index = (sector + PAGE_SECTORS - 1) >> PAGE_SECTORS_SHIFT;
+	unsigned long end = (sector + (size >> SECTOR_SHIFT)) >>
+		PAGE_SECTORS_SHIFT;
+
+	write_lock(&zram->zram_lock);
+	for (; index < end; index++)
+		zram_free_slot(zram, index);
+	zram->zram_stats.discards++;
+	write_unlock(&zram->zram_lock);
+}
+
+static int zram_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct zram_device *zram = q->queuedata;
+	struct bio_vec *bvec;
+	unsigned long index;
+	sector_t sector;
+	int i;
+	int err = -EIO;
+
+	sector = bio->bi_sector;
+	if (sector + (bio->bi_size >> SECTOR_SHIFT) >
+					get_capacity(zram->zram_disk))
+		goto out_invalid;
+
+	if (bio_rw_flagged(bio, BIO_RW_DISCARD)) {
+		zram_discard(zram, sector, bio->bi_size);
+		err = 0;
+		goto out;
+	}
+
+	if (sector & (PAGE_SECTORS - 1))
+		goto out_invalid;
+
+	index = sector >> PAGE_SECTORS_SHIFT;
+	bio_for_each_segment(bvec, bio, i) {
+		if (bvec->bv_len != PAGE_SIZE || bvec->bv_offset)
+			goto out_invalid;
+
+		if (bio_data_dir(bio) == READ) {
+			atomic_long_inc(&zram->zram_stats.num_reads);
+			err = zram_read(zram, bvec->bv_page, index);
+		} else {
+			atomic_long_inc(&zram->zram_stats.num_writes);
+			err = zram_write(zram, bvec->bv_page, index);
+		}
+		if (err)
+			break;
+		index++;
+	}
+
+out:
+	bio_endio(bio, err);
+	return 0;
+
+out_invalid:
+	atomic_long_inc(&zram->zram_stats.invalid_io);
+	bio_io_error(bio);
+	return 0;
+}
+
+static void zram_slot_free_notify(struct block_device *bdev,
+				  unsigned long index)
+{
+	struct zram_device *zram = bdev->bd_disk->private_data;
+
+	write_lock(&zram->zram_lock);
+	zram_free_slot(zram, index);
+	zram->zram_stats.notify_free++;
+	write_unlock(&zram->zram_lock);
+}
+
+static const struct block_device_operations zram_fops = {
+	.owner =		THIS_MODULE,
+	.swap_slot_free_notify = zram_slot_free_notify,
+};
+
+/*
+ * Statistics, in /sys/block/zramN/
+ */
+static struct zram_device *dev_to_zram(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+static ssize_t disksize_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct zram_device *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)zram->zram_pages << PAGE_SHIFT);
+}
+static DEVICE_ATTR(disksize, S_IRUGO, disksize_show, NULL);
+
+#define ZRAM_STAT_ATTR(name, expr)					\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	struct zram_device *zram = dev_to_zram(dev);			\
+	struct zram_stats *stats = &zram->zram_stats;			\
+	u64 val;							\
+									\
+	read_lock(&zram->zram_lock);					\
+	val = (expr);							\
+	read_unlock(&zram->zram_lock);					\
+	return sprintf(buf, "%llu\n", (unsigned long long)val);		\
+}									\
+static DEVICE_ATTR(name, S_IRUGO, name##_show, NULL)
+
+ZRAM_STAT_ATTR(num_reads, atomic_long_read(&stats->num_reads));
+ZRAM_STAT_ATTR(num_writes, atomic_long_read(&stats->num_writes));
+ZRAM_STAT_ATTR(invalid_io, atomic_long_read(&stats->invalid_io));
+ZRAM_STAT_ATTR(notify_free, stats->notify_free);
+ZRAM_STAT_ATTR(discards, stats->discards);
+ZRAM_STAT_ATTR(zero_pages, stats->pages_zero);
+ZRAM_STAT_ATTR(huge_pages, stats->pages_huge);
+ZRAM_STAT_ATTR(orig_data_size, (u64)stats->pages_stored << PAGE_SHIFT);
+ZRAM_STAT_ATTR(compr_data_size, stats->compr_size);
+/* the slabs of the classes are shared by all devices, see /proc/slabinfo */
+ZRAM_STAT_ATTR(obj_data_size, stats->obj_size);
+
+/* compressed size in percent of the original */
+ZRAM_STAT_ATTR(compr_ratio, stats->pages_stored ?
+	       div64_u64(stats->compr_size * 100,
+			 (u64)stats->pages_stored << PAGE_SHIFT) : 0);
+
+static struct attribute *zram_attrs[] = {
+	&dev_attr_disksize.attr,
+	&dev_attr_num_reads.attr,
+	&dev_attr_num_writes.attr,
+	&dev_attr_invalid_io.attr,
+	&dev_attr_notify_free.attr,
+	&dev_attr_discards.attr,
+	&dev_attr_zero_pages.attr,
+	&dev_attr_huge_pages.attr,
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_obj_data_size.attr,
+	&dev_attr_compr_ratio.attr,
+	NULL,
+};
+
+static struct attribute_group zram_attr_group = {
+	.attrs = zram_attrs,
+};
+
+static int zram_alloc(struct zram_device *zram, int i, unsigned long pages)
+{
+	struct gendisk *disk;
+
+	zram->zram_number = i;
+	zram->zram_pages = pages;
+	rwlock_init(&zram->zram_lock);
+	mutex_init(&zram->zram_mutex);
+
+	zram->zram_table = vmalloc(pages * sizeof(struct zram_slot));
+	if (!zram->zram_table)
+		goto out;
+	memset(zram->zram_table, 0, pages * sizeof(struct zram_slot));
+
+	zram->zram_workmem = kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	if (!zram->zram_workmem)
+		goto out_free_table;
+
+	zram->zram_buffer = kmalloc(lzo1x_worst_compress(PAGE_SIZE),
+				    GFP_KERNEL);
+	if (!zram->zram_buffer)
+		goto out_free_workmem;
+
+	zram->zram_queue = blk_alloc_queue(GFP_KERNEL);
+	if (!zram->zram_queue)
+		goto out_free_buffer;
+	zram->zram_queue->queuedata = zram;
+	blk_queue_make_request(zram->zram_queue, zram_make_request);
+	blk_queue_logical_block_size(zram->zram_queue, PAGE_SIZE);
+	blk_queue_max_sectors(zram->zram_queue, 1024);
+	blk_queue_max_discard_sectors(zram->zram_queue, UINT_MAX);
+	blk_queue_bounce_limit(zram->zram_queue, BLK_BOUNCE_ANY);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->zram_queue);
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, zram->zram_queue);
+
+	disk = zram->zram_disk = alloc_disk(1);
+	if (!disk)
+		goto out_free_queue;
+	disk->major		= zram_major;
+	disk->first_minor	= i;
+	disk->fops		= &zram_fops;
+	disk->private_data	= zram;
+	disk->queue		= zram->zram_queue;
+	disk->flags |= GENHD_FL_SUPPRESS_PARTITION_INFO;
+	sprintf(disk->disk_name, "zram%d", i);
+	set_capacity(disk, pages << PAGE_SECTORS_SHIFT);
+
+	return 0;
+
+out_free_queue:
+	blk_cleanup_queue(zram->zram_queue);
+out_free_buffer:
+	kfree(zram->zram_buffer);
+out_free_workmem:
+	kfree(zram->zram_workmem);
+out_free_table:
+	vfree(zram->zram_table);
+out:
+	return -ENOMEM;
+}
+
+static void zram_free(struct zram_device *zram)
+{
+	unsigned long index;
+
+	put_disk(zram->zram_disk);
+	blk_cleanup_queue(zram->zram_queue);
+
+	for (index = 0; index < zram->zram_pages; index++)
+		zram_free_slot(zram, index);
+
+	kfree(zram->zram_buffer);
+	kfree(zram->zram_workmem);
+	vfree(zram->zram_table);
+}
+
+static void zram_destroy_classes(void)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_NR_CLASSES; i++)
+		if (zram_classes[i])
+			kmem_cache_destroy(zram_classes[i]);
+}
+
+static int __init zram_create_classes(void)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_NR_CLASSES; i++) {
+		sprintf(zram_class_names[i], "zram-%d",
+			(i + 1) << ZRAM_CLASS_SHIFT);
+		zram_classes[i] = kmem_cache_create(zram_class_names[i],
+				(i + 1) << ZRAM_CLASS_SHIFT, 0, 0, NULL);
+		if (!zram_classes[i]) {
+			zram_destroy_classes();
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static int __init zram_init(void)
+{
+	unsigned long pages;
+	int i;
+	int err;
+
+	/* huge pages record PAGE_SIZE in the slot */
+	BUILD_BUG_ON(PAGE_SIZE > 0xffff);
+
+	if (num_devices < 1)
+		return -EINVAL;
+
+	if (disksize_kb)
+		pages = disksize_kb >> (PAGE_SHIFT - 10);
+	else
+		pages = totalram_pages / 4;
+
+	err = zram_create_classes();
+	if (err)
+		return err;
+
+	zram_major = register_blkdev(0, "zram");
+	if (zram_major <= 0) {
+		err = -EIO;
+		goto out_classes;
+	}
+
+	zram_devices = kzalloc(num_devices * sizeof(*zram_devices),
+			       GFP_KERNEL);
+	if (!zram_devices) {
+		err = -ENOMEM;
+		goto out_unregister;
+	}
+
+	for (i = 0; i < num_devices; i++) {
+		err = zram_alloc(&zram_devices[i], i, pages);
+		if (err)
+			goto out_free;
+	}
+
+	/* point of no return */
+
+	for (i = 0; i < num_devices; i++) {
+		add_disk(zram_devices[i].zram_disk);
+		if (sysfs_create_group(&disk_to_dev(zram_devices[i].zram_disk)
+				       ->kobj, &zram_attr_group))
+			printk(KERN_WARNING "zram%d: no sysfs statistics\n", i);
+	}
+
+	printk(KERN_INFO "zram: %d device(s) of %lu kB\n", num_devices,
+	       pages << (PAGE_SHIFT - 10));
+	return 0;
+
+out_free:
+	while (i--)
+		zram_free(&zram_devices[i]);
+	kfree(zram_devices);
+out_unregister:
+	unregister_blkdev(zram_major, "zram");
+out_classes:
+	zram_destroy_classes();
+	return err;
+}
+
+static void __exit zram_exit(void)
+{
+	struct zram_device *zram;
+	int i;
+
+	for (i = 0; i < num_devices; i++) {
+		zram = &zram_devices[i];
+		sysfs_remove_group(&disk_to_dev(zram->zram_disk)->kobj,
+				   &zram_attr_group);
+		del_gendisk(zram->zram_disk);
+		zram_free(zram);
+	}
+
+	kfree(zram_devices);
+	unregister_blkdev(zram_major, "zram");
+	zram_destroy_classes();
+}
+
+module_init(zram_init);
+module_exit(zram_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed RAM block device");
@@ -23,6 +23,9 @@
 #include <linux/ktime.h>
 #include <linux/sched.h>
 #include <linux/platform_device.h>
+#include <linux/notifier.h>
+
+#include <trace/events/power.h>
 
 /*
  * dbs is used in this file as a shortform for demandbased switching
@@ -36,6 +39,7 @@
 #define MICRO_FREQUENCY_MIN_SAMPLE_RATE		(10000)
 #define MIN_FREQUENCY_UP_THRESHOLD		(11)
 #define MAX_FREQUENCY_UP_THRESHOLD		(100)
+#define DEF_SCHED_HINT_LOAD			(2 * SCHED_LOAD_SCALE)
 
 /*
  * The polling frequency of this governor depends on the capability of
@@ -90,6 +94,19 @@ struct cpu_dbs_info_s {
 	 * when user is changing the governor or limits.
 	 */
 	struct mutex timer_mutex;
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+	/*
+	 * hint_timer pulls the next sample in when the scheduler reports
+	 * a runnable load above sched_hint_load; hint_time is the rq clock
+	 * of that report, used to trace the decision latency. Bit 0 of
+	 * hint_armed is set while the timer is armed or about to be.
+	 */
+	struct timer_list hint_timer;
+	u64 hint_time;
+	unsigned long hint_armed;
+	int hint_enabled;
+	int hint_pending;
+#endif
 };
 static DEFINE_PER_CPU(struct cpu_dbs_info_s, od_cpu_dbs_info);
 
@@ -109,11 +126,13 @@ static struct dbs_tuners {
 	unsigned int down_differential;
 	unsigned int ignore_nice;
 	unsigned int powersave_bias;
+	unsigned int sched_hint_load;
 } dbs_tuners_ins = {
 	.up_threshold = DEF_FREQUENCY_UP_THRESHOLD,
 	.down_differential = DEF_FREQUENCY_DOWN_DIFFERENTIAL,
 	.ignore_nice = 0,
 	.powersave_bias = 0,
+	.sched_hint_load = DEF_SCHED_HINT_LOAD,
 };
 
 static inline cputime64_t get_cpu_idle_time_jiffy(unsigned int cpu,
@@ -386,6 +405,29 @@ define_one_rw(up_threshold);
 define_one_rw(ignore_nice_load);
 define_one_rw(powersave_bias);
 
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+show_one(sched_hint_load, sched_hint_load);
+
+static ssize_t store_sched_hint_load(struct kobject *a, struct attribute *b,
+				     const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1)
+		return -EINVAL;
+
+	mutex_lock(&dbs_mutex);
+	dbs_tuners_ins.sched_hint_load = input;
+	mutex_unlock(&dbs_mutex);
+
+	return count;
+}
+
+define_one_rw(sched_hint_load);
+#endif
+
 static struct attribute *dbs_attributes[] = {
 	&sampling_rate_max.attr,
 	&sampling_rate_min.attr,
@@ -393,6 +435,9 @@ static struct attribute *dbs_attributes[] = {
 	&up_threshold.attr,
 	&ignore_nice_load.attr,
 	&powersave_bias.attr,
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+	&sched_hint_load.attr,
+#endif
 	NULL
 };
 
@@ -567,6 +612,124 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	}
 }
 
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+/*
+ * Called from the scheduler with the runqueue lock held and interrupts
+ * disabled. The CPUs of a policy hold different runqueue locks, so
+ * hint_armed picks the one hint that arms the owner's timer.
+ */
+static int dbs_sched_load_notify(struct notifier_block *nb,
+				 unsigned long event, void *data)
+{
+	struct sched_load_info *info = data;
+	struct cpu_dbs_info_s *dbs_info;
+	unsigned int hint_load = dbs_tuners_ins.sched_hint_load;
+
+	if (event == SCHED_LOAD_DEQUEUE || !hint_load || info->load < hint_load)
+		return NOTIFY_DONE;
+
+	dbs_info = &per_cpu(od_cpu_dbs_info, info->cpu);
+	if (!dbs_info->hint_enabled)
+		return NOTIFY_DONE;
+
+	/* Frequency is managed by the policy owner's sampling work */
+	dbs_info = &per_cpu(od_cpu_dbs_info, dbs_info->cur_policy->cpu);
+	if (dbs_info->cur_policy->cur == dbs_info->cur_policy->max ||
+	    test_and_set_bit(0, &dbs_info->hint_armed))
+		return NOTIFY_DONE;
+
+	dbs_info->hint_time = info->time;
+	dbs_info->hint_timer.expires = jiffies;
+	add_timer_on(&dbs_info->hint_timer, dbs_info->cpu);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block dbs_sched_load_nb = {
+	.notifier_call = dbs_sched_load_notify,
+};
+
+/*
+ * We cannot queue work from under the runqueue lock, so the hint is
+ * bounced through a timer and the pending sample is re-armed to run now.
+ * If the sample is already queued or running, it sees hint_pending.
+ */
+static void dbs_hint_timer(unsigned long data)
+{
+	struct cpu_dbs_info_s *dbs_info = (struct cpu_dbs_info_s *)data;
+
+	clear_bit(0, &dbs_info->hint_armed);
+	dbs_info->hint_pending = 1;
+	if (cancel_delayed_work(&dbs_info->work))
+		queue_delayed_work_on(dbs_info->cpu, kondemand_wq,
+				      &dbs_info->work, 0);
+}
+
+static void dbs_sched_hint_boost(struct cpu_dbs_info_s *dbs_info)
+{
+	struct cpufreq_policy *policy = dbs_info->cur_policy;
+	unsigned int old_freq = policy->cur;
+
+	dbs_info->hint_pending = 0;
+	if (!dbs_tuners_ins.powersave_bias) {
+		if (policy->cur != policy->max)
+			__cpufreq_driver_target(policy, policy->max,
+				CPUFREQ_RELATION_H);
+	} else {
+		int freq = powersave_bias_target(policy, policy->max,
+				CPUFREQ_RELATION_H);
+		__cpufreq_driver_target(policy, freq, CPUFREQ_RELATION_L);
+	}
+
+	trace_power_sched_hint(dbs_info->cpu, old_freq, policy->cur,
+			       cpu_clock(dbs_info->cpu) - dbs_info->hint_time);
+}
+
+static void dbs_hint_init(struct cpu_dbs_info_s *dbs_info)
+{
+	unsigned int j;
+
+	dbs_info->hint_pending = 0;
+	dbs_info->hint_armed = 0;
+	setup_timer(&dbs_info->hint_timer, dbs_hint_timer,
+		    (unsigned long)dbs_info);
+	for_each_cpu(j, dbs_info->cur_policy->cpus)
+		per_cpu(od_cpu_dbs_info, j).hint_enabled = 1;
+}
+
+static void dbs_hint_exit(struct cpu_dbs_info_s *dbs_info)
+{
+	unsigned int j;
+
+	for_each_cpu(j, dbs_info->cur_policy->cpus)
+		per_cpu(od_cpu_dbs_info, j).hint_enabled = 0;
+	/* Notifiers run with interrupts off; wait for any in flight */
+	synchronize_sched();
+	del_timer_sync(&dbs_info->hint_timer);
+}
+
+static inline int dbs_hint_pending(struct cpu_dbs_info_s *dbs_info)
+{
+	return dbs_info->hint_pending;
+}
+#else
+static inline void dbs_sched_hint_boost(struct cpu_dbs_info_s *dbs_info)
+{
+}
+
+static inline void dbs_hint_init(struct cpu_dbs_info_s *dbs_info)
+{
+}
+
+static inline void dbs_hint_exit(struct cpu_dbs_info_s *dbs_info)
+{
+}
+
+static inline int dbs_hint_pending(struct cpu_dbs_info_s *dbs_info)
+{
+	return 0;
+}
+#endif
+
 static void do_dbs_timer(struct work_struct *work)
 {
 	struct cpu_dbs_info_s *dbs_info =
@@ -584,7 +747,10 @@ static void do_dbs_timer(struct work_struct *work)
 
 	/* Common NORMAL_SAMPLE setup */
 	dbs_info->sample_type = DBS_NORMAL_SAMPLE;
-	if (!dbs_tuners_ins.powersave_bias ||
+	if (dbs_hint_pending(dbs_info)) {
+		/* Runnable load went up: act now, re-evaluate next period */
+		dbs_sched_hint_boost(dbs_info);
+	} else if (!dbs_tuners_ins.powersave_bias ||
 	    sample_type == DBS_NORMAL_SAMPLE) {
 		dbs_check_cpu(dbs_info);
 		if (dbs_info->freq_lo) {
@@ -736,9 +902,11 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 
 		mutex_init(&this_dbs_info->timer_mutex);
 		dbs_timer_init(this_dbs_info);
+		dbs_hint_init(this_dbs_info);
 		break;
 
 	case CPUFREQ_GOV_STOP:
+		dbs_hint_exit(this_dbs_info);
 		dbs_timer_exit(this_dbs_info);
 
 		mutex_lock(&dbs_mutex);
@@ -807,6 +975,9 @@ static int __init cpufreq_gov_dbs_init(void)
 	if (err)
 		goto err1;
 
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+	register_sched_load_notifier(&dbs_sched_load_nb);
+#endif
 	return 0;
 
 err1:
@@ -820,6 +991,9 @@ err2:
 
 static void __exit cpufreq_gov_dbs_exit(void)
 {
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+	unregister_sched_load_notifier(&dbs_sched_load_nb);
+#endif
 	platform_driver_unregister(&ondemand_dummy_driver);
 	cpufreq_unregister_governor(&cpufreq_gov_ondemand);
 	destroy_workqueue(kondemand_wq);
@@ -53,10 +53,20 @@
 #include "protocol.h"
 #include "debug.h"
 #include <linux/wakelock.h>
+#include <linux/moduleparam.h>
 
 extern struct wake_lock netmux_send_wakelock;
 extern struct wake_lock netmux_receive_wakelock;
 
+/*
+ * channel_weight lets the platform favour latency sensitive channels,
+ * e.g. netmux.channel_weight=1,1,4 gives channel 2 four times the share
+ * of the link of channels 0 and 1.  Unset entries use the default weight.
+ */
+static int channel_weight[MUX_MAX_WEIGHTED_CHANNELS];
+module_param_array(channel_weight, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(channel_weight, "Per channel send scheduling weights");
+
 void check_all_receive_queues_emptiness(MUX *mux);
 void check_all_send_queues_emptiness(MUX *mux);
 
@@ -537,10 +547,48 @@ void CommBuffReleased(int32 channel, int32 size, void *param)
 	exit_write_criticalsection(&mux->lock);
 }
 
+/*
+ * ChannelWeight returns the scheduling weight for a newly enabled channel
+ *
+ * Params:
+ * channel -- the channel being enabled
+ */
+static
+int32 ChannelWeight(int32 channel)
+{
+	if (channel < MUX_MAX_WEIGHTED_CHANNELS && channel_weight[channel] > 0)
+		return channel_weight[channel];
+
+	return MUX_DEFAULT_CHANNEL_WEIGHT;
+}
+
+/*
+ * ChannelHasDeficit implements deficit round robin between the channels.
+ * Every visit of the send task tops the channel's deficit up by its
+ * quantum until the packet at the front of its queue fits.
+ *
+ * Callers are responsible for holding the mux lock.
+ *
+ * Params:
+ * chanlPtr -- the channel being visited
+ * length -- the length of the packet at the front of its send queue
+ * mux -- the mux object pointer
+ */
+static
+int32 ChannelHasDeficit(CHANNEL *chanlPtr, int32 length, MUX *mux)
+{
+	if (chanlPtr->deficit < length)
+		chanlPtr->deficit +=
+		    chanlPtr->weight * mux->remote_rcv_buffer_size;
+
+	return chanlPtr->deficit >= length;
+}
+
 /*
  * ProcessSendQueues is responsible for the actual sending of data
  * from the mux to a linkdriver. Data will be delivered from the lowest
- * numbered channel first. If the linkdriver returns an error on the
+ * numbered channel first, channels being served by deficit round robin
+ * according to their weight. If the linkdriver returns an error on the
  * send the mux stops sending and waits for the linkdriver to inform
  * the mux that it is okay to run again.
  *
@@ -565,6 +613,7 @@ void ProcessSendQueues(struct work_struct *work)
 	CHANNEL *chanlPtr;
 	static int32 chanlNum = 0;
 	int32 startChanlNum = chanlNum;
+	int32 nextChanl;
 	int32 holding_lock = 0;
 
 	DEBUG("ProcessSendQueues(%p)\n", work);
@@ -665,6 +714,11 @@ void ProcessSendQueues(struct work_struct *work)
 						ignore_amount +=
 						    chanlPtr->
 						    qed_totl_amount;
+					} else if (!ChannelHasDeficit
+						   (chanlPtr, buffLength,
+						    mux)) {
+						/* let the others go first */
+						commbuff = NULL;
 					} else {
 						/* we have a winner! */
 						commbuff =
@@ -735,6 +789,22 @@ void ProcessSendQueues(struct work_struct *work)
 				credit->client_send_credit -= numBuffers;
 				mux->send_buffers_available -= numBuffers;
 
+				nextChanl = chanlNum + 1;
+				if (nextChanl == mux->maxchannels)
+					nextChanl = 0;
+
+				/* stay on this channel while what is left of
+				 * its deficit covers the next packet
+				 */
+				chanlPtr->deficit -= buffLength;
+				currentQ = &(chanlPtr->send_queue);
+				if (!queue_length(currentQ))
+					chanlPtr->deficit = 0;
+				else if (chanlPtr->deficit >=
+					 commbuff_length(queue_frontbuff
+							 (currentQ)))
+					nextChanl = chanlNum;
+
 				if (!(chanlPtr->qed_data_amount)) {
 					/* let the interface know that
 					 *  we finished sending its data
@@ -759,9 +829,10 @@ void ProcessSendQueues(struct work_struct *work)
 
 				/* since we broke from the inner
 				 * while loop above, increment the channel
-				 * index to go to the next channel
+				 * index to go to the next channel unless
+				 * this one still has its turn
 				 */
-				chanlNum++;
+				chanlNum = nextChanl;
 			}
 		}
 	}
@@ -1703,6 +1774,8 @@ int32 EnableChannel(int32 acktype,
 				enable_channel->burst_size = burst_size;
 				enable_channel->max_data_amount =
 				    max_data_amount;
+				enable_channel->weight =
+				    ChannelWeight(channel);
 				enable_channel->state = OPENING;
 
 				channels[channel] = enable_channel;
@@ -1905,6 +1978,8 @@ int32 EnableChannel(int32 acktype,
 				enable_channel->burst_size = burst_size;
 				enable_channel->max_data_amount =
 				    max_data_amount;
+				enable_channel->weight =
+				    ChannelWeight(channel);
 				enable_channel->state = OPEN;
 
 				channels[channel] = enable_channel;
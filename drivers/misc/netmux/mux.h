@@ -106,6 +106,15 @@
 #define MUX_BYTECREDIT_SEND_LIMIT_DIVISOR 4
 #define MUX_SENDCREDIT_SEND_LIMIT_DIVISOR 2
 
+/*
+ * Define the scheduling weights of the channels.  Each time the send
+ * task visits a channel it earns weight remote receive buffers worth of
+ * bytes it may send, so channels queueing large packets cannot hold up
+ * the ones queueing small packets.
+ */
+#define MUX_DEFAULT_CHANNEL_WEIGHT 1
+#define MUX_MAX_WEIGHTED_CHANNELS  32
+
 
 /*
  * Define inform types that can be delivered to MUX interfaces
@@ -169,6 +178,8 @@ typedef struct PARTIAL_RECEIVE {
  * client_interface is the destination interface on
  * 	the client side for this channel
  * host_interface is the source interface on the host side for this channel
+ * weight is the channel's share of the link when several channels send
+ * deficit is the number of bytes the channel may still send in this round
  */
 typedef struct CHANNEL {
 	MUXINTERFACE *connected_interface;
@@ -183,6 +194,8 @@ typedef struct CHANNEL {
 	int32 state;
 	int32 client_interface;
 	int32 host_interface;
+	int32 weight;
+	int32 deficit;
 } CHANNEL;
 
 /*
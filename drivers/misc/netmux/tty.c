@@ -61,6 +61,18 @@ static const struct tty_operations tty_ops = {
 	.ioctl = TTYIOCtl,
 };
 
+/*
+ * TTYWrite runs in atomic context and cannot take ttyif->lock,
+ * so data_amount is changed under the process_queue lock.
+ */
+static void tty_account_data(TTY_CHANNELDATA *chdat, sint32 length)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&chdat->process_queue.lock, flags);
+	chdat->data_amount += length;
+	spin_unlock_irqrestore(&chdat->process_queue.lock, flags);
+}
 
 /*
  * TTYInform is called by the mux (and sometimes the
@@ -304,9 +316,9 @@ int32 TTYInform(void *param1, void *param2)
 						    dequeue_commbuff
 						    (&chdat->
 						     process_queue);
-						chdat->data_amount -=
-						    commbuff_length
-						    (transmit);
+						tty_account_data(chdat,
+						    -commbuff_length
+						    (transmit));
 						chdat->
 						    mux_channel_queue_space
 						    -=
@@ -327,10 +339,9 @@ int32 TTYInform(void *param1, void *param2)
 							    (split,
 							     &chdat->
 							     process_queue);
-							chdat->
-							    data_amount +=
+							tty_account_data(chdat,
 							    commbuff_length
-							    (split);
+							    (split));
 							chdat->
 							mux_channel_queue_space
 							 +=
@@ -350,9 +361,9 @@ int32 TTYInform(void *param1, void *param2)
 						    (transmit,
 						     &chdat->
 						     process_queue);
-						chdat->data_amount +=
+						tty_account_data(chdat,
 						    commbuff_length
-						    (transmit);
+						    (transmit));
 						chdat->
 						    mux_channel_queue_space
 						    +=
@@ -737,6 +748,7 @@ ssize_t TTYWrite(struct tty_struct *tty, const unsigned char *buf,
 	TTY_CHANNELDATA *chdat;
 	int32 minor;
 	sint32 amount_written;
+	unsigned long flags;
 
 	DEBUG("TTYWrite(0x%p, 0x%p, %d)\n", tty, buf, count);
 
@@ -761,12 +773,35 @@ ssize_t TTYWrite(struct tty_struct *tty, const unsigned char *buf,
 		amount_written = count;
 
 	if (amount_written > 0) {
-		commbuff =
-		    alloc_commbuff(amount_written,
-				   sizeof(DATA_PACKET_HDR));
-		memcpy(commbuff_data(commbuff), buf, amount_written);
-		queue_commbuff(commbuff, &chdat->process_queue);
-		chdat->data_amount += commbuff_length(commbuff);
+		/* append to the last queued buffer if it has room
+		 * rather than queueing another one; a split left by
+		 * SendData() may share its data and is not touched
+		 */
+		spin_lock_irqsave(&chdat->process_queue.lock, flags);
+		commbuff = skb_peek_tail(&chdat->process_queue);
+		if (commbuff && !skb_cloned(commbuff) &&
+		    skb_tailroom(commbuff) >= amount_written) {
+			memcpy(skb_put(commbuff, amount_written), buf,
+			       amount_written);
+			chdat->data_amount += amount_written;
+		} else
+			commbuff = NULL;
+		spin_unlock_irqrestore(&chdat->process_queue.lock, flags);
+
+		if (!commbuff) {
+			commbuff =
+			    alloc_commbuff(max_t(sint32, amount_written,
+						 TTY_WRITE_COALESCE_SIZE),
+					   sizeof(DATA_PACKET_HDR));
+			skb_trim(commbuff, amount_written);
+			memcpy(commbuff_data(commbuff), buf, amount_written);
+
+			spin_lock_irqsave(&chdat->process_queue.lock, flags);
+			__skb_queue_tail(&chdat->process_queue, commbuff);
+			chdat->data_amount += amount_written;
+			spin_unlock_irqrestore(&chdat->process_queue.lock,
+					       flags);
+		}
 		RunSend(ttyif->mux);
 	} else {
 		amount_written = 0;
@@ -71,6 +71,12 @@
 
 #define TTY_DEFAULT_MODEM_FLAGS 0
 
+/*
+ * Smallest commbuff allocated for a write, so that the small writes
+ * typical of AT command traffic share a buffer while waiting to be sent
+ */
+#define TTY_WRITE_COALESCE_SIZE 256
+
 /*
  * Declares different states a tty channel can be placed in
  */
@@ -260,7 +260,6 @@ struct dlci_struct {
 
 struct chan_struct {
 	struct mutex	write_lock;
-	u8		*buf;
 };
 
 
@@ -4,6 +4,7 @@
 #include <linux/kernel.h>
 #include <linux/string.h>
 #include <linux/poll.h>
+#include <linux/uio.h>
 
 #include "ts27010_mux.h"
 #include "ts27010_ringbuf.h"
@@ -38,6 +39,40 @@ int ts27010_ldisc_send(struct tty_struct *tty, u8 *data, int len)
 	return len;
 }
 
+/*
+ * Send a frame described by nr_segs segments totalling len bytes.  The
+ * segments go to the driver back to back under send_lock, so frames from
+ * different channels never interleave and the payload is never copied
+ * into an intermediate frame buffer.
+ */
+int ts27010_ldisc_send_iov(struct tty_struct *tty, const struct kvec *iov,
+			   int nr_segs, int len)
+{
+	struct ts27010_ldisc_data *ts = tty->disc_data;
+	int sent = 0;
+	int res;
+	int i;
+
+	mutex_lock(&ts->send_lock);
+	if (tty->driver->ops->write_room(tty) < len)
+		pr_err("\n******** write overflow ********\n\n");
+	for (i = 0; i < nr_segs; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		res = tty->driver->ops->write(tty, iov[i].iov_base,
+					      iov[i].iov_len);
+		if (res < 0) {
+			sent = res;
+			break;
+		}
+		sent += res;
+		if (res != iov[i].iov_len)
+			break;
+	}
+	mutex_unlock(&ts->send_lock);
+	return sent;
+}
+
 /*
  * Called when a tty is put into tx27010mux line discipline. Called in process
  * context.
@@ -66,6 +66,7 @@
 #include <linux/init.h>
 #include <linux/uaccess.h>
 #include <linux/bitops.h>
+#include <linux/uio.h>
 
 #include <asm/system.h>
 
@@ -86,9 +87,6 @@
 #define TS0710MUX_IO_FC_ON 0x54F4
 #define TS0710MUX_IO_FC_OFF 0x54F5
 
-
-#define TS0710MUX_SEND_BUF_SIZE (TS0710_FRAME_SIZE(DEF_TS0710_MTU))
-
 #define TS0710MUX_SERIAL_BUF_SIZE 2048
 
 #define CMDTAG 0x55
@@ -124,16 +122,6 @@ static const struct dlci_tty dlci2tty[] = {
 	{15, 15},			/* DLCI 16 */
 };
 
-enum recv_state {
-	RECV_STATE_IDLE,
-	RECV_STATE_ADDR,
-	RECV_STATE_CONTROL,
-	RECV_STATE_LEN,
-	RECV_STATE_LEN2,
-	RECV_STATE_DATA,
-	RECV_STATE_END,
-};
-
 /* Bit number in flags of mux_send_struct */
 struct tty_struct *ts27010mux_tty;
 
@@ -394,6 +382,63 @@ static int ts0710_pkt_send(struct ts0710_con *ts0710, u8 *data)
 
 }
 
+/*
+ * Send a UIH frame straight from the caller's buffer: the header, tag and
+ * trailer are built on the stack and handed to the line discipline along
+ * with the payload as an iovec.  The UIH FCS only covers the header, so
+ * the payload is never touched.
+ */
+static int ts0710_pkt_send_uih(struct ts0710_con *ts0710, u8 dlci, u8 tag,
+			       const u8 *data, int len)
+{
+	u8 head[1 + sizeof(struct long_frame) + 1];
+	u8 tail[FCS_SIZE + 1];
+	struct kvec iov[3];
+	int header_len;
+	int frame_len;
+	int res;
+
+	ts0710_pkt_set_header(head, len + 1, 1, MCC_CMD, dlci, CLR_PF(UIH));
+	if (len + 1 > SHORT_PAYLOAD_SIZE)
+		header_len = sizeof(struct long_frame);
+	else
+		header_len = sizeof(struct short_frame);
+
+	head[0] = TS0710_BASIC_FLAG;
+	head[1 + header_len] = tag;
+	tail[0] = ts0710_crc_data(head + 1, header_len);
+	tail[1] = TS0710_BASIC_FLAG;
+
+	iov[0].iov_base = head;
+	iov[0].iov_len = 1 + header_len + 1;
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = len;
+	iov[2].iov_base = tail;
+	iov[2].iov_len = sizeof(tail);
+	frame_len = TS0710_FRAME_SIZE(len + 1);
+
+	ts27010_debughex(DBG_VERBOSE, "ts27010: > ", head, iov[0].iov_len);
+
+	if (!ts27010mux_tty) {
+		pr_warning("ts27010: ldisc closed.  discarding %d bytes\n",
+			   frame_len);
+		return frame_len;
+	}
+
+	res = ts27010_ldisc_send_iov(ts27010mux_tty, iov, ARRAY_SIZE(iov),
+				     frame_len);
+
+	if (res < 0) {
+		pr_err("ts27010: pkt write error %d\n", res);
+		return res;
+	} else if (res != frame_len) {
+		pr_err("ts27010: short write %d < %d\n", res, frame_len);
+		return -EIO;
+	}
+
+	return res;
+}
+
 /* TODO: look at this */
 static void ts0710_reset_dlci(u8 j)
 {
@@ -471,15 +516,12 @@ static int ts27010_send_disc(struct ts0710_con *ts0710, u8 dlci)
 }
 
 static int ts27010_send_uih(struct ts0710_con *ts0710, u8 dlci,
-			    u8 *frame, u8 tag, const u8 *data, int len)
+			    u8 tag, const u8 *data, int len)
 {
 	ts_debug(DBG_CMD,
 		 "ts27010: sending %d length UIH packet to DLCI %d\n",
 		 len, dlci);
-	ts0710_pkt_set_header(frame, len+1, 1, MCC_CMD, dlci, CLR_PF(UIH));
-	*(u8 *)ts0710_pkt_data(frame) = tag;
-	memcpy(ts0710_pkt_data(frame)+1, data, len);
-	return ts0710_pkt_send(ts0710, frame);
+	return ts0710_pkt_send_uih(ts0710, dlci, tag, data, len);
 }
 
 static void ts27010_mcc_set_header(u8 *frame, int len, int cr, int cmd)
@@ -633,15 +675,13 @@ static void ts27010_handle_pn(struct ts0710_con *ts0710, u8 type,
 	u8 dlci;
 	u16 frame_size;
 	struct pn_msg_data pn;
-	int i;
 
 	if (len != 8) {
 		pr_err("ts27010: reveived pn on length:%d != 8\n", len);
 		return;
 	}
 
-	for (i = 0; i < 8; i++)
-		((u8 *)&pn)[i] = ts27010_ringbuf_peek(rbuf, data_idx + i);
+	ts27010_ringbuf_read(rbuf, data_idx, (u8 *)&pn, sizeof(pn));
 
 	dlci = pn.dlci;
 	frame_size = pn.frame_sizel | (pn.frame_sizeh << 8);
@@ -1278,8 +1318,7 @@ int ts27010_mux_line_write(int line, const unsigned char *buf, int count)
 			tag = DATATAG;
 		}
 
-		ts27010_send_uih(ts0710, dlci, ts0710->chan[line].buf,
-				 tag, buf, c);
+		ts27010_send_uih(ts0710, dlci, tag, buf, c);
 
 		mutex_unlock(&ts0710->chan[line].write_lock);
 
@@ -1321,100 +1360,93 @@ int ts27010_mux_line_write_room(int line)
 }
 
 
+/*
+ * Parse as many complete basic mode frames as the ring buffer holds.
+ *
+ * Rather than running every byte through a state machine, the parser
+ * looks for the opening flag with memchr() over contiguous runs of the
+ * ring, reads the 3 or 4 byte header in one go and then jumps straight
+ * to the FCS and closing flag.  Payload bytes are only touched again when
+ * they are delivered, in bulk, to the tty.  A frame that is not complete
+ * yet is left in the buffer for the next call.
+ */
 void ts27010_mux_recv(struct ts27010_ringbuf *rbuf)
 {
 	int count;
 	int i;
-	u8 c;
-	int state = RECV_STATE_IDLE;
-	int consume_idx = -1;
-	int data_idx = 0;
-	u8 addr = 0;
-	u8 control = 0;
-	int len = 0;
-	u8 fcs = 0;
+	int n;
+	u8 hdr[5];
+	int hdr_len;
+	int data_idx;
+	int len;
+	u8 fcs;
 
 	count = ts27010_ringbuf_level(rbuf);
-
-	for (i = 0; i < count; i++) {
-		c = ts27010_ringbuf_peek(rbuf, i);
-
-		switch (state) {
-		case RECV_STATE_IDLE:
-			if (c == TS0710_BASIC_FLAG) {
-				fcs = ts0710_crc_start();
-				state = RECV_STATE_ADDR;
-			} else {
-				consume_idx = i;
-			}
-			break;
-
-		case RECV_STATE_ADDR:
-			if (c != TS0710_BASIC_FLAG) {
-				fcs = ts0710_crc_calc(fcs, c);
-				addr = c;
-				state = RECV_STATE_CONTROL;
-			} else {
-				pr_warning(
-					"ts27010: RX wrong data. Drop msg.\n");
-				consume_idx = i;
-			}
+	/* pairs with the write barrier in ts27010_ringbuf_write() */
+	smp_rmb();
+
+	i = 0;
+	while (i < count) {
+		n = ts27010_ringbuf_find(rbuf, i, count - i, TS0710_BASIC_FLAG);
+		if (n < 0) {
+			i = count;
 			break;
+		}
+		i = n;
 
-		case RECV_STATE_CONTROL:
-			fcs = ts0710_crc_calc(fcs, c);
-			control = c;
-			state = RECV_STATE_LEN;
+		/* flag, address, control and at least one length byte */
+		if (count - i < 4)
 			break;
+		ts27010_ringbuf_read(rbuf, i, hdr, 4);
 
-		case RECV_STATE_LEN:
-			fcs = ts0710_crc_calc(fcs, c);
-			len = c>>1;
-			if (c & 0x1) {
-				data_idx = i+1;
-				state = RECV_STATE_DATA;
-			} else {
-				state = RECV_STATE_LEN2;
-			}
-			break;
+		if (hdr[1] == TS0710_BASIC_FLAG) {
+			/* back to back flags: this one only closed a frame */
+			i++;
+			continue;
+		}
 
-		case RECV_STATE_LEN2:
-			fcs = ts0710_crc_calc(fcs, c);
-			len |= c<<7;
-			data_idx = i+1;
-			if (len + data_idx >= LDISC_BUFFER_SIZE) {
-				pr_warning(
-					"ts27010: wrong length, Drop msg.\n");
-				state = RECV_STATE_IDLE;
-				consume_idx = i;
+		len = hdr[3] >> 1;
+		if (hdr[3] & 0x1) {
+			hdr_len = 3;
+		} else {
+			if (count - i < 5)
 				break;
-			}
-			state = RECV_STATE_DATA;
-			break;
+			hdr[4] = ts27010_ringbuf_peek(rbuf, i + 4);
+			len |= hdr[4] << 7;
+			hdr_len = 4;
+		}
+		data_idx = i + 1 + hdr_len;
 
-		case RECV_STATE_DATA:
-			if (i == data_idx+len) {
-				/* FCS byte */
-				fcs = ts0710_crc_calc(fcs, c);
-				state = RECV_STATE_END;
-			}
-			break;
+		/* flag, header, payload, FCS and flag must fit in the
+		 * buffer once what is before them has been consumed
+		 */
+		if (len + hdr_len + 3 > LDISC_BUFFER_SIZE) {
+			pr_warning("ts27010: wrong length, Drop msg.\n");
+			i = data_idx;
+			continue;
+		}
 
-		case RECV_STATE_END:
-			if (c == TS0710_BASIC_FLAG && ts0710_crc_check(fcs)) {
-				ts27010_handle_frame(rbuf, addr, control,
-						      data_idx, len);
-			} else {
-				pr_warning("ts27010: lost synchronization\n");
-			}
-			consume_idx = i;
-			state = RECV_STATE_IDLE;
+		/* payload, FCS and closing flag */
+		if (count - data_idx < len + 2)
 			break;
+
+		fcs = ts0710_crc_start();
+		for (n = 1; n <= hdr_len; n++)
+			fcs = ts0710_crc_calc(fcs, hdr[n]);
+		fcs = ts0710_crc_calc(fcs,
+				      ts27010_ringbuf_peek(rbuf, data_idx + len));
+
+		if (ts27010_ringbuf_peek(rbuf, data_idx + len + 1) ==
+		    TS0710_BASIC_FLAG && ts0710_crc_check(fcs)) {
+			ts27010_handle_frame(rbuf, hdr[1], hdr[2],
+					     data_idx, len);
+		} else {
+			pr_warning("ts27010: lost synchronization\n");
 		}
+		i = data_idx + len + 2;
 	}
 
-	ts27010_ringbuf_consume(rbuf, consume_idx+1);
-
+	ts27010_ringbuf_consume(rbuf, i);
 }
 
 static int __init mux_init(void)
@@ -1427,18 +1459,9 @@ static int __init mux_init(void)
 	for (j = 0; j < TS0710_MAX_CHN; j++)
 		mutex_init(&ts0710_connection.dlci[j].lock);
 
-	for (j = 0; j < NR_MUXS; j++) {
-		ts0710_connection.chan[j].buf =
-			kmalloc(TS0710MUX_SEND_BUF_SIZE, GFP_KERNEL);
-		if (ts0710_connection.chan[j].buf == NULL) {
-			err = -ENOMEM;
-			goto err0;
-		}
-
+	for (j = 0; j < NR_MUXS; j++)
 		mutex_init(&ts0710_connection.chan[j].write_lock);
 
-	}
-
 	err = ts27010_ldisc_init();
 	if (err != 0) {
 		pr_err("ts27010mux: error %d registering line disc.\n", err);
@@ -1459,19 +1482,11 @@ err1:
 	ts27010_ldisc_remove();
 
 err0:
-	for (j = 0; j < NR_MUXS; j++)
-		kfree(ts0710_connection.chan[j].buf);
-
 	return err;
 }
 
 static void __exit mux_exit(void)
 {
-	int j;
-
-	for (j = 0; j < NR_MUXS; j++)
-		kfree(&ts0710_connection.chan[j].buf);
-
 	ts27010_tty_remove();
 	ts27010_ldisc_remove();
 }
@@ -31,7 +31,8 @@
 #define NUM_MUX_DATA_FILES 0
 #define NUM_MUX_FILES (NUM_MUX_CMD_FILES  +  NUM_MUX_DATA_FILES)
 
-#define LDISC_BUFFER_SIZE (4096 - sizeof(struct ts27010_ringbuf))
+/* must be a power of two */
+#define LDISC_BUFFER_SIZE 4096
 
 /* TODO: should use the IOCTLNUM macros */
 /* Special ioctl() upon a MUX device file for hanging up a call */
@@ -51,6 +52,7 @@
 extern struct tty_struct *ts27010mux_tty;
 
 struct ts27010_ringbuf;
+struct kvec;
 
 int ts27010_mux_active(void);
 int ts27010_mux_line_open(int line);
@@ -63,6 +65,8 @@ void ts27010_mux_recv(struct ts27010_ringbuf *rbuf);
 int ts27010_ldisc_init(void);
 void ts27010_ldisc_remove(void);
 int ts27010_ldisc_send(struct tty_struct *tty, u8 *data, int len);
+int ts27010_ldisc_send_iov(struct tty_struct *tty, const struct kvec *iov,
+			   int nr_segs, int len);
 
 
 int ts27010_tty_init(void);
@@ -2,14 +2,18 @@
  * simple ring buffer
  *
  * supports a concurrent reader and writer without locking
+ *
+ * len must be a power of two.  head and tail run freely and are masked
+ * on access, so the whole buffer can be used and level is head - tail.
  */
 
 
 struct ts27010_ringbuf {
-	int len;
-	int head;
-	int tail;
-	u8 buf[];
+	unsigned int len;
+	unsigned int mask;
+	unsigned int head;
+	unsigned int tail;
+	u8 *buf;
 };
 
 
@@ -17,11 +21,20 @@ static inline struct ts27010_ringbuf *ts27010_ringbuf_alloc(int len)
 {
 	struct ts27010_ringbuf *rbuf;
 
-	rbuf = kzalloc(sizeof(*rbuf) + len, GFP_KERNEL);
+	BUG_ON(!is_power_of_2(len));
+
+	rbuf = kzalloc(sizeof(*rbuf), GFP_KERNEL);
 	if (rbuf == NULL)
 		return NULL;
 
+	rbuf->buf = kmalloc(len, GFP_KERNEL);
+	if (rbuf->buf == NULL) {
+		kfree(rbuf);
+		return NULL;
+	}
+
 	rbuf->len = len;
+	rbuf->mask = len - 1;
 	rbuf->head = 0;
 	rbuf->tail = 0;
 
@@ -30,27 +43,74 @@ static inline struct ts27010_ringbuf *ts27010_ringbuf_alloc(int len)
 
 static inline void ts27010_ringbuf_free(struct ts27010_ringbuf *rbuf)
 {
+	kfree(rbuf->buf);
 	kfree(rbuf);
 }
 
 static inline int ts27010_ringbuf_level(struct ts27010_ringbuf *rbuf)
 {
-	int level = rbuf->head - rbuf->tail;
-
-	if (level < 0)
-		level = rbuf->len + level;
-
-	return level;
+	return rbuf->head - rbuf->tail;
 }
 
 static inline int ts27010_ringbuf_room(struct ts27010_ringbuf *rbuf)
 {
-	return rbuf->len - ts27010_ringbuf_level(rbuf) - 1;
+	return rbuf->len - ts27010_ringbuf_level(rbuf);
 }
 
 static inline u8 ts27010_ringbuf_peek(struct ts27010_ringbuf *rbuf, int i)
 {
-	return rbuf->buf[(rbuf->tail + i) % rbuf->len];
+	return rbuf->buf[(rbuf->tail + i) & rbuf->mask];
+}
+
+/*
+ * Copy len bytes starting i bytes past the tail into data, without
+ * consuming them.  The caller must know that they are in the buffer.
+ */
+static inline void ts27010_ringbuf_read(struct ts27010_ringbuf *rbuf, int i,
+					u8 *data, int len)
+{
+	unsigned int off = (rbuf->tail + i) & rbuf->mask;
+	unsigned int l = min_t(unsigned int, len, rbuf->len - off);
+
+	memcpy(data, rbuf->buf + off, l);
+	memcpy(data + l, rbuf->buf, len - l);
+}
+
+/*
+ * Point data at the contiguous run of at most len bytes that starts i
+ * bytes past the tail, and return its length.  A range that wraps takes
+ * two calls.
+ */
+static inline int ts27010_ringbuf_run(struct ts27010_ringbuf *rbuf, int i,
+				      int len, u8 **data)
+{
+	unsigned int off = (rbuf->tail + i) & rbuf->mask;
+
+	*data = rbuf->buf + off;
+	return min_t(unsigned int, len, rbuf->len - off);
+}
+
+/*
+ * Return the offset from the tail of the first c in the len bytes that
+ * start i bytes past the tail, or -1 if there is none.
+ */
+static inline int ts27010_ringbuf_find(struct ts27010_ringbuf *rbuf, int i,
+				       int len, u8 c)
+{
+	u8 *data;
+	u8 *p;
+	int n;
+
+	while (len > 0) {
+		n = ts27010_ringbuf_run(rbuf, i, len, &data);
+		p = memchr(data, c, n);
+		if (p)
+			return i + (p - data);
+		i += n;
+		len -= n;
+	}
+
+	return -1;
 }
 
 static inline int ts27010_ringbuf_consume(struct ts27010_ringbuf *rbuf,
@@ -58,7 +118,9 @@ static inline int ts27010_ringbuf_consume(struct ts27010_ringbuf *rbuf,
 {
 	count = min(count, ts27010_ringbuf_level(rbuf));
 
-	rbuf->tail = (rbuf->tail + count) % rbuf->len;
+	/* finish reading before handing the space back to the writer */
+	smp_mb();
+	rbuf->tail += count;
 
 	return count;
 }
@@ -68,8 +130,9 @@ static inline int ts27010_ringbuf_push(struct ts27010_ringbuf *rbuf, u8 datum)
 	if (ts27010_ringbuf_room(rbuf) == 0)
 		return 0;
 
-	rbuf->buf[rbuf->head] = datum;
-	rbuf->head = (rbuf->head + 1) % rbuf->len;
+	rbuf->buf[rbuf->head & rbuf->mask] = datum;
+	smp_wmb();
+	rbuf->head++;
 
 	return 1;
 }
@@ -77,13 +140,24 @@ static inline int ts27010_ringbuf_push(struct ts27010_ringbuf *rbuf, u8 datum)
 static inline int ts27010_ringbuf_write(struct ts27010_ringbuf *rbuf,
 					const u8 *data, int len)
 {
-	int count = 0;
-	int i;
+	unsigned int off;
+	unsigned int l;
 
-	for (i = 0; i < len; i++)
-		count += ts27010_ringbuf_push(rbuf, data[i]);
+	len = min(len, ts27010_ringbuf_room(rbuf));
 
-	return count;
+	/* sample tail before overwriting the space it frees */
+	smp_mb();
+
+	off = rbuf->head & rbuf->mask;
+	l = min_t(unsigned int, len, rbuf->len - off);
+	memcpy(rbuf->buf + off, data, l);
+	memcpy(rbuf->buf, data + l, len - l);
+
+	/* make the data visible before the reader sees the new head */
+	smp_wmb();
+	rbuf->head += len;
+
+	return len;
 }
 
 
@@ -45,6 +45,9 @@ int ts27010_tty_send_rbuf(int line, struct ts27010_ringbuf *rbuf,
 {
 	struct ts27010_tty_data *td = driver->driver_state;
 	struct tty_struct *tty = td->chan[line].tty;
+	u8 *data;
+	int sent = 0;
+	int n;
 
 	if (!tty) {
 		pr_info("ts27010: mux%d no open.  discarding %d bytes\n",
@@ -52,12 +55,18 @@ int ts27010_tty_send_rbuf(int line, struct ts27010_ringbuf *rbuf,
 		return 0;
 	}
 
-	while (len--) {
-		char c = ts27010_ringbuf_peek(rbuf, data_idx++);
-		tty_insert_flip_char(tty, c, TTY_NORMAL);
+	/* at most two contiguous runs of the ring */
+	while (len > 0) {
+		n = ts27010_ringbuf_run(rbuf, data_idx, len, &data);
+		n = tty_insert_flip_string(tty, data, n);
+		if (n == 0)
+			break;
+		data_idx += n;
+		len -= n;
+		sent += n;
 	}
 	tty_flip_buffer_push(tty);
-	return len;
+	return sent;
 }
 
 static int ts27010_tty_open(struct tty_struct *tty, struct file *filp)
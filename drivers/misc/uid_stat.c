@@ -124,7 +124,7 @@ static struct uid_stat *create_stat(uid_t uid) {
 int update_tcp_snd(uid_t uid, int size)
 {
 	struct uid_stat *entry;
-	activity_stats_update();
+	activity_stats_update(uid);
 	if ((entry = find_uid_stat(uid)) == NULL &&
 		((entry = create_stat(uid)) == NULL)) {
 			return -1;
@@ -136,7 +136,7 @@ int update_tcp_snd(uid_t uid, int size)
 int update_tcp_rcv(uid_t uid, int size)
 {
 	struct uid_stat *entry;
-	activity_stats_update();
+	activity_stats_update(uid);
 	if ((entry = find_uid_stat(uid)) == NULL &&
 		((entry = create_stat(uid)) == NULL)) {
 			return -1;
@@ -338,13 +338,6 @@ static const struct block_device_operations mmc_bdops = {
 	.owner			= THIS_MODULE,
 };
 
-struct mmc_blk_request {
-	struct mmc_request	mrq;
-	struct mmc_command	cmd;
-	struct mmc_command	stop;
-	struct mmc_data		data;
-};
-
 static u32 mmc_sd_num_wr_blocks(struct mmc_card *card)
 {
 	int err;
@@ -612,145 +605,342 @@ static bool mmc_handle_toshiba_write(struct mmc_queue *mq,
 
 	return true;
 }
-#define BUSY_TIMEOUT_MS (8 * 1024)
-static int mmc_blk_xfer_rq(struct mmc_blk_data *md,
-	struct request *req, unsigned int *bytes_xfered)
+/*
+ * Toshiba eMMC writes go through the workarounds above, which build their
+ * own commands.
+ */
+static bool mmc_blk_toshiba_write(struct mmc_card *card, struct request *req)
 {
-	struct mmc_card *card = md->queue.card;
-	struct mmc_blk_request brq;
-	int ret = 1;
-	int disable_multi = 0;
-	int retry = 0;
-	unsigned long timeout = 0;
+	return rq_data_dir(req) == WRITE && mmc_card_mmc(card) &&
+		card->cid.manfid == TOSHIBA_MANFID;
+}
 
-#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
-	if (mmc_bus_needs_resume(card->host)) {
-		mmc_resume_bus(card->host);
-		mmc_blk_set_blksize(md, card);
+/*
+ * Send the CMD23 set up for brq, if any.  Its failure is reported as a
+ * failure of the read or write command.
+ */
+static int mmc_blk_send_sbc(struct mmc_card *card,
+			    struct mmc_blk_request *brq)
+{
+	int err;
+
+	if (!brq->sbc.opcode)
+		return 0;
+
+	err = mmc_wait_for_cmd(card->host, &brq->sbc, 0);
+	if (err) {
+		brq->cmd.error = err;
+		brq->cmd.resp[0] = brq->sbc.resp[0];
 	}
-#endif
+	return err;
+}
 
-	BUG_ON(!bytes_xfered);
+static void mmc_blk_count(struct mmc_card *card, struct mmc_blk_request *brq)
+{
+	struct mmc_blk_stats *stats = &card->blk_stats;
 
-	do {
-		struct mmc_command cmd;
-		u32 readcmd, writecmd, status = 0;
+	if (brq->data.flags & MMC_DATA_READ) {
+		stats->reads++;
+		stats->read_blocks += brq->data.blocks;
+	} else {
+		stats->writes++;
+		stats->write_blocks += brq->data.blocks;
+	}
+	if (brq->sbc.opcode)
+		stats->sbc++;
+	if (brq->sbc.arg & MMC_CMD23_ARG_REL_WR)
+		stats->rel_writes++;
+	if (brq->mrq.stop)
+		stats->stops++;
+}
 
-		memset(&brq, 0, sizeof(struct mmc_blk_request));
-		brq.mrq.cmd = &brq.cmd;
-		brq.mrq.data = &brq.data;
+/*
+ * Fill in the read or write command for req, or for as much of it as can
+ * be sent at once, and map its data.
+ */
+static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
+			       struct mmc_card *card, int disable_multi,
+			       struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	u32 readcmd, writecmd;
+	int do_rel_wr;
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+	brq->data.blocks = blk_rq_sectors(req);
 
-		brq.cmd.arg = blk_rq_pos(req);
-		if (!mmc_card_blockaddr(card))
-			brq.cmd.arg <<= 9;
-		brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
-		brq.data.blksz = 512;
-		brq.stop.opcode = MMC_STOP_TRANSMISSION;
-		brq.stop.arg = 0;
-		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = blk_rq_sectors(req);
+	/*
+	 * In order to improve performance on Toshiba eMMC parts,
+	 * we are going to split any writes less than or equal to
+	 * 24 sectors that cross a page boundary into multiple
+	 * writes that each access a single 8kB page.  This loop
+	 * will perform multiple write commands until all the
+	 * data has been written.
+	 */
+	if (mmc_card_mmc(card) && card->cid.manfid == 0x11
+		&& rq_data_dir(req) == WRITE
+		&& blk_rq_sectors(req) <= 24) {
+		int sectors_left_in_page = 16 - blk_rq_pos(req) % 16;
+		if (blk_rq_sectors(req) > sectors_left_in_page)
+			brq->data.blocks = sectors_left_in_page;
+	}
 
-		/*
-		 * In order to improve performance on Toshiba eMMC parts,
-		 * we are going to split any writes less than or equal to
-		 * 24 sectors that cross a page boundary into multiple
-		 * writes that each access a single 8kB page.  This loop
-		 * will perform multiple write commands until all the
-		 * data has been written.
-		 */
-		if (mmc_card_mmc(card) && card->cid.manfid == 0x11
-			&& rq_data_dir(req) == WRITE
-			&& blk_rq_sectors(req) <= 24) {
-			int sectors_left_in_page = 16 - blk_rq_pos(req) % 16;
-			if (blk_rq_sectors(req) > sectors_left_in_page)
-				brq.data.blocks = sectors_left_in_page;
-		}
+	/*
+	 * The block layer doesn't support all sector count
+	 * restrictions, so we need to be prepared for too big
+	 * requests.
+	 */
+	if (brq->data.blocks > card->host->max_blk_count)
+		brq->data.blocks = card->host->max_blk_count;
 
-		/*
-		 * The block layer doesn't support all sector count
-		 * restrictions, so we need to be prepared for too big
-		 * requests.
-		 */
-		if (brq.data.blocks > card->host->max_blk_count)
-			brq.data.blocks = card->host->max_blk_count;
+	/*
+	 * After a read error, we redo the request one sector at a time
+	 * in order to accurately determine which sectors can be read
+	 * successfully.
+	 */
+	if (disable_multi && brq->data.blocks > 1)
+		brq->data.blocks = 1;
 
-		/*
-		 * After a read error, we redo the request one sector at a time
-		 * in order to accurately determine which sectors can be read
-		 * successfully.
+	if (brq->data.blocks > 1) {
+		/* SPI multiblock writes terminate using a special
+		 * token, not a STOP_TRANSMISSION request.
 		 */
-		if (disable_multi && brq.data.blocks > 1)
-			brq.data.blocks = 1;
+		if (!mmc_host_is_spi(card->host)
+				|| rq_data_dir(req) == READ)
+			brq->mrq.stop = &brq->stop;
+		readcmd = MMC_READ_MULTIPLE_BLOCK;
+		writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+	} else {
+		brq->mrq.stop = NULL;
+		readcmd = MMC_READ_SINGLE_BLOCK;
+		writecmd = MMC_WRITE_BLOCK;
+	}
 
-		if (brq.data.blocks > 1) {
-			/* SPI multiblock writes terminate using a special
-			 * token, not a STOP_TRANSMISSION request.
-			 */
-			if (!mmc_host_is_spi(card->host)
-					|| rq_data_dir(req) == READ)
-				brq.mrq.stop = &brq.stop;
-			readcmd = MMC_READ_MULTIPLE_BLOCK;
-			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
-		} else {
-			brq.mrq.stop = NULL;
-			readcmd = MMC_READ_SINGLE_BLOCK;
-			writecmd = MMC_WRITE_BLOCK;
-		}
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = readcmd;
+		brq->data.flags |= MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = writecmd;
+		brq->data.flags |= MMC_DATA_WRITE;
+	}
 
-		if (rq_data_dir(req) == READ) {
-			brq.cmd.opcode = readcmd;
-			brq.data.flags |= MMC_DATA_READ;
-		} else {
-			brq.cmd.opcode = writecmd;
-			brq.data.flags |= MMC_DATA_WRITE;
+	if (rq_data_dir(req) == WRITE)
+		mmc_adjust_toshiba_write(card, &brq->mrq);
+
+	do_rel_wr = rq_data_dir(req) == WRITE && mmc_blk_use_rel_wr(card) &&
+		(blk_barrier_rq(req) || blk_fua_rq(req)) &&
+		!mmc_blk_toshiba_write(card, req);
+	if (do_rel_wr && !(card->ext_csd.rel_param & EXT_CSD_WR_REL_PARAM_EN)) {
+		/* Legacy reliable writes are of one block or one unit */
+		if (blk_rq_pos(req) % card->ext_csd.rel_wr_sec_c)
+			brq->data.blocks = 1;
+		if (brq->data.blocks > card->ext_csd.rel_wr_sec_c)
+			brq->data.blocks = card->ext_csd.rel_wr_sec_c;
+		else if (brq->data.blocks < card->ext_csd.rel_wr_sec_c)
+			brq->data.blocks = 1;
+	}
+
+	/*
+	 * Tell the card how many blocks are coming instead of stopping it
+	 * afterwards.  The Toshiba write workaround below sends its own.
+	 */
+	if ((brq->data.blocks > 1 || do_rel_wr) && mmc_blk_use_cmd23(card) &&
+	    !mmc_blk_toshiba_write(card, req)) {
+		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+		brq->sbc.arg = brq->data.blocks;
+		if (do_rel_wr)
+			brq->sbc.arg |= MMC_CMD23_ARG_REL_WR;
+		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		brq->cmd.opcode = rq_data_dir(req) == READ ?
+			MMC_READ_MULTIPLE_BLOCK : MMC_WRITE_MULTIPLE_BLOCK;
+		brq->mrq.stop = NULL;
+	}
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	/*
+	 * Adjust the sg list so it is the same size as the
+	 * request.
+	 */
+	if (brq->data.blocks != blk_rq_sectors(req)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
+			}
 		}
+		brq->data.sg_len = i;
+	}
+}
 
-		if (rq_data_dir(req) == WRITE)
-			mmc_adjust_toshiba_write(card, &brq.mrq);
+/*
+ * Called while a request is on the bus: fetch the next one and, if it
+ * can go out as a single mmc request, set it up, fill its bounce buffer
+ * and have the host map it, so that it is ready to start as soon as the
+ * bus is free.  Writes that the Toshiba workarounds rework or that may
+ * be packed at issue time are only fetched.
+ */
+static void mmc_blk_prep_next(struct mmc_queue *mq)
+{
+	struct mmc_queue_req *mqrq = mq->mqrq_next;
+	struct mmc_card *card = mq->card;
+	struct request *req;
 
-		mmc_set_data_timeout(&brq.data, card);
+	req = mmc_queue_fetch_next(mq);
+	if (!req || blk_discard_rq(req))
+		return;
+
+	if (mmc_blk_toshiba_write(card, req))
+		return;
+
+	/* may be packed with the writes behind it when issued */
+	if (rq_data_dir(req) == WRITE && mmc_blk_use_packed(card))
+		return;
+
+	mmc_blk_rw_rq_prep(mqrq, card, 0, mq);
+	if (mqrq->brq.data.blocks != blk_rq_sectors(req))
+		return;
+
+	mmc_queue_bounce_pre(mqrq);
+	mmc_pre_req(card->host, &mqrq->brq.mrq, false);
+	mqrq->prepared = 1;
+}
 
-		brq.data.sg = md->queue.sg;
-		brq.data.sg_len = mmc_queue_map_sg(&md->queue);
+#define BUSY_TIMEOUT_MS (8 * 1024)
+/*
+ * Wait for the card to leave the programming state after a write.
+ */
+static int mmc_blk_wait_for_prg(struct mmc_blk_data *md, struct request *req)
+{
+	struct mmc_card *card = md->queue.card;
+	struct mmc_command cmd;
+	unsigned long timeout;
+	int ret = 0;
 
+	timeout = jiffies + msecs_to_jiffies(BUSY_TIMEOUT_MS);
+	do {
+		int err;
+		cmd.opcode = MMC_SEND_STATUS;
+		cmd.arg = card->rca << 16;
+		cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		err = mmc_wait_for_cmd(card->host, &cmd, 5);
+		if (err) {
+			printk(KERN_ERR "%s: error %d requesting status\n",
+			       req->rq_disk->disk_name, err);
+			ret = err;
+			break;
+		}
+		if (cmd.resp[0] & R1_ERROR_MASK) {
+			printk(KERN_ERR "%s: card err %#x\n",
+				req->rq_disk->disk_name,
+				cmd.resp[0]);
+			/* ignored, as transfer is done */
+			break;
+		}
 		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
+		 * Some cards mishandle the status bits,
+		 * so make sure to check both the busy
+		 * indication and the card state.
 		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
-			}
-			brq.data.sg_len = i;
-		}
+		if ((cmd.resp[0] & R1_READY_FOR_DATA) &&
+		    (R1_CURRENT_STATE(cmd.resp[0]) != 7))
+			break;
+	} while (time_before(jiffies, timeout));
+	if (R1_CURRENT_STATE(cmd.resp[0]) == 7) {
+		printk(KERN_WARNING "%s: card stay in prg "
+			"timeout, re-init the card\n",
+			md->disk->disk_name);
+		mmc_reinit_host(card->host);
+		ret = -ETIMEDOUT;
+	}
+
+	return ret;
+}
+
+static int mmc_blk_xfer_rq(struct mmc_blk_data *md,
+	struct mmc_queue_req *mqrq, unsigned int *bytes_xfered)
+{
+	struct mmc_card *card = md->queue.card;
+	struct request *req = mqrq->req;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct completion complete;
+	int ret = 1;
+	int disable_multi = 0;
+	int retry = 0;
+	int prepared;
+
+#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
+	if (mmc_bus_needs_resume(card->host)) {
+		mmc_resume_bus(card->host);
+		mmc_blk_set_blksize(md, card);
+	}
+#endif
 
-		mmc_queue_bounce_pre(&md->queue);
+	BUG_ON(!bytes_xfered);
+
+	do {
+		u32 status = 0;
+
+		/* set up by mmc_blk_prep_next() during the last request */
+		prepared = mqrq->prepared;
+		mqrq->prepared = 0;
+		if (!prepared) {
+			mmc_blk_rw_rq_prep(mqrq, card, disable_multi,
+					   &md->queue);
+			mmc_queue_bounce_pre(mqrq);
+		}
 
 		/*
 		 * Try the workaround first for writes, then fall back.
 		 */
 		if (rq_data_dir(req) != WRITE || disable_multi ||
-		    !mmc_handle_toshiba_write(&md->queue, card, &brq.mrq))
-			mmc_wait_for_req(card->host, &brq.mrq);
+		    !mmc_handle_toshiba_write(&md->queue, card, &brq->mrq)) {
+			if (!mmc_blk_send_sbc(card, brq)) {
+				mmc_start_req(card->host, &brq->mrq, &complete);
+				mmc_blk_prep_next(&md->queue);
+				mmc_wait_for_req_done(&brq->mrq);
+
+				/* no CMD12 to end the transfer on errors */
+				if (brq->sbc.opcode &&
+				    (brq->cmd.error || brq->data.error))
+					mmc_wait_for_cmd(card->host,
+							 &brq->stop, 0);
+			}
+		}
+		mmc_blk_count(card, brq);
 
-		mmc_queue_bounce_post(&md->queue);
+		if (prepared)
+			mmc_post_req(card->host, &brq->mrq, brq->data.error);
+		mmc_queue_bounce_post(mqrq);
 
 		ret = 0;
-		*bytes_xfered = brq.data.bytes_xfered;
+		*bytes_xfered = brq->data.bytes_xfered;
 		/*
 		 * Check for errors here, but don't jump to cmd_err
 		 * until later as we need to wait for the card to leave
 		 * programming mode even when things go wrong.
 		 */
-		if (brq.cmd.error || brq.data.error || brq.stop.error) {
-			if (brq.data.blocks > 1 && rq_data_dir(req) == READ) {
+		if (brq->cmd.error || brq->data.error || brq->stop.error) {
+			if (brq->data.blocks > 1 && rq_data_dir(req) == READ) {
 				/* Redo read one sector at a time */
 				printk(KERN_WARNING "%s: retrying using single "
 				       "block read\n", req->rq_disk->disk_name);
@@ -766,32 +956,32 @@ static int mmc_blk_xfer_rq(struct mmc_blk_data *md,
 		}
 		retry = 0;
 
-		if (brq.cmd.error) {
-			ret = brq.cmd.error;
+		if (brq->cmd.error) {
+			ret = brq->cmd.error;
 			printk(KERN_ERR "%s: error %d sending read/write "
 			       "command, response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.cmd.error,
-			       brq.cmd.resp[0], status);
+			       req->rq_disk->disk_name, brq->cmd.error,
+			       brq->cmd.resp[0], status);
 		}
 
-		if (brq.data.error) {
-			ret = brq.data.error;
-			if (brq.data.error == -ETIMEDOUT && brq.mrq.stop)
+		if (brq->data.error) {
+			ret = brq->data.error;
+			if (brq->data.error == -ETIMEDOUT && brq->mrq.stop)
 				/* 'Stop' response contains card status */
-				status = brq.mrq.stop->resp[0];
+				status = brq->mrq.stop->resp[0];
 			printk(KERN_ERR "%s: error %d transferring data,"
 			       " sector %u, nr %u, card status %#x\n",
-			       req->rq_disk->disk_name, brq.data.error,
+			       req->rq_disk->disk_name, brq->data.error,
 			       (unsigned)blk_rq_pos(req),
 			       (unsigned)blk_rq_sectors(req), status);
 		}
 
-		if (brq.stop.error) {
-			ret = brq.stop.error;
+		if (brq->stop.error) {
+			ret = brq->stop.error;
 			printk(KERN_ERR "%s: error %d sending stop command, "
 			       "response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.stop.error,
-			       brq.stop.resp[0], status);
+			       req->rq_disk->disk_name, brq->stop.error,
+			       brq->stop.resp[0], status);
 		}
 
 		/*
@@ -799,43 +989,10 @@ static int mmc_blk_xfer_rq(struct mmc_blk_data *md,
 		* even when things go wrong.
 		*/
 		if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ &&
-		    !brq.cmd.error && !brq.data.error && !brq.stop.error) {
-			timeout = jiffies + msecs_to_jiffies(BUSY_TIMEOUT_MS);
-			do {
-				int err;
-				cmd.opcode = MMC_SEND_STATUS;
-				cmd.arg = card->rca << 16;
-				cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
-				err = mmc_wait_for_cmd(card->host, &cmd, 5);
-				if (err) {
-					printk(KERN_ERR "%s: error %d requesting status\n",
-					       req->rq_disk->disk_name, err);
-					ret = err;
-					break;
-				}
-				if (cmd.resp[0] & R1_ERROR_MASK) {
-					printk(KERN_ERR "%s: card err %#x\n",
-						req->rq_disk->disk_name,
-						cmd.resp[0]);
-					/* ignored, as transfer is done */
-					break;
-				}
-				/*
-				 * Some cards mishandle the status bits,
-				 * so make sure to check both the busy
-				 * indication and the card state.
-				 */
-				if ((cmd.resp[0] & R1_READY_FOR_DATA) &&
-				    (R1_CURRENT_STATE(cmd.resp[0]) != 7))
-					break;
-			} while (time_before(jiffies, timeout));
-			if (R1_CURRENT_STATE(cmd.resp[0]) == 7) {
-				printk(KERN_WARNING "%s: card stay in prg "
-					"timeout, re-init the card\n",
-					md->disk->disk_name);
-				mmc_reinit_host(card->host);
-				ret = -ETIMEDOUT;
-			}
+		    !brq->cmd.error && !brq->data.error && !brq->stop.error) {
+			int err = mmc_blk_wait_for_prg(md, req);
+			if (err)
+				ret = err;
 		}
 
 		/*
@@ -987,9 +1144,10 @@ out:
 	return 0;
 }
 
-static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
+static int mmc_blk_issue_one(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
 {
 	struct mmc_blk_data *md = mq->data;
+	struct request *req = mqrq->req;
 	struct mmc_card *card = md->queue.card;
 	int ret, err, bytes_xfered;
 
@@ -999,7 +1157,7 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 		if (blk_discard_rq(req))
 			err = mmc_blk_erase_rq(md, req, &bytes_xfered);
 		else
-			err = mmc_blk_xfer_rq(md, req, &bytes_xfered);
+			err = mmc_blk_xfer_rq(md, mqrq, &bytes_xfered);
 
 		/*
 		 * First handle the sectors that got transferred
@@ -1033,6 +1191,211 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	return 1;
 }
 
+/*
+ * eMMC 4.5 packed writes: the writes queued behind a write go out in the
+ * same CMD23/CMD25 as it, each with its own address and length in a
+ * header block sent ahead of the data.
+ */
+static bool mmc_blk_can_pack(struct mmc_card *card, struct request *req)
+{
+	return blk_fs_request(req) && rq_data_dir(req) == WRITE &&
+		!blk_discard_rq(req) && !blk_barrier_rq(req) &&
+		!blk_fua_rq(req) && !mmc_blk_toshiba_write(card, req);
+}
+
+/*
+ * Take as many writes off the queue to pack with mqrq->req as the card
+ * and the host allow.  mqrq->packed_num is left at 0 if there are none.
+ */
+static void mmc_blk_pack(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
+{
+	struct mmc_card *card = mq->card;
+	struct mmc_host *host = card->host;
+	struct request_queue *q = mq->queue;
+	struct request *req = mqrq->req, *next;
+	unsigned int max_blocks, max_segs, blocks, segs, num = 1;
+
+	mqrq->packed_num = 0;
+	if (!mqrq->packed_hdr || !mmc_blk_can_pack(card, req))
+		return;
+
+	/* CMD23 has 16 bits of block count, one block is the header */
+	max_blocks = min(host->max_blk_count, host->max_req_size / 512);
+	max_blocks = min(max_blocks, 0xffffU);
+	max_segs = min(host->max_hw_segs, host->max_phys_segs);
+	blocks = 1 + blk_rq_sectors(req);
+	segs = 1 + req->nr_phys_segments;
+	if (blocks > max_blocks || segs > max_segs)
+		return;
+
+	INIT_LIST_HEAD(&mqrq->packed_list);
+	list_add_tail(&req->queuelist, &mqrq->packed_list);
+
+	spin_lock_irq(q->queue_lock);
+	while (num < card->ext_csd.max_packed_writes &&
+	       !blk_queue_plugged(q) && !blk_queue_stopped(q)) {
+		next = blk_peek_request(q);
+		if (!next || !mmc_blk_can_pack(card, next) ||
+		    blocks + blk_rq_sectors(next) > max_blocks ||
+		    segs + next->nr_phys_segments > max_segs)
+			break;
+
+		blk_start_request(next);
+		list_add_tail(&next->queuelist, &mqrq->packed_list);
+		blocks += blk_rq_sectors(next);
+		segs += next->nr_phys_segments;
+		num++;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	if (num == 1) {
+		list_del_init(&req->queuelist);
+		return;
+	}
+
+	mqrq->packed_num = num;
+	mqrq->packed_blocks = blocks - 1;
+}
+
+static void mmc_blk_packed_prep(struct mmc_queue *mq,
+				struct mmc_queue_req *mqrq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct mmc_card *card = mq->card;
+	__le32 *hdr = mqrq->packed_hdr;
+	struct scatterlist *sg = mqrq->sg;
+	struct request *prq;
+	unsigned int i = 1, sg_len = 1, n;
+	u32 addr;
+
+	memset(hdr, 0, 512);
+	hdr[0] = cpu_to_le32((mqrq->packed_num << 16) |
+			     (MMC_PACKED_WR << 8) | MMC_PACKED_VER);
+
+	sg_set_buf(sg, hdr, 512);
+	sg_unmark_end(sg);
+	list_for_each_entry(prq, &mqrq->packed_list, queuelist) {
+		addr = blk_rq_pos(prq);
+		if (!mmc_card_blockaddr(card))
+			addr <<= 9;
+		hdr[i * 2] = cpu_to_le32(blk_rq_sectors(prq));
+		hdr[i * 2 + 1] = cpu_to_le32(addr);
+		i++;
+
+		n = blk_rq_map_sg(mq->queue, prq, sg + sg_len);
+		sg_len += n;
+		sg_unmark_end(&sg[sg_len - 1]);
+	}
+	sg_mark_end(&sg[sg_len - 1]);
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+	brq->sbc.arg = MMC_CMD23_ARG_PACKED | (mqrq->packed_blocks + 1);
+	brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(mqrq->req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	/* only sent if the transfer fails */
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = mqrq->packed_blocks + 1;
+	brq->data.flags = MMC_DATA_WRITE;
+	brq->data.sg = sg;
+	brq->data.sg_len = sg_len;
+	mmc_set_data_timeout(&brq->data, card);
+}
+
+static int mmc_blk_issue_packed(struct mmc_queue *mq,
+				struct mmc_queue_req *mqrq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct completion complete;
+	int err;
+
+#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
+	if (mmc_bus_needs_resume(card->host)) {
+		mmc_resume_bus(card->host);
+		mmc_blk_set_blksize(md, card);
+	}
+#endif
+
+	mmc_claim_host(card->host);
+
+	mmc_blk_packed_prep(mq, mqrq);
+	if (!mmc_blk_send_sbc(card, brq)) {
+		mmc_start_req(card->host, &brq->mrq, &complete);
+		mmc_blk_prep_next(mq);
+		mmc_wait_for_req_done(&brq->mrq);
+	}
+
+	err = brq->cmd.error;
+	if (!err)
+		err = brq->data.error;
+	if (err) {
+		if (!brq->sbc.error)
+			mmc_wait_for_cmd(card->host, &brq->stop, 0);
+		printk(KERN_WARNING "%s: packed write of %u requests failed "
+		       "(%d), redoing them one by one\n",
+		       md->disk->disk_name, mqrq->packed_num, err);
+	} else if (!mmc_host_is_spi(card->host)) {
+		err = mmc_blk_wait_for_prg(md, mqrq->req);
+	}
+
+	mmc_release_host(card->host);
+
+	card->blk_stats.writes++;
+	card->blk_stats.write_blocks += brq->data.blocks;
+	card->blk_stats.sbc++;
+	card->blk_stats.packed++;
+	card->blk_stats.packed_reqs += mqrq->packed_num;
+	if (err)
+		card->blk_stats.packed_fail++;
+
+	return err;
+}
+
+static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_queue_req *mqrq = mq->mqrq_cur;
+	struct request *prq, *tmp;
+	int ret = 1, err;
+
+	if (!mqrq->prepared && mmc_blk_use_packed(md->queue.card))
+		mmc_blk_pack(mq, mqrq);
+	if (!mqrq->packed_num)
+		return mmc_blk_issue_one(mq, mqrq);
+
+	err = mmc_blk_issue_packed(mq, mqrq);
+	list_for_each_entry_safe(prq, tmp, &mqrq->packed_list, queuelist) {
+		list_del_init(&prq->queuelist);
+		if (!err) {
+			spin_lock_irq(&md->lock);
+			__blk_end_request_all(prq, 0);
+			spin_unlock_irq(&md->lock);
+		} else {
+			mqrq->req = prq;
+			ret &= mmc_blk_issue_one(mq, mqrq);
+		}
+	}
+	mqrq->req = req;
+	mqrq->packed_num = 0;
+
+	return ret;
+}
+
 
 static inline int mmc_blk_readonly(struct mmc_card *card)
 {
@@ -14,6 +14,10 @@
 #include <linux/mmc/host.h>
 #include <linux/mmc/mmc.h>
 
+#include <linux/completion.h>
+#include <linux/kernel_stat.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/scatterlist.h>
 
 #define RESULT_OK		0
@@ -29,6 +33,7 @@ struct mmc_test_card {
 
 	u8		scratch[BUFFER_SIZE];
 	u8		*buffer;
+	int		sbc;		/* CMD23 ahead of multiple blocks */
 #ifdef CONFIG_HIGHMEM
 	struct page	*highmem;
 #endif
@@ -56,6 +61,31 @@ static int mmc_test_set_blksize(struct mmc_test_card *test, unsigned size)
 	return 0;
 }
 
+/*
+ * Send CMD23 ahead of a multiple block transfer
+ */
+static int mmc_test_set_block_count(struct mmc_test_card *test, u32 arg)
+{
+	struct mmc_command cmd;
+
+	memset(&cmd, 0, sizeof(struct mmc_command));
+
+	cmd.opcode = MMC_SET_BLOCK_COUNT;
+	cmd.arg = arg;
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	return mmc_wait_for_cmd(test->card->host, &cmd, 0);
+}
+
+/*
+ * Card address of a sector
+ */
+static unsigned mmc_test_sector_addr(struct mmc_test_card *test,
+	unsigned sector)
+{
+	return mmc_card_blockaddr(test->card) ? sector : sector << 9;
+}
+
 /*
  * Fill in the mmc_request structure given a set of transfer parameters.
  */
@@ -335,6 +365,13 @@ static int mmc_test_simple_transfer(struct mmc_test_card *test,
 	mmc_test_prepare_mrq(test, &mrq, sg, sg_len, dev_addr,
 		blocks, blksz, write);
 
+	if (test->sbc && blocks > 1) {
+		int ret = mmc_test_set_block_count(test, blocks);
+		if (ret)
+			return ret;
+		mrq.stop = NULL;
+	}
+
 	mmc_wait_for_req(test->card->host, &mrq);
 
 	mmc_test_wait_busy(test);
@@ -891,6 +928,430 @@ static int mmc_test_multi_read_high(struct mmc_test_card *test)
 
 #endif /* CONFIG_HIGHMEM */
 
+static int mmc_test_cmd23_supported(struct mmc_test_card *test)
+{
+	if (!mmc_card_mmc(test->card) ||
+	    test->card->csd.mmca_vsn < CSD_SPEC_VER_3)
+		return RESULT_UNSUP_CARD;
+
+	if (!(test->card->host->caps & MMC_CAP_CMD23))
+		return RESULT_UNSUP_HOST;
+
+	return 0;
+}
+
+static int mmc_test_sbc_multi_write(struct mmc_test_card *test)
+{
+	int ret;
+
+	ret = mmc_test_cmd23_supported(test);
+	if (ret)
+		return ret;
+
+	test->sbc = 1;
+	ret = mmc_test_multi_write(test);
+	test->sbc = 0;
+
+	return ret;
+}
+
+static int mmc_test_sbc_multi_read(struct mmc_test_card *test)
+{
+	int ret;
+
+	ret = mmc_test_cmd23_supported(test);
+	if (ret)
+		return ret;
+
+	test->sbc = 1;
+	ret = mmc_test_multi_read(test);
+	test->sbc = 0;
+
+	return ret;
+}
+
+/*
+ * Two writes to separate places in one packed command, with a sector
+ * between them that must be left alone.
+ */
+#define PACKED_GAP_SECTOR	5
+
+static int mmc_test_packed_write(struct mmc_test_card *test)
+{
+	static const unsigned sector[] = { 2, 8 }, count[] = { 2, 1 };
+	struct mmc_request mrq;
+	struct mmc_command cmd;
+	struct mmc_command stop;
+	struct mmc_data data;
+	struct scatterlist sg;
+	__le32 *hdr = (__le32 *)test->buffer;
+	u8 *buf = test->buffer + 512;
+	unsigned i, j, k, blocks = 0;
+	int ret;
+
+	ret = mmc_test_cmd23_supported(test);
+	if (ret)
+		return ret;
+
+	if (test->card->ext_csd.max_packed_writes < 2)
+		return RESULT_UNSUP_CARD;
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		return ret;
+
+	memset(test->buffer, 0xDF, 512);
+	ret = mmc_test_buffer_transfer(test, test->buffer,
+		mmc_test_sector_addr(test, PACKED_GAP_SECTOR), 512, 1);
+	if (ret)
+		return ret;
+
+	memset(hdr, 0, 512);
+	hdr[0] = cpu_to_le32((ARRAY_SIZE(sector) << 16) |
+		(MMC_PACKED_WR << 8) | MMC_PACKED_VER);
+	for (i = 0;i < ARRAY_SIZE(sector);i++) {
+		hdr[2 + i * 2] = cpu_to_le32(count[i]);
+		hdr[3 + i * 2] = cpu_to_le32(mmc_test_sector_addr(test,
+			sector[i]));
+		blocks += count[i];
+	}
+	for (i = 0;i < blocks * 512;i++)
+		buf[i] = i + i / 512;
+
+	ret = mmc_test_set_block_count(test,
+		MMC_CMD23_ARG_PACKED | (blocks + 1));
+	if (ret)
+		return ret;
+
+	memset(&mrq, 0, sizeof(struct mmc_request));
+	memset(&cmd, 0, sizeof(struct mmc_command));
+	memset(&stop, 0, sizeof(struct mmc_command));
+	memset(&data, 0, sizeof(struct mmc_data));
+
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+	mrq.stop = &stop;
+
+	sg_init_one(&sg, test->buffer, (blocks + 1) * 512);
+
+	mmc_test_prepare_mrq(test, &mrq, &sg, 1,
+		mmc_test_sector_addr(test, sector[0]), blocks + 1, 512, 1);
+	mrq.stop = NULL;	/* the block count was set by CMD23 */
+
+	mmc_wait_for_req(test->card->host, &mrq);
+
+	mmc_test_wait_busy(test);
+
+	ret = mmc_test_check_result(test, &mrq);
+	if (ret)
+		return ret;
+
+	for (i = 0, j = 0;i < ARRAY_SIZE(sector);i++) {
+		for (k = 0;k < count[i];k++, j++) {
+			ret = mmc_test_buffer_transfer(test, test->buffer,
+				mmc_test_sector_addr(test, sector[i] + k),
+				512, 0);
+			if (ret)
+				return ret;
+			for (ret = 0;ret < 512;ret++) {
+				if (test->buffer[ret] !=
+				    (u8)(j * 512 + ret + j))
+					return RESULT_FAIL;
+			}
+		}
+	}
+
+	ret = mmc_test_buffer_transfer(test, test->buffer,
+		mmc_test_sector_addr(test, PACKED_GAP_SECTOR), 512, 0);
+	if (ret)
+		return ret;
+	for (i = 0;i < 512;i++) {
+		if (test->buffer[i] != 0xDF)
+			return RESULT_FAIL;
+	}
+
+	return 0;
+}
+
+/*
+ * Sequential transfers of PERF_TOTAL_SIZE, timed with and without the
+ * next request being prepared while the current one is on the bus.
+ */
+#define PERF_TOTAL_SIZE		(4 * 1024 * 1024)
+#define PERF_MAX_SIZE		(64 * 1024)
+
+struct mmc_test_perf_req {
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+	struct scatterlist	sg;
+	struct completion	complete;
+};
+
+static void mmc_test_perf_prepare(struct mmc_test_card *test,
+	struct mmc_test_perf_req *preq, void *buf, unsigned size,
+	unsigned index, int write)
+{
+	unsigned dev_addr = index * (size / 512);
+
+	if (!mmc_card_blockaddr(test->card))
+		dev_addr <<= 9;
+
+	memset(&preq->mrq, 0, sizeof(struct mmc_request));
+	memset(&preq->cmd, 0, sizeof(struct mmc_command));
+	memset(&preq->data, 0, sizeof(struct mmc_data));
+	memset(&preq->stop, 0, sizeof(struct mmc_command));
+
+	preq->mrq.cmd = &preq->cmd;
+	preq->mrq.data = &preq->data;
+	preq->mrq.stop = &preq->stop;
+
+	sg_init_one(&preq->sg, buf, size);
+
+	mmc_test_prepare_mrq(test, &preq->mrq, &preq->sg, 1, dev_addr,
+		size / 512, 512, write);
+}
+
+static int mmc_test_perf_transfer(struct mmc_test_card *test, void **buf,
+	unsigned size, int write, int nonblock)
+{
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_perf_req preq[2], *cur, *next, *tmp;
+	unsigned i, count = PERF_TOTAL_SIZE / size;
+	ktime_t start;
+	u64 ns;
+	int ret = 0;
+
+	cur = &preq[0];
+	next = &preq[1];
+
+	start = ktime_get();
+
+	mmc_test_perf_prepare(test, cur, buf[0], size, 0, write);
+	if (nonblock)
+		mmc_pre_req(host, &cur->mrq, true);
+
+	for (i = 0;i < count;i++) {
+		mmc_start_req(host, &cur->mrq, &cur->complete);
+
+		if (nonblock && i + 1 < count) {
+			mmc_test_perf_prepare(test, next, buf[(i + 1) & 1],
+				size, i + 1, write);
+			mmc_pre_req(host, &next->mrq, false);
+		}
+
+		mmc_wait_for_req_done(&cur->mrq);
+		if (nonblock)
+			mmc_post_req(host, &cur->mrq, cur->data.error);
+
+		ret = cur->cmd.error;
+		if (!ret)
+			ret = cur->data.error;
+		if (!ret && cur->mrq.stop)
+			ret = cur->stop.error;
+		if (!ret && write)
+			ret = mmc_test_wait_busy(test);
+		if (ret) {
+			if (nonblock && i + 1 < count)
+				mmc_post_req(host, &next->mrq, ret);
+			return ret;
+		}
+
+		if (!nonblock && i + 1 < count)
+			mmc_test_perf_prepare(test, next, buf[(i + 1) & 1],
+				size, i + 1, write);
+
+		tmp = cur;
+		cur = next;
+		next = tmp;
+	}
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	printk(KERN_INFO "%s: %s %u x %u bytes in %llu us, %llu KiB/s\n",
+		mmc_hostname(host), nonblock ? "non-blocking" : "blocking",
+		count, size, div_u64(ns, NSEC_PER_USEC),
+		div64_u64((u64)PERF_TOTAL_SIZE * NSEC_PER_SEC / 1024,
+			ns ? ns : 1));
+
+	return 0;
+}
+
+static int mmc_test_perf(struct mmc_test_card *test, int write)
+{
+	struct mmc_host *host = test->card->host;
+	void *buf[2];
+	unsigned int size;
+	int ret;
+
+	size = PERF_MAX_SIZE;
+	size = min(size, host->max_req_size);
+	size = min(size, host->max_seg_size);
+	size = min(size, host->max_blk_count * 512);
+	size &= ~511;
+
+	if (size < 1024)
+		return RESULT_UNSUP_HOST;
+
+	buf[0] = kzalloc(size, GFP_KERNEL);
+	buf[1] = kzalloc(size, GFP_KERNEL);
+	if (!buf[0] || !buf[1]) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		goto out;
+
+	ret = mmc_test_perf_transfer(test, buf, size, write, 0);
+	if (ret)
+		goto out;
+
+	ret = mmc_test_perf_transfer(test, buf, size, write, 1);
+
+out:
+	kfree(buf[1]);
+	kfree(buf[0]);
+	return ret;
+}
+
+static int mmc_test_perf_write(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 1);
+}
+
+static int mmc_test_perf_read(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 0);
+}
+
+/*
+ * Idle time of all CPUs, for the CPU load of a timed run
+ */
+static u64 mmc_test_idle_ns(void)
+{
+	cputime64_t idle = cputime64_zero;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		idle = cputime64_add(idle, kstat_cpu(cpu).cpustat.idle);
+		idle = cputime64_add(idle, kstat_cpu(cpu).cpustat.iowait);
+	}
+
+	return cputime64_to_jiffies64(idle) * (NSEC_PER_SEC / HZ);
+}
+
+static int mmc_test_perf_sg_transfer(struct mmc_test_card *test,
+	struct scatterlist *sg, unsigned sg_len, unsigned size, int write)
+{
+	struct mmc_host *host = test->card->host;
+	unsigned i, blocks = size / 512, count = PERF_TOTAL_SIZE / size;
+	ktime_t start;
+	u64 ns, idle, load;
+	int ret;
+
+	idle = mmc_test_idle_ns();
+	start = ktime_get();
+
+	for (i = 0;i < count;i++) {
+		ret = mmc_test_simple_transfer(test, sg, sg_len,
+			mmc_test_sector_addr(test, i * blocks), blocks, 512,
+			write);
+		if (ret)
+			return ret;
+	}
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	idle = mmc_test_idle_ns() - idle;
+
+	ns = ns ? ns : 1;
+	load = ns * num_online_cpus();
+	load = idle < load ? div64_u64((load - idle) * 100, load) : 0;
+
+	printk(KERN_INFO "%s: %u x %u bytes in %u segments in %llu us, "
+		"%llu KiB/s, %llu%% CPU\n", mmc_hostname(host), count, size,
+		sg_len, div_u64(ns, NSEC_PER_USEC),
+		div64_u64((u64)PERF_TOTAL_SIZE * NSEC_PER_SEC / 1024, ns),
+		load);
+
+	return 0;
+}
+
+/*
+ * The same sequential transfers with the buffer in one page per
+ * scatterlist entry, as requests come from the page cache, and in one
+ * contiguous entry.  The difference is the cost of a segment to the
+ * host driver.
+ */
+static int mmc_test_perf_sg(struct mmc_test_card *test, int write)
+{
+	struct mmc_host *host = test->card->host;
+	struct scatterlist sg[PERF_MAX_SIZE / PAGE_SIZE];
+	struct page *pages[PERF_MAX_SIZE / PAGE_SIZE];
+	unsigned int size, nr_pages, i;
+	void *buf;
+	int ret;
+
+	nr_pages = ARRAY_SIZE(pages);
+	nr_pages = min_t(unsigned int, nr_pages, host->max_hw_segs);
+	nr_pages = min_t(unsigned int, nr_pages, host->max_phys_segs);
+	nr_pages = min_t(unsigned int, nr_pages,
+		host->max_req_size / PAGE_SIZE);
+	nr_pages = min_t(unsigned int, nr_pages,
+		host->max_blk_count * 512 / PAGE_SIZE);
+	size = nr_pages * PAGE_SIZE;
+
+	if (nr_pages < 2 || host->max_seg_size < size)
+		return RESULT_UNSUP_HOST;
+
+	memset(pages, 0, sizeof(pages));
+	buf = kzalloc(size, GFP_KERNEL);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	sg_init_table(sg, nr_pages);
+	for (i = 0;i < nr_pages;i++) {
+		pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		sg_set_page(&sg[i], pages[i], PAGE_SIZE, 0);
+	}
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		goto out;
+
+	ret = mmc_test_perf_sg_transfer(test, sg, nr_pages, size, write);
+	if (ret)
+		goto out;
+
+	sg_init_one(&sg[0], buf, size);
+	ret = mmc_test_perf_sg_transfer(test, sg, 1, size, write);
+
+out:
+	for (i = 0;i < nr_pages;i++)
+		if (pages[i])
+			__free_page(pages[i]);
+	kfree(buf);
+	return ret;
+}
+
+static int mmc_test_perf_sg_write(struct mmc_test_card *test)
+{
+	return mmc_test_perf_sg(test, 1);
+}
+
+static int mmc_test_perf_sg_read(struct mmc_test_card *test)
+{
+	return mmc_test_perf_sg(test, 0);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -1038,6 +1499,46 @@ static const struct mmc_test_case mmc_test_cases[] = {
 
 #endif /* CONFIG_HIGHMEM */
 
+	{
+		.name = "Multi-block write with CMD23",
+		.prepare = mmc_test_prepare_write,
+		.run = mmc_test_sbc_multi_write,
+		.cleanup = mmc_test_cleanup,
+	},
+
+	{
+		.name = "Multi-block read with CMD23",
+		.prepare = mmc_test_prepare_read,
+		.run = mmc_test_sbc_multi_read,
+		.cleanup = mmc_test_cleanup,
+	},
+
+	{
+		.name = "Packed write",
+		.run = mmc_test_packed_write,
+		.cleanup = mmc_test_cleanup,
+	},
+
+	{
+		.name = "Sequential write performance, blocking vs. non-blocking",
+		.run = mmc_test_perf_write,
+	},
+
+	{
+		.name = "Sequential read performance, blocking vs. non-blocking",
+		.run = mmc_test_perf_read,
+	},
+
+	{
+		.name = "Scattered page write performance",
+		.run = mmc_test_perf_sg_write,
+	},
+
+	{
+		.name = "Scattered page read performance",
+		.run = mmc_test_perf_sg_read,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -4,6 +4,32 @@
 struct request;
 struct task_struct;
 
+struct mmc_blk_request {
+	struct mmc_request	mrq;
+	struct mmc_command	sbc;	/* CMD23, sent first if opcode is set */
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+};
+
+/*
+ * One of the two request slots of a queue: the request being issued, or
+ * the one fetched and set up while it is in flight.
+ */
+struct mmc_queue_req {
+	struct request		*req;
+	struct mmc_blk_request	brq;
+	struct scatterlist	*sg;
+	char			*bounce_buf;
+	struct scatterlist	*bounce_sg;
+	unsigned int		bounce_sg_len;
+	int			prepared;	/* brq is set up for all of req */
+	struct list_head	packed_list;	/* req and the writes packed */
+	unsigned int		packed_num;	/* with it, if any */
+	unsigned int		packed_blocks;
+	__le32			*packed_hdr;
+};
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
@@ -13,19 +39,43 @@ struct mmc_queue {
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
 	void			*data;
 	struct request_queue	*queue;
-	struct scatterlist	*sg;
-	char			*bounce_buf;
-	struct scatterlist	*bounce_sg;
-	unsigned int		bounce_sg_len;
+	struct mmc_queue_req	mqrq[2];
+	struct mmc_queue_req	*mqrq_cur;
+	struct mmc_queue_req	*mqrq_next;
 };
 
+/*
+ * Send CMD23 ahead of multiple block transfers rather than CMD12 after
+ * them.  It is mandatory from MMC 3.1, but hosts doing an automatic CMD12
+ * would stop the transfer early, so they have to ask for it.
+ */
+static inline int mmc_blk_use_cmd23(struct mmc_card *card)
+{
+	return mmc_card_mmc(card) && card->csd.mmca_vsn >= CSD_SPEC_VER_3 &&
+		(card->host->caps & MMC_CAP_CMD23);
+}
+
+/* Reliable writes for barrier and FUA requests (MMC 4.3 and later) */
+static inline int mmc_blk_use_rel_wr(struct mmc_card *card)
+{
+	return mmc_blk_use_cmd23(card) && card->ext_csd.rel_wr_sec_c;
+}
+
+/* Packed writes (eMMC 4.5 and later) */
+static inline int mmc_blk_use_packed(struct mmc_card *card)
+{
+	return mmc_blk_use_cmd23(card) && card->ext_csd.max_packed_writes > 1;
+}
+
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *);
 extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
+extern struct request *mmc_queue_fetch_next(struct mmc_queue *);
 
-extern unsigned int mmc_queue_map_sg(struct mmc_queue *);
-extern void mmc_queue_bounce_pre(struct mmc_queue *);
-extern void mmc_queue_bounce_post(struct mmc_queue *);
+extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
+				     struct mmc_queue_req *);
+extern void mmc_queue_bounce_pre(struct mmc_queue_req *);
+extern void mmc_queue_bounce_post(struct mmc_queue_req *);
 
 #endif
@@ -213,6 +213,73 @@ void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
 
 EXPORT_SYMBOL(mmc_wait_for_req);
 
+/**
+ *	mmc_start_req - start a request without waiting for it
+ *	@host: MMC host to start command
+ *	@mrq: MMC request to start
+ *	@complete: completion to signal when the request is done
+ *
+ *	Start a new MMC request for a host and return at once, so that
+ *	the caller can prepare its next request while this one is on the
+ *	bus.  The caller must call mmc_wait_for_req_done() before looking
+ *	at the result or reusing @mrq, and @complete must live until then.
+ */
+void mmc_start_req(struct mmc_host *host, struct mmc_request *mrq,
+	struct completion *complete)
+{
+	init_completion(complete);
+	mrq->done_data = complete;
+	mrq->done = mmc_wait_done;
+
+	mmc_start_request(host, mrq);
+}
+
+EXPORT_SYMBOL(mmc_start_req);
+
+/**
+ *	mmc_wait_for_req_done - wait for a request started by mmc_start_req
+ *	@mrq: MMC request to wait for
+ */
+void mmc_wait_for_req_done(struct mmc_request *mrq)
+{
+	wait_for_completion(mrq->done_data);
+}
+
+EXPORT_SYMBOL(mmc_wait_for_req_done);
+
+/**
+ *	mmc_pre_req - prepare a request ahead of starting it
+ *	@host: MMC host the request will be started on
+ *	@mrq: MMC request to prepare
+ *	@is_first_req: no other request is in flight on the host
+ *
+ *	Let the host driver map the data of @mrq for DMA while the bus
+ *	is busy with another request.  Every request passed here must
+ *	later be passed to mmc_post_req(), whether it was started or not.
+ */
+void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+	bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+
+EXPORT_SYMBOL(mmc_pre_req);
+
+/**
+ *	mmc_post_req - undo mmc_pre_req once a request is done
+ *	@host: MMC host the request was started on
+ *	@mrq: MMC request that was prepared
+ *	@err: error the request completed with, if any
+ */
+void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq, int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+
+EXPORT_SYMBOL(mmc_post_req);
+
 /**
  *	mmc_wait_for_cmd - start a command and wait for completion
  *	@host: MMC host to start command
@@ -184,6 +184,36 @@ static int mmc_dbg_card_status_get(void *data, u64 *val)
 DEFINE_SIMPLE_ATTRIBUTE(mmc_dbg_card_status_fops, mmc_dbg_card_status_get,
 		NULL, "%08llx\n");
 
+static int mmc_blk_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_card *card = s->private;
+	struct mmc_blk_stats *stats = &card->blk_stats;
+
+	seq_printf(s, "reads:\t\t%lu (%lu blocks)\n", stats->reads,
+		   stats->read_blocks);
+	seq_printf(s, "writes:\t\t%lu (%lu blocks)\n", stats->writes,
+		   stats->write_blocks);
+	seq_printf(s, "CMD23:\t\t%lu\n", stats->sbc);
+	seq_printf(s, "CMD12:\t\t%lu\n", stats->stops);
+	seq_printf(s, "reliable:\t%lu\n", stats->rel_writes);
+	seq_printf(s, "packed:\t\t%lu (%lu requests, %lu failed)\n",
+		   stats->packed, stats->packed_reqs, stats->packed_fail);
+
+	return 0;
+}
+
+static int mmc_blk_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_blk_stats_show, inode->i_private);
+}
+
+static const struct file_operations mmc_dbg_blk_stats_fops = {
+	.open		= mmc_blk_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 #define EXT_CSD_STR_LEN 1025
 
 static int mmc_ext_csd_open(struct inode *inode, struct file *filp)
@@ -278,6 +308,11 @@ void mmc_add_card_debugfs(struct mmc_card *card)
 					&mmc_dbg_ext_csd_fops))
 			goto err;
 
+	if (mmc_card_mmc(card) || mmc_card_sd(card))
+		if (!debugfs_create_file("blk_stats", S_IRUSR, root, card,
+					&mmc_dbg_blk_stats_fops))
+			goto err;
+
 	return;
 
 err:
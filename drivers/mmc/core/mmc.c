@@ -216,7 +216,7 @@ static int mmc_read_ext_csd(struct mmc_card *card)
 	}
 
 	card->ext_csd.rev = ext_csd[EXT_CSD_REV];
-	if (card->ext_csd.rev > 5) {
+	if (card->ext_csd.rev > 6) {
 		printk(KERN_ERR "%s: unrecognised EXT_CSD structure "
 			"version %d\n", mmc_hostname(card->host),
 			card->ext_csd.rev);
@@ -261,8 +261,15 @@ static int mmc_read_ext_csd(struct mmc_card *card)
 					1 << ext_csd[EXT_CSD_S_A_TIMEOUT];
 	}
 
-	if (card->ext_csd.rev >= 5)
+	if (card->ext_csd.rev >= 5) {
 		card->ext_csd.rel_wr_sec_c = ext_csd[EXT_CSD_REL_WR_SEC_C];
+		card->ext_csd.rel_param = ext_csd[EXT_CSD_WR_REL_PARAM];
+	}
+
+	if (card->ext_csd.rev >= 6)
+		card->ext_csd.max_packed_writes =
+			min_t(u8, ext_csd[EXT_CSD_MAX_PACKED_WRITES],
+			      MMC_PACKED_MAX_ENTRIES);
 
 out:
 	kfree(ext_csd);
@@ -0,0 +1,1193 @@
+/*
+ *  linux/drivers/mmc/host/mmc_emu.c - emulated MMC/SD host and card
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A host controller with an eMMC or SD card behind it that only exists
+ * in memory, or in an image file, so that the MMC core, the block driver
+ * and mmc_test can be run, timed and made to fail without hardware.
+ *
+ * The card answers the commands the core and the block driver send: it
+ * goes through the identification states, reports CID, CSD, EXT_CSD or
+ * SCR registers built from the module parameters, switches bus width
+ * and timing, and does single, multiple, CMD23 counted, reliable and
+ * packed reads and writes and erases.  Commands it does not know, or
+ * gets in the wrong state, are not answered and so time out.
+ *
+ * Requests are carried out by a workqueue and completed from an hrtimer
+ * once the time they would have taken has passed: the command and data
+ * bits at the current bus clock and width, plus the access latencies
+ * and media bandwidths set by read_us, write_us, read_kbps and
+ * write_kbps.  After a write the card is busy programming for prog_us,
+ * which CMD13 reports, and R1b commands are held until it is done.
+ * A write to another erase block than the last write keeps it busy for
+ * switch_us more, as a card that has to close its open block would.
+ * Any of these can be changed at run time under
+ * /sys/module/mmc_emu/parameters, and setting fail_every makes every
+ * Nth data transfer, or every Nth fail_opcode command, fail with
+ * fail_error.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/platform_device.h>
+#include <linux/workqueue.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/scatterlist.h>
+#include <linux/vmalloc.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/err.h>
+#include <linux/mmc/host.h>
+#include <linux/mmc/card.h>
+#include <linux/mmc/mmc.h>
+#include <linux/mmc/sd.h>
+
+#include <asm/uaccess.h>
+
+#define DRIVER_NAME "mmc_emu"
+
+static unsigned int size_mb = 64;
+module_param(size_mb, uint, 0444);
+MODULE_PARM_DESC(size_mb, "Size of a card kept in memory, in MiB");
+
+static char *image;
+module_param(image, charp, 0444);
+MODULE_PARM_DESC(image, "File or block device to keep the card in instead");
+
+static int sd;
+module_param(sd, bool, 0444);
+MODULE_PARM_DESC(sd, "Emulate an SD card instead of an eMMC");
+
+static int hc = -1;
+module_param(hc, int, 0444);
+MODULE_PARM_DESC(hc, "Sector addressed card: 1, 0, or -1 if over 1 GiB");
+
+static unsigned int bus_width = 8;
+module_param(bus_width, uint, 0444);
+MODULE_PARM_DESC(bus_width, "Host data lines: 1, 4 or 8");
+
+static unsigned int f_max = 52000000;
+module_param(f_max, uint, 0444);
+MODULE_PARM_DESC(f_max, "Fastest host clock in Hz");
+
+static unsigned int packed = 32;
+module_param(packed, uint, 0444);
+MODULE_PARM_DESC(packed, "eMMC MAX_PACKED_WRITES, 0 for no packed commands");
+
+static int bus_timing = 1;
+module_param(bus_timing, bool, 0644);
+MODULE_PARM_DESC(bus_timing, "Take as long as the bus would");
+
+static unsigned int read_us;
+module_param(read_us, uint, 0644);
+MODULE_PARM_DESC(read_us, "Card latency ahead of each read, in us");
+
+static unsigned int write_us;
+module_param(write_us, uint, 0644);
+MODULE_PARM_DESC(write_us, "Card latency ahead of each write, in us");
+
+static unsigned int prog_us;
+module_param(prog_us, uint, 0644);
+MODULE_PARM_DESC(prog_us, "Card busy time after each write or erase, in us");
+
+static unsigned int switch_us;
+module_param(switch_us, uint, 0644);
+MODULE_PARM_DESC(switch_us, "More busy time when a write leaves the last "
+		 "one's erase block, in us");
+
+static unsigned int switch_kb = 512;
+module_param(switch_kb, uint, 0644);
+MODULE_PARM_DESC(switch_kb, "Erase block size for switch_us, in KiB");
+
+static unsigned int read_kbps;
+module_param(read_kbps, uint, 0644);
+MODULE_PARM_DESC(read_kbps, "Card read bandwidth in KiB/s, 0 for the bus's");
+
+static unsigned int write_kbps;
+module_param(write_kbps, uint, 0644);
+MODULE_PARM_DESC(write_kbps, "Card write bandwidth in KiB/s, 0 for the bus's");
+
+static unsigned int fail_every;
+module_param(fail_every, uint, 0644);
+MODULE_PARM_DESC(fail_every, "Fail every Nth data transfer or command, 0 never");
+
+static int fail_opcode = -1;
+module_param(fail_opcode, int, 0644);
+MODULE_PARM_DESC(fail_opcode, "Fail this command instead of data transfers");
+
+static unsigned int fail_error = EILSEQ;
+module_param(fail_error, uint, 0644);
+MODULE_PARM_DESC(fail_error, "Error for failures, default EILSEQ (bad CRC)");
+
+/* card states, as reported in R1 */
+enum {
+	MMC_EMU_IDLE,
+	MMC_EMU_READY,
+	MMC_EMU_IDENT,
+	MMC_EMU_STBY,
+	MMC_EMU_TRAN,
+	MMC_EMU_DATA,
+	MMC_EMU_RCV,
+	MMC_EMU_PRG,
+	MMC_EMU_DIS,
+	MMC_EMU_BTST,
+	MMC_EMU_SLP,
+};
+
+/* what the card does on the data lines after a command */
+enum {
+	MMC_EMU_XFER_NONE,
+	MMC_EMU_XFER_REG,	/* send xfer_len bytes of buf */
+	MMC_EMU_XFER_READ,
+	MMC_EMU_XFER_WRITE,
+	MMC_EMU_XFER_PACKED,
+};
+
+#define MMC_EMU_OCR		0x00ff8000	/* 2.7-3.6V */
+#define MMC_EMU_SD_RCA		0x1234
+#define MMC_EMU_BYTE_MAX	(4096 * 512)	/* sectors, with 512B blocks */
+
+#define MMC_EMU_CMD_CLOCKS	56	/* 48 bit command and Ncr */
+#define MMC_EMU_BLOCK_CLOCKS	20	/* start, CRC, end and Nac */
+
+struct mmc_emu_host {
+	struct mmc_host		*mmc;
+	struct mmc_request	*mrq;
+	struct workqueue_struct	*workqueue;
+	struct work_struct	work;
+	struct hrtimer		timer;
+
+	/* the card is kept in one of */
+	u8			*ram;
+	struct file		*filp;
+	u64			size;		/* bytes */
+
+	/* registers */
+	int			hc;
+	u32			cid[4];
+	u32			csd[4];
+	u8			ext_csd[512];
+
+	/* state */
+	unsigned int		state;
+	u16			rca;
+	u32			status;		/* R1 error bits, clear on read */
+	unsigned int		app_cmd:1;
+	unsigned int		sd_hs:1;
+	unsigned int		blklen;
+	u32			sbc;		/* CMD23 argument, 0 if none */
+	u32			erase_start;
+	u32			erase_end;
+	u32			wr_blocks;	/* for ACMD22 */
+	u64			wr_block;	/* erase block of the last write */
+	u64			busy_until;	/* ns, programming till then */
+	unsigned int		nr_fail;
+
+	int			xfer;
+	u64			xfer_pos;
+	unsigned int		xfer_len;
+	unsigned int		xfer_blocks;	/* 0: until stopped */
+
+	u8			buf[512] __aligned(4);
+};
+
+/*
+ * Set a field of a 128 bit register as the core's UNSTUFF_BITS() reads it
+ */
+static void mmc_emu_stuff(u32 *reg, unsigned int start, unsigned int size,
+	u32 value)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; i++, start++) {
+		if (value & (1 << i))
+			reg[3 - start / 32] |= 1 << (start % 32);
+	}
+}
+
+static int mmc_emu_should_fail(struct mmc_emu_host *host)
+{
+	return fail_every && ++host->nr_fail % fail_every == 0;
+}
+
+/*
+ * Build the registers for a card of host->size bytes, trimming the size
+ * to what they can describe.
+ */
+static void mmc_emu_init_card(struct mmc_emu_host *host)
+{
+	u64 sectors = host->size >> 9;
+	unsigned int c_size, mult = 0;
+	u32 *cid = host->cid, *csd = host->csd;
+	u8 *ext_csd = host->ext_csd;
+
+	host->hc = hc < 0 ? sectors > MMC_EMU_BYTE_MAX : hc;
+	if (!host->hc && sectors > MMC_EMU_BYTE_MAX) {
+		printk(KERN_WARNING DRIVER_NAME ": byte addressed cards "
+		       "stop at 1 GiB\n");
+		sectors = MMC_EMU_BYTE_MAX;
+	}
+
+	if (sd && host->hc) {
+		/* CSD 2.0, C_SIZE in 512KiB units */
+		c_size = (sectors >> 10) - 1;
+		sectors = (u64)(c_size + 1) << 10;
+	} else if (host->hc) {
+		/* the size is in EXT_CSD, C_SIZE has the magic value */
+		c_size = 4095;
+		mult = 7;
+	} else {
+		while ((sectors >> (mult + 2)) > 4096)
+			mult++;
+		c_size = (sectors >> (mult + 2)) - 1;
+		sectors = (u64)(c_size + 1) << (mult + 2);
+	}
+	host->size = sectors << 9;
+
+	memset(csd, 0, sizeof(host->csd));
+	memset(cid, 0, sizeof(host->cid));
+	mmc_emu_stuff(csd, 112, 8, 0x0e);	/* TAAC 1ms */
+	mmc_emu_stuff(csd, 96, 8, 0x32);	/* TRAN_SPEED 25MHz */
+	mmc_emu_stuff(csd, 80, 4, 9);		/* READ_BL_LEN */
+	mmc_emu_stuff(csd, 26, 3, 2);		/* R2W_FACTOR */
+	mmc_emu_stuff(csd, 22, 4, 9);		/* WRITE_BL_LEN */
+	mmc_emu_stuff(cid, 120, 8, 0xfe);	/* MID */
+
+	if (sd) {
+		mmc_emu_stuff(csd, 84, 12, CCC_BASIC | CCC_BLOCK_READ |
+			CCC_BLOCK_WRITE | CCC_ERASE | CCC_LOCK_CARD |
+			CCC_APP_SPEC | CCC_SWITCH);
+		mmc_emu_stuff(csd, 46, 1, 1);		/* ERASE_BLK_EN */
+		if (host->hc) {
+			mmc_emu_stuff(csd, 126, 2, 1);
+			mmc_emu_stuff(csd, 48, 22, c_size);
+		} else {
+			mmc_emu_stuff(csd, 79, 1, 1);	/* READ_BL_PARTIAL */
+			mmc_emu_stuff(csd, 62, 12, c_size);
+			mmc_emu_stuff(csd, 47, 3, mult);
+		}
+
+		mmc_emu_stuff(cid, 104, 16, 0x4c58);	/* "LX" */
+		mmc_emu_stuff(cid, 96, 8, 'E');
+		mmc_emu_stuff(cid, 88, 8, 'M');
+		mmc_emu_stuff(cid, 80, 8, 'U');
+		mmc_emu_stuff(cid, 72, 8, 'S');
+		mmc_emu_stuff(cid, 64, 8, 'D');
+		mmc_emu_stuff(cid, 24, 32, 1);		/* PSN */
+		mmc_emu_stuff(cid, 12, 8, 10);		/* 2010 */
+		mmc_emu_stuff(cid, 8, 4, 1);
+		return;
+	}
+
+	mmc_emu_stuff(csd, 126, 2, CSD_STRUCT_VER_1_2);
+	mmc_emu_stuff(csd, 122, 4, CSD_SPEC_VER_4);
+	mmc_emu_stuff(csd, 84, 12, CCC_BASIC | CCC_BLOCK_READ |
+		CCC_BLOCK_WRITE | CCC_ERASE | CCC_LOCK_CARD | CCC_SWITCH);
+	mmc_emu_stuff(csd, 79, 1, !host->hc);	/* READ_BL_PARTIAL */
+	mmc_emu_stuff(csd, 62, 12, c_size);
+	mmc_emu_stuff(csd, 47, 3, mult);
+	mmc_emu_stuff(csd, 37, 5, 31);		/* 16KiB erase groups */
+
+	mmc_emu_stuff(cid, 104, 8, 0x4c);	/* "L" */
+	mmc_emu_stuff(cid, 96, 8, 'E');
+	mmc_emu_stuff(cid, 88, 8, 'M');
+	mmc_emu_stuff(cid, 80, 8, 'U');
+	mmc_emu_stuff(cid, 72, 8, 'M');
+	mmc_emu_stuff(cid, 64, 8, 'M');
+	mmc_emu_stuff(cid, 56, 8, 'C');
+	mmc_emu_stuff(cid, 16, 32, 1);		/* PSN */
+	mmc_emu_stuff(cid, 12, 4, 1);
+	mmc_emu_stuff(cid, 8, 4, 13);		/* 2010 */
+
+	memset(ext_csd, 0, sizeof(host->ext_csd));
+	ext_csd[EXT_CSD_REV] = 6;
+	ext_csd[EXT_CSD_CSD_STRUCTURE] = 2;
+	ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+		EXT_CSD_CARD_TYPE_52;
+	ext_csd[EXT_CSD_SEC_CNT + 0] = sectors >> 0;
+	ext_csd[EXT_CSD_SEC_CNT + 1] = sectors >> 8;
+	ext_csd[EXT_CSD_SEC_CNT + 2] = sectors >> 16;
+	ext_csd[EXT_CSD_SEC_CNT + 3] = sectors >> 24;
+	ext_csd[EXT_CSD_S_A_TIMEOUT] = 0x11;
+	ext_csd[EXT_CSD_REL_WR_SEC_C] = 1;
+	ext_csd[EXT_CSD_WR_REL_PARAM] = EXT_CSD_WR_REL_PARAM_EN;
+	ext_csd[EXT_CSD_MAX_PACKED_WRITES] =
+		min_t(unsigned int, packed, MMC_PACKED_MAX_ENTRIES);
+}
+
+/*
+ * Power up or CMD0
+ */
+static void mmc_emu_reset(struct mmc_emu_host *host)
+{
+	host->state = MMC_EMU_IDLE;
+	host->rca = 0;
+	host->status = 0;
+	host->app_cmd = 0;
+	host->sd_hs = 0;
+	host->blklen = 512;
+	host->sbc = 0;
+	host->busy_until = 0;
+	host->xfer = MMC_EMU_XFER_NONE;
+	host->ext_csd[EXT_CSD_BUS_WIDTH] = EXT_CSD_BUS_WIDTH_1;
+	host->ext_csd[EXT_CSD_HS_TIMING] = 0;
+}
+
+/*
+ * Time for the given number of bus clocks
+ */
+static u64 mmc_emu_clocks(struct mmc_emu_host *host, u64 clocks)
+{
+	unsigned int clock = host->mmc->ios.clock;
+
+	if (!bus_timing || !clock)
+		return 0;
+
+	return div_u64(clocks * NSEC_PER_SEC, clock);
+}
+
+static u64 mmc_emu_bus_ns(struct mmc_emu_host *host, unsigned int blocks,
+	unsigned int blksz)
+{
+	unsigned int width = 1 << host->mmc->ios.bus_width;
+
+	return mmc_emu_clocks(host, blocks *
+		(u64)(DIV_ROUND_UP(blksz * 8, width) + MMC_EMU_BLOCK_CLOCKS));
+}
+
+/*
+ * Time for a data transfer: the card's access latency, then the bus or
+ * the card's media, whichever is slower.
+ */
+static u64 mmc_emu_data_ns(struct mmc_emu_host *host, unsigned int blocks,
+	unsigned int blksz, int write)
+{
+	unsigned int kbps = write ? write_kbps : read_kbps;
+	u64 bytes = (u64)blocks * blksz;
+	u64 bus, media = 0;
+
+	bus = mmc_emu_bus_ns(host, blocks, blksz);
+	if (kbps)
+		media = div_u64((bytes * NSEC_PER_SEC) >> 10, kbps);
+
+	return (u64)(write ? write_us : read_us) * NSEC_PER_USEC +
+		max(bus, media);
+}
+
+static u32 mmc_emu_r1(struct mmc_emu_host *host, u64 now)
+{
+	unsigned int state = host->state;
+	u32 r1 = host->status;
+
+	host->status = 0;
+	if (state == MMC_EMU_TRAN && now < host->busy_until)
+		state = MMC_EMU_PRG;
+	r1 |= state << 9;
+	if (state != MMC_EMU_PRG)
+		r1 |= R1_READY_FOR_DATA;
+	if (host->app_cmd)
+		r1 |= R1_APP_CMD;
+
+	return r1;
+}
+
+/*
+ * Card address to image offset
+ */
+static u64 mmc_emu_pos(struct mmc_emu_host *host, u32 addr)
+{
+	return host->hc ? (u64)addr << 9 : addr;
+}
+
+/*
+ * Read or write len bytes of the image at pos.
+ */
+static int mmc_emu_image_io(struct mmc_emu_host *host, void *buf, u64 pos,
+	size_t len, int write)
+{
+	mm_segment_t old_fs;
+	loff_t off = pos;
+	ssize_t ret;
+
+	if (host->ram) {
+		if (write)
+			memcpy(host->ram + pos, buf, len);
+		else
+			memcpy(buf, host->ram + pos, len);
+		return 0;
+	}
+
+	old_fs = get_fs();
+	set_fs(get_ds());
+	if (write)
+		ret = vfs_write(host->filp, (const char __user *)buf, len, &off);
+	else
+		ret = vfs_read(host->filp, (char __user *)buf, len, &off);
+	set_fs(old_fs);
+
+	return ret == len ? 0 : -EIO;
+}
+
+/*
+ * Move len bytes between the request's pages and buf, or the image at
+ * pos if buf is NULL.
+ */
+static int mmc_emu_sg_io(struct mmc_emu_host *host,
+	struct sg_mapping_iter *miter, void *buf, u64 pos, size_t len,
+	int write)
+{
+	size_t n;
+	int ret;
+
+	while (len) {
+		if (!sg_miter_next(miter))
+			return -EINVAL;
+
+		n = min(len, miter->length);
+		if (buf) {
+			if (write)
+				memcpy(buf, miter->addr, n);
+			else
+				memcpy(miter->addr, buf, n);
+			buf += n;
+		} else {
+			ret = mmc_emu_image_io(host, miter->addr, pos, n,
+				write);
+			if (ret)
+				return ret;
+			pos += n;
+		}
+		miter->consumed = n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int mmc_emu_erase(struct mmc_emu_host *host)
+{
+	u64 pos = mmc_emu_pos(host, host->erase_start);
+	u64 end = mmc_emu_pos(host, host->erase_end) + 512;
+	size_t n;
+	int ret;
+
+	if (end > host->size)
+		end = host->size;
+	if (pos >= end)
+		return -EINVAL;
+
+	if (host->ram) {
+		memset(host->ram + pos, 0, end - pos);
+		return 0;
+	}
+
+	for (; pos < end; pos += n) {
+		n = min_t(u64, end - pos, PAGE_SIZE);
+		ret = mmc_emu_image_io(host, page_address(ZERO_PAGE(0)),
+			pos, n, 1);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Set up a read or write of the image for a data command
+ */
+static void mmc_emu_rw(struct mmc_emu_host *host, struct mmc_command *cmd,
+	int write, int multi)
+{
+	host->xfer = write ? MMC_EMU_XFER_WRITE : MMC_EMU_XFER_READ;
+	host->xfer_pos = mmc_emu_pos(host, cmd->arg);
+	host->xfer_blocks = 1;
+	if (multi)
+		host->xfer_blocks = host->sbc & 0xffff;
+	if (multi && write && (host->sbc & MMC_CMD23_ARG_PACKED))
+		host->xfer = MMC_EMU_XFER_PACKED;
+	host->sbc = 0;
+
+	host->state = write ? MMC_EMU_RCV : MMC_EMU_DATA;
+}
+
+static void mmc_emu_reg(struct mmc_emu_host *host, unsigned int len)
+{
+	host->xfer = MMC_EMU_XFER_REG;
+	host->xfer_len = len;
+	host->state = MMC_EMU_DATA;
+}
+
+/*
+ * CMD6 of SD cards: only function group 1, default or high speed
+ */
+static void mmc_emu_sd_switch(struct mmc_emu_host *host, u32 arg)
+{
+	u8 *status = host->buf;
+	unsigned int fn = arg & 0xf;
+	int i;
+
+	memset(status, 0, 64);
+	status[1] = 100;			/* mA */
+	for (i = 3; i < 12; i += 2)
+		status[i] = 0x01;		/* groups 6 to 2: default */
+	status[13] = 0x03;			/* group 1: and high speed */
+
+	if (fn == 0xf)
+		fn = host->sd_hs;
+	else if (fn > 1)
+		fn = 0xf;
+	else if (arg & (1U << 31))
+		host->sd_hs = fn;
+	status[16] = fn;
+
+	mmc_emu_reg(host, 64);
+}
+
+/*
+ * CMD6 of MMC cards, on EXT_CSD
+ */
+static void mmc_emu_mmc_switch(struct mmc_emu_host *host, u32 arg)
+{
+	unsigned int access = (arg >> 24) & 3;
+	unsigned int index = (arg >> 16) & 0xff;
+	u8 value = (arg >> 8) & 0xff;
+
+	if (access == MMC_SWITCH_MODE_CMD_SET)
+		return;
+
+	switch (access) {
+	case MMC_SWITCH_MODE_SET_BITS:
+		value |= host->ext_csd[index];
+		break;
+	case MMC_SWITCH_MODE_CLEAR_BITS:
+		value = host->ext_csd[index] & ~value;
+		break;
+	}
+
+	if (index >= EXT_CSD_REV ||
+	    (index == EXT_CSD_BUS_WIDTH && value > EXT_CSD_BUS_WIDTH_8) ||
+	    (index == EXT_CSD_HS_TIMING && value > 1)) {
+		host->status |= R1_SWITCH_ERROR;
+		return;
+	}
+
+	host->ext_csd[index] = value;
+}
+
+/*
+ * Application specific commands of SD cards.  Returns 0 if cmd was not
+ * one, to be taken as a normal command.
+ */
+static int mmc_emu_app_command(struct mmc_emu_host *host,
+	struct mmc_command *cmd, u32 r1)
+{
+	unsigned int state = host->state;
+
+	switch (cmd->opcode) {
+	case SD_APP_SET_BUS_WIDTH:
+		if (state != MMC_EMU_TRAN)
+			break;
+		cmd->resp[0] = r1;
+		return 1;
+	case SD_APP_SEND_NUM_WR_BLKS:
+		if (state != MMC_EMU_TRAN)
+			break;
+		*(__be32 *)host->buf = cpu_to_be32(host->wr_blocks);
+		mmc_emu_reg(host, 4);
+		cmd->resp[0] = r1;
+		return 1;
+	case SD_APP_OP_COND:
+		if (state != MMC_EMU_IDLE && state != MMC_EMU_READY)
+			break;
+		cmd->resp[0] = MMC_EMU_OCR | MMC_CARD_BUSY;
+		if (host->hc)
+			cmd->resp[0] |= 1 << 30;	/* CCS */
+		if (cmd->arg)
+			host->state = MMC_EMU_READY;
+		return 1;
+	case SD_APP_SEND_SCR:
+		if (state != MMC_EMU_TRAN)
+			break;
+		memset(host->buf, 0, 8);
+		host->buf[0] = SCR_SPEC_VER_2;
+		host->buf[1] = SD_SCR_BUS_WIDTH_1 | SD_SCR_BUS_WIDTH_4;
+		mmc_emu_reg(host, 8);
+		cmd->resp[0] = r1;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Carry out a command at time *now, which is moved on by the time the
+ * command takes.  Commands the card does not answer time out.
+ */
+static void mmc_emu_command(struct mmc_emu_host *host,
+	struct mmc_command *cmd, u64 *now)
+{
+	unsigned int state = host->state;
+	int app = host->app_cmd;
+	int addressed = (cmd->arg >> 16) == host->rca;
+	u32 r1;
+
+	*now += mmc_emu_clocks(host, MMC_EMU_CMD_CLOCKS +
+		(cmd->flags & MMC_RSP_136 ? 136 : 48));
+
+	cmd->error = 0;
+	memset(cmd->resp, 0, sizeof(cmd->resp));
+	if (cmd->opcode == fail_opcode && mmc_emu_should_fail(host)) {
+		cmd->error = -fail_error;
+		return;
+	}
+
+	r1 = mmc_emu_r1(host, *now);
+	host->app_cmd = 0;
+	host->xfer = MMC_EMU_XFER_NONE;
+
+	if (sd && app && mmc_emu_app_command(host, cmd, r1))
+		return;
+
+	switch (cmd->opcode) {
+	case MMC_GO_IDLE_STATE:
+		mmc_emu_reset(host);
+		return;
+	case MMC_SEND_OP_COND:
+		if (sd || state > MMC_EMU_READY)
+			break;
+		cmd->resp[0] = MMC_EMU_OCR | MMC_CARD_BUSY | (host->hc ?
+			MMC_OCR_REG_ACCESS_MODE_SECTOR :
+			MMC_OCR_REG_ACCESS_MODE_BYTE);
+		if (cmd->arg)
+			host->state = MMC_EMU_READY;
+		return;
+	case MMC_ALL_SEND_CID:
+		if (state != MMC_EMU_READY)
+			break;
+		memcpy(cmd->resp, host->cid, sizeof(host->cid));
+		host->state = MMC_EMU_IDENT;
+		return;
+	case MMC_SET_RELATIVE_ADDR:
+		if (state != MMC_EMU_IDENT &&
+		    !(sd && state == MMC_EMU_STBY))
+			break;
+		if (sd) {
+			host->rca = MMC_EMU_SD_RCA;
+			cmd->resp[0] = host->rca << 16 | (r1 & 0x1fff);
+		} else {
+			host->rca = cmd->arg >> 16;
+			cmd->resp[0] = r1;
+		}
+		host->state = MMC_EMU_STBY;
+		return;
+	case MMC_SLEEP_AWAKE:
+		/* also the SDIO probe, which we must not answer */
+		if (sd || !addressed ||
+		    (state != MMC_EMU_STBY && state != MMC_EMU_SLP))
+			break;
+		host->state = cmd->arg & (1 << 15) ?
+			MMC_EMU_SLP : MMC_EMU_STBY;
+		cmd->resp[0] = r1;
+		return;
+	case MMC_SWITCH:
+		if (state != MMC_EMU_TRAN)
+			break;
+		cmd->resp[0] = r1;
+		if (sd)
+			mmc_emu_sd_switch(host, cmd->arg);
+		else
+			mmc_emu_mmc_switch(host, cmd->arg);
+		return;
+	case MMC_SELECT_CARD:
+		if (addressed && host->rca) {
+			if (state != MMC_EMU_STBY && state != MMC_EMU_TRAN)
+				break;
+			host->state = MMC_EMU_TRAN;
+			cmd->resp[0] = r1;
+		} else if (state == MMC_EMU_TRAN) {
+			/* deselected, and not the one to answer */
+			host->state = MMC_EMU_STBY;
+		}
+		return;
+	case MMC_SEND_EXT_CSD:
+		/* SD_SEND_IF_COND */
+		if (sd) {
+			if (state != MMC_EMU_IDLE)
+				break;
+			cmd->resp[0] = cmd->arg & 0xfff;
+			return;
+		}
+		if (state != MMC_EMU_TRAN)
+			break;
+		memcpy(host->buf, host->ext_csd, 512);
+		mmc_emu_reg(host, 512);
+		cmd->resp[0] = r1;
+		return;
+	case MMC_SEND_CSD:
+	case MMC_SEND_CID:
+		if (!addressed || state != MMC_EMU_STBY)
+			break;
+		memcpy(cmd->resp, cmd->opcode == MMC_SEND_CSD ?
+			host->csd : host->cid, sizeof(cmd->resp));
+		return;
+	case MMC_STOP_TRANSMISSION:
+		if (state != MMC_EMU_DATA && state != MMC_EMU_RCV)
+			break;
+		host->state = MMC_EMU_TRAN;
+		cmd->resp[0] = r1;
+		return;
+	case MMC_SEND_STATUS:
+		if (!addressed || state < MMC_EMU_STBY)
+			break;
+		cmd->resp[0] = r1;
+		return;
+	case MMC_SET_BLOCKLEN:
+		if (state != MMC_EMU_TRAN)
+			break;
+		if (!cmd->arg || cmd->arg > 512)
+			host->status |= R1_BLOCK_LEN_ERROR;
+		else
+			host->blklen = cmd->arg;
+		cmd->resp[0] = r1;
+		return;
+	case MMC_READ_SINGLE_BLOCK:
+	case MMC_READ_MULTIPLE_BLOCK:
+	case MMC_WRITE_BLOCK:
+	case MMC_WRITE_MULTIPLE_BLOCK:
+		if (state != MMC_EMU_TRAN)
+			break;
+		mmc_emu_rw(host, cmd, cmd->opcode >= MMC_WRITE_BLOCK,
+			cmd->opcode == MMC_READ_MULTIPLE_BLOCK ||
+			cmd->opcode == MMC_WRITE_MULTIPLE_BLOCK);
+		cmd->resp[0] = r1;
+		return;
+	case MMC_SET_BLOCK_COUNT:
+		if (sd || state != MMC_EMU_TRAN)
+			break;
+		host->sbc = cmd->arg;
+		cmd->resp[0] = r1;
+		return;
+	case SD_ERASE_WR_BLK_START:
+	case SD_ERASE_WR_BLK_END:
+	case MMC_ERASE_GROUP_START:
+	case MMC_ERASE_GROUP_END:
+		if (state != MMC_EMU_TRAN ||
+		    (sd != (cmd->opcode < MMC_ERASE_GROUP_START)))
+			break;
+		if (cmd->opcode == SD_ERASE_WR_BLK_START ||
+		    cmd->opcode == MMC_ERASE_GROUP_START)
+			host->erase_start = cmd->arg;
+		else
+			host->erase_end = cmd->arg;
+		cmd->resp[0] = r1;
+		return;
+	case MMC_ERASE:
+		if (state != MMC_EMU_TRAN)
+			break;
+		if (mmc_emu_erase(host))
+			host->status |= R1_ERASE_PARAM;
+		host->busy_until = *now + (u64)prog_us * NSEC_PER_USEC;
+		cmd->resp[0] = r1;
+		return;
+	case MMC_APP_CMD:
+		if (!sd || !addressed)
+			break;
+		host->app_cmd = 1;
+		cmd->resp[0] = r1 | R1_APP_CMD;
+		return;
+	}
+
+	pr_debug("%s: CMD%u %08x not answered in state %u\n",
+		 mmc_hostname(host->mmc), cmd->opcode, cmd->arg, state);
+	if (cmd->flags & MMC_RSP_PRESENT)
+		cmd->error = -ETIMEDOUT;
+}
+
+/*
+ * The header block of a packed write lists the entries that follow it,
+ * each as the argument of the CMD23 and CMD25 it stands for.
+ */
+static int mmc_emu_packed(struct mmc_emu_host *host,
+	struct sg_mapping_iter *miter, unsigned int blocks)
+{
+	__le32 *hdr = (__le32 *)host->buf;
+	unsigned int i, n, count, total = 0;
+	u64 pos;
+	int ret;
+
+	ret = mmc_emu_sg_io(host, miter, host->buf, 0, 512, 1);
+	if (ret)
+		return ret;
+
+	n = host->buf[2];
+	if (host->buf[0] != MMC_PACKED_VER || host->buf[1] != MMC_PACKED_WR ||
+	    !n || n > host->ext_csd[EXT_CSD_MAX_PACKED_WRITES])
+		return -EINVAL;
+
+	for (i = 1; i <= n; i++) {
+		count = le32_to_cpu(hdr[i * 2]) & 0xffff;
+		pos = mmc_emu_pos(host, le32_to_cpu(hdr[i * 2 + 1]));
+		total += count;
+		if (total > blocks - 1 || pos + count * 512 > host->size)
+			return -EINVAL;
+	}
+	if (total != blocks - 1)
+		return -EINVAL;
+
+	/* with no bounce buffer the entries go straight to the image */
+	for (i = 1; i <= n; i++) {
+		count = le32_to_cpu(hdr[i * 2]) & 0xffff;
+		pos = mmc_emu_pos(host, le32_to_cpu(hdr[i * 2 + 1]));
+		ret = mmc_emu_sg_io(host, miter, NULL, pos, count * 512, 1);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Send a register
+ */
+static int mmc_emu_reg_data(struct mmc_emu_host *host, struct mmc_data *data,
+	struct sg_mapping_iter *miter, u64 *now)
+{
+	unsigned int len = min(data->blocks * data->blksz, host->xfer_len);
+	int err;
+
+	host->state = MMC_EMU_TRAN;
+	err = mmc_emu_sg_io(host, miter, host->buf, 0, len, 0);
+	if (err)
+		return err;
+
+	*now += mmc_emu_bus_ns(host, 1, len);
+	data->bytes_xfered = len;
+	if (len < data->blocks * data->blksz)
+		return -ETIMEDOUT;
+
+	return 0;
+}
+
+/*
+ * Carry out the data part of a request, from time *now on.
+ */
+static void mmc_emu_data(struct mmc_emu_host *host, struct mmc_data *data,
+	u64 *now)
+{
+	struct sg_mapping_iter miter;
+	int write = host->xfer == MMC_EMU_XFER_WRITE ||
+		host->xfer == MMC_EMU_XFER_PACKED;
+	unsigned int blocks = host->xfer_blocks;
+	unsigned int blksz = data->blksz;
+	int err = 0;
+
+	data->bytes_xfered = 0;
+	data->error = 0;
+
+	if (host->xfer == MMC_EMU_XFER_NONE ||
+	    write != !!(data->flags & MMC_DATA_WRITE)) {
+		data->error = -ETIMEDOUT;
+		return;
+	}
+
+	sg_miter_start(&miter, data->sg, data->sg_len,
+		       write ? SG_MITER_FROM_SG : SG_MITER_TO_SG);
+
+	if (host->xfer == MMC_EMU_XFER_REG) {
+		err = mmc_emu_reg_data(host, data, &miter, now);
+		goto out;
+	}
+
+	/* the card moves blocks of its own length */
+	if (blksz != (host->hc ? 512 : host->blklen)) {
+		err = -EILSEQ;
+		goto out;
+	}
+
+	if (!blocks || blocks > data->blocks)
+		blocks = data->blocks;
+	if (host->xfer_pos + (u64)blocks * blksz > host->size) {
+		host->status |= R1_OUT_OF_RANGE;
+		blocks = host->xfer_pos < host->size ?
+			div_u64(host->size - host->xfer_pos, blksz) : 0;
+	}
+
+	if (fail_opcode < 0 && mmc_emu_should_fail(host)) {
+		err = -fail_error;
+		goto out;
+	}
+
+	if (host->xfer == MMC_EMU_XFER_PACKED) {
+		err = blocks == data->blocks ?
+			mmc_emu_packed(host, &miter, blocks) : -EINVAL;
+		if (err) {
+			host->status |= R1_ERROR;
+			err = -EIO;
+			goto out;
+		}
+	} else {
+		err = mmc_emu_sg_io(host, &miter, NULL, host->xfer_pos,
+			blocks * blksz, write);
+		if (err)
+			goto out;
+	}
+
+	data->bytes_xfered = blocks * blksz;
+	if (blocks < data->blocks)
+		err = -ETIMEDOUT;
+	else if (host->xfer_blocks)
+		host->state = MMC_EMU_TRAN;
+
+	*now += mmc_emu_data_ns(host, blocks, blksz, write);
+	if (write) {
+		u64 prog = prog_us;
+
+		if (switch_us && switch_kb) {
+			u64 block = div_u64(host->xfer_pos, switch_kb << 10);
+
+			if (block != host->wr_block)
+				prog += switch_us;
+			host->wr_block = block;
+		}
+		host->wr_blocks = blocks;
+		host->busy_until = *now + prog * NSEC_PER_USEC;
+	}
+
+out:
+	sg_miter_stop(&miter);
+	data->error = err;
+	host->xfer = MMC_EMU_XFER_NONE;
+}
+
+static void mmc_emu_work(struct work_struct *work)
+{
+	struct mmc_emu_host *host =
+		container_of(work, struct mmc_emu_host, work);
+	struct mmc_request *mrq = host->mrq;
+	u64 now = ktime_to_ns(ktime_get());
+	int busy;
+
+	mmc_emu_command(host, mrq->cmd, &now);
+	busy = mrq->cmd->flags & MMC_RSP_BUSY;
+
+	if (mrq->data) {
+		if (!mrq->cmd->error)
+			mmc_emu_data(host, mrq->data, &now);
+		else
+			mrq->data->bytes_xfered = 0;
+		if (mrq->stop) {
+			mmc_emu_command(host, mrq->stop, &now);
+			busy = mrq->stop->flags & MMC_RSP_BUSY;
+		}
+	}
+
+	/* R1b: the host waits for the card */
+	if (busy && now < host->busy_until)
+		now = host->busy_until;
+
+	hrtimer_start(&host->timer, ns_to_ktime(now), HRTIMER_MODE_ABS);
+}
+
+static enum hrtimer_restart mmc_emu_done(struct hrtimer *timer)
+{
+	struct mmc_emu_host *host =
+		container_of(timer, struct mmc_emu_host, timer);
+	struct mmc_request *mrq = host->mrq;
+
+	host->mrq = NULL;
+	mmc_request_done(host->mmc, mrq);
+
+	return HRTIMER_NORESTART;
+}
+
+static void mmc_emu_request(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct mmc_emu_host *host = mmc_priv(mmc);
+
+	WARN_ON(host->mrq != NULL);
+	host->mrq = mrq;
+	queue_work(host->workqueue, &host->work);
+}
+
+static void mmc_emu_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
+{
+	struct mmc_emu_host *host = mmc_priv(mmc);
+
+	/* the bus timings are taken from mmc->ios as requests come */
+	if (ios->power_mode == MMC_POWER_OFF)
+		mmc_emu_reset(host);
+}
+
+static const struct mmc_host_ops mmc_emu_ops = {
+	.request	= mmc_emu_request,
+	.set_ios	= mmc_emu_set_ios,
+};
+
+static int mmc_emu_open(struct mmc_emu_host *host)
+{
+	struct file *filp;
+
+	if (!image) {
+		host->size = (u64)size_mb << 20;
+		host->ram = vmalloc(host->size);
+		if (!host->ram)
+			return -ENOMEM;
+		memset(host->ram, 0, host->size);
+		return 0;
+	}
+
+	filp = filp_open(image, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(filp)) {
+		printk(KERN_ERR DRIVER_NAME ": unable to open %s\n", image);
+		return PTR_ERR(filp);
+	}
+
+	host->filp = filp;
+	host->size = i_size_read(filp->f_mapping->host);
+	if (host->size < 1024 * 1024) {
+		printk(KERN_ERR DRIVER_NAME ": %s is under 1 MiB\n", image);
+		filp_close(filp, NULL);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void mmc_emu_close(struct mmc_emu_host *host)
+{
+	if (host->filp)
+		filp_close(host->filp, NULL);
+	else
+		vfree(host->ram);
+}
+
+static int __devinit mmc_emu_probe(struct platform_device *pdev)
+{
+	struct mmc_host *mmc;
+	struct mmc_emu_host *host;
+	int ret;
+
+	mmc = mmc_alloc_host(sizeof(struct mmc_emu_host), &pdev->dev);
+	if (!mmc)
+		return -ENOMEM;
+
+	host = mmc_priv(mmc);
+	host->mmc = mmc;
+	INIT_WORK(&host->work, mmc_emu_work);
+	hrtimer_init(&host->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	host->timer.function = mmc_emu_done;
+
+	ret = mmc_emu_open(host);
+	if (ret)
+		goto err_free;
+
+	host->workqueue = create_singlethread_workqueue(DRIVER_NAME);
+	if (!host->workqueue) {
+		ret = -ENOMEM;
+		goto err_close;
+	}
+
+	mmc_emu_init_card(host);
+	mmc_emu_reset(host);
+
+	mmc->ops = &mmc_emu_ops;
+	mmc->f_min = 400000;
+	mmc->f_max = f_max;
+	mmc->ocr_avail = MMC_VDD_32_33 | MMC_VDD_33_34;
+	mmc->caps = MMC_CAP_MMC_HIGHSPEED | MMC_CAP_SD_HIGHSPEED |
+		    MMC_CAP_WAIT_WHILE_BUSY | MMC_CAP_CMD23;
+	if (bus_width >= 4)
+		mmc->caps |= MMC_CAP_4_BIT_DATA;
+	if (bus_width >= 8)
+		mmc->caps |= MMC_CAP_8_BIT_DATA;
+
+	mmc->max_hw_segs = 128;
+	mmc->max_phys_segs = 128;
+	mmc->max_blk_size = 512;
+	mmc->max_blk_count = 2048;
+	mmc->max_req_size = mmc->max_blk_size * mmc->max_blk_count;
+	mmc->max_seg_size = mmc->max_req_size;
+
+	platform_set_drvdata(pdev, mmc);
+
+	ret = mmc_add_host(mmc);
+	if (ret)
+		goto err_wq;
+
+	printk(KERN_INFO "%s: emulated %s%s card of %llu MiB in %s\n",
+	       mmc_hostname(mmc), sd ? "SD" : "eMMC", host->hc ? "" :
+	       " byte addressed", (unsigned long long)host->size >> 20,
+	       image ? image : "memory");
+
+	return 0;
+
+err_wq:
+	platform_set_drvdata(pdev, NULL);
+	destroy_workqueue(host->workqueue);
+err_close:
+	mmc_emu_close(host);
+err_free:
+	mmc_free_host(mmc);
+	return ret;
+}
+
+static int __devexit mmc_emu_remove(struct platform_device *pdev)
+{
+	struct mmc_host *mmc = platform_get_drvdata(pdev);
+	struct mmc_emu_host *host = mmc_priv(mmc);
+
+	platform_set_drvdata(pdev, NULL);
+
+	mmc_remove_host(mmc);
+	destroy_workqueue(host->workqueue);
+	hrtimer_cancel(&host->timer);
+	mmc_emu_close(host);
+	mmc_free_host(mmc);
+
+	return 0;
+}
+
+static struct platform_driver mmc_emu_driver = {
+	.probe		= mmc_emu_probe,
+	.remove		= __devexit_p(mmc_emu_remove),
+	.driver		= {
+		.name	= DRIVER_NAME,
+		.owner	= THIS_MODULE,
+	},
+};
+
+static struct platform_device *mmc_emu_device;
+
+static int __init mmc_emu_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&mmc_emu_driver);
+	if (ret)
+		return ret;
+
+	mmc_emu_device = platform_device_register_simple(DRIVER_NAME, -1,
+							 NULL, 0);
+	if (IS_ERR(mmc_emu_device)) {
+		platform_driver_unregister(&mmc_emu_driver);
+		return PTR_ERR(mmc_emu_device);
+	}
+
+	return 0;
+}
+
+static void __exit mmc_emu_exit(void)
+{
+	platform_device_unregister(mmc_emu_device);
+	platform_driver_unregister(&mmc_emu_driver);
+}
+
+module_init(mmc_emu_init);
+module_exit(mmc_emu_exit);
+
+MODULE_DESCRIPTION("Emulated MMC/SD host and card");
+MODULE_LICENSE("GPL");
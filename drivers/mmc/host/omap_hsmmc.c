@@ -125,6 +125,9 @@
 #define OMAP_MMC_MASTER_CLOCK	96000000
 #define DRIVER_NAME		"mmci-omap-hs"
 
+/* Logical DMA channels linked per host: one running, the rest queued */
+#define OMAP_HSMMC_DMA_CHAIN_LEN	4
+
 /* Timeouts for entering power saving states on inactivity, msec */
 #define OMAP_MMC_DISABLED_TIMEOUT	100
 #define OMAP_MMC_SLEEP_TIMEOUT		1000
@@ -164,6 +167,7 @@ struct omap_hsmmc_host {
 	unsigned int		id;
 	unsigned int		dma_len;
 	unsigned int		dma_sg_idx;
+	unsigned int		dma_sg_done;
 	unsigned char		bus_mode;
 	unsigned char		power_mode;
 	u32			*buffer;
@@ -171,6 +175,7 @@ struct omap_hsmmc_host {
 	int			suspended;
 	int			irq;
 	int			use_dma, dma_ch;
+	int			dma_chain;
 	int			dma_line_tx, dma_line_rx;
 	int			slot_id;
 	int			got_dbclk;
@@ -521,7 +526,7 @@ omap_hsmmc_xfer_done(struct omap_hsmmc_host *host, struct mmc_data *data)
 
 	host->data = NULL;
 
-	if (host->use_dma && host->dma_ch != -1)
+	if (host->use_dma && host->dma_ch != -1 && !data->host_cookie)
 		dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
 			omap_hsmmc_get_dma_dir(host, data));
 
@@ -572,9 +577,11 @@ static void omap_hsmmc_dma_cleanup(struct omap_hsmmc_host *host, int errno)
 	host->data->error = errno;
 
 	if (host->use_dma && host->dma_ch != -1) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg, host->dma_len,
-			omap_hsmmc_get_dma_dir(host, host->data));
-		omap_free_dma(host->dma_ch);
+		if (!host->data->host_cookie)
+			dma_unmap_sg(mmc_dev(host->mmc), host->data->sg,
+				host->dma_len,
+				omap_hsmmc_get_dma_dir(host, host->data));
+		omap_stop_dma_chain_transfers(host->dma_ch);
 		host->dma_ch = -1;
 		up(&host->sem);
 	}
@@ -882,38 +889,66 @@ static int omap_hsmmc_get_dma_sync_dev(struct omap_hsmmc_host *host,
 	return sync_dev;
 }
 
-static void omap_hsmmc_config_dma_params(struct omap_hsmmc_host *host,
-				       struct mmc_data *data,
-				       struct scatterlist *sgl)
+/*
+ * The channel parameters common to all segments of a transfer.  Only the
+ * buffer address and the block count are written per segment, so these
+ * are set for every transfer: a CORE off clears the channels, and the
+ * context loss count does not always tell.
+ */
+static void omap_hsmmc_config_dma_chain(struct omap_hsmmc_host *host,
+					struct mmc_data *data)
 {
-	int blksz, nblk, dma_ch;
-
-	dma_ch = host->dma_ch;
-	if (data->flags & MMC_DATA_WRITE) {
-		omap_set_dma_dest_params(dma_ch, 0, OMAP_DMA_AMODE_CONSTANT,
-			(host->mapbase + OMAP_HSMMC_DATA), 0, 0);
-		omap_set_dma_src_params(dma_ch, 0, OMAP_DMA_AMODE_POST_INC,
-			sg_dma_address(sgl), 0, 0);
+	struct omap_dma_channel_params params;
+	int dir = !!(data->flags & MMC_DATA_WRITE);
+
+	memset(&params, 0, sizeof(params));
+	params.data_type = OMAP_DMA_DATA_TYPE_S32;
+	params.elem_count = data->blksz / 4;
+	params.frame_count = 1;
+	params.sync_mode = OMAP_DMA_SYNC_FRAME;
+	params.trigger = omap_hsmmc_get_dma_sync_dev(host, data);
+	params.src_or_dst_synch = !dir;
+	if (dir) {
+		params.src_amode = OMAP_DMA_AMODE_POST_INC;
+		params.dst_amode = OMAP_DMA_AMODE_CONSTANT;
+		params.dst_start = host->mapbase + OMAP_HSMMC_DATA;
 	} else {
-		omap_set_dma_src_params(dma_ch, 0, OMAP_DMA_AMODE_CONSTANT,
-			(host->mapbase + OMAP_HSMMC_DATA), 0, 0);
-		omap_set_dma_dest_params(dma_ch, 0, OMAP_DMA_AMODE_POST_INC,
-			sg_dma_address(sgl), 0, 0);
+		params.src_amode = OMAP_DMA_AMODE_CONSTANT;
+		params.src_start = host->mapbase + OMAP_HSMMC_DATA;
+		params.dst_amode = OMAP_DMA_AMODE_POST_INC;
 	}
 
-	blksz = host->data->blksz;
-	nblk = sg_dma_len(sgl) / blksz;
+	omap_modify_dma_chain_params(host->dma_chain, params);
+}
 
-	omap_set_dma_transfer_params(dma_ch, OMAP_DMA_DATA_TYPE_S32,
-			blksz / 4, nblk, OMAP_DMA_SYNC_FRAME,
-			omap_hsmmc_get_dma_sync_dev(host, data),
-			!(data->flags & MMC_DATA_WRITE));
+/*
+ * Queue the next segment of the scatterlist on the chain.  A free
+ * channel is linked behind the one running, so the DMA controller moves
+ * on to it by itself when the running one completes.
+ */
+static int omap_hsmmc_queue_dma_sg(struct omap_hsmmc_host *host,
+				   struct mmc_data *data)
+{
+	struct scatterlist *sgl = data->sg + host->dma_sg_idx;
+	int src, dst, ret;
+
+	if (data->flags & MMC_DATA_WRITE) {
+		src = sg_dma_address(sgl);
+		dst = host->mapbase + OMAP_HSMMC_DATA;
+	} else {
+		src = host->mapbase + OMAP_HSMMC_DATA;
+		dst = sg_dma_address(sgl);
+	}
 
-	omap_start_dma(dma_ch);
+	ret = omap_dma_chain_a_transfer(host->dma_chain, src, dst,
+			data->blksz / 4, sg_dma_len(sgl) / data->blksz, host);
+	if (ret == 0)
+		host->dma_sg_idx++;
+	return ret;
 }
 
 /*
- * DMA call back function
+ * DMA call back function, once for each completed segment
  */
 static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *data)
 {
@@ -925,15 +960,14 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *data)
 	if (host->dma_ch < 0)
 		return;
 
-	host->dma_sg_idx++;
-	if (host->dma_sg_idx < host->dma_len) {
-		/* Fire up the next transfer. */
-		omap_hsmmc_config_dma_params(host, host->data,
-					   host->data->sg + host->dma_sg_idx);
+	/* Refill the channel that just completed. */
+	host->dma_sg_done++;
+	if (host->dma_sg_idx < host->dma_len)
+		omap_hsmmc_queue_dma_sg(host, host->data);
+	if (host->dma_sg_done < host->dma_len)
 		return;
-	}
 
-	omap_free_dma(host->dma_ch);
+	omap_stop_dma_chain_transfers(host->dma_ch);
 	host->dma_ch = -1;
 	/*
 	 * DMA Callback: run in interrupt context.
@@ -948,7 +982,7 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *data)
 static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
 					struct mmc_request *req)
 {
-	int dma_ch = 0, ret = 0, err = 1, i;
+	int ret = 0, err = 1, i;
 	struct mmc_data *data = req->data;
 
 	/* Sanity check: all the SG entries must be aligned by block size. */
@@ -967,14 +1001,14 @@ static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
 
 	/*
 	 * If for some reason the DMA transfer is still active,
-	 * we free the dma directly without waiting, as the last
+	 * we stop the dma directly without waiting, as the last
 	 * request should already reported err for this dma transfer
 	 *
 	 * One possibility we arrive here is _cb not called
 	 */
 	if (host->dma_ch != -1) {
 		if (down_trylock(&host->sem)) {
-			omap_free_dma(host->dma_ch);
+			omap_stop_dma_chain_transfers(host->dma_ch);
 			host->dma_ch = -1;
 			up(&host->sem);
 			return err;
@@ -984,21 +1018,42 @@ static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
 			return err;
 	}
 
-	ret = omap_request_dma(omap_hsmmc_get_dma_sync_dev(host, data),
-			       "MMC/SD", omap_hsmmc_dma_cb, host, &dma_ch);
+	/* already mapped by omap_hsmmc_pre_req() if it has a cookie */
+	if (data->host_cookie)
+		host->dma_len = data->host_cookie;
+	else
+		host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
+	host->dma_ch = host->dma_chain;
+	host->dma_sg_idx = 0;
+	host->dma_sg_done = 0;
+
+	omap_hsmmc_config_dma_chain(host, data);
+
+	/*
+	 * Start the chain on the first segment, then link as many of the
+	 * following ones as there are channels.  The interrupts of the
+	 * channels are only enabled as they are queued on a running chain.
+	 */
+	ret = omap_hsmmc_queue_dma_sg(host, data);
+	if (ret == 0)
+		ret = omap_start_dma_chain_transfers(host->dma_chain);
 	if (ret != 0) {
-		dev_err(mmc_dev(host->mmc),
-			"%s: omap_request_dma() failed with %d\n",
-			mmc_hostname(host->mmc), ret);
+		dev_err(mmc_dev(host->mmc), "%s: DMA chain start failed "
+			"with %d\n", mmc_hostname(host->mmc), ret);
+		omap_stop_dma_chain_transfers(host->dma_chain);
+		if (!data->host_cookie)
+			dma_unmap_sg(mmc_dev(host->mmc), data->sg,
+				data->sg_len,
+				omap_hsmmc_get_dma_dir(host, data));
+		host->dma_ch = -1;
+		up(&host->sem);
 		return ret;
 	}
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
-	host->dma_ch = dma_ch;
-	host->dma_sg_idx = 0;
-
-	omap_hsmmc_config_dma_params(host, data, data->sg);
+	while (host->dma_sg_idx < host->dma_len &&
+	       omap_hsmmc_queue_dma_sg(host, data) == 0)
+		;
 
 	return 0;
 }
@@ -1134,6 +1189,38 @@ static void omap_hsmmc_request(struct mmc_host *mmc, struct mmc_request *req)
 	omap_hsmmc_start_command(host, req->cmd, req->data);
 }
 
+/*
+ * Map the data of the next request, and do the cache maintenance that
+ * goes with it, while the current one is being transferred.  The number
+ * of mapped entries is kept in host_cookie for the request path to use.
+ */
+static void omap_hsmmc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			       bool is_first_req)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!host->use_dma || !data || data->host_cookie)
+		return;
+
+	data->host_cookie = dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+				       omap_hsmmc_get_dma_dir(host, data));
+}
+
+static void omap_hsmmc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				int err)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		     omap_hsmmc_get_dma_dir(host, data));
+	data->host_cookie = 0;
+}
+
 /* Routine to configure clock values. Exposed API to core */
 static void omap_hsmmc_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
 {
@@ -1552,6 +1639,8 @@ static const struct mmc_host_ops omap_hsmmc_ops = {
 	.enable = omap_hsmmc_enable_fclk,
 	.disable = omap_hsmmc_disable_fclk,
 	.request = omap_hsmmc_request,
+	.pre_req = omap_hsmmc_pre_req,
+	.post_req = omap_hsmmc_post_req,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
 	.get_ro = omap_hsmmc_get_ro,
@@ -1565,6 +1654,8 @@ static const struct mmc_host_ops omap_hsmmc_ps_ops = {
 	.enable = omap_hsmmc_enable,
 	.disable = omap_hsmmc_disable,
 	.request = omap_hsmmc_request,
+	.pre_req = omap_hsmmc_pre_req,
+	.post_req = omap_hsmmc_post_req,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
 	.get_ro = omap_hsmmc_get_ro,
@@ -1697,6 +1788,7 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 	struct omap_mmc_platform_data *pdata = pdev->dev.platform_data;
 	struct mmc_host *mmc;
 	struct omap_hsmmc_host *host = NULL;
+	struct omap_dma_channel_params dma_params;
 	struct resource *res;
 	int ret = 0, irq;
 
@@ -1815,8 +1907,8 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 							" clk failed\n");
 	}
 
-	/* Since we do only SG emulation, we can have as many segs
-	 * as we want. */
+	/* Segments are queued on the DMA chain as channels free up, so
+	 * we can have as many as we want. */
 	mmc->max_phys_segs = 1024;
 	mmc->max_hw_segs = 1024;
 
@@ -1826,7 +1918,7 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 	mmc->max_seg_size = mmc->max_req_size;
 
 	mmc->caps |= MMC_CAP_MMC_HIGHSPEED | MMC_CAP_SD_HIGHSPEED |
-		     MMC_CAP_WAIT_WHILE_BUSY;
+		     MMC_CAP_WAIT_WHILE_BUSY | MMC_CAP_CMD23;
 
 	switch (mmc_slot(host).wires) {
 	case 8:
@@ -1877,12 +1969,28 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 		goto err_irq;
 	}
 
+	/*
+	 * Keep a chain of linked logical channels for the lifetime of the
+	 * host, so that a scatterlist is transferred without the CPU
+	 * restarting the DMA for each segment.  The channel parameters are
+	 * set by each transfer.
+	 */
+	memset(&dma_params, 0, sizeof(dma_params));
+	ret = omap_request_dma_chain(host->dma_line_rx, "MMC/SD",
+				     omap_hsmmc_dma_cb, &host->dma_chain,
+				     OMAP_HSMMC_DMA_CHAIN_LEN,
+				     OMAP_DMA_DYNAMIC_CHAIN, dma_params);
+	if (ret) {
+		dev_err(mmc_dev(host->mmc), "Unable to get DMA channels\n");
+		goto err_irq;
+	}
+
 	/* Request IRQ for MMC operations */
 	ret = request_irq(host->irq, omap_hsmmc_irq, IRQF_DISABLED,
 			mmc_hostname(mmc), host);
 	if (ret) {
 		dev_dbg(mmc_dev(host->mmc), "Unable to grab HSMMC IRQ\n");
-		goto err_irq;
+		goto err_dma;
 	}
 
 	/* initialize power supplies, gpios, etc */
@@ -1952,6 +2060,8 @@ err_irq_cd:
 	free_irq(mmc_slot(host).card_detect_irq, host);
 err_irq_cd_init:
 	free_irq(host->irq, host);
+err_dma:
+	omap_free_dma_chain(host->dma_chain);
 err_irq:
 	mmc_host_disable(host->mmc);
 	clk_disable(host->iclk);
@@ -1986,6 +2096,7 @@ static int omap_hsmmc_remove(struct platform_device *pdev)
 		if (mmc_slot(host).card_detect_irq)
 			free_irq(mmc_slot(host).card_detect_irq, host);
 		flush_scheduled_work();
+		omap_free_dma_chain(host->dma_chain);
 
 		mmc_host_disable(host->mmc);
 		clk_disable(host->iclk);
@@ -40,7 +40,9 @@
  *
  * This is sometimes called "CDC ECM" (Ethernet Control Model) to support
  * TLA-soup.  "CDC ACM" (Abstract Control Model) is for modems, and a new
- * "CDC EEM" (Ethernet Emulation Model) is starting to spread.
+ * "CDC EEM" (Ethernet Emulation Model) is starting to spread, as is
+ * "CDC NCM" (Network Control Model), which packs several frames into
+ * each USB transfer.
  *
  * There's some hardware that can't talk CDC ECM.  We make that hardware
  * implement a "minimalist" vendor-agnostic CDC core:  same framing, but
@@ -115,6 +117,7 @@ static inline bool has_rndis(void)
 #include "rndis.c"
 #endif
 #include "f_eem.c"
+#include "f_ncm.c"
 #include "u_ether.c"
 
 /*-------------------------------------------------------------------------*/
@@ -259,8 +262,16 @@ static int use_eem;
 module_param(use_eem, bool, 0);
 MODULE_PARM_DESC(use_eem, "use CDC EEM mode");
 
+#ifdef CONFIG_USB_ETH_NCM
+static int use_ncm = 1;
+#else
+static int use_ncm;
+#endif
+module_param(use_ncm, bool, 0);
+MODULE_PARM_DESC(use_ncm, "use CDC NCM mode");
+
 /*
- * We _always_ have an ECM, CDC Subset, or EEM configuration.
+ * We _always_ have an ECM, CDC Subset, EEM, or NCM configuration.
  */
 static int __init eth_do_config(struct usb_configuration *c)
 {
@@ -273,6 +284,8 @@ static int __init eth_do_config(struct usb_configuration *c)
 
 	if (use_eem)
 		return eem_bind_config(c);
+	else if (use_ncm)
+		return ncm_bind_config(c, hostaddr);
 	else if (can_support_ecm(c->cdev->gadget))
 		return ecm_bind_config(c, hostaddr);
 	else
@@ -306,6 +319,9 @@ static int __init eth_bind(struct usb_composite_dev *cdev)
 		eth_config_driver.label = "CDC Ethernet (EEM)";
 		device_desc.idVendor = cpu_to_le16(EEM_VENDOR_NUM);
 		device_desc.idProduct = cpu_to_le16(EEM_PRODUCT_NUM);
+	} else if (use_ncm) {
+		/* NCM, which shares the ECM product ID */
+		eth_config_driver.label = "CDC Ethernet (NCM)";
 	} else if (can_support_ecm(cdev->gadget)) {
 		/* ECM */
 		eth_config_driver.label = "CDC Ethernet (ECM)";
@@ -41,6 +41,19 @@
 /* number of tx requests to allocate */
 #define TX_REQ_MAX 4
 
+/*
+ * Deeper and larger tx requests let adbd's writes queue up behind each
+ * other instead of waiting for the host to poll for each 4k.  read()s
+ * may also be up to buflen bytes.
+ */
+static unsigned int tx_reqs = TX_REQ_MAX * 2;
+module_param_named(adb_tx_reqs, tx_reqs, uint, S_IRUGO);
+MODULE_PARM_DESC(adb_tx_reqs, "number of write requests, 1 to 32");
+
+static unsigned int buflen = BULK_BUFFER_SIZE * 4;
+module_param_named(adb_buflen, buflen, uint, S_IRUGO);
+MODULE_PARM_DESC(adb_buflen, "size of each request buffer, 4k to 64k");
+
 #ifdef CONFIG_USB_MOT_ANDROID
 #define STRING_INTERFACE        0
 
@@ -85,6 +98,8 @@ struct adb_dev {
 	struct usb_request *rx_req;
 	int rx_done;
 	struct mutex adb_enable_mutex;
+
+	unsigned int buf_size;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -273,14 +288,14 @@ static int __init create_bulk_endpoints(struct adb_dev *dev,
 	dev->ep_out = ep;
 
 	/* now allocate requests for our endpoints */
-	req = adb_request_new(dev->ep_out, BULK_BUFFER_SIZE);
+	req = adb_request_new(dev->ep_out, dev->buf_size);
 	if (!req)
 		goto fail;
 	req->complete = adb_complete_out;
 	dev->rx_req = req;
 
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = adb_request_new(dev->ep_in, BULK_BUFFER_SIZE);
+	for (i = 0; i < clamp(tx_reqs, 1U, 32U); i++) {
+		req = adb_request_new(dev->ep_in, dev->buf_size);
 		if (!req)
 			goto fail;
 		req->complete = adb_complete_in;
@@ -305,7 +320,7 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "adb_read(%d)\n", count);
 
-	if (count > BULK_BUFFER_SIZE)
+	if (count > dev->buf_size)
 		return -EINVAL;
 
 	if (_lock(&dev->read_excl))
@@ -399,8 +414,8 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 
 		if (req != 0) {
-			if (count > BULK_BUFFER_SIZE)
-				xfer = BULK_BUFFER_SIZE;
+			if (count > dev->buf_size)
+				xfer = dev->buf_size;
 			else
 				xfer = count;
 			if (copy_from_user(req->buf, buf, xfer)) {
@@ -652,6 +667,8 @@ static int adb_bind_config(struct usb_configuration *c)
 	mutex_init(&dev->adb_enable_mutex);
 
 	INIT_LIST_HEAD(&dev->tx_idle);
+	dev->buf_size = clamp_t(unsigned int, buflen & PAGE_MASK,
+				BULK_BUFFER_SIZE, 65536);
 
 #ifdef CONFIG_USB_MOT_ANDROID
 	status = usb_string_id(c->cdev);
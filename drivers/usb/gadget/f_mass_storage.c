@@ -59,6 +59,7 @@
 #include <linux/kref.h>
 #include <linux/kthread.h>
 #include <linux/limits.h>
+#include <linux/mm.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
@@ -80,7 +81,7 @@
 #include "f_mot_android.h"
 #endif
 
-#define BULK_BUFFER_SIZE           4096
+#define BULK_BUFFER_SIZE           16384
 
 /*-------------------------------------------------------------------------*/
 
@@ -271,13 +272,28 @@ static struct lun *dev_to_lun(struct device *dev)
 /* Big enough to hold our biggest descriptor */
 #define EP0_BUFSIZE	256
 
-/* Number of buffers we will use.  2 is enough for double-buffering */
+/* Number of buffers we will use.  2 is enough for double-buffering,
+ * more keeps the controller busy while the backing file is read. */
+#define MAX_BUFFERS	16
 #ifdef CONFIG_USB_MOT_ANDROID
 #define NUM_BUFFERS     16
 #else
-#define NUM_BUFFERS	2
+#define NUM_BUFFERS	4
 #endif
 
+static unsigned int num_buffers = NUM_BUFFERS;
+module_param_named(ums_buffers, num_buffers, uint, S_IRUGO);
+MODULE_PARM_DESC(ums_buffers, "number of I/O buffers, 2 to 16");
+
+static unsigned int buflen = BULK_BUFFER_SIZE;
+module_param_named(ums_buflen, buflen, uint, S_IRUGO);
+MODULE_PARM_DESC(ums_buflen, "size of each I/O buffer, 4k to 64k");
+
+static int readahead = 1;
+module_param_named(ums_readahead, readahead, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ums_readahead,
+		"start reading all of a READ command's data at once");
+
 enum fsg_buffer_state {
 	BUF_STATE_EMPTY = 0,
 	BUF_STATE_FULL,
@@ -360,7 +376,8 @@ struct fsg_dev {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[NUM_BUFFERS];
+	unsigned int		num_buffers;
+	struct fsg_buffhd	buffhds[MAX_BUFFERS];
 
 	int			thread_wakeup_needed;
 	struct completion	thread_notifier;
@@ -807,6 +824,29 @@ static int sleep_thread(struct fsg_dev *fsg)
 
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Get the backing file reading all of a command's data before the first
+ * buffer is filled.  The I/O is only submitted here, so it proceeds while
+ * do_read() sends what has already arrived, instead of the file being
+ * read one buffer at a time as the buffers drain.
+ */
+static void start_readahead(struct fsg_dev *fsg, struct lun *curlun,
+		loff_t file_offset, u32 amount)
+{
+	struct file	*filp = curlun->filp;
+	pgoff_t		index, end;
+
+	if (!readahead || amount <= fsg->buf_size)
+		return;
+	amount = min((loff_t) amount, curlun->file_length - file_offset);
+	if (amount == 0)
+		return;
+	index = file_offset >> PAGE_CACHE_SHIFT;
+	end = (file_offset + amount - 1) >> PAGE_CACHE_SHIFT;
+	page_cache_sync_readahead(filp->f_mapping, &filp->f_ra, filp,
+			index, end - index + 1);
+}
+
 static int do_read(struct fsg_dev *fsg)
 {
 	struct lun		*curlun = fsg->curlun;
@@ -844,6 +884,7 @@ static int do_read(struct fsg_dev *fsg)
 	amount_left = fsg->data_size_from_cmnd;
 	if (unlikely(amount_left == 0))
 		return -EIO;		/* No default reply */
+	start_readahead(fsg, curlun, file_offset, amount_left);
 
 	for (;;) {
 
@@ -1031,6 +1072,7 @@ static int do_write(struct fsg_dev *fsg)
 			 * the bulk-out maxpacket size */
 			bh->outreq->length = bh->bulk_out_intended_length =
 					amount;
+			bh->outreq->short_not_ok = 1;
 			start_transfer(fsg, fsg->bulk_out, bh->outreq,
 					&bh->outreq_busy, &bh->state);
 			fsg->next_buffhd_to_fill = bh->next;
@@ -1763,6 +1805,7 @@ static int throw_away_data(struct fsg_dev *fsg)
 			 * the bulk-out maxpacket size */
 			bh->outreq->length = bh->bulk_out_intended_length =
 					amount;
+			bh->outreq->short_not_ok = 1;
 			start_transfer(fsg, fsg->bulk_out, bh->outreq,
 					&bh->outreq_busy, &bh->state);
 			fsg->next_buffhd_to_fill = bh->next;
@@ -2354,6 +2397,7 @@ static int get_next_command(struct fsg_dev *fsg)
 
 	/* Queue a request to read a Bulk-only CBW */
 	set_bulk_out_req_length(fsg, bh, USB_BULK_CB_WRAP_LEN);
+	bh->outreq->short_not_ok = 1;
 	start_transfer(fsg, fsg->bulk_out, bh->outreq,
 			&bh->outreq_busy, &bh->state);
 
@@ -2553,7 +2597,7 @@ static void handle_exception(struct fsg_dev *fsg)
 	 * state, and the exception.  Then invoke the handler. */
 	spin_lock_irq(&fsg->lock);
 
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		bh = &fsg->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2969,7 +3013,7 @@ fsg_function_unbind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Deallocate the requests */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd *bh = &fsg->buffhds[i];
 		if (bh->inreq) {
 			usb_ep_free_request(fsg->bulk_in, bh->inreq);
@@ -2982,7 +3026,7 @@ fsg_function_unbind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Free the data buffers */
-	for (i = 0; i < NUM_BUFFERS; ++i)
+	for (i = 0; i < fsg->num_buffers; ++i)
 		kfree(fsg->buffhds[i].buf);
 	switch_dev_unregister(&fsg->sdev);
 }
@@ -3090,7 +3134,7 @@ fsg_function_bind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Allocate the data buffers */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &fsg->buffhds[i];
 
 		/* Allocate for the bulk-in endpoint.  We assume that
@@ -3101,10 +3145,10 @@ fsg_function_bind(struct usb_configuration *c, struct usb_function *f)
 			goto out;
 		bh->next = bh + 1;
 	}
-	fsg->buffhds[NUM_BUFFERS - 1].next = &fsg->buffhds[0];
+	fsg->buffhds[fsg->num_buffers - 1].next = &fsg->buffhds[0];
 
 	/* Allocate the requests */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd       *bh = &fsg->buffhds[i];
 
 		rc = alloc_request(fsg, fsg->bulk_in, &bh->inreq);
@@ -3253,7 +3297,10 @@ int mass_storage_bind_config(struct usb_configuration *c)
 	kref_init(&fsg->ref);
 	init_completion(&fsg->thread_notifier);
 
-	the_fsg->buf_size = BULK_BUFFER_SIZE;
+	the_fsg->num_buffers = clamp_t(unsigned int, num_buffers, 2,
+				       MAX_BUFFERS);
+	the_fsg->buf_size = clamp_t(unsigned int, buflen & PAGE_CACHE_MASK,
+				    PAGE_CACHE_SIZE, 65536);
 	the_fsg->sdev.name = DRIVER_NAME;
 	the_fsg->sdev.print_name = print_switch_name;
 	the_fsg->sdev.print_state = print_switch_state;
@@ -32,6 +32,9 @@
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 #include <linux/proc_fs.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
 
 #include <linux/usb/ch9.h>
 #include <linux/usb/composite.h>
@@ -54,6 +57,8 @@
 #endif
 
 #define BULK_BUFFER_SIZE    8192
+/* bulk request buffers, larger than what write() sends for file transfers */
+#define BULK_REQ_SIZE       16384
 #define MIN(a, b)	((a < b) ? a : b)
 
 /*
@@ -154,7 +159,7 @@ static struct usb_descriptor_header *hs_mtp_descs[] = {
 };
 
 #define MAX_BULK_RX_REQ_NUM 8
-#define MAX_BULK_TX_REQ_NUM 4
+#define MAX_BULK_TX_REQ_NUM 8
 #define MAX_CTL_RX_REQ_NUM	8
 #define EHOSTRESET 0xFFFE
 
@@ -375,7 +380,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 			if (!req)
 				break;
 requeue_req:
-			req->length = BULK_BUFFER_SIZE;
+			req->length = BULK_REQ_SIZE;
 			mtp_debug("rx %p queue\n", req);
 			ret = usb_ep_queue(g_usb_mtp_context.bulk_out,
 				req, GFP_ATOMIC);
@@ -512,6 +517,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			}
 
 			req->length = xfer;
+			/* mtp_send_file() may have left it set */
+			req->zero = 0;
 			ret = usb_ep_queue(g_usb_mtp_context.bulk_in,
 				req, GFP_ATOMIC);
 			if (ret < 0) {
@@ -548,12 +555,226 @@ struct mtp_event_data {
 #define MTP_IOC_CANCEL_IO        _IO(MTP_IOC_MAGIC, 5)
 #define MTP_IOC_DEVICE_RESET     _IO(MTP_IOC_MAGIC, 6)
 
+/*
+ * Send or receive length bytes of the file open on fd, from offset, without
+ * passing them through userspace.  A non-zero command makes SEND_FILE
+ * start with the MTP data container header, so that header and data go out
+ * as one transfer.
+ */
+struct mtp_file_range {
+	int fd;
+	loff_t offset;
+	int64_t length;
+	uint16_t command;
+	uint32_t transaction_id;
+};
+
+#define MTP_IOC_SEND_FILE        _IOW(MTP_IOC_MAGIC, 7, struct mtp_file_range)
+#define MTP_IOC_RECEIVE_FILE     _IOW(MTP_IOC_MAGIC, 8, struct mtp_file_range)
+
+#define MTP_CONTAINER_HEADER_SIZE	12
+#define MTP_CONTAINER_TYPE_DATA		2
+
+static void start_out_receive(void);
+
+static void mtp_fill_header(u8 *buf, int64_t length, u16 command, u32 tid)
+{
+	__le32 len = cpu_to_le32(length > 0xffffffff ? 0xffffffff : length);
+	__le16 type = cpu_to_le16(MTP_CONTAINER_TYPE_DATA);
+	__le16 code = cpu_to_le16(command);
+	__le32 id = cpu_to_le32(tid);
+
+	memcpy(buf, &len, 4);
+	memcpy(buf + 4, &type, 2);
+	memcpy(buf + 6, &code, 2);
+	memcpy(buf + 8, &id, 4);
+}
+
+/*
+ * Reads the file straight into the tx requests and keeps all of them
+ * queued, so that the page cache is read ahead while the link is busy.
+ */
+static int mtp_send_file(struct mtp_file_range *range)
+{
+	struct usb_request *req;
+	struct file *filp;
+	mm_segment_t old_fs;
+	loff_t offset = range->offset;
+	int64_t count = range->length, total = range->length;
+	int header = 0, xfer, ret = 0;
+	ssize_t n;
+
+	if (count < 0)
+		return -EINVAL;
+	filp = fget(range->fd);
+	if (!filp)
+		return -EBADF;
+
+	if (range->command) {
+		header = MTP_CONTAINER_HEADER_SIZE;
+		total += header;
+	}
+	mtp_debug("fd=%d offset=%lld length=%lld\n", range->fd, offset, count);
+
+	while (count > 0 || header) {
+		if (g_usb_mtp_context.error) {
+			ret = -EIO;
+			break;
+		}
+
+		req = 0;
+		ret = wait_event_interruptible(g_usb_mtp_context.tx_wq,
+			((req = req_get(&g_usb_mtp_context.tx_reqs))
+			 || g_usb_mtp_context.cancel));
+		if (g_usb_mtp_context.cancel) {
+			mtp_debug("cancel return in mtp_send_file\n");
+			if (req != 0)
+				req_put(&g_usb_mtp_context.tx_reqs, req);
+			g_usb_mtp_context.cancel = 0;
+			ret = -EINVAL;
+			break;
+		}
+		if (ret < 0)
+			break;
+
+		xfer = 0;
+		if (header) {
+			mtp_fill_header(req->buf, total, range->command,
+					range->transaction_id);
+			xfer = header;
+			header = 0;
+		}
+		n = min_t(int64_t, count, BULK_REQ_SIZE - xfer);
+		if (n > 0) {
+			old_fs = get_fs();
+			set_fs(KERNEL_DS);
+			n = vfs_read(filp, (char __user *)req->buf + xfer, n,
+				     &offset);
+			set_fs(old_fs);
+			if (n <= 0) {
+				/* the file is shorter than announced */
+				req_put(&g_usb_mtp_context.tx_reqs, req);
+				ret = n ? n : -EIO;
+				break;
+			}
+			xfer += n;
+			count -= n;
+		}
+
+		req->length = xfer;
+		/* end the transfer with a short packet */
+		req->zero = !count;
+		ret = usb_ep_queue(g_usb_mtp_context.bulk_in, req, GFP_KERNEL);
+		if (ret < 0) {
+			mtp_err("error %d\n", ret);
+			g_usb_mtp_context.error = 1;
+			req_put(&g_usb_mtp_context.tx_reqs, req);
+			break;
+		}
+	}
+
+	fput(filp);
+	mtp_debug("returning %d, %lld bytes left\n", ret, count);
+	return ret;
+}
+
+/*
+ * Writes the next length bytes received to the file, starting with what
+ * read() left in the current request, from the rx requests themselves.
+ * The data phase ends with a short packet: one before length bytes is an
+ * error.  What the last request holds past length stays for read().
+ */
+static int mtp_receive_file(struct mtp_file_range *range)
+{
+	struct usb_request *req;
+	struct file *filp;
+	mm_segment_t old_fs;
+	loff_t offset = range->offset;
+	int64_t count = range->length;
+	int xfer, ret = 0, ended = 0;
+	ssize_t n;
+
+	if (count < 0)
+		return -EINVAL;
+	filp = fget(range->fd);
+	if (!filp)
+		return -EBADF;
+	mtp_debug("fd=%d offset=%lld length=%lld\n", range->fd, offset, count);
+
+	while (count > 0) {
+		if (g_usb_mtp_context.error) {
+			ret = -EIO;
+			break;
+		}
+
+		if (g_usb_mtp_context.data_len > 0) {
+			xfer = min_t(int64_t, count, g_usb_mtp_context.data_len);
+			old_fs = get_fs();
+			set_fs(KERNEL_DS);
+			n = vfs_write(filp, (const char __user *)
+				      g_usb_mtp_context.read_buf, xfer, &offset);
+			set_fs(old_fs);
+			if (n != xfer) {
+				ret = n < 0 ? n : -EIO;
+				break;
+			}
+			g_usb_mtp_context.read_buf += xfer;
+			g_usb_mtp_context.data_len -= xfer;
+			count -= xfer;
+
+			if (g_usb_mtp_context.data_len == 0) {
+				req_put(&g_usb_mtp_context.rx_reqs,
+						g_usb_mtp_context.cur_read_req);
+				g_usb_mtp_context.cur_read_req = 0;
+			}
+			continue;
+		}
+		if (ended) {
+			mtp_err("transfer ended %lld bytes short\n", count);
+			ret = -EIO;
+			break;
+		}
+
+		/* keep every idle request queued while we write */
+		start_out_receive();
+
+		req = 0;
+		ret = wait_event_interruptible(g_usb_mtp_context.rx_wq,
+			((req = req_get(&g_usb_mtp_context.rx_done_reqs))
+			 || g_usb_mtp_context.cancel));
+		if (g_usb_mtp_context.cancel) {
+			mtp_debug("cancel return in mtp_receive_file\n");
+			if (req != 0)
+				req_put(&g_usb_mtp_context.rx_reqs, req);
+			g_usb_mtp_context.cancel = 0;
+			ret = -EINVAL;
+			break;
+		}
+		if (ret < 0)
+			break;
+
+		ended = req->actual < req->length;
+		if (req->actual == 0) {
+			req_put(&g_usb_mtp_context.rx_reqs, req);
+			continue;
+		}
+		g_usb_mtp_context.cur_read_req = req;
+		g_usb_mtp_context.data_len = req->actual;
+		g_usb_mtp_context.read_buf = req->buf;
+	}
+
+	fput(filp);
+	mtp_debug("returning %d, %lld bytes left\n", ret, count);
+	return ret;
+}
+
 static int mtp_ioctl(struct inode *inode, struct file *file,
 		unsigned int cmd, unsigned long arg)
 {
 	int len, clen, count, n;
 	struct usb_request *req;
 	struct mtp_event_data event;
+	struct mtp_file_range range;
 
 	if (!g_usb_mtp_context.online)
 		return -EINVAL;
@@ -598,6 +819,13 @@ static int mtp_ioctl(struct inode *inode, struct file *file,
 			return -EINVAL;
 		}
 		break;
+	case MTP_IOC_SEND_FILE:
+	case MTP_IOC_RECEIVE_FILE:
+		if (copy_from_user(&range, (void __user *)arg, sizeof(range)))
+			return -EFAULT;
+		if (cmd == MTP_IOC_SEND_FILE)
+			return mtp_send_file(&range);
+		return mtp_receive_file(&range);
 	case MTP_IOC_GET_EP_SIZE_IN:
 		/* get endpoint buffer size for bulk in */
 		len = BULK_BUFFER_SIZE;
@@ -930,7 +1158,7 @@ mtp_function_bind(struct usb_configuration *c, struct usb_function *f)
 	rc = -ENOMEM;
 
 	for (n = 0; n < MAX_BULK_RX_REQ_NUM; n++) {
-		req = req_new(g_usb_mtp_context.bulk_out, BULK_BUFFER_SIZE);
+		req = req_new(g_usb_mtp_context.bulk_out, BULK_REQ_SIZE);
 		if (!req)
 			goto autoconf_fail;
 
@@ -940,7 +1168,7 @@ mtp_function_bind(struct usb_configuration *c, struct usb_function *f)
 		req_put(&g_usb_mtp_context.rx_reqs, req);
 	}
 	for (n = 0; n < MAX_BULK_TX_REQ_NUM; n++) {
-		req = req_new(g_usb_mtp_context.bulk_in, BULK_BUFFER_SIZE);
+		req = req_new(g_usb_mtp_context.bulk_in, BULK_REQ_SIZE);
 		if (!req)
 			goto autoconf_fail;
 
@@ -1019,7 +1247,7 @@ static void start_out_receive(void)
 
 	/* if we have idle read requests, get them queued */
 	while ((req = req_get(&g_usb_mtp_context.rx_reqs))) {
-		req->length = BULK_BUFFER_SIZE;
+		req->length = BULK_REQ_SIZE;
 		ret = usb_ep_queue(g_usb_mtp_context.bulk_out, req, GFP_ATOMIC);
 		if (ret < 0) {
 			mtp_err("error %d\n", ret);
@@ -0,0 +1,1094 @@
+/*
+ * f_ncm.c -- USB CDC Network (NCM) link function driver
+ *
+ * Copyright (C) 2003-2005,2008 David Brownell
+ * Copyright (C) 2008 Nokia Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* #define VERBOSE_DEBUG */
+
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/etherdevice.h>
+
+#include <asm/unaligned.h>
+
+#include "u_ether.h"
+
+
+/*
+ * This function is a "CDC Network Control Model" (CDC NCM) Ethernet link.
+ * The control model is that of ECM, and so is most of this code; but
+ * the data interface carries "NCM Transfer Blocks" (NTBs), each holding
+ * as many Ethernet frames as fit, instead of one frame per transfer.
+ * That saves a USB transaction and an interrupt per frame on both sides
+ * of the link, which is what limits throughput with small frames.
+ *
+ * Only the 16 bit NTB format is supported, without CRCs.  Towards the
+ * host an NTB goes out once it's full or when no more frames came for
+ * a while (u_ether's tx_flush_us); it's at most as large as the host
+ * asked for with SET_NTB_INPUT_SIZE, and ncm_ntb_in_max_size.
+ */
+
+struct ncm_ep_descs {
+	struct usb_endpoint_descriptor	*in;
+	struct usb_endpoint_descriptor	*out;
+	struct usb_endpoint_descriptor	*notify;
+};
+
+enum ncm_notify_state {
+	NCM_NOTIFY_NONE,		/* don't notify */
+	NCM_NOTIFY_CONNECT,		/* issue CONNECT next */
+	NCM_NOTIFY_SPEED,		/* issue SPEED_CHANGE next */
+};
+
+/* datagrams start on this boundary in the NTBs we send */
+#define NCM_NDP_IN_DIVISOR		4
+#define NCM_NDP_IN_ALIGN		4
+#define NCM_NTB_MAX_DGRAMS		32
+
+/* NDP16 length for n datagrams, counting the terminating entry */
+#define NCM_NDP16_LEN(n)	(sizeof(struct usb_cdc_ncm_ndp16) \
+				+ ((n) + 1) * sizeof(struct usb_cdc_ncm_dpe16))
+
+struct f_ncm {
+	struct gether			port;
+	u8				ctrl_id, data_id;
+
+	char				ethaddr[14];
+
+	struct ncm_ep_descs		fs;
+	struct ncm_ep_descs		hs;
+
+	struct usb_ep			*notify;
+	struct usb_endpoint_descriptor	*notify_desc;
+	struct usb_request		*notify_req;
+	u8				notify_state;
+	bool				is_open;
+
+	/* largest NTB the host takes, from SET_NTB_INPUT_SIZE */
+	u32				ntb_in_size;
+
+	/* the NTB being filled, and where its datagrams are */
+	struct sk_buff			*tx_skb;
+	unsigned			tx_max;
+	unsigned			tx_ndgrams;
+	struct usb_cdc_ncm_dpe16	tx_dpe[NCM_NTB_MAX_DGRAMS];
+	u16				tx_seq;
+};
+
+static inline struct f_ncm *func_to_ncm(struct usb_function *f)
+{
+	return container_of(f, struct f_ncm, port.func);
+}
+
+/* peak (theoretical) bulk transfer rate in bits-per-second */
+static inline unsigned ncm_bitrate(struct usb_gadget *g)
+{
+	if (gadget_is_dualspeed(g) && g->speed == USB_SPEED_HIGH)
+		return 13 * 512 * 8 * 1000 * 8;
+	else
+		return 19 *  64 * 1 * 1000 * 8;
+}
+
+static unsigned ncm_ntb_in_max_size = 16384;
+module_param(ncm_ntb_in_max_size, uint, S_IRUGO);
+MODULE_PARM_DESC(ncm_ntb_in_max_size, "most bytes per NTB sent to the host");
+
+/* the host's NTBs are received whole, so keep these to a few pages */
+#define NCM_NTB_OUT_MAX_SIZE		8192
+
+/*-------------------------------------------------------------------------*/
+
+/*
+ * As with ECM, the status endpoint is used for connect and speed change
+ * notifications; wMaxPacketSize fits SPEED_CHANGE in one packet.
+ */
+
+#define LOG2_STATUS_INTERVAL_MSEC	5	/* 1 << 5 == 32 msec */
+#define NCM_STATUS_BYTECOUNT		16	/* 8 byte header + data */
+
+
+/* interface descriptor: */
+
+static struct usb_interface_descriptor ncm_control_intf __initdata = {
+	.bLength =		sizeof ncm_control_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	/* .bInterfaceNumber = DYNAMIC */
+	.bNumEndpoints =	1,
+	.bInterfaceClass =	USB_CLASS_COMM,
+	.bInterfaceSubClass =	USB_CDC_SUBCLASS_NCM,
+	.bInterfaceProtocol =	USB_CDC_PROTO_NONE,
+	/* .iInterface = DYNAMIC */
+};
+
+static struct usb_cdc_header_desc ncm_header_desc __initdata = {
+	.bLength =		sizeof ncm_header_desc,
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_HEADER_TYPE,
+
+	.bcdCDC =		cpu_to_le16(0x0110),
+};
+
+static struct usb_cdc_union_desc ncm_union_desc __initdata = {
+	.bLength =		sizeof(ncm_union_desc),
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_UNION_TYPE,
+	/* .bMasterInterface0 =	DYNAMIC */
+	/* .bSlaveInterface0 =	DYNAMIC */
+};
+
+static struct usb_cdc_ether_desc ncm_ether_desc __initdata = {
+	.bLength =		sizeof ncm_ether_desc,
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_ETHERNET_TYPE,
+
+	/* .iMACAddress = DYNAMIC */
+	.bmEthernetStatistics =	cpu_to_le32(0), /* no statistics */
+	.wMaxSegmentSize =	cpu_to_le16(ETH_FRAME_LEN),
+	.wNumberMCFilters =	cpu_to_le16(0),
+	.bNumberPowerFilters =	0,
+};
+
+static struct usb_cdc_ncm_desc ncm_desc __initdata = {
+	.bLength =		sizeof ncm_desc,
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_NCM_TYPE,
+
+	.bcdNcmVersion =	cpu_to_le16(0x0100),
+	/* only SET_ETHERNET_PACKET_FILTER of the optional requests */
+	.bmNetworkCapabilities = USB_CDC_NCM_NCAP_ETH_FILTER,
+};
+
+/* the default data interface has no endpoints ... */
+
+static struct usb_interface_descriptor ncm_data_nop_intf __initdata = {
+	.bLength =		sizeof ncm_data_nop_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bInterfaceNumber =	1,
+	.bAlternateSetting =	0,
+	.bNumEndpoints =	0,
+	.bInterfaceClass =	USB_CLASS_CDC_DATA,
+	.bInterfaceSubClass =	0,
+	.bInterfaceProtocol =	USB_CDC_NCM_PROTO_NTB,
+	/* .iInterface = DYNAMIC */
+};
+
+/* ... but the "real" data interface has two bulk endpoints */
+
+static struct usb_interface_descriptor ncm_data_intf __initdata = {
+	.bLength =		sizeof ncm_data_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bInterfaceNumber =	1,
+	.bAlternateSetting =	1,
+	.bNumEndpoints =	2,
+	.bInterfaceClass =	USB_CLASS_CDC_DATA,
+	.bInterfaceSubClass =	0,
+	.bInterfaceProtocol =	USB_CDC_NCM_PROTO_NTB,
+	/* .iInterface = DYNAMIC */
+};
+
+/* full speed support: */
+
+static struct usb_endpoint_descriptor fs_ncm_notify_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_INT,
+	.wMaxPacketSize =	cpu_to_le16(NCM_STATUS_BYTECOUNT),
+	.bInterval =		1 << LOG2_STATUS_INTERVAL_MSEC,
+};
+
+static struct usb_endpoint_descriptor fs_ncm_in_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_endpoint_descriptor fs_ncm_out_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_OUT,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_descriptor_header *ncm_fs_function[] __initdata = {
+	/* CDC NCM control descriptors */
+	(struct usb_descriptor_header *) &ncm_control_intf,
+	(struct usb_descriptor_header *) &ncm_header_desc,
+	(struct usb_descriptor_header *) &ncm_union_desc,
+	(struct usb_descriptor_header *) &ncm_ether_desc,
+	(struct usb_descriptor_header *) &ncm_desc,
+	(struct usb_descriptor_header *) &fs_ncm_notify_desc,
+	/* data interface, altsettings 0 and 1 */
+	(struct usb_descriptor_header *) &ncm_data_nop_intf,
+	(struct usb_descriptor_header *) &ncm_data_intf,
+	(struct usb_descriptor_header *) &fs_ncm_in_desc,
+	(struct usb_descriptor_header *) &fs_ncm_out_desc,
+	NULL,
+};
+
+/* high speed support: */
+
+static struct usb_endpoint_descriptor hs_ncm_notify_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_INT,
+	.wMaxPacketSize =	cpu_to_le16(NCM_STATUS_BYTECOUNT),
+	.bInterval =		LOG2_STATUS_INTERVAL_MSEC + 4,
+};
+static struct usb_endpoint_descriptor hs_ncm_in_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(512),
+};
+
+static struct usb_endpoint_descriptor hs_ncm_out_desc __initdata = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_OUT,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(512),
+};
+
+static struct usb_descriptor_header *ncm_hs_function[] __initdata = {
+	/* CDC NCM control descriptors */
+	(struct usb_descriptor_header *) &ncm_control_intf,
+	(struct usb_descriptor_header *) &ncm_header_desc,
+	(struct usb_descriptor_header *) &ncm_union_desc,
+	(struct usb_descriptor_header *) &ncm_ether_desc,
+	(struct usb_descriptor_header *) &ncm_desc,
+	(struct usb_descriptor_header *) &hs_ncm_notify_desc,
+	/* data interface, altsettings 0 and 1 */
+	(struct usb_descriptor_header *) &ncm_data_nop_intf,
+	(struct usb_descriptor_header *) &ncm_data_intf,
+	(struct usb_descriptor_header *) &hs_ncm_in_desc,
+	(struct usb_descriptor_header *) &hs_ncm_out_desc,
+	NULL,
+};
+
+/* string descriptors: */
+
+static struct usb_string ncm_string_defs[] = {
+	[0].s = "CDC Network Control Model (NCM)",
+	[1].s = NULL /* DYNAMIC */,
+	[2].s = "CDC Network Data",
+	{  } /* end of list */
+};
+
+static struct usb_gadget_strings ncm_string_table = {
+	.language =		0x0409,	/* en-us */
+	.strings =		ncm_string_defs,
+};
+
+static struct usb_gadget_strings *ncm_strings[] = {
+	&ncm_string_table,
+	NULL,
+};
+
+/*-------------------------------------------------------------------------*/
+
+static void ncm_do_notify(struct f_ncm *ncm)
+{
+	struct usb_request		*req = ncm->notify_req;
+	struct usb_cdc_notification	*event;
+	struct usb_composite_dev	*cdev = ncm->port.func.config->cdev;
+	__le32				*data;
+	int				status;
+
+	/* notification already in flight? */
+	if (!req)
+		return;
+
+	event = req->buf;
+	switch (ncm->notify_state) {
+	case NCM_NOTIFY_NONE:
+		return;
+
+	case NCM_NOTIFY_CONNECT:
+		event->bNotificationType = USB_CDC_NOTIFY_NETWORK_CONNECTION;
+		if (ncm->is_open)
+			event->wValue = cpu_to_le16(1);
+		else
+			event->wValue = cpu_to_le16(0);
+		event->wLength = 0;
+		req->length = sizeof *event;
+
+		DBG(cdev, "notify connect %s\n",
+				ncm->is_open ? "true" : "false");
+		ncm->notify_state = NCM_NOTIFY_SPEED;
+		break;
+
+	case NCM_NOTIFY_SPEED:
+		event->bNotificationType = USB_CDC_NOTIFY_SPEED_CHANGE;
+		event->wValue = cpu_to_le16(0);
+		event->wLength = cpu_to_le16(8);
+		req->length = NCM_STATUS_BYTECOUNT;
+
+		/* SPEED_CHANGE data is up/down speeds in bits/sec */
+		data = req->buf + sizeof *event;
+		data[0] = cpu_to_le32(ncm_bitrate(cdev->gadget));
+		data[1] = data[0];
+
+		DBG(cdev, "notify speed %d\n", ncm_bitrate(cdev->gadget));
+		ncm->notify_state = NCM_NOTIFY_NONE;
+		break;
+	}
+	event->bmRequestType = 0xA1;
+	event->wIndex = cpu_to_le16(ncm->ctrl_id);
+
+	ncm->notify_req = NULL;
+	status = usb_ep_queue(ncm->notify, req, GFP_ATOMIC);
+	if (status < 0) {
+		ncm->notify_req = req;
+		DBG(cdev, "notify --> %d\n", status);
+	}
+}
+
+static void ncm_notify(struct f_ncm *ncm)
+{
+	ncm->notify_state = NCM_NOTIFY_CONNECT;
+	ncm_do_notify(ncm);
+}
+
+static void ncm_notify_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct f_ncm			*ncm = req->context;
+	struct usb_composite_dev	*cdev = ncm->port.func.config->cdev;
+	struct usb_cdc_notification	*event = req->buf;
+
+	switch (req->status) {
+	case 0:
+		/* no fault */
+		break;
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		ncm->notify_state = NCM_NOTIFY_NONE;
+		break;
+	default:
+		DBG(cdev, "event %02x --> %d\n",
+			event->bNotificationType, req->status);
+		break;
+	}
+	ncm->notify_req = req;
+	ncm_do_notify(ncm);
+}
+
+/* data stage of SET_NTB_INPUT_SIZE */
+static void ncm_ep0out_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct f_ncm			*ncm = req->context;
+	struct usb_composite_dev	*cdev = ncm->port.func.config->cdev;
+	u32				size;
+
+	if (req->status || req->actual < 4) {
+		usb_ep_set_halt(ep);
+		return;
+	}
+
+	size = get_unaligned_le32(req->buf);
+	if (size < USB_CDC_NCM_NTB_MIN_IN_SIZE
+			|| size > ncm_ntb_in_max_size) {
+		DBG(cdev, "bad NTB input size %u\n", size);
+		usb_ep_set_halt(ep);
+		return;
+	}
+	ncm->ntb_in_size = size;
+	DBG(cdev, "NTB input size %u\n", size);
+}
+
+static int ncm_setup(struct usb_function *f, const struct usb_ctrlrequest *ctrl)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+	struct usb_composite_dev *cdev = f->config->cdev;
+	struct usb_request	*req = cdev->req;
+	int			value = -EOPNOTSUPP;
+	u16			w_index = le16_to_cpu(ctrl->wIndex);
+	u16			w_value = le16_to_cpu(ctrl->wValue);
+	u16			w_length = le16_to_cpu(ctrl->wLength);
+
+	/* composite driver infrastructure handles everything except
+	 * CDC class messages; interface activation uses set_alt().
+	 */
+	switch ((ctrl->bRequestType << 8) | ctrl->bRequest) {
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_ETHERNET_PACKET_FILTER:
+		/* see 6.2.30: no data, wIndex = interface,
+		 * wValue = packet filter bitmap
+		 */
+		if (w_length != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		DBG(cdev, "packet filter %02x\n", w_value);
+		/* REVISIT locking of cdc_filter, as for ECM */
+		ncm->port.cdc_filter = w_value;
+		value = 0;
+		break;
+
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_NTB_PARAMETERS: {
+		struct usb_cdc_ncm_ntb_parameters	*params = req->buf;
+
+		if (w_length == 0 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		memset(params, 0, sizeof *params);
+		params->wLength = cpu_to_le16(sizeof *params);
+		params->bmNtbFormatsSupported =
+				cpu_to_le16(USB_CDC_NCM_NTB16_SUPPORTED);
+		params->dwNtbInMaxSize = cpu_to_le32(ncm_ntb_in_max_size);
+		params->wNdpInDivisor = cpu_to_le16(NCM_NDP_IN_DIVISOR);
+		params->wNdpInAlignment = cpu_to_le16(NCM_NDP_IN_ALIGN);
+		params->dwNtbOutMaxSize = cpu_to_le32(NCM_NTB_OUT_MAX_SIZE);
+		params->wNdpOutDivisor = cpu_to_le16(4);
+		params->wNdpOutAlignment = cpu_to_le16(4);
+		value = min_t(unsigned, w_length, sizeof *params);
+		break;
+	}
+
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_NTB_INPUT_SIZE:
+		if (w_length < 4 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		put_unaligned_le32(ncm->ntb_in_size, req->buf);
+		value = 4;
+		break;
+
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_NTB_INPUT_SIZE:
+		if (w_length != 4 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		req->complete = ncm_ep0out_complete;
+		req->context = ncm;
+		value = w_length;
+		break;
+
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_NTB_FORMAT:
+	case ((USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_GET_CRC_MODE:
+		/* always NTB16, never CRCs */
+		if (w_length < 2 || w_value != 0 || w_index != ncm->ctrl_id)
+			goto invalid;
+		put_unaligned_le16(0, req->buf);
+		value = 2;
+		break;
+
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_NTB_FORMAT:
+		if (w_length != 0 || w_index != ncm->ctrl_id
+				|| w_value != USB_CDC_NCM_NTB16_FORMAT)
+			goto invalid;
+		value = 0;
+		break;
+
+	case ((USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE) << 8)
+			| USB_CDC_SET_CRC_MODE:
+		if (w_length != 0 || w_index != ncm->ctrl_id
+				|| w_value != USB_CDC_NCM_CRC_NOT_APPENDED)
+			goto invalid;
+		value = 0;
+		break;
+
+	/* and optionally, none of which we claim in ncm_desc:
+	 * case USB_CDC_GET_NET_ADDRESS:
+	 * case USB_CDC_SET_NET_ADDRESS:
+	 * case USB_CDC_GET_MAX_DATAGRAM_SIZE:
+	 * case USB_CDC_SET_MAX_DATAGRAM_SIZE:
+	 */
+
+	default:
+invalid:
+		DBG(cdev, "invalid control req%02x.%02x v%04x i%04x l%d\n",
+			ctrl->bRequestType, ctrl->bRequest,
+			w_value, w_index, w_length);
+	}
+
+	/* respond with data transfer or status phase? */
+	if (value >= 0) {
+		DBG(cdev, "ncm req%02x.%02x v%04x i%04x l%d\n",
+			ctrl->bRequestType, ctrl->bRequest,
+			w_value, w_index, w_length);
+		req->zero = 0;
+		req->length = value;
+		value = usb_ep_queue(cdev->gadget->ep0, req, GFP_ATOMIC);
+		if (value < 0)
+			ERROR(cdev, "ncm req %02x.%02x response err %d\n",
+					ctrl->bRequestType, ctrl->bRequest,
+					value);
+	}
+
+	/* device either stalls (value < 0) or reports success */
+	return value;
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* finish the NTB being filled: its NDP goes after the datagrams */
+static struct sk_buff *ncm_close_ntb(struct f_ncm *ncm)
+{
+	struct sk_buff			*skb = ncm->tx_skb;
+	struct usb_cdc_ncm_nth16	*nth;
+	struct usb_cdc_ncm_ndp16	*ndp;
+	unsigned			pad, ndp_len;
+
+	if (!skb)
+		return NULL;
+	ncm->tx_skb = NULL;
+
+	pad = ALIGN(skb->len, NCM_NDP_IN_ALIGN) - skb->len;
+	memset(skb_put(skb, pad), 0, pad);
+
+	nth = (void *) skb->data;
+	put_unaligned_le16(skb->len, &nth->wNdpIndex);
+
+	ndp_len = NCM_NDP16_LEN(ncm->tx_ndgrams);
+	ndp = (void *) skb_put(skb, ndp_len);
+	ndp->dwSignature = cpu_to_le32(USB_CDC_NCM_NDP16_NOCRC_SIGN);
+	ndp->wLength = cpu_to_le16(ndp_len);
+	ndp->wNextNdpIndex = 0;
+	memcpy(ndp->dpe16, ncm->tx_dpe, ncm->tx_ndgrams * sizeof *ndp->dpe16);
+	memset(&ndp->dpe16[ncm->tx_ndgrams], 0, sizeof *ndp->dpe16);
+
+	put_unaligned_le16(skb->len, &nth->wBlockLength);
+	return skb;
+}
+
+static struct sk_buff *ncm_wrap_ntb(struct gether *port, struct sk_buff *skb)
+{
+	struct f_ncm			*ncm = func_to_ncm(&port->func);
+	struct usb_cdc_ncm_nth16	*nth;
+	struct sk_buff			*skb2 = NULL;
+	unsigned			offset, pad;
+
+	/* flush whatever is waiting */
+	if (!skb)
+		return ncm_close_ntb(ncm);
+
+	/* send what's waiting if this one doesn't fit behind it */
+	if (ncm->tx_skb && (ncm->tx_ndgrams >= NCM_NTB_MAX_DGRAMS
+			|| ALIGN(ALIGN(ncm->tx_skb->len, NCM_NDP_IN_DIVISOR)
+				+ skb->len, NCM_NDP_IN_ALIGN)
+				+ NCM_NDP16_LEN(ncm->tx_ndgrams + 1) > ncm->tx_max))
+		skb2 = ncm_close_ntb(ncm);
+
+	/* the host may change the size between NTBs, not within one;
+	 * without zlps u_ether pads a whole number of packets with a
+	 * byte, which must still fit in dwNtbInMaxSize
+	 */
+	if (!ncm->tx_skb) {
+		ncm->tx_max = ncm->ntb_in_size - !ncm->port.is_zlp_ok;
+		ncm->tx_skb = alloc_skb(ncm->tx_max, GFP_ATOMIC);
+		if (!ncm->tx_skb) {
+			/* drop it; the next frame may have better luck */
+			dev_kfree_skb_any(skb);
+			return skb2;
+		}
+		ncm->tx_ndgrams = 0;
+
+		nth = (void *) skb_put(ncm->tx_skb, sizeof *nth);
+		memset(nth, 0, sizeof *nth);
+		nth->dwSignature = cpu_to_le32(USB_CDC_NCM_NTH16_SIGN);
+		nth->wHeaderLength = cpu_to_le16(sizeof *nth);
+		nth->wSequence = cpu_to_le16(ncm->tx_seq++);
+	}
+
+	offset = ALIGN(ncm->tx_skb->len, NCM_NDP_IN_DIVISOR);
+	pad = offset - ncm->tx_skb->len;
+	memset(skb_put(ncm->tx_skb, pad), 0, pad);
+	skb_copy_bits(skb, 0, skb_put(ncm->tx_skb, skb->len), skb->len);
+
+	ncm->tx_dpe[ncm->tx_ndgrams].wDatagramIndex = cpu_to_le16(offset);
+	ncm->tx_dpe[ncm->tx_ndgrams].wDatagramLength = cpu_to_le16(skb->len);
+	ncm->tx_ndgrams++;
+	dev_kfree_skb_any(skb);
+
+	/* send it right away once no full sized frame fits */
+	if (!skb2 && (ncm->tx_ndgrams >= NCM_NTB_MAX_DGRAMS
+			|| ALIGN(ncm->tx_skb->len, NCM_NDP_IN_DIVISOR)
+				+ ETH_FRAME_LEN + NCM_NDP_IN_ALIGN
+				+ NCM_NDP16_LEN(ncm->tx_ndgrams + 1) > ncm->tx_max))
+		skb2 = ncm_close_ntb(ncm);
+
+	return skb2;
+}
+
+/* bound on NDPs per NTB, so a loop in their chain can't hang us */
+#define NCM_NTB_MAX_NDPS		8
+
+static int ncm_unwrap_ntb(struct gether *port,
+			struct sk_buff *skb,
+			struct sk_buff_head *list)
+{
+	struct usb_cdc_ncm_nth16	*nth = (void *) skb->data;
+	struct usb_cdc_ncm_ndp16	*ndp;
+	struct usb_cdc_ncm_dpe16	*dpe;
+	struct sk_buff			*skb2;
+	unsigned			block_len, ndp_index, ndp_len;
+	unsigned			index, len;
+	int				ndps = 0;
+	int				status = -EINVAL;
+
+	if (skb->len < sizeof *nth
+			|| get_unaligned_le32(&nth->dwSignature)
+				!= USB_CDC_NCM_NTH16_SIGN
+			|| get_unaligned_le16(&nth->wHeaderLength)
+				!= sizeof *nth)
+		goto err;
+
+	/* zero means the block ends with the transfer */
+	block_len = get_unaligned_le16(&nth->wBlockLength);
+	if (!block_len)
+		block_len = skb->len;
+	else if (block_len > skb->len)
+		goto err;
+
+	ndp_index = get_unaligned_le16(&nth->wNdpIndex);
+	do {
+		if (ndp_index % 4 || ndp_index < sizeof *nth
+				|| ndp_index + sizeof *ndp > block_len
+				|| ++ndps > NCM_NTB_MAX_NDPS)
+			goto err;
+		ndp = (void *) skb->data + ndp_index;
+
+		/* we never agreed to CRCs */
+		if (get_unaligned_le32(&ndp->dwSignature)
+				!= USB_CDC_NCM_NDP16_NOCRC_SIGN)
+			goto err;
+		ndp_len = get_unaligned_le16(&ndp->wLength);
+		if (ndp_len < NCM_NDP16_LEN(1) || ndp_len % 4
+				|| ndp_index + ndp_len > block_len)
+			goto err;
+
+		for (dpe = ndp->dpe16;
+				(void *) (dpe + 1) <= (void *) ndp + ndp_len;
+				dpe++) {
+			index = get_unaligned_le16(&dpe->wDatagramIndex);
+			len = get_unaligned_le16(&dpe->wDatagramLength);
+			if (!index || !len)
+				break;
+			if (index + len > block_len)
+				goto err;
+
+			skb2 = skb_clone(skb, GFP_ATOMIC);
+			if (!skb2) {
+				status = -ENOMEM;
+				goto err;
+			}
+			skb_pull(skb2, index);
+			skb_trim(skb2, len);
+			skb_queue_tail(list, skb2);
+		}
+
+		ndp_index = get_unaligned_le16(&ndp->wNextNdpIndex);
+	} while (ndp_index);
+
+	dev_kfree_skb_any(skb);
+	return 0;
+
+err:
+	/* whatever was queued gets dropped along with the rest */
+	dev_kfree_skb_any(skb);
+	return status;
+}
+
+/*-------------------------------------------------------------------------*/
+
+static void ncm_reset_tx(struct f_ncm *ncm)
+{
+	if (ncm->tx_skb) {
+		dev_kfree_skb_any(ncm->tx_skb);
+		ncm->tx_skb = NULL;
+	}
+}
+
+static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+	struct usb_composite_dev *cdev = f->config->cdev;
+
+	/* Control interface has only altsetting 0 */
+	if (intf == ncm->ctrl_id) {
+		if (alt != 0)
+			goto fail;
+
+		if (ncm->notify->driver_data) {
+			VDBG(cdev, "reset ncm control %d\n", intf);
+			usb_ep_disable(ncm->notify);
+		} else {
+			VDBG(cdev, "init ncm ctrl %d\n", intf);
+			ncm->notify_desc = ep_choose(cdev->gadget,
+					ncm->hs.notify,
+					ncm->fs.notify);
+		}
+		usb_ep_enable(ncm->notify, ncm->notify_desc);
+		ncm->notify->driver_data = ncm;
+
+	/* Data interface has two altsettings, 0 and 1 */
+	} else if (intf == ncm->data_id) {
+		if (alt > 1)
+			goto fail;
+
+		if (ncm->port.in_ep->driver_data) {
+			DBG(cdev, "reset ncm\n");
+			gether_disconnect(&ncm->port);
+			ncm_reset_tx(ncm);
+		}
+
+		if (!ncm->port.in) {
+			DBG(cdev, "init ncm\n");
+			ncm->port.in = ep_choose(cdev->gadget,
+					ncm->hs.in, ncm->fs.in);
+			ncm->port.out = ep_choose(cdev->gadget,
+					ncm->hs.out, ncm->fs.out);
+		}
+
+		/* NCM only sends data in non-default altsettings, and
+		 * selecting altsetting 0 resets the NTB parameters.
+		 */
+		if (alt == 0) {
+			ncm->ntb_in_size = ncm_ntb_in_max_size;
+		} else {
+			struct net_device	*net;
+
+			/* NTBs are terminated by a short packet, and the
+			 * same controllers as for ECM can't do zlps.
+			 */
+			ncm->port.is_zlp_ok = !(
+				   gadget_is_sa1100(cdev->gadget)
+				|| gadget_is_musbhdrc(cdev->gadget)
+				);
+			ncm->port.cdc_filter = DEFAULT_FILTER;
+			DBG(cdev, "activate ncm\n");
+			net = gether_connect(&ncm->port);
+			if (IS_ERR(net))
+				return PTR_ERR(net);
+		}
+
+		ncm_notify(ncm);
+	} else
+		goto fail;
+
+	return 0;
+fail:
+	return -EINVAL;
+}
+
+/* Because the data interface supports multiple altsettings,
+ * this NCM function *MUST* implement a get_alt() method.
+ */
+static int ncm_get_alt(struct usb_function *f, unsigned intf)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+
+	if (intf == ncm->ctrl_id)
+		return 0;
+	return ncm->port.in_ep->driver_data ? 1 : 0;
+}
+
+static void ncm_disable(struct usb_function *f)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+	struct usb_composite_dev *cdev = f->config->cdev;
+
+	DBG(cdev, "ncm deactivated\n");
+
+	if (ncm->port.in_ep->driver_data) {
+		gether_disconnect(&ncm->port);
+		ncm_reset_tx(ncm);
+	}
+
+	if (ncm->notify->driver_data) {
+		usb_ep_disable(ncm->notify);
+		ncm->notify->driver_data = NULL;
+		ncm->notify_desc = NULL;
+	}
+}
+
+/*-------------------------------------------------------------------------*/
+
+/*
+ * Callbacks let us notify the host about connect/disconnect when the
+ * net device is opened or closed; see f_ecm.c for the states to test.
+ */
+
+static void ncm_open(struct gether *geth)
+{
+	struct f_ncm		*ncm = func_to_ncm(&geth->func);
+
+	DBG(ncm->port.func.config->cdev, "%s\n", __func__);
+
+	ncm->is_open = true;
+	ncm_notify(ncm);
+}
+
+static void ncm_close(struct gether *geth)
+{
+	struct f_ncm		*ncm = func_to_ncm(&geth->func);
+
+	DBG(ncm->port.func.config->cdev, "%s\n", __func__);
+
+	ncm->is_open = false;
+	ncm_notify(ncm);
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* ethernet function driver setup/binding */
+
+static int __init
+ncm_bind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct usb_composite_dev *cdev = c->cdev;
+	struct f_ncm		*ncm = func_to_ncm(f);
+	int			status;
+	struct usb_ep		*ep;
+
+	/* allocate instance-specific interface IDs */
+	status = usb_interface_id(c, f);
+	if (status < 0)
+		goto fail;
+	ncm->ctrl_id = status;
+
+	ncm_control_intf.bInterfaceNumber = status;
+	ncm_union_desc.bMasterInterface0 = status;
+
+	status = usb_interface_id(c, f);
+	if (status < 0)
+		goto fail;
+	ncm->data_id = status;
+
+	ncm_data_nop_intf.bInterfaceNumber = status;
+	ncm_data_intf.bInterfaceNumber = status;
+	ncm_union_desc.bSlaveInterface0 = status;
+
+	status = -ENODEV;
+
+	/* allocate instance-specific endpoints */
+	ep = usb_ep_autoconfig(cdev->gadget, &fs_ncm_in_desc);
+	if (!ep)
+		goto fail;
+	ncm->port.in_ep = ep;
+	ep->driver_data = cdev;	/* claim */
+
+	ep = usb_ep_autoconfig(cdev->gadget, &fs_ncm_out_desc);
+	if (!ep)
+		goto fail;
+	ncm->port.out_ep = ep;
+	ep->driver_data = cdev;	/* claim */
+
+	ep = usb_ep_autoconfig(cdev->gadget, &fs_ncm_notify_desc);
+	if (!ep)
+		goto fail;
+	ncm->notify = ep;
+	ep->driver_data = cdev;	/* claim */
+
+	status = -ENOMEM;
+
+	/* allocate notification request and buffer */
+	ncm->notify_req = usb_ep_alloc_request(ep, GFP_KERNEL);
+	if (!ncm->notify_req)
+		goto fail;
+	ncm->notify_req->buf = kmalloc(NCM_STATUS_BYTECOUNT, GFP_KERNEL);
+	if (!ncm->notify_req->buf)
+		goto fail;
+	ncm->notify_req->context = ncm;
+	ncm->notify_req->complete = ncm_notify_complete;
+
+	/* copy descriptors, and track endpoint copies */
+	f->descriptors = usb_copy_descriptors(ncm_fs_function);
+	if (!f->descriptors)
+		goto fail;
+
+	ncm->fs.in = usb_find_endpoint(ncm_fs_function,
+			f->descriptors, &fs_ncm_in_desc);
+	ncm->fs.out = usb_find_endpoint(ncm_fs_function,
+			f->descriptors, &fs_ncm_out_desc);
+	ncm->fs.notify = usb_find_endpoint(ncm_fs_function,
+			f->descriptors, &fs_ncm_notify_desc);
+
+	/* support all relevant hardware speeds... we expect that when
+	 * hardware is dual speed, all bulk-capable endpoints work at
+	 * both speeds
+	 */
+	if (gadget_is_dualspeed(c->cdev->gadget)) {
+		hs_ncm_in_desc.bEndpointAddress =
+				fs_ncm_in_desc.bEndpointAddress;
+		hs_ncm_out_desc.bEndpointAddress =
+				fs_ncm_out_desc.bEndpointAddress;
+		hs_ncm_notify_desc.bEndpointAddress =
+				fs_ncm_notify_desc.bEndpointAddress;
+
+		/* copy descriptors, and track endpoint copies */
+		f->hs_descriptors = usb_copy_descriptors(ncm_hs_function);
+		if (!f->hs_descriptors)
+			goto fail;
+
+		ncm->hs.in = usb_find_endpoint(ncm_hs_function,
+				f->hs_descriptors, &hs_ncm_in_desc);
+		ncm->hs.out = usb_find_endpoint(ncm_hs_function,
+				f->hs_descriptors, &hs_ncm_out_desc);
+		ncm->hs.notify = usb_find_endpoint(ncm_hs_function,
+				f->hs_descriptors, &hs_ncm_notify_desc);
+	}
+
+	ncm->port.open = ncm_open;
+	ncm->port.close = ncm_close;
+
+	DBG(cdev, "CDC Network: %s speed IN/%s OUT/%s NOTIFY/%s\n",
+			gadget_is_dualspeed(c->cdev->gadget) ? "dual" : "full",
+			ncm->port.in_ep->name, ncm->port.out_ep->name,
+			ncm->notify->name);
+	return 0;
+
+fail:
+	if (f->descriptors)
+		usb_free_descriptors(f->descriptors);
+
+	if (ncm->notify_req) {
+		kfree(ncm->notify_req->buf);
+		usb_ep_free_request(ncm->notify, ncm->notify_req);
+	}
+
+	/* we might as well release our claims on endpoints */
+	if (ncm->notify)
+		ncm->notify->driver_data = NULL;
+	if (ncm->port.out)
+		ncm->port.out_ep->driver_data = NULL;
+	if (ncm->port.in)
+		ncm->port.in_ep->driver_data = NULL;
+
+	ERROR(cdev, "%s: can't bind, err %d\n", f->name, status);
+
+	return status;
+}
+
+static void
+ncm_unbind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct f_ncm		*ncm = func_to_ncm(f);
+
+	DBG(c->cdev, "ncm unbind\n");
+
+	if (gadget_is_dualspeed(c->cdev->gadget))
+		usb_free_descriptors(f->hs_descriptors);
+	usb_free_descriptors(f->descriptors);
+
+	kfree(ncm->notify_req->buf);
+	usb_ep_free_request(ncm->notify, ncm->notify_req);
+
+	ncm_string_defs[1].s = NULL;
+	kfree(ncm);
+}
+
+/**
+ * ncm_bind_config - add CDC Network link to a configuration
+ * @c: the configuration to support the network link
+ * @ethaddr: a buffer in which the ethernet address of the host side
+ *	side of the link was recorded
+ * Context: single threaded during gadget setup
+ *
+ * Returns zero on success, else negative errno.
+ *
+ * Caller must have called @gether_setup().  Caller is also responsible
+ * for calling @gether_cleanup() before module unload.
+ */
+int __init ncm_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN])
+{
+	struct f_ncm	*ncm;
+	int		status;
+
+	if (!can_support_ecm(c->cdev->gadget) || !ethaddr)
+		return -EINVAL;
+
+	/* NTB16 lengths and offsets are 16 bits wide */
+	ncm_ntb_in_max_size = clamp_t(unsigned, ncm_ntb_in_max_size,
+			USB_CDC_NCM_NTB_MIN_IN_SIZE, 0xffff);
+
+	/* maybe allocate device-global string IDs */
+	if (ncm_string_defs[0].id == 0) {
+
+		/* control interface label */
+		status = usb_string_id(c->cdev);
+		if (status < 0)
+			return status;
+		ncm_string_defs[0].id = status;
+		ncm_control_intf.iInterface = status;
+
+		/* data interface label */
+		status = usb_string_id(c->cdev);
+		if (status < 0)
+			return status;
+		ncm_string_defs[2].id = status;
+		ncm_data_intf.iInterface = status;
+
+		/* MAC address */
+		status = usb_string_id(c->cdev);
+		if (status < 0)
+			return status;
+		ncm_string_defs[1].id = status;
+		ncm_ether_desc.iMACAddress = status;
+	}
+
+	/* allocate and initialize one new instance */
+	ncm = kzalloc(sizeof *ncm, GFP_KERNEL);
+	if (!ncm)
+		return -ENOMEM;
+
+	/* export host's Ethernet address in CDC format */
+	snprintf(ncm->ethaddr, sizeof ncm->ethaddr,
+		"%02X%02X%02X%02X%02X%02X",
+		ethaddr[0], ethaddr[1], ethaddr[2],
+		ethaddr[3], ethaddr[4], ethaddr[5]);
+	ncm_string_defs[1].s = ncm->ethaddr;
+
+	ncm->port.cdc_filter = DEFAULT_FILTER;
+	ncm->ntb_in_size = ncm_ntb_in_max_size;
+
+	ncm->port.wrap = ncm_wrap_ntb;
+	ncm->port.unwrap = ncm_unwrap_ntb;
+	ncm->port.is_multi_frame = true;
+	ncm->port.ul_max_xfer_size = NCM_NTB_OUT_MAX_SIZE;
+
+	ncm->port.func.name = "cdc_network";
+	ncm->port.func.strings = ncm_strings;
+	/* descriptors are per-instance copies */
+	ncm->port.func.bind = ncm_bind;
+	ncm->port.func.unbind = ncm_unbind;
+	ncm->port.func.set_alt = ncm_set_alt;
+	ncm->port.func.get_alt = ncm_get_alt;
+	ncm->port.func.setup = ncm_setup;
+	ncm->port.func.disable = ncm_disable;
+
+	status = usb_add_function(c, &ncm->port.func);
+	if (status) {
+		ncm_string_defs[1].s = NULL;
+		kfree(ncm);
+	}
+	return status;
+}
@@ -96,6 +96,10 @@ struct f_rndis {
 	struct usb_endpoint_descriptor	*notify_desc;
 	struct usb_request		*notify_req;
 	atomic_t			notify_count;
+
+	/* packet messages waiting to go out in one transfer */
+	struct sk_buff			*tx_skb;
+	unsigned			tx_pkts;
 };
 
 static inline struct f_rndis *func_to_rndis(struct usb_function *f)
@@ -114,6 +118,34 @@ static unsigned int bitrate(struct usb_gadget *g)
 
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Several packet messages may share one bulk transfer, sparing an
+ * interrupt and a request per frame.  Towards the host that's limited
+ * by the MaxTransferSize it gave in REMOTE_NDIS_INITIALIZE_MSG, and by
+ * these; a partial transfer goes out when no more frames come for a
+ * while (u_ether's tx_flush_us).  Setting a count to 1 turns it off.
+ */
+static unsigned rndis_dl_max_pkt_per_xfer = 10;
+module_param(rndis_dl_max_pkt_per_xfer, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(rndis_dl_max_pkt_per_xfer,
+	"most packets per IN transfer");
+
+static unsigned rndis_dl_max_xfer_size = 8192;
+module_param(rndis_dl_max_xfer_size, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(rndis_dl_max_xfer_size, "most bytes per IN transfer");
+
+static unsigned rndis_ul_max_pkt_per_xfer = 3;
+module_param(rndis_ul_max_pkt_per_xfer, uint, S_IRUGO);
+MODULE_PARM_DESC(rndis_ul_max_pkt_per_xfer,
+	"most packets per OUT transfer");
+
+/* the longest packet message, with a frame of the largest MTU */
+#define RNDIS_MAX_MSG_SIZE	ALIGN(sizeof(struct rndis_packet_msg_type) \
+					+ ETH_HLEN + ETH_FRAME_LEN + 22, \
+					1 << RNDIS_PACKET_ALIGN_SHIFT)
+
+/*-------------------------------------------------------------------------*/
+
 /*
  */
 
@@ -360,13 +392,71 @@ static struct usb_ether_platform_data *rndis_pdata;
 static struct sk_buff *rndis_add_header(struct gether *port,
 					struct sk_buff *skb)
 {
-	struct sk_buff *skb2;
+	struct f_rndis			*rndis = func_to_rndis(&port->func);
+	struct rndis_packet_msg_type	*header;
+	struct sk_buff			*skb2 = NULL;
+	unsigned			max, len;
+
+	/* flush whatever is waiting */
+	if (!skb) {
+		skb2 = rndis->tx_skb;
+		rndis->tx_skb = NULL;
+		return skb2;
+	}
+
+	max = min(rndis_get_dl_max_xfer_size(rndis->config),
+			rndis_dl_max_xfer_size);
+	/* leave room for the byte u_ether pads with instead of a zlp */
+	if (!port->is_zlp_ok)
+		max--;
+	if (rndis_dl_max_pkt_per_xfer <= 1 || max < 2 * RNDIS_MAX_MSG_SIZE) {
+		skb2 = skb_realloc_headroom(skb,
+				sizeof(struct rndis_packet_msg_type));
+		if (skb2)
+			rndis_add_hdr(skb2);
+
+		dev_kfree_skb_any(skb);
+		return skb2;
+	}
 
-	skb2 = skb_realloc_headroom(skb, sizeof(struct rndis_packet_msg_type));
-	if (skb2)
-		rndis_add_hdr(skb2);
+	len = ALIGN(sizeof *header + skb->len, 1 << RNDIS_PACKET_ALIGN_SHIFT);
 
+	/* send what's waiting if this one doesn't fit behind it */
+	if (rndis->tx_skb && (rndis->tx_skb->len + len > max
+			|| rndis->tx_pkts >= rndis_dl_max_pkt_per_xfer)) {
+		skb2 = rndis->tx_skb;
+		rndis->tx_skb = NULL;
+	}
+
+	if (!rndis->tx_skb) {
+		rndis->tx_skb = alloc_skb(max, GFP_ATOMIC);
+		if (!rndis->tx_skb) {
+			/* drop it; the next frame may have better luck */
+			dev_kfree_skb_any(skb);
+			return skb2;
+		}
+		rndis->tx_pkts = 0;
+	}
+
+	header = (void *) skb_put(rndis->tx_skb, len);
+	memset(header, 0, sizeof *header);
+	header->MessageType = cpu_to_le32(REMOTE_NDIS_PACKET_MSG);
+	header->MessageLength = cpu_to_le32(len);
+	header->DataOffset = cpu_to_le32(36);
+	header->DataLength = cpu_to_le32(skb->len);
+	skb_copy_bits(skb, 0, header + 1, skb->len);
+	memset((void *) (header + 1) + skb->len, 0,
+			len - sizeof *header - skb->len);
+	rndis->tx_pkts++;
 	dev_kfree_skb_any(skb);
+
+	/* send it right away once nothing more fits */
+	if (!skb2 && (rndis->tx_pkts >= rndis_dl_max_pkt_per_xfer
+			|| rndis->tx_skb->len + RNDIS_MAX_MSG_SIZE > max)) {
+		skb2 = rndis->tx_skb;
+		rndis->tx_skb = NULL;
+	}
+
 	return skb2;
 }
 
@@ -573,6 +663,13 @@ static int rndis_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 		/* Avoid ZLPs; they can be troublesome. */
 		rndis->port.is_zlp_ok = false;
 
+		/* leave room for as many packets as INIT_CMPLT allows */
+		if (rndis_ul_max_pkt_per_xfer > 1)
+			rndis->port.ul_max_xfer_size =
+				rndis_ul_max_pkt_per_xfer * RNDIS_MAX_MSG_SIZE;
+		else
+			rndis->port.ul_max_xfer_size = 0;
+
 		/* RNDIS should be in the "RNDIS uninitialized" state,
 		 * either never activated or after rndis_uninit().
 		 *
@@ -622,6 +719,11 @@ static void rndis_disable(struct usb_function *f)
 	rndis_uninit(rndis->config);
 	gether_disconnect(&rndis->port);
 
+	if (rndis->tx_skb) {
+		dev_kfree_skb_any(rndis->tx_skb);
+		rndis->tx_skb = NULL;
+	}
+
 	usb_ep_disable(rndis->notify);
 	rndis->notify->driver_data = NULL;
 }
@@ -787,6 +889,8 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
+	rndis_set_max_pkt_xfer(rndis->config, min(rndis_ul_max_pkt_per_xfer,
+			255U));
 
 #ifdef CONFIG_USB_ANDROID_RNDIS
 	if (rndis_pdata) {
@@ -923,6 +1027,7 @@ int __init rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN])
 	rndis->port.header_len = sizeof(struct rndis_packet_msg_type);
 	rndis->port.wrap = rndis_add_header;
 	rndis->port.unwrap = rndis_rm_hdr;
+	rndis->port.is_multi_frame = true;
 
 	rndis->port.func.name = "rndis";
 	rndis->port.func.strings = rndis_strings;
@@ -27,6 +27,8 @@
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 
 #include "u_ether.h"
 
@@ -78,6 +80,10 @@ struct eth_dev {
 
 	struct work_struct	work;
 
+	/* flushes a partial multi-frame transfer */
+	struct hrtimer		tx_timer;
+	struct tasklet_struct	tx_tasklet;
+
 	unsigned long		todo;
 #define	WORK_RX_MEMORY		0
 
@@ -102,6 +108,11 @@ MODULE_PARM_DESC(qmult, "queue length multiplier at high speed");
 #define qmult		1
 #endif
 
+/* how long a partial multi-frame transfer waits for more frames */
+static unsigned tx_flush_us = 300;
+module_param(tx_flush_us, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(tx_flush_us, "usecs before sending a partial aggregate");
+
 /* for dual-speed hardware, use deeper queues at highspeed */
 static inline int qlen(struct usb_gadget *gadget)
 {
@@ -236,6 +247,8 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
 	size += dev->port_usb->header_len;
+	if (dev->port_usb->ul_max_xfer_size > size)
+		size = dev->port_usb->ul_max_xfer_size;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
@@ -494,30 +507,35 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 					struct net_device *net)
 {
 	struct eth_dev		*dev = netdev_priv(net);
-	int			length = skb->len;
+	int			length = skb ? skb->len : 0;
 	int			retval;
 	struct usb_request	*req = NULL;
 	unsigned long		flags;
 	struct usb_ep		*in;
 	u16			cdc_filter;
+	bool			multi_frame;
+	bool			flush = !skb;
 
 	spin_lock_irqsave(&dev->lock, flags);
 	if (dev->port_usb) {
 		in = dev->port_usb->in_ep;
 		cdc_filter = dev->port_usb->cdc_filter;
+		multi_frame = dev->port_usb->is_multi_frame;
 	} else {
 		in = NULL;
 		cdc_filter = 0;
+		multi_frame = false;
 	}
 	spin_unlock_irqrestore(&dev->lock, flags);
 
 	if (!in) {
-		dev_kfree_skb_any(skb);
+		if (skb)
+			dev_kfree_skb_any(skb);
 		return NETDEV_TX_OK;
 	}
 
 	/* apply outgoing CDC or RNDIS filters */
-	if (!is_promisc(cdc_filter)) {
+	if (!flush && !is_promisc(cdc_filter)) {
 		u8		*dest = skb->data;
 
 		if (is_multicast_ether_addr(dest)) {
@@ -568,10 +586,24 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		if (dev->port_usb)
 			skb = dev->wrap(dev->port_usb, skb);
 		spin_unlock_irqrestore(&dev->lock, flags);
-		if (!skb)
+
+		/* the function may be holding this frame, or have sent an
+		 * earlier transfer and kept this one to start the next
+		 */
+		if (multi_frame && !flush && !hrtimer_active(&dev->tx_timer))
+			hrtimer_start(&dev->tx_timer,
+				ktime_set(0, tx_flush_us * NSEC_PER_USEC),
+				HRTIMER_MODE_REL);
+		if (!skb) {
+			/* not a drop: the frame waits for the next ones */
+			if (multi_frame)
+				goto multiframe;
 			goto drop;
+		}
 
 		length = skb->len;
+	} else if (flush) {
+		goto multiframe;
 	}
 	req->buf = skb->data;
 	req->context = skb;
@@ -607,6 +639,7 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		dev_kfree_skb_any(skb);
 drop:
 		dev->net->stats.tx_dropped++;
+multiframe:
 		spin_lock_irqsave(&dev->req_lock, flags);
 		if (list_empty(&dev->tx_reqs))
 			netif_start_queue(net);
@@ -616,6 +649,35 @@ drop:
 	return NETDEV_TX_OK;
 }
 
+/*
+ * No frame came in to fill up the transfer a multi-frame function is
+ * holding, so send it as it is.  The timer fires in hardirq context;
+ * the flush goes through the xmit path, under the netdev tx lock.
+ */
+static enum hrtimer_restart eth_tx_timeout(struct hrtimer *timer)
+{
+	struct eth_dev	*dev = container_of(timer, struct eth_dev, tx_timer);
+
+	tasklet_schedule(&dev->tx_tasklet);
+	return HRTIMER_NORESTART;
+}
+
+static void eth_tx_flush(unsigned long data)
+{
+	struct eth_dev	*dev = (struct eth_dev *) data;
+	netdev_tx_t	status;
+
+	netif_tx_lock(dev->net);
+	status = eth_start_xmit(NULL, dev->net);
+	netif_tx_unlock(dev->net);
+
+	/* all requests in flight; try again once they've had time */
+	if (status == NETDEV_TX_BUSY)
+		hrtimer_start(&dev->tx_timer,
+			ktime_set(0, tx_flush_us * NSEC_PER_USEC),
+			HRTIMER_MODE_REL);
+}
+
 /*-------------------------------------------------------------------------*/
 
 static void eth_start(struct eth_dev *dev, gfp_t gfp_flags)
@@ -779,6 +841,10 @@ int __init gether_setup(struct usb_gadget *g, u8 ethaddr[ETH_ALEN])
 	INIT_LIST_HEAD(&dev->tx_reqs);
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
+	hrtimer_init(&dev->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dev->tx_timer.function = eth_tx_timeout;
+	tasklet_init(&dev->tx_tasklet, eth_tx_flush, (unsigned long) dev);
+
 	skb_queue_head_init(&dev->rx_frames);
 
 	/* network device setup */
@@ -834,6 +900,9 @@ void gether_cleanup(void)
 	if (!the_dev)
 		return;
 
+	hrtimer_cancel(&the_dev->tx_timer);
+	tasklet_kill(&the_dev->tx_tasklet);
+
 	unregister_netdev(the_dev->net);
 	free_netdev(the_dev->net);
 
@@ -949,6 +1018,9 @@ void gether_disconnect(struct gether *link)
 	netif_stop_queue(dev->net);
 	netif_carrier_off(dev->net);
 
+	/* a pending flush finds port_usb gone, and does nothing */
+	hrtimer_try_to_cancel(&dev->tx_timer);
+
 	/* disable endpoints, forcing (synchronous) completion
 	 * of all pending i/o.  then free the request objects
 	 * and forget about the endpoints.
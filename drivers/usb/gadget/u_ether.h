@@ -68,6 +68,16 @@ struct gether {
 						struct sk_buff *skb,
 						struct sk_buff_head *list);
 
+	/* Framings that carry several frames per transfer (RNDIS, NCM)
+	 * set is_multi_frame.  Their wrap() may then keep the frame it's
+	 * given and return NULL until a transfer is full; it's called
+	 * with a NULL skb to hand over a partial transfer when no more
+	 * frames came in for a while.  ul_max_xfer_size is the largest
+	 * transfer the host may send us, if more than one frame.
+	 */
+	bool				is_multi_frame;
+	u32				ul_max_xfer_size;
+
 	/* called on network open/close */
 	void				(*open)(struct gether *);
 	void				(*close)(struct gether *);
@@ -111,6 +121,7 @@ static inline bool can_support_ecm(struct usb_gadget *gadget)
 int geth_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN]);
 int ecm_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN]);
 int eem_bind_config(struct usb_configuration *c);
+int ncm_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN]);
 
 #if defined(CONFIG_USB_ETH_RNDIS) || defined(CONFIG_USB_ANDROID_RNDIS)
 
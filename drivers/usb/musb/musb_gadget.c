@@ -43,6 +43,8 @@
 #include <linux/moduleparam.h>
 #include <linux/stat.h>
 #include <linux/dma-mapping.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "musb_core.h"
 #include "omap2430.h"
@@ -259,7 +261,32 @@ static inline int max_ep_writesize(struct musb *musb, struct musb_ep *ep)
 
  * Non-Mentor DMA engines can of course work differently, such as by
  * upleveling from irq-per-packet to irq-per-buffer.
+ *
+ * A mode 1 transfer only loads the fifo as packets leave it, so a bulk
+ * request can be started from the completion of the one before, while
+ * that one's last packet still waits for an IN token.  That saves the
+ * TxAvail interrupt and keeps the fifo full between requests.
  */
+static int chain_tx = 1;
+
+/* "echo 0 > /sys/module/musb_hdrc/parameters/chain_tx" etc */
+module_param(chain_tx, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(chain_tx, "start bulk IN requests behind the one before");
+
+static inline int can_chain_tx(struct musb_ep *musb_ep,
+		struct usb_request *request)
+{
+	return chain_tx
+		&& musb_ep->dma
+		&& musb_ep->type == USB_ENDPOINT_XFER_BULK
+		&& request->dma != DMA_ADDR_INVALID
+		&& !((request->dma + request->actual) % 4)
+		&& request->length - request->actual >= musb_ep->packet_sz;
+}
+
+#else
+
+#define can_chain_tx(musb_ep, request)	0
 
 #endif
 
@@ -278,6 +305,7 @@ static void txstate(struct musb *musb, struct musb_request *req)
 	struct usb_request	*request;
 	u16			fifo_count = 0, csr;
 	int			use_dma = 0;
+	int			chained = 0;
 
 	musb_ep = req->ep;
 
@@ -295,9 +323,12 @@ static void txstate(struct musb *musb, struct musb_request *req)
 			(int)(request->length - request->actual));
 
 	if (csr & MUSB_TXCSR_TXPKTRDY) {
-		DBG(5, "%s old packet still ready , txcsr %03x\n",
-				musb_ep->end_point.name, csr);
-		return;
+		if (!can_chain_tx(musb_ep, request)) {
+			DBG(5, "%s old packet still ready , txcsr %03x\n",
+					musb_ep->end_point.name, csr);
+			return;
+		}
+		chained = 1;
 	}
 
 	if (csr & MUSB_TXCSR_P_SENDSTALL) {
@@ -357,8 +388,15 @@ static void txstate(struct musb *musb, struct musb_request *req)
 							| MUSB_TXCSR_DMAMODE
 							| MUSB_TXCSR_MODE);
 
-				csr &= ~MUSB_TXCSR_P_UNDERRUN;
+				/* don't set TXPKTRDY for a chained request */
+				csr &= ~(MUSB_TXCSR_P_UNDERRUN
+						| MUSB_TXCSR_TXPKTRDY);
 				musb_writew(epio, MUSB_TXCSR, csr);
+				if (chained)
+					musb_ep->stats.chained++;
+			} else if (chained) {
+				/* the fifo is busy; wait for TxAvail */
+				return;
 			}
 		}
 
@@ -410,6 +448,7 @@ static void txstate(struct musb *musb, struct musb_request *req)
 		musb_write_fifo(musb_ep->hw_ep, fifo_count,
 				(u8 *) (request->buf + request->actual));
 		request->actual += fifo_count;
+		musb_ep->stats.pio_bytes += fifo_count;
 		csr |= MUSB_TXCSR_TXPKTRDY;
 		csr &= ~MUSB_TXCSR_P_UNDERRUN;
 		musb_writew(epio, MUSB_TXCSR, csr);
@@ -443,6 +482,7 @@ void musb_g_tx(struct musb *musb, u8 epnum)
 	csr = musb_readw(epio, MUSB_TXCSR);
 	DBG(4, "<== %s, txcsr %04x\n", musb_ep->end_point.name, csr);
 
+	musb_ep->stats.irqs++;
 	dma = is_dma_capable() ? musb_ep->dma : NULL;
 	do {
 		/* CSR cannot be zero. If we encounter this condition, just free
@@ -495,6 +535,9 @@ void musb_g_tx(struct musb *musb, u8 epnum)
 				/* ensure writebuffer is empty */
 				csr = musb_readw(epio, MUSB_TXCSR);
 				request->actual += musb_ep->dma->actual_len;
+				musb_ep->stats.dma_irqs++;
+				musb_ep->stats.dma_bytes +=
+						musb_ep->dma->actual_len;
 				DBG(4, "TXCSR%d %04x, dma off, "
 						"len %zu, req %p\n",
 					epnum, csr,
@@ -538,14 +581,11 @@ void musb_g_tx(struct musb *musb, u8 epnum)
 
 				/* kickstart next transfer if appropriate;
 				 * the packet that just completed might not
-				 * be transmitted for hours or days.
-				 * REVISIT for double buffering...
+				 * be transmitted for hours or days.  Only
+				 * mode 1 DMA can be queued behind it.
 				 * FIXME revisit for stalls too...
 				 */
 				musb_ep_select(mbase, epnum);
-				csr = musb_readw(epio, MUSB_TXCSR);
-				if (csr & MUSB_TXCSR_FIFONOTEMPTY)
-					break;
 				request = musb_ep->desc
 						? next_request(musb_ep)
 						: NULL;
@@ -554,6 +594,11 @@ void musb_g_tx(struct musb *musb, u8 epnum)
 						musb_ep->end_point.name);
 					break;
 				}
+				csr = musb_readw(epio, MUSB_TXCSR);
+				if ((csr & MUSB_TXCSR_FIFONOTEMPTY)
+						&& !can_chain_tx(musb_ep,
+							request))
+					break;
 			}
 
 			txstate(musb, to_musb_request(request));
@@ -567,7 +612,8 @@ void musb_g_tx(struct musb *musb, u8 epnum)
 #ifdef CONFIG_USB_INVENTRA_DMA
 
 /* Peripheral rx (OUT) using Mentor DMA works as follows:
-	- Only mode 0 is used.
+	- Mode 0 is used, unless the request has short_not_ok set
+	  and is a whole number of packets; see rx_use_mode1().
 
 	- Request is queued by the gadget class driver.
 		-> if queue was previously empty, rxstate()
@@ -593,6 +639,25 @@ void musb_g_tx(struct musb *musb, u8 epnum)
  * Non-Mentor DMA engines can of course work differently.
  */
 
+/*
+ * Mode 1 moves a whole request without an interrupt per packet, but a
+ * short packet doesn't end it; so it's only used when the gadget driver
+ * says a short packet would be an error anyway (mass storage data).
+ * The packet of len bytes already in the fifo must be a full one too,
+ * as its interrupt is the one a short packet would have raised.
+ */
+static inline int rx_use_mode1(struct musb_ep *musb_ep,
+		struct usb_request *request, u16 len)
+{
+	unsigned	left = request->length - request->actual;
+
+	return request->short_not_ok
+		&& musb_ep->type == USB_ENDPOINT_XFER_BULK
+		&& len == musb_ep->packet_sz
+		&& left > musb_ep->packet_sz
+		&& !(left % musb_ep->packet_sz);
+}
+
 #endif
 
 /*
@@ -655,9 +720,11 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 				struct dma_controller	*c;
 				struct dma_channel	*channel;
 				int			use_dma = 0;
+				int			mode1;
 
 				c = musb->dma_controller;
 				channel = musb_ep->dma;
+				mode1 = rx_use_mode1(musb_ep, request, len);
 
 	/* We use DMA Req mode 0 in rx_csr, and DMA controller operates in
 	 * mode 0 only. So we do not get endpoint interrupts due to DMA
@@ -676,32 +743,33 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 	 * to get endpoint interrupt on every DMA req, but that didn't seem
 	 * to work reliably.
 	 *
-	 * REVISIT an updated g_file_storage can set req->short_not_ok, which
-	 * then becomes usable as a runtime "use mode 1" hint...
+	 * Gadget drivers that know the size, like g_file_storage, set
+	 * req->short_not_ok; that's our runtime "use mode 1" hint.
 	 */
 
 				csr |= MUSB_RXCSR_DMAENAB;
-#ifdef USE_MODE1
-				csr |= MUSB_RXCSR_AUTOCLEAR;
-				/* csr |= MUSB_RXCSR_DMAMODE; */
+				if (mode1) {
+					csr |= MUSB_RXCSR_AUTOCLEAR;
 
-				/* this special sequence (enabling and then
-				 * disabling MUSB_RXCSR_DMAMODE) is required
-				 * to get DMAReq to activate
-				 */
-				musb_writew(epio, MUSB_RXCSR,
-					csr | MUSB_RXCSR_DMAMODE);
-#endif
+					/* this special sequence (enabling and
+					 * then disabling MUSB_RXCSR_DMAMODE)
+					 * is required to get DMAReq to activate
+					 */
+					musb_writew(epio, MUSB_RXCSR,
+						csr | MUSB_RXCSR_DMAMODE);
+				}
 				musb_writew(epio, MUSB_RXCSR, csr);
 
 				if (request->actual < request->length) {
 					int transfer_size = 0;
-#ifdef USE_MODE1
-					transfer_size = min(request->length,
+
+					if (mode1)
+						transfer_size = min(
+							request->length
+							- request->actual,
 							channel->max_len);
-#else
-					transfer_size = len;
-#endif
+					else
+						transfer_size = len;
 					if (transfer_size <= musb_ep->packet_sz)
 						musb_ep->dma->desired_mode = 0;
 					else
@@ -720,11 +788,9 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 					return;
 
 				/* disable the MUSB DMA if it is failed */
-				csr &= ~MUSB_RXCSR_DMAENAB;
-#ifdef USE_MODE1
-				csr &= ~MUSB_RXCSR_AUTOCLEAR;
-				csr &= ~MUSB_RXCSR_DMAMODE;
-#endif
+				csr &= ~(MUSB_RXCSR_DMAENAB
+						| MUSB_RXCSR_AUTOCLEAR
+						| MUSB_RXCSR_DMAMODE);
 				musb_writew(epio, MUSB_RXCSR, csr);
 			}
 #endif	/* Mentor's DMA */
@@ -757,6 +823,7 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 			musb_read_fifo(musb_ep->hw_ep, fifo_count, (u8 *)
 					(request->buf + request->actual));
 			request->actual += fifo_count;
+			musb_ep->stats.pio_bytes += fifo_count;
 
 			/* REVISIT if we left anything in the fifo, flush
 			 * it and report -EOVERFLOW
@@ -774,6 +841,24 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 		musb_g_giveback(musb_ep, request, 0);
 }
 
+#ifdef CONFIG_USB_INVENTRA_DMA
+/*
+ * Give an OUT request's buffer back to the CPU, so that what DMA didn't
+ * move can be read from the fifo; musb_g_giveback() then leaves it be.
+ */
+static void musb_g_unmap_for_pio(struct musb *musb, struct musb_request *req)
+{
+	if (req->mapped) {
+		dma_unmap_single(musb->controller, req->request.dma,
+				req->request.length, DMA_FROM_DEVICE);
+		req->mapped = 0;
+	} else if (req->request.dma != DMA_ADDR_INVALID)
+		dma_sync_single_for_cpu(musb->controller, req->request.dma,
+				req->request.length, DMA_FROM_DEVICE);
+	req->request.dma = DMA_ADDR_INVALID;
+}
+#endif
+
 /*
  * Data ready for a request; called from IRQ
  */
@@ -796,6 +881,8 @@ void musb_g_rx(struct musb *musb, u8 epnum)
 	DBG(4, "<== %s, rxcsr %04x%s %p\n", musb_ep->end_point.name,
 			csr, dma ? " (dma)" : "", request);
 
+	musb_ep->stats.irqs++;
+
 	if (csr & MUSB_RXCSR_P_SENTSTALL) {
 		csr |= MUSB_RXCSR_P_WZC_BITS;
 		csr &= ~MUSB_RXCSR_P_SENTSTALL;
@@ -818,6 +905,44 @@ void musb_g_rx(struct musb *musb, u8 epnum)
 	}
 
 	if (dma_channel_status(dma) == MUSB_DMA_STATUS_BUSY) {
+#ifdef CONFIG_USB_INVENTRA_DMA
+		/* a short packet in mode 1, which the request said would
+		 * be an error: stop there and let the gadget driver know
+		 */
+		if (request && dma->desired_mode
+				&& (csr & MUSB_RXCSR_RXPKTRDY)
+				&& musb_readw(epio, MUSB_RXCOUNT)
+					< musb_ep->packet_sz) {
+			u16 fifo_count, len;
+
+			musb->dma_controller->channel_abort(dma);
+			request->actual += dma->actual_len;
+			musb_ep->stats.dma_bytes += dma->actual_len;
+
+			/* the short packet itself is still in the fifo */
+			musb_g_unmap_for_pio(musb, to_musb_request(request));
+			fifo_count = musb_readw(epio, MUSB_RXCOUNT);
+			len = min_t(unsigned, fifo_count,
+					request->length - request->actual);
+			musb_read_fifo(musb_ep->hw_ep, len, (u8 *)
+					(request->buf + request->actual));
+			request->actual += len;
+			musb_ep->stats.pio_bytes += len;
+
+			csr = musb_readw(epio, MUSB_RXCSR);
+			csr |= MUSB_RXCSR_P_WZC_BITS;
+			if (len < fifo_count)
+				csr |= MUSB_RXCSR_FLUSHFIFO;
+			csr &= ~MUSB_RXCSR_RXPKTRDY;
+			musb_writew(epio, MUSB_RXCSR, csr);
+
+			DBG(3, "%s short packet in mode 1, %d/%d\n",
+				musb_ep->end_point.name,
+				request->actual, request->length);
+			musb_g_giveback(musb_ep, request, -EREMOTEIO);
+			return;
+		}
+#endif
 		/* "should not happen"; likely RXPKTRDY pending for DMA */
 		DBG((csr & MUSB_RXCSR_DMAENAB) ? 4 : 1,
 			"%s busy, csr %04x\n",
@@ -833,6 +958,8 @@ void musb_g_rx(struct musb *musb, u8 epnum)
 			MUSB_RXCSR_P_WZC_BITS | csr);
 
 		request->actual += musb_ep->dma->actual_len;
+		musb_ep->stats.dma_irqs++;
+		musb_ep->stats.dma_bytes += musb_ep->dma->actual_len;
 
 		DBG(4, "RXCSR%d %04x, dma off, %04x, len %zu, req %p\n",
 			epnum, csr,
@@ -854,6 +981,16 @@ void musb_g_rx(struct musb *musb, u8 epnum)
 				&& (musb_ep->dma->actual_len
 					== musb_ep->packet_sz))
 			return;
+#endif
+#ifdef CONFIG_USB_INVENTRA_DMA
+		/* mode 1 stops at max_len; go on with the rest */
+		if (dma->desired_mode
+				&& (request->actual < request->length)
+				&& !(dma->actual_len
+					& (musb_ep->packet_sz - 1))) {
+			rxstate(musb, to_musb_request(request));
+			return;
+		}
 #endif
 		musb_g_giveback(musb_ep, request, 0);
 
@@ -1191,6 +1328,7 @@ static int musb_gadget_queue(struct usb_ep *ep, struct usb_request *req,
 
 	/* add request to the list */
 	list_add_tail(&(request->request.list), &(musb_ep->req_list));
+	musb_ep->stats.requests++;
 
 	/* it this is the head of the queue, start i/o ... */
 	if (!musb_ep->busy && &request->request.list == musb_ep->req_list.next)
@@ -1674,6 +1812,103 @@ static inline void __init musb_g_init_endpoints(struct musb *musb)
 	}
 }
 
+#ifdef CONFIG_DEBUG_FS
+
+/*
+ * debugfs "musb_gadget_stats": per endpoint requests, completions (all,
+ * and those of DMA transfers), DMA transfers started behind a pending
+ * packet, and bytes moved by PIO and by DMA.  Writing to it clears them.
+ */
+static struct dentry *musb_g_debugfs;
+
+static void musb_g_ep_stats_show(struct seq_file *s, struct musb_ep *ep)
+{
+	struct musb_ep_stats	*st = &ep->stats;
+
+	if (!st->requests && !st->irqs)
+		return;
+	seq_printf(s, "%-8s %9lu %9lu %9lu %9lu %12lu %12lu\n",
+			ep->name, st->requests, st->irqs, st->dma_irqs,
+			st->chained, st->pio_bytes, st->dma_bytes);
+}
+
+static int musb_g_stats_show(struct seq_file *s, void *unused)
+{
+	struct musb		*musb = s->private;
+	struct musb_hw_ep	*hw_ep;
+	unsigned long		flags;
+	u8			epnum;
+
+	seq_printf(s, "%-8s %9s %9s %9s %9s %12s %12s\n", "ep",
+			"requests", "irqs", "dma_irqs", "chained",
+			"pio_bytes", "dma_bytes");
+
+	spin_lock_irqsave(&musb->lock, flags);
+	for (epnum = 1, hw_ep = musb->endpoints + 1;
+			epnum < musb->nr_endpoints;
+			epnum++, hw_ep++) {
+		musb_g_ep_stats_show(s, &hw_ep->ep_in);
+		if (!hw_ep->is_shared_fifo)
+			musb_g_ep_stats_show(s, &hw_ep->ep_out);
+	}
+	spin_unlock_irqrestore(&musb->lock, flags);
+
+	return 0;
+}
+
+static int musb_g_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, musb_g_stats_show, inode->i_private);
+}
+
+static ssize_t musb_g_stats_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct musb		*musb = file->f_dentry->d_inode->i_private;
+	struct musb_hw_ep	*hw_ep;
+	unsigned long		flags;
+	u8			epnum;
+
+	spin_lock_irqsave(&musb->lock, flags);
+	for (epnum = 1, hw_ep = musb->endpoints + 1;
+			epnum < musb->nr_endpoints;
+			epnum++, hw_ep++) {
+		memset(&hw_ep->ep_in.stats, 0, sizeof hw_ep->ep_in.stats);
+		memset(&hw_ep->ep_out.stats, 0, sizeof hw_ep->ep_out.stats);
+	}
+	spin_unlock_irqrestore(&musb->lock, flags);
+
+	return count;
+}
+
+static const struct file_operations musb_g_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= musb_g_stats_open,
+	.read		= seq_read,
+	.write		= musb_g_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void musb_g_debugfs_init(struct musb *musb)
+{
+	musb_g_debugfs = debugfs_create_file("musb_gadget_stats",
+			S_IRUGO | S_IWUSR, NULL, musb, &musb_g_stats_fops);
+}
+
+static void musb_g_debugfs_exit(void)
+{
+	debugfs_remove(musb_g_debugfs);
+	musb_g_debugfs = NULL;
+}
+
+#else
+
+static inline void musb_g_debugfs_init(struct musb *musb) { }
+static inline void musb_g_debugfs_exit(void) { }
+
+#endif	/* CONFIG_DEBUG_FS */
+
 /* called once during driver setup to initialize and link into
  * the driver model; memory is zeroed.
  */
@@ -1711,6 +1946,8 @@ int __init musb_gadget_setup(struct musb *musb)
 	status = device_register(&musb->g.dev);
 	if (status != 0)
 		the_gadget = NULL;
+	else
+		musb_g_debugfs_init(musb);
 	return status;
 }
 
@@ -1719,6 +1956,7 @@ void musb_gadget_cleanup(struct musb *musb)
 	if (musb != the_gadget)
 		return;
 
+	musb_g_debugfs_exit();
 	device_unregister(&musb->g.dev);
 	the_gadget = NULL;
 }
@@ -57,6 +57,16 @@ extern void musb_free_request(struct usb_ep *ep, struct usb_request *req);
 /*
  * struct musb_ep - peripheral side view of endpoint rx or tx side
  */
+/* where an endpoint's data went, as shown in debugfs */
+struct musb_ep_stats {
+	unsigned long			requests;
+	unsigned long			irqs;		/* all completions */
+	unsigned long			dma_irqs;	/* ... of DMA */
+	unsigned long			chained;	/* DMA queued early */
+	unsigned long			pio_bytes;
+	unsigned long			dma_bytes;
+};
+
 struct musb_ep {
 	/* stuff towards the head is basically write-once. */
 	struct usb_ep			end_point;
@@ -77,6 +87,8 @@ struct musb_ep {
 
 	/* true if lock must be dropped but req_list may not be advanced */
 	u8				busy;
+
+	struct musb_ep_stats		stats;
 };
 
 static inline struct musb_ep *to_musb_ep(struct usb_ep *ep)
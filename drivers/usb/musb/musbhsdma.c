@@ -91,7 +91,9 @@ static struct dma_channel *dma_channel_allocate(struct dma_controller *c,
 			channel->private_data = musb_channel;
 			channel->status = MUSB_DMA_STATUS_FREE;
 			channel->max_len = 0x10000;
-			/* Tx => mode 1; Rx => mode 0 */
+			/* Tx => mode 1; Rx => mode 0, unless the gadget
+			 * side knows the transfer has no short packets
+			 */
 			channel->desired_mode = transmit;
 			channel->actual_len = 0;
 			break;
@@ -245,6 +247,10 @@ static int dma_channel_abort(struct dma_channel *channel)
 			musb_writew(mbase, offset, csr);
 		}
 
+		/* say how far it got, for callers cutting a transfer short */
+		channel->actual_len = musb_read_hsdma_addr(mbase, bchannel)
+				- musb_channel->start_addr;
+
 		musb_writew(mbase,
 			MUSB_HSDMA_CHANNEL_OFFSET(bchannel, MUSB_HSDMA_CONTROL),
 			0);
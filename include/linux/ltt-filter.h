@@ -0,0 +1,90 @@
+#ifndef _LINUX_LTT_FILTER_H
+#define _LINUX_LTT_FILTER_H
+
+/*
+ * LTT event filter bytecode.
+ *
+ * A filter expression written to /debugfs/ltt/filter/event is compiled
+ * by ltt-filter.c into a short program for a small stack machine, which
+ * the serializers run on the event fields before reserving any buffer
+ * space.  Jumps only go forward and the stack depth of every instruction
+ * is checked at load time, so a program always terminates and can neither
+ * underflow nor overflow its stack.
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ */
+
+#include <linux/types.h>
+#include <stdarg.h>
+
+#define LTT_FILTER_MAX_INSNS	64
+#define LTT_FILTER_MAX_CONSTS	16
+#define LTT_FILTER_MAX_FIELDS	8
+#define LTT_FILTER_MAX_ARGS	16
+#define LTT_FILTER_STACK	8
+
+enum ltt_filter_op {
+	LTT_FILTER_RET,		/* return top of stack != 0 */
+	LTT_FILTER_FIELD,	/* push field[arg] */
+	LTT_FILTER_CONST,	/* push consts[arg] */
+	LTT_FILTER_PID,		/* push current->pid */
+	LTT_FILTER_TGID,	/* push current->tgid */
+	LTT_FILTER_CPU,		/* push the current CPU */
+	LTT_FILTER_NOT,
+	LTT_FILTER_BOOL,	/* top = top != 0 */
+	LTT_FILTER_AND,		/* bitwise */
+	LTT_FILTER_EQ,
+	LTT_FILTER_NE,
+	LTT_FILTER_LT,
+	LTT_FILTER_LE,
+	LTT_FILTER_GT,
+	LTT_FILTER_GE,
+	LTT_FILTER_JZ,		/* top == 0 ? skip arg insns : pop */
+	LTT_FILTER_JNZ,		/* top != 0 ? skip arg insns : pop */
+};
+
+struct ltt_filter_insn {
+	u8 op;
+	u8 arg;
+};
+
+/*
+ * A field as recorded in the trace: at offset in the payload of
+ * specialized probes, size bytes, sign extended or not.
+ */
+struct ltt_filter_field {
+	u16 offset;
+	u8 size;
+	u8 sign;
+};
+
+/*
+ * A marker argument, for walking the va_list of ltt_vtrace(): its C size
+ * (0 for a string) and the field it feeds, or -1.
+ */
+struct ltt_filter_arg {
+	u8 c_size;
+	s8 field;
+};
+
+struct ltt_filter {
+	unsigned int nr_insns;
+	unsigned int nr_consts;
+	unsigned int nr_fields;
+	unsigned int nr_args;
+	struct ltt_filter_insn insns[LTT_FILTER_MAX_INSNS];
+	s64 consts[LTT_FILTER_MAX_CONSTS];
+	struct ltt_filter_field fields[LTT_FILTER_MAX_FIELDS];
+	struct ltt_filter_arg args[LTT_FILTER_MAX_ARGS];
+};
+
+extern int ltt_filter_verify(const struct ltt_filter *filter);
+extern int ltt_filter_match_va(const struct ltt_filter *filter,
+			       va_list *args);
+extern int ltt_filter_match_data(const struct ltt_filter *filter,
+				 const void *data);
+
+extern int ltt_marker_set_filter(const char *channel, const char *mname,
+				 struct ltt_filter *filter);
+
+#endif /* _LINUX_LTT_FILTER_H */
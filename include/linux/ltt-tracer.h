@@ -20,6 +20,7 @@
 #include <linux/ltt-relay.h>
 #include <linux/ltt-channels.h>
 #include <linux/ltt-core.h>
+#include <linux/ltt-filter.h>
 #include <linux/marker.h>
 #include <linux/trace-clock.h>
 #include <asm/atomic.h>
@@ -113,6 +114,7 @@ struct ltt_active_marker {
 	const char *name;
 	const char *format;
 	struct ltt_available_probe *probe;
+	struct ltt_filter *filter;	/* RCU-sched, NULL records all */
 };
 
 extern void ltt_vtrace(const struct marker *mdata, void *probe_data,
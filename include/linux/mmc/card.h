@@ -44,11 +44,29 @@ struct mmc_ext_csd {
 	u8			rev;
 	u8			csd_structure;
 	u8			rel_wr_sec_c;
+	u8			rel_param;
+	u8			max_packed_writes;
 	unsigned int		sa_timeout;		/* Units: 100ns */
 	unsigned int		hs_max_dtr;
 	unsigned int		sectors;
 };
 
+/*
+ * Counted by the block driver, shown in debugfs.
+ */
+struct mmc_blk_stats {
+	unsigned long		reads;		/* read commands */
+	unsigned long		read_blocks;
+	unsigned long		writes;		/* write commands */
+	unsigned long		write_blocks;
+	unsigned long		sbc;		/* preceded by CMD23 */
+	unsigned long		stops;		/* followed by CMD12 */
+	unsigned long		rel_writes;	/* reliable writes */
+	unsigned long		packed;		/* packed writes */
+	unsigned long		packed_reqs;	/* requests they carried */
+	unsigned long		packed_fail;	/* redone request by request */
+};
+
 struct sd_scr {
 	unsigned char		sda_vsn;
 	unsigned char		bus_widths;
@@ -121,6 +139,8 @@ struct mmc_card {
 	const char		**info;		/* info strings */
 	struct sdio_func_tuple	*tuples;	/* unknown common tuples */
 
+	struct mmc_blk_stats	blk_stats;	/* block driver counters */
+
 	struct dentry		*debugfs_root;
 };
 
@@ -82,6 +82,19 @@ struct mmc_host_ops {
 	int (*enable)(struct mmc_host *host);
 	int (*disable)(struct mmc_host *host, int lazy);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
+	/*
+	 * 'pre_req' and 'post_req' let the host do the work of a request that
+	 * does not need the bus, like mapping its data for DMA and the cache
+	 * maintenance that goes with it, ahead of 'request' and after it has
+	 * completed.  The block driver calls 'pre_req' for its next request
+	 * while the current one is in flight; 'is_first_req' is set when
+	 * nothing is.  Both are optional and called in process context, and
+	 * a request is always passed to 'post_req' if it went to 'pre_req'.
+	 */
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req,
+			   bool is_first_req);
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
 	 * since underlaying controller might implement them in an expensive
@@ -156,6 +169,7 @@ struct mmc_host {
 #define MMC_CAP_DISABLE		(1 << 7)	/* Can the host be disabled */
 #define MMC_CAP_NONREMOVABLE	(1 << 8)	/* Nonremovable e.g. eMMC */
 #define MMC_CAP_WAIT_WHILE_BUSY	(1 << 9)	/* Waits while card is busy */
+#define MMC_CAP_CMD23		(1 << 10)	/* No auto CMD12, CMD23 is fine */
 
 	/* host specific block data */
 	unsigned int		max_seg_size;	/* see blk_queue_max_segment_size */
@@ -258,6 +258,7 @@ struct _mmc_csd {
  * EXT_CSD fields
  */
 
+#define EXT_CSD_WR_REL_PARAM	166	/* RO */
 #define EXT_CSD_BUS_WIDTH	183	/* R/W */
 #define EXT_CSD_HS_TIMING	185	/* R/W */
 #define EXT_CSD_REV		192	/* RO */
@@ -266,6 +267,7 @@ struct _mmc_csd {
 #define EXT_CSD_SEC_CNT		212	/* RO, 4 bytes */
 #define EXT_CSD_S_A_TIMEOUT	217
 #define EXT_CSD_REL_WR_SEC_C    222	/* RO */
+#define EXT_CSD_MAX_PACKED_WRITES 500	/* RO */
 /*
  * EXT_CSD field definitions
  */
@@ -285,6 +287,23 @@ struct _mmc_csd {
 #define EXT_CSD_BUS_WIDTH_4	1	/* Card is in 4 bit mode */
 #define EXT_CSD_BUS_WIDTH_8	2	/* Card is in 8 bit mode */
 
+#define EXT_CSD_WR_REL_PARAM_EN	(1<<2)	/* Reliable writes of any size */
+
+/*
+ * MMC_SET_BLOCK_COUNT argument
+ */
+
+#define MMC_CMD23_ARG_REL_WR	(1 << 31)	/* Reliable write */
+#define MMC_CMD23_ARG_PACKED	(1 << 30)	/* Packed command follows */
+
+/*
+ * Packed command header, in the first block of a packed write
+ */
+
+#define MMC_PACKED_VER		0x01
+#define MMC_PACKED_WR		0x02
+#define MMC_PACKED_MAX_ENTRIES	63	/* that fit in a 512 byte header */
+
 /*
  * MMC_SWITCH access modes
  */
@@ -304,6 +304,40 @@ extern void scheduler_tick(void);
 
 extern void sched_show_task(struct task_struct *p);
 
+/*
+ * Runqueue load change events published by CFS to frequency governors.
+ * Notifiers are called with the runqueue lock held and interrupts
+ * disabled: they must not sleep, and must not wake up tasks.
+ */
+enum {
+	SCHED_LOAD_ENQUEUE,
+	SCHED_LOAD_WAKEUP,
+	SCHED_LOAD_DEQUEUE,
+};
+
+struct sched_load_info {
+	int cpu;
+	unsigned long load;		/* runnable CFS weight on @cpu */
+	unsigned int nr_running;	/* runnable CFS tasks on @cpu */
+	u64 time;			/* rq clock of the event, in ns */
+};
+
+struct notifier_block;
+
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+extern int register_sched_load_notifier(struct notifier_block *nb);
+extern int unregister_sched_load_notifier(struct notifier_block *nb);
+#else
+static inline int register_sched_load_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+static inline int unregister_sched_load_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_DETECT_SOFTLOCKUP
 extern void softlockup_tick(void);
 extern void touch_softlockup_watchdog(void);
@@ -18,6 +18,7 @@
 #define USB_CDC_SUBCLASS_MDLM			0x0a
 #define USB_CDC_SUBCLASS_OBEX			0x0b
 #define USB_CDC_SUBCLASS_EEM			0x0c
+#define USB_CDC_SUBCLASS_NCM			0x0d
 
 #define USB_CDC_PROTO_NONE			0
 
@@ -31,6 +32,8 @@
 
 #define USB_CDC_PROTO_EEM			7
 
+#define USB_CDC_NCM_PROTO_NTB			1
+
 /*-------------------------------------------------------------------------*/
 
 /*
@@ -49,6 +52,7 @@
 #define USB_CDC_MDLM_DETAIL_TYPE	0x13	/* mdlm_detail_desc */
 #define USB_CDC_DMM_TYPE		0x14
 #define USB_CDC_OBEX_TYPE		0x15
+#define USB_CDC_NCM_TYPE		0x1a
 
 /* "Header Functional Descriptor" from CDC spec  5.2.3.1 */
 struct usb_cdc_header_desc {
@@ -174,6 +178,22 @@ struct usb_cdc_obex_desc {
 	__le16	bcdVersion;
 } __attribute__ ((packed));
 
+/* "NCM Control Model Functional Descriptor" from CDC NCM spec 5.2.1 */
+struct usb_cdc_ncm_desc {
+	__u8	bLength;
+	__u8	bDescriptorType;
+	__u8	bDescriptorSubType;
+
+	__le16	bcdNcmVersion;
+	__u8	bmNetworkCapabilities;
+} __attribute__ ((packed));
+
+#define USB_CDC_NCM_NCAP_ETH_FILTER		(1 << 0)
+#define USB_CDC_NCM_NCAP_NET_ADDRESS		(1 << 1)
+#define USB_CDC_NCM_NCAP_ENCAP_COMMAND		(1 << 2)
+#define USB_CDC_NCM_NCAP_MAX_DATAGRAM_SIZE	(1 << 3)
+#define USB_CDC_NCM_NCAP_CRC_MODE		(1 << 4)
+
 /*-------------------------------------------------------------------------*/
 
 /*
@@ -197,6 +217,17 @@ struct usb_cdc_obex_desc {
 #define USB_CDC_GET_ETHERNET_PM_PATTERN_FILTER	0x42
 #define USB_CDC_SET_ETHERNET_PACKET_FILTER	0x43
 #define USB_CDC_GET_ETHERNET_STATISTIC		0x44
+#define USB_CDC_GET_NTB_PARAMETERS		0x80
+#define USB_CDC_GET_NET_ADDRESS			0x81
+#define USB_CDC_SET_NET_ADDRESS			0x82
+#define USB_CDC_GET_NTB_FORMAT			0x83
+#define USB_CDC_SET_NTB_FORMAT			0x84
+#define USB_CDC_GET_NTB_INPUT_SIZE		0x85
+#define USB_CDC_SET_NTB_INPUT_SIZE		0x86
+#define USB_CDC_GET_MAX_DATAGRAM_SIZE		0x87
+#define USB_CDC_SET_MAX_DATAGRAM_SIZE		0x88
+#define USB_CDC_GET_CRC_MODE			0x89
+#define USB_CDC_SET_CRC_MODE			0x8a
 
 /* Line Coding Structure from CDC spec 6.2.13 */
 struct usb_cdc_line_coding {
@@ -223,6 +254,31 @@ struct usb_cdc_line_coding {
 #define	USB_CDC_PACKET_TYPE_BROADCAST		(1 << 3)
 #define	USB_CDC_PACKET_TYPE_MULTICAST		(1 << 4) /* filtered */
 
+/* NTB Parameter Structure from CDC NCM spec 6.2.1 */
+struct usb_cdc_ncm_ntb_parameters {
+	__le16	wLength;
+	__le16	bmNtbFormatsSupported;
+#define USB_CDC_NCM_NTB16_SUPPORTED		(1 << 0)
+#define USB_CDC_NCM_NTB32_SUPPORTED		(1 << 1)
+
+	__le32	dwNtbInMaxSize;
+	__le16	wNdpInDivisor;
+	__le16	wNdpInPayloadRemainder;
+	__le16	wNdpInAlignment;
+	__le16	wPadding1;
+	__le32	dwNtbOutMaxSize;
+	__le16	wNdpOutDivisor;
+	__le16	wNdpOutPayloadRemainder;
+	__le16	wNdpOutAlignment;
+	__le16	wPadding2;
+} __attribute__ ((packed));
+
+/* SET_NTB_FORMAT and SET_CRC_MODE values, CDC NCM spec 6.2.5, 6.2.11 */
+#define USB_CDC_NCM_NTB16_FORMAT		0x00
+#define USB_CDC_NCM_NTB32_FORMAT		0x01
+#define USB_CDC_NCM_CRC_NOT_APPENDED		0x00
+#define USB_CDC_NCM_CRC_APPENDED		0x01
+
 
 /*-------------------------------------------------------------------------*/
 
@@ -247,4 +303,39 @@ struct usb_cdc_notification {
 	__le16	wLength;
 } __attribute__ ((packed));
 
+/*-------------------------------------------------------------------------*/
+
+/*
+ * NCM Transfer Blocks (CDC NCM spec 3.2, 3.3): a transfer header, the
+ * datagrams, and datagram pointer tables saying where they are.  Only
+ * the 16 bit format is defined here.
+ */
+
+#define USB_CDC_NCM_NTH16_SIGN		0x484D434E	/* "NCMH" */
+#define USB_CDC_NCM_NDP16_NOCRC_SIGN	0x304D434E	/* "NCM0" */
+#define USB_CDC_NCM_NDP16_CRC_SIGN	0x314D434E	/* "NCM1" */
+
+struct usb_cdc_ncm_nth16 {
+	__le32	dwSignature;
+	__le16	wHeaderLength;
+	__le16	wSequence;
+	__le16	wBlockLength;
+	__le16	wNdpIndex;
+} __attribute__ ((packed));
+
+struct usb_cdc_ncm_dpe16 {
+	__le16	wDatagramIndex;
+	__le16	wDatagramLength;
+} __attribute__ ((packed));
+
+struct usb_cdc_ncm_ndp16 {
+	__le32	dwSignature;
+	__le16	wLength;
+	__le16	wNextNdpIndex;
+	struct usb_cdc_ncm_dpe16 dpe16[0];
+} __attribute__ ((packed));
+
+#define USB_CDC_NCM_NTB_MIN_IN_SIZE	2048
+#define USB_CDC_NCM_NTB_MIN_OUT_SIZE	2048
+
 #endif /* __LINUX_USB_CDC_H */
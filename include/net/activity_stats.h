@@ -16,10 +16,14 @@
 #ifndef __activity_stats_h
 #define __activity_stats_h
 
+struct net_device;
+
 #ifdef CONFIG_NET_ACTIVITY_STATS
-void activity_stats_update(void);
+void activity_stats_update(uid_t uid);
+void activity_stats_dev_update(struct net_device *dev);
 #else
-#define activity_stats_update(void) {}
+#define activity_stats_update(uid) do {} while (0)
+#define activity_stats_dev_update(dev) do {} while (0)
 #endif
 
 #endif /* _NET_ACTIVITY_STATS_H */
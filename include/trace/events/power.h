@@ -75,6 +75,37 @@ TRACE_EVENT(power_frequency,
 	TP_printk("type=%lu state=%lu", (unsigned long)__entry->type, (unsigned long) __entry->state)
 );
 
+/*
+ * Emitted by a governor when it acts on a scheduler load hint; latency is
+ * the time between the runqueue event and the frequency decision.
+ */
+TRACE_EVENT(power_sched_hint,
+
+	TP_PROTO(unsigned int cpu, unsigned int old_freq, unsigned int new_freq,
+		 u64 latency),
+
+	TP_ARGS(cpu, old_freq, new_freq, latency),
+
+	TP_STRUCT__entry(
+		__field(	u32,		cpu		)
+		__field(	u32,		old_freq	)
+		__field(	u32,		new_freq	)
+		__field(	u64,		latency		)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->old_freq = old_freq;
+		__entry->new_freq = new_freq;
+		__entry->latency = latency;
+	),
+
+	TP_printk("cpu=%lu old_freq=%lu new_freq=%lu latency_ns=%llu",
+		  (unsigned long)__entry->cpu, (unsigned long)__entry->old_freq,
+		  (unsigned long)__entry->new_freq,
+		  (unsigned long long)__entry->latency)
+);
+
 #endif /* _TRACE_POWER_H */
 
 /* This part must be outside protection */
@@ -216,6 +216,34 @@ TRACE_EVENT(sched_migrate_task,
 		  __entry->orig_cpu, __entry->dest_cpu)
 );
 
+/*
+ * Tracepoint for a CFS runqueue load change published to governors:
+ */
+TRACE_EVENT(sched_load_hint,
+
+	TP_PROTO(struct sched_load_info *info, unsigned long type),
+
+	TP_ARGS(info, type),
+
+	TP_STRUCT__entry(
+		__field(	int,		cpu			)
+		__field(	unsigned long,	load			)
+		__field(	unsigned int,	nr_running		)
+		__field(	unsigned long,	type			)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= info->cpu;
+		__entry->load		= info->load;
+		__entry->nr_running	= info->nr_running;
+		__entry->type		= type;
+	),
+
+	TP_printk("cpu=%d load=%lu nr_running=%u type=%lu",
+		  __entry->cpu, __entry->load, __entry->nr_running,
+		  __entry->type)
+);
+
 /*
  * Tracepoint for freeing a task:
  */
@@ -1817,6 +1817,47 @@ static void cfs_rq_set_shares(struct cfs_rq *cfs_rq, unsigned long shares)
 static void calc_load_account_active(struct rq *this_rq);
 static void update_sysctl(void);
 
+#ifdef CONFIG_CPU_FREQ_SCHED_HINTS
+static ATOMIC_NOTIFIER_HEAD(sched_load_notifier_list);
+
+/**
+ * register_sched_load_notifier - be told when a runqueue's CFS load changes
+ * @nb: notifier block, called with a struct sched_load_info
+ *
+ * The callback runs under the runqueue lock with interrupts disabled, at
+ * enqueue and dequeue time, so that frequency governors can react to load
+ * changes without waiting for their next sampling period.
+ */
+int register_sched_load_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&sched_load_notifier_list, nb);
+}
+EXPORT_SYMBOL_GPL(register_sched_load_notifier);
+
+int unregister_sched_load_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&sched_load_notifier_list, nb);
+}
+EXPORT_SYMBOL_GPL(unregister_sched_load_notifier);
+
+static void sched_load_notify(struct rq *rq, unsigned long event)
+{
+	struct sched_load_info info;
+
+	info.cpu = cpu_of(rq);
+	info.load = rq->load.weight;
+	info.nr_running = rq->cfs.nr_running;
+	info.time = rq->clock;
+
+	trace_sched_load_hint(&info, event);
+	atomic_notifier_call_chain(&sched_load_notifier_list, event, &info);
+}
+#else
+static inline void sched_load_notify(struct rq *rq, unsigned long event)
+{
+}
+#endif
+
 #include "sched_stats.h"
 #include "sched_idletask.c"
 #include "sched_fair.c"
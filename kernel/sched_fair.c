@@ -1013,6 +1013,7 @@ static void enqueue_task_fair(struct rq *rq, struct task_struct *p, int wakeup)
 {
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
+	unsigned long event = wakeup ? SCHED_LOAD_WAKEUP : SCHED_LOAD_ENQUEUE;
 
 	for_each_sched_entity(se) {
 		if (se->on_rq)
@@ -1023,6 +1024,7 @@ static void enqueue_task_fair(struct rq *rq, struct task_struct *p, int wakeup)
 	}
 
 	hrtick_update(rq);
+	sched_load_notify(rq, event);
 }
 
 /*
@@ -1045,6 +1047,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int sleep)
 	}
 
 	hrtick_update(rq);
+	sched_load_notify(rq, SCHED_LOAD_DEQUEUE);
 }
 
 /*
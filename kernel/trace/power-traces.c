@@ -17,4 +17,5 @@
 EXPORT_TRACEPOINT_SYMBOL_GPL(power_start);
 EXPORT_TRACEPOINT_SYMBOL_GPL(power_end);
 EXPORT_TRACEPOINT_SYMBOL_GPL(power_frequency);
+EXPORT_TRACEPOINT_SYMBOL_GPL(power_sched_hint);
 
@@ -29,290 +29,169 @@
 #include <linux/compiler.h>
 #include <linux/types.h>
 #include <linux/init.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/slab.h>
 #include <asm/atomic.h>
 #include "crc32defs.h"
 
 #if CRC_LE_BITS > 8
-# define tole(x) (__force u32) __constant_cpu_to_le32(x)
+# define tole(x) ((__force u32) __constant_cpu_to_le32(x))
 #else
 # define tole(x) (x)
 #endif
 
 #if CRC_BE_BITS > 8
-# define tobe(x) (__force u32) __constant_cpu_to_be32(x)
+# define tobe(x) ((__force u32) __constant_cpu_to_be32(x))
 #else
 # define tobe(x) (x)
 #endif
 #include "crc32table.h"
 
 MODULE_AUTHOR("Matt Domsch <Matt_Domsch@dell.com>");
-MODULE_DESCRIPTION("Ethernet CRC32 calculations");
+MODULE_DESCRIPTION("Various CRC32 calculations");
 MODULE_LICENSE("GPL");
 
 #if CRC_LE_BITS > 8
-static inline u32 crc32_le_body(u32 crc, u8 const *buf, size_t len)
-{
-	const u8 *p8;
-	const u32 *p32;
-	int init_bytes, end_bytes;
-	size_t words;
-	int i;
-	u32 q;
-	u8 i0, i1, i2, i3;
-
-	crc = (__force u32) __cpu_to_le32(crc);
-
-#if CRC_LE_BITS == 64
-	p8 = buf;
-	p32 = (u32 *)(((uintptr_t)p8 + 7) & ~7);
-
-	init_bytes = (uintptr_t)p32 - (uintptr_t)p8;
-	if (init_bytes > len)
-		init_bytes = len;
-	words = (len - init_bytes) >> 3;
-	end_bytes = (len - init_bytes) & 7;
-#else
-	p8 = buf;
-	p32 = (u32 *)(((uintptr_t)p8 + 3) & ~3);
-
-	init_bytes = (uintptr_t)p32 - (uintptr_t)p8;
-	if (init_bytes > len)
-		init_bytes = len;
-	words = (len - init_bytes) >> 2;
-	end_bytes = (len - init_bytes) & 3;
-#endif
-
-	for (i = 0; i < init_bytes; i++) {
-#ifdef __LITTLE_ENDIAN
-		i0 = *p8++ ^ crc;
-		crc = t0_le[i0] ^ (crc >> 8);
-#else
-		i0 = *p8++ ^ (crc >> 24);
-		crc = t0_le[i0] ^ (crc << 8);
-#endif
-	}
-
-	for (i = 0; i < words; i++) {
-#ifdef __LITTLE_ENDIAN
-#  if CRC_LE_BITS == 64
-		/* slice by 8 algorithm */
-		q = *p32++ ^ crc;
-		i3 = q;
-		i2 = q >> 8;
-		i1 = q >> 16;
-		i0 = q >> 24;
-		crc = t7_le[i3] ^ t6_le[i2] ^ t5_le[i1] ^ t4_le[i0];
-
-		q = *p32++;
-		i3 = q;
-		i2 = q >> 8;
-		i1 = q >> 16;
-		i0 = q >> 24;
-		crc ^= t3_le[i3] ^ t2_le[i2] ^ t1_le[i1] ^ t0_le[i0];
-#  else
-		/* slice by 4 algorithm */
-		q = *p32++ ^ crc;
-		i3 = q;
-		i2 = q >> 8;
-		i1 = q >> 16;
-		i0 = q >> 24;
-		crc = t3_le[i3] ^ t2_le[i2] ^ t1_le[i1] ^ t0_le[i0];
-#  endif
-#else
-#  if CRC_LE_BITS == 64
-		q = *p32++ ^ crc;
-		i3 = q >> 24;
-		i2 = q >> 16;
-		i1 = q >> 8;
-		i0 = q;
-		crc = t7_le[i3] ^ t6_le[i2] ^ t5_le[i1] ^ t4_le[i0];
-
-		q = *p32++;
-		i3 = q >> 24;
-		i2 = q >> 16;
-		i1 = q >> 8;
-		i0 = q;
-		crc ^= t3_le[i3] ^ t2_le[i2] ^ t1_le[i1] ^ t0_le[i0];
-#  else
-		q = *p32++ ^ crc;
-		i3 = q >> 24;
-		i2 = q >> 16;
-		i1 = q >> 8;
-		i0 = q;
-		crc = t3_le[i3] ^ t2_le[i2] ^ t1_le[i1] ^ t0_le[i0];
-#  endif
-#endif
-	}
-
-	p8 = (u8 *)p32;
-
-	for (i = 0; i < end_bytes; i++) {
-#ifdef __LITTLE_ENDIAN
-		i0 = *p8++ ^ crc;
-		crc = t0_le[i0] ^ (crc >> 8);
-#else
-		i0 = *p8++ ^ (crc >> 24);
-		crc = t0_le[i0] ^ (crc << 8);
-#endif
-	}
-
-	return __le32_to_cpu((__force __le32)crc);
-}
-#endif
+/*
+ * Slice by 4 and slice by 8: xor the crc into the next aligned word and
+ * look each of its bytes up in its own table, which holds the effect of
+ * that byte shifted through the remaining ones.  With eight tables a
+ * second word is folded in per step.  The tables are stored in the byte
+ * order of the crc (see tole/tobe), so the same loop serves the little
+ * and big endian crc with the crc kept in that order.
+ */
+# ifdef __LITTLE_ENDIAN
+#  define DO_CRC(x) (crc = t0[(crc ^ (x)) & 255] ^ (crc >> 8))
+#  define DO_CRC4 (t3[q & 255] ^ t2[(q >> 8) & 255] ^ \
+		   t1[(q >> 16) & 255] ^ t0[q >> 24])
+#  define DO_CRC8 (t7[q & 255] ^ t6[(q >> 8) & 255] ^ \
+		   t5[(q >> 16) & 255] ^ t4[q >> 24])
+# else
+#  define DO_CRC(x) (crc = t0[((crc >> 24) ^ (x)) & 255] ^ (crc << 8))
+#  define DO_CRC4 (t0[q & 255] ^ t1[(q >> 8) & 255] ^ \
+		   t2[(q >> 16) & 255] ^ t3[q >> 24])
+#  define DO_CRC8 (t4[q & 255] ^ t5[(q >> 8) & 255] ^ \
+		   t6[(q >> 16) & 255] ^ t7[q >> 24])
+# endif
 
-#if CRC_BE_BITS > 8
-static inline u32 crc32_be_body(u32 crc, u8 const *buf, size_t len)
+static inline u32 __pure crc32_body(u32 crc, unsigned char const *buf,
+				    size_t len, const u32 (*tab)[256])
 {
-	const u8 *p8;
+	const u32 *t0 = tab[0], *t1 = tab[1], *t2 = tab[2], *t3 = tab[3];
+# if CRC_LE_BITS == 64
+	const u32 *t4 = tab[4], *t5 = tab[5], *t6 = tab[6], *t7 = tab[7];
+# endif
 	const u32 *p32;
-	int init_bytes, end_bytes;
 	size_t words;
-	int i;
 	u32 q;
-	u8 i0, i1, i2, i3;
-
-	crc = (__force u32) __cpu_to_be32(crc);
 
-#if CRC_LE_BITS == 64
-	p8 = buf;
-	p32 = (u32 *)(((uintptr_t)p8 + 7) & ~7);
+	for (; len && ((unsigned long)buf & 3); len--)
+		DO_CRC(*buf++);
 
-	init_bytes = (uintptr_t)p32 - (uintptr_t)p8;
-	if (init_bytes > len)
-		init_bytes = len;
-	words = (len - init_bytes) >> 3;
-	end_bytes = (len - init_bytes) & 7;
-#else
-	p8 = buf;
-	p32 = (u32 *)(((uintptr_t)p8 + 3) & ~3);
-
-	init_bytes = (uintptr_t)p32 - (uintptr_t)p8;
-	if (init_bytes > len)
-		init_bytes = len;
-	words = (len - init_bytes) >> 2;
-	end_bytes = (len - init_bytes) & 3;
-#endif
+	p32 = (const u32 *)buf;
+	words = len / (CRC_LE_BITS / 8);
+	len %= CRC_LE_BITS / 8;
 
-	for (i = 0; i < init_bytes; i++) {
-#ifdef __LITTLE_ENDIAN
-		i0 = *p8++ ^ crc;
-		crc = t0_be[i0] ^ (crc >> 8);
-#else
-		i0 = *p8++ ^ (crc >> 24);
-		crc = t0_be[i0] ^ (crc << 8);
-#endif
-	}
-
-	for (i = 0; i < words; i++) {
-#ifdef __LITTLE_ENDIAN
-#  if CRC_LE_BITS == 64
-		/* slice by 8 algorithm */
+	while (words--) {
 		q = *p32++ ^ crc;
-		i3 = q;
-		i2 = q >> 8;
-		i1 = q >> 16;
-		i0 = q >> 24;
-		crc = t7_be[i3] ^ t6_be[i2] ^ t5_be[i1] ^ t4_be[i0];
-
+# if CRC_LE_BITS == 64
+		crc = DO_CRC8;
 		q = *p32++;
-		i3 = q;
-		i2 = q >> 8;
-		i1 = q >> 16;
-		i0 = q >> 24;
-		crc ^= t3_be[i3] ^ t2_be[i2] ^ t1_be[i1] ^ t0_be[i0];
-#  else
-		/* slice by 4 algorithm */
-		q = *p32++ ^ crc;
-		i3 = q;
-		i2 = q >> 8;
-		i1 = q >> 16;
-		i0 = q >> 24;
-		crc = t3_be[i3] ^ t2_be[i2] ^ t1_be[i1] ^ t0_be[i0];
-#  endif
-#else
-#  if CRC_LE_BITS == 64
-		q = *p32++ ^ crc;
-		i3 = q >> 24;
-		i2 = q >> 16;
-		i1 = q >> 8;
-		i0 = q;
-		crc = t7_be[i3] ^ t6_be[i2] ^ t5_be[i1] ^ t4_be[i0];
-
-		q = *p32++;
-		i3 = q >> 24;
-		i2 = q >> 16;
-		i1 = q >> 8;
-		i0 = q;
-		crc ^= t3_be[i3] ^ t2_be[i2] ^ t1_be[i1] ^ t0_be[i0];
-#  else
-		q = *p32++ ^ crc;
-		i3 = q >> 24;
-		i2 = q >> 16;
-		i1 = q >> 8;
-		i0 = q;
-		crc = t3_be[i3] ^ t2_be[i2] ^ t1_be[i1] ^ t0_be[i0];
-#  endif
-#endif
+		crc ^= DO_CRC4;
+# else
+		crc = DO_CRC4;
+# endif
 	}
 
-	p8 = (u8 *)p32;
-
-	for (i = 0; i < end_bytes; i++) {
-#ifdef __LITTLE_ENDIAN
-		i0 = *p8++ ^ crc;
-		crc = t0_be[i0] ^ (crc >> 8);
-#else
-		i0 = *p8++ ^ (crc >> 24);
-		crc = t0_be[i0] ^ (crc << 8);
-#endif
-	}
+	for (buf = (const u8 *)p32; len; len--)
+		DO_CRC(*buf++);
 
-	return __be32_to_cpu((__force __be32)crc);
+	return crc;
 }
+
+# if CRC_LE_BITS == 64 && defined(CONFIG_ARCH_HAS_CRC32_SLICEBY8)
+/* The same slice by 8 loop in assembler, see arch/<arch>/lib */
+extern u32 __pure arch_crc32_sliceby8(u32 crc, unsigned char const *buf,
+				      size_t len, const u32 (*tab)[256]);
+#  define crc32_sliced arch_crc32_sliceby8
+#  define CRC32_ARCH_SLICEBY8
+# else
+#  define crc32_sliced crc32_body
+# endif
 #endif
 
-/**
- * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
- * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
- *	other uses, or the previous crc32 value if computing incrementally.
- * @p: pointer to buffer over which CRC is run
- * @len: length of buffer @p
- */
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+static inline u32 __pure crc32_le_generic(u32 crc, unsigned char const *p,
+					  size_t len, const u32 (*tab)[256],
+					  u32 polynomial)
 {
 #if CRC_LE_BITS == 1
 	int i;
 	while (len--) {
 		crc ^= *p++;
 		for (i = 0; i < 8; i++)
-			crc = (crc >> 1) ^ ((crc & 1) ? CRCPOLY_LE : 0);
+			crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
 	}
 # elif CRC_LE_BITS == 2
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 2) ^ t0_le[crc & 0x03];
-		crc = (crc >> 2) ^ t0_le[crc & 0x03];
-		crc = (crc >> 2) ^ t0_le[crc & 0x03];
-		crc = (crc >> 2) ^ t0_le[crc & 0x03];
+		crc = (crc >> 2) ^ tab[0][crc & 0x03];
+		crc = (crc >> 2) ^ tab[0][crc & 0x03];
+		crc = (crc >> 2) ^ tab[0][crc & 0x03];
+		crc = (crc >> 2) ^ tab[0][crc & 0x03];
 	}
 # elif CRC_LE_BITS == 4
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 4) ^ t0_le[crc & 0x0f];
-		crc = (crc >> 4) ^ t0_le[crc & 0x0f];
+		crc = (crc >> 4) ^ tab[0][crc & 0x0f];
+		crc = (crc >> 4) ^ tab[0][crc & 0x0f];
 	}
 # elif CRC_LE_BITS == 8
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 8) ^ t0_le[crc & 0xff];
+		crc = (crc >> 8) ^ tab[0][crc & 0xff];
 	}
 # else
-	crc = crc32_le_body(crc, p, len);
+	crc = (__force u32) __cpu_to_le32(crc);
+	crc = crc32_sliced(crc, p, len, tab);
+	crc = __le32_to_cpu((__force __le32)crc);
 # endif
 	return crc;
 }
+
+#if CRC_LE_BITS == 1
+# define crc32table_le NULL
+# define crc32ctable_le NULL
+#endif
+
+/**
+ * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
+ * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
+ *	other uses, or the previous crc32 value if computing incrementally.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ */
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, crc32table_le, CRCPOLY_LE);
+}
 EXPORT_SYMBOL(crc32_le);
 
+/**
+ * __crc32c_le() - Calculate the Castagnoli CRC32c
+ * @crc: seed value for computation, normally ~0
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ *
+ * Like crc32_le(), the result is not inverted.  Used by crypto/crc32c.c.
+ */
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, crc32ctable_le, CRC32C_POLY_LE);
+}
+EXPORT_SYMBOL(__crc32c_le);
+
 /**
  * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
  * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
@@ -333,29 +212,157 @@ u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 # elif CRC_BE_BITS == 2
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 2) ^ t0_be[crc >> 30];
-		crc = (crc << 2) ^ t0_be[crc >> 30];
-		crc = (crc << 2) ^ t0_be[crc >> 30];
-		crc = (crc << 2) ^ t0_be[crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
 	}
 # elif CRC_BE_BITS == 4
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 4) ^ t0_be[crc >> 28];
-		crc = (crc << 4) ^ t0_be[crc >> 28];
+		crc = (crc << 4) ^ crc32table_be[0][crc >> 28];
+		crc = (crc << 4) ^ crc32table_be[0][crc >> 28];
 	}
 # elif CRC_BE_BITS == 8
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 8) ^ t0_be[crc >> 24];
+		crc = (crc << 8) ^ crc32table_be[0][crc >> 24];
 	}
 # else
-	crc = crc32_be_body(crc, p, len);
+	crc = (__force u32) __cpu_to_be32(crc);
+	crc = crc32_sliced(crc, p, len, crc32table_be);
+	crc = __be32_to_cpu((__force __be32)crc);
 # endif
 	return crc;
 }
 EXPORT_SYMBOL(crc32_be);
 
+#ifdef CONFIG_CRC32_SELFTEST
+/*
+ * Check all three crcs against a bit at a time reference, for every
+ * alignment and short length and for each buffer size class, then time
+ * each class: protocol headers, small packets, full frames and pages.
+ */
+static const size_t crc32_test_sizes[] __initconst = {
+	8, 64, 256, 1500, 4096,
+};
+
+#define CRC32_TEST_BUF		4096
+#define CRC32_TEST_BYTES	(1 << 20)	/* hashed per timing run */
+
+typedef u32 (*crc32_fn)(u32, unsigned char const *, size_t);
+
+static u32 __init crc32_le_ref(u32 crc, const u8 *p, size_t len, u32 poly)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? poly : 0);
+	}
+	return crc;
+}
+
+static u32 __init crc32_be_ref(u32 crc, const u8 *p, size_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++ << 24;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^
+			      ((crc & 0x80000000) ? CRCPOLY_BE : 0);
+	}
+	return crc;
+}
+
+static int __init crc32_check(const u8 *p, size_t len)
+{
+	u32 seed = random32();
+
+	return crc32_le(seed, p, len) != crc32_le_ref(seed, p, len, CRCPOLY_LE) ||
+	       __crc32c_le(seed, p, len) !=
+			crc32_le_ref(seed, p, len, CRC32C_POLY_LE) ||
+	       crc32_be(seed, p, len) != crc32_be_ref(seed, p, len);
+}
+
+#ifdef CRC32_ARCH_SLICEBY8
+/* crc32_le() without the arch loop, for comparison */
+static u32 __init crc32_le_c(u32 crc, unsigned char const *p, size_t len)
+{
+	crc = crc32_body((__force u32) __cpu_to_le32(crc), p, len,
+			 crc32table_le);
+	return __le32_to_cpu((__force __le32)crc);
+}
+#endif
+
+/* Throughput of fn in MB/s over buffers of len bytes */
+static unsigned int __init crc32_rate(crc32_fn fn, const u8 *p, size_t len)
+{
+	unsigned int i, loops = CRC32_TEST_BYTES / len;
+	ktime_t start;
+	u64 ns;
+	u32 crc = ~0;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++)
+		crc = fn(crc, p, len);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return div64_u64((u64)loops * len * 1000, ns ? ns : 1);
+}
+
+static int __init crc32_selftest(void)
+{
+	int i, errors = 0;
+	size_t len, off;
+	u8 *buf;
+
+	buf = kmalloc(CRC32_TEST_BUF + 8, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	get_random_bytes(buf, CRC32_TEST_BUF + 8);
+
+	for (off = 0; off < 8; off++)
+		for (len = 0; len <= 64; len++)
+			errors += crc32_check(buf + off, len);
+
+	for (i = 0; i < ARRAY_SIZE(crc32_test_sizes); i++) {
+		len = crc32_test_sizes[i];
+		for (off = 0; off < 8; off++)
+			errors += crc32_check(buf + off, len);
+
+		printk(KERN_INFO "crc32: %4zu bytes: le %u MB/s, be %u MB/s, "
+		       "crc32c %u MB/s\n", len,
+		       crc32_rate(crc32_le, buf, len),
+		       crc32_rate(crc32_be, buf, len),
+		       crc32_rate(__crc32c_le, buf, len));
+#ifdef CRC32_ARCH_SLICEBY8
+		printk(KERN_INFO "crc32: %4zu bytes: le %u MB/s without the "
+		       "arch loop\n", len, crc32_rate(crc32_le_c, buf, len));
+#endif
+	}
+	kfree(buf);
+
+	if (errors) {
+		printk(KERN_ERR "crc32: self test failed, %d mismatches\n",
+		       errors);
+		return -EINVAL;
+	}
+	printk(KERN_INFO "crc32: self test passed (CRC_LE_BITS %d)\n",
+	       CRC_LE_BITS);
+	return 0;
+}
+
+static void __exit crc32_exit(void)
+{
+}
+
+module_init(crc32_selftest);
+module_exit(crc32_exit);
+#endif /* CONFIG_CRC32_SELFTEST */
+
 /*
  * A brief CRC tutorial.
  *
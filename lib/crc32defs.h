@@ -6,13 +6,31 @@
 #define CRCPOLY_LE 0xedb88320
 #define CRCPOLY_BE 0x04c11db7
 
-/* How many bits at a time to use.  Valid values are 1, 2, 4, 8, 32 and 64. */
-/* For less performance-sensitive, use 4 */
-#ifndef CRC_LE_BITS 
-# define CRC_LE_BITS 64
+/*
+ * This is the CRC32c polynomial, as outlined by Castagnoli.
+ * x^32+x^28+x^27+x^26+x^25+x^23+x^22+x^20+x^19+x^18+x^14+x^13+x^11+
+ * x^10+x^9+x^8+x^6+x^0
+ */
+#define CRC32C_POLY_LE 0x82f63b78
+
+/*
+ * How many bits at a time to use.  Valid values are 1, 2, 4, 8, 32 and 64.
+ * The default comes from the CRC32 implementation choice in lib/Kconfig;
+ * 64 (slice by 8) is fastest but needs 8kB of tables per polynomial.
+ */
+#ifndef CRC_LE_BITS
+# ifdef CONFIG_CRC32_BIT
+#  define CRC_LE_BITS 1
+# elif defined(CONFIG_CRC32_SARWATE)
+#  define CRC_LE_BITS 8
+# elif defined(CONFIG_CRC32_SLICEBY4)
+#  define CRC_LE_BITS 32
+# else
+#  define CRC_LE_BITS 64
+# endif
 #endif
 #ifndef CRC_BE_BITS
-# define CRC_BE_BITS 64
+# define CRC_BE_BITS CRC_LE_BITS
 #endif
 
 /*
@@ -32,3 +50,8 @@
 	CRC_BE_BITS & CRC_BE_BITS-1
 # error "CRC_BE_BITS must be one of {1, 2, 4, 8, 32, 64}"
 #endif
+
+/* The word loop is shared, so big endian can only slice like little endian */
+#if CRC_BE_BITS > 8 && CRC_BE_BITS != CRC_LE_BITS
+# error "CRC_BE_BITS must equal CRC_LE_BITS for slice by 4 or 8"
+#endif
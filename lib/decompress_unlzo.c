@@ -0,0 +1,271 @@
+/*
+ * LZO decompressor for the Linux kernel. Reads the lzop file format:
+ * a header followed by blocks of at most 256kB, each compressed
+ * separately with LZO1X.
+ *
+ * The preboot case, with all the input in memory and an output buffer
+ * big enough for the kernel, decompresses every block straight to its
+ * final place so the data is written exactly once.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifdef STATIC
+#define PREBOOT
+#include "lzo/lzo1x_decompress.c"
+#else
+#include <linux/slab.h>
+#include <linux/decompress/unlzo.h>
+#endif
+
+#include <linux/types.h>
+#include <linux/lzo.h>
+#include <linux/decompress/mm.h>
+
+#include <linux/compiler.h>
+#include <asm/unaligned.h>
+
+static const unsigned char lzop_magic[] = {
+	0x89, 0x4c, 0x5a, 0x4f, 0x00, 0x0d, 0x0a, 0x1a, 0x0a };
+
+#define LZO_BLOCK_SIZE		(256*1024l)
+#define LZO_IOBUF_SIZE		(lzo1x_worst_compress(LZO_BLOCK_SIZE) + 12)
+
+/* lzop header flags */
+#define F_ADLER32_D		0x00000001
+#define F_ADLER32_C		0x00000002
+#define F_H_FILTER		0x00000800
+#define F_CRC32_D		0x00000100
+#define F_CRC32_C		0x00000200
+
+struct unlzo_input {
+	u8 *buf;
+	u8 *pos;
+	long avail;
+	int done;	/* bytes consumed */
+	int (*fill)(void *, unsigned int);
+};
+
+/*
+ * Make sure at least n bytes of input are available at in->pos,
+ * refilling the buffer if the caller gave us a fill function.
+ */
+static int INIT unlzo_need(struct unlzo_input *in, long n)
+{
+	long i;
+	int ret;
+
+	if (in->avail >= n)
+		return 1;
+	if (!in->fill || n > LZO_IOBUF_SIZE)
+		return 0;
+
+	/* slide what is left to the front */
+	for (i = 0; i < in->avail; i++)
+		in->buf[i] = in->pos[i];
+	in->pos = in->buf;
+
+	while (in->avail < n) {
+		ret = in->fill(in->buf + in->avail, LZO_IOBUF_SIZE - in->avail);
+		if (ret <= 0)
+			return 0;
+		in->avail += ret;
+	}
+
+	return 1;
+}
+
+static inline void INIT unlzo_skip(struct unlzo_input *in, long n)
+{
+	in->pos += n;
+	in->avail -= n;
+	in->done += n;
+}
+
+/* Parse the lzop header, returning its flags or -1 */
+static long INIT parse_header(struct unlzo_input *in)
+{
+	u16 version;
+	u32 flags;
+	int i;
+
+	/* magic, version, lib version, version needed, method, level */
+	if (!unlzo_need(in, 9 + 9 + 4))
+		return -1;
+	for (i = 0; i < 9; i++)
+		if (in->pos[i] != lzop_magic[i])
+			return -1;
+	unlzo_skip(in, 9);
+
+	version = get_unaligned_be16(in->pos);
+	/* version, lib version, version needed to extract, method */
+	unlzo_skip(in, version >= 0x0940 ? 7 : 5);
+	if (version >= 0x0940)
+		unlzo_skip(in, 1);	/* level */
+
+	flags = get_unaligned_be32(in->pos);
+	unlzo_skip(in, 4);
+	if (flags & F_H_FILTER) {
+		if (!unlzo_need(in, 4))
+			return -1;
+		unlzo_skip(in, 4);
+	}
+
+	/* mode, mtime, name length */
+	if (!unlzo_need(in, 4 + 8 + 1))
+		return -1;
+	unlzo_skip(in, version >= 0x0940 ? 12 : 8);
+
+	/* name and header checksum */
+	if (!unlzo_need(in, 1 + in->pos[0] + 4))
+		return -1;
+	unlzo_skip(in, 1 + in->pos[0] + 4);
+
+	return flags;
+}
+
+STATIC inline int INIT unlzo(u8 *input, int in_len,
+			     int (*fill) (void *, unsigned int),
+			     int (*flush) (void *, unsigned int),
+			     u8 *output, int *posp,
+			     void (*error_fn) (char *x))
+{
+	struct unlzo_input in;
+	long flags;
+	u32 src_len, dst_len;
+	int checksums_d, checksums_c;
+	size_t out_len;
+	u8 *out_buf;
+	int r, ret = -1;
+
+	set_error_fn(error_fn);
+	in.done = 0;
+
+	if (output) {
+		out_buf = output;
+	} else if (!flush) {
+		error("NULL output pointer and no flush function provided");
+		goto exit;
+	} else {
+		out_buf = malloc(LZO_BLOCK_SIZE);
+		if (!out_buf) {
+			error("Could not allocate output buffer");
+			goto exit;
+		}
+	}
+
+	if (input && fill) {
+		error("Both input pointer and fill function provided, "
+		      "don't know what to do");
+		goto exit_1;
+	} else if (input) {
+		in.buf = input;
+		in.avail = in_len;
+	} else if (!fill) {
+		error("NULL input pointer and missing fill function");
+		goto exit_1;
+	} else {
+		in.buf = malloc(LZO_IOBUF_SIZE);
+		if (!in.buf) {
+			error("Could not allocate input buffer");
+			goto exit_1;
+		}
+		in.avail = 0;
+	}
+	in.pos = in.buf;
+	in.fill = fill;
+
+	flags = parse_header(&in);
+	if (flags < 0) {
+		error("invalid header");
+		goto exit_2;
+	}
+	checksums_d = !!(flags & F_ADLER32_D) + !!(flags & F_CRC32_D);
+	checksums_c = !!(flags & F_ADLER32_C) + !!(flags & F_CRC32_C);
+
+	for (;;) {
+		if (!unlzo_need(&in, 4))
+			goto truncated;
+		dst_len = get_unaligned_be32(in.pos);
+		unlzo_skip(&in, 4);
+
+		/* a zero length block ends the stream */
+		if (dst_len == 0)
+			break;
+
+		if (dst_len > LZO_BLOCK_SIZE) {
+			error("dest len longer than block size");
+			goto exit_2;
+		}
+
+		if (!unlzo_need(&in, 4 + 4 * checksums_d))
+			goto truncated;
+		src_len = get_unaligned_be32(in.pos);
+		unlzo_skip(&in, 4 + 4 * checksums_d);
+
+		if (src_len == 0 || src_len > dst_len) {
+			error("file corrupted");
+			goto exit_2;
+		}
+
+		/* the checksums are not verified, only skipped */
+		if (src_len < dst_len) {
+			if (!unlzo_need(&in, 4 * checksums_c))
+				goto truncated;
+			unlzo_skip(&in, 4 * checksums_c);
+		}
+
+		if (!unlzo_need(&in, src_len))
+			goto truncated;
+
+		if (src_len < dst_len) {
+			out_len = dst_len;
+			r = lzo1x_decompress_safe(in.pos, src_len,
+						  out_buf, &out_len);
+			if (r != LZO_E_OK || dst_len != out_len) {
+				error("decompressor error");
+				goto exit_2;
+			}
+		} else {
+			/* stored uncompressed */
+			memcpy(out_buf, in.pos, dst_len);
+		}
+
+		if (flush && flush(out_buf, dst_len) != (int)dst_len)
+			goto exit_2;
+		if (output)
+			out_buf += dst_len;
+
+		unlzo_skip(&in, src_len);
+	}
+
+	ret = 0;
+	goto exit_2;
+
+truncated:
+	error("unexpected end of input");
+exit_2:
+	if (!input)
+		free(in.buf);
+exit_1:
+	if (!output)
+		free(out_buf);
+exit:
+	if (posp)
+		*posp = in.done;
+	return ret;
+}
+
+#ifdef PREBOOT
+STATIC int INIT decompress(unsigned char *buf, int len,
+			   int (*fill)(void *, unsigned int),
+			   int (*flush)(void *, unsigned int),
+			   unsigned char *out_buf,
+			   int *pos,
+			   void (*error_fn)(char *x))
+{
+	return unlzo(buf, len, fill, flush, out_buf, pos, error_fn);
+}
+#endif
@@ -4,19 +4,24 @@
 
 #define ENTRIES_PER_LINE 4
 
-#if CRC_LE_BITS <= 8
-#define LE_TABLE_SIZE (1 << CRC_LE_BITS)
+#if CRC_LE_BITS > 8
+# define LE_TABLE_ROWS (CRC_LE_BITS/8)
+# define LE_TABLE_SIZE 256
 #else
-#define LE_TABLE_SIZE 256
+# define LE_TABLE_ROWS 1
+# define LE_TABLE_SIZE (1 << CRC_LE_BITS)
 #endif
 
-#if CRC_BE_BITS <= 8
-#define BE_TABLE_SIZE (1 << CRC_BE_BITS)
+#if CRC_BE_BITS > 8
+# define BE_TABLE_ROWS (CRC_BE_BITS/8)
+# define BE_TABLE_SIZE 256
 #else
-#define BE_TABLE_SIZE 256
+# define BE_TABLE_ROWS 1
+# define BE_TABLE_SIZE (1 << CRC_BE_BITS)
 #endif
 
 static uint32_t crc32table_le[8][256];
+static uint32_t crc32ctable_le[8][256];
 static uint32_t crc32table_be[8][256];
 
 /**
@@ -26,23 +31,23 @@ static uint32_t crc32table_be[8][256];
  * fact that crctable[i^j] = crctable[i] ^ crctable[j].
  *
  */
-static void crc32init_le(void)
+static void crc32init_le(uint32_t (*table)[256], uint32_t polynomial)
 {
 	unsigned i, j;
 	uint32_t crc = 1;
 
-	crc32table_le[0][0] = 0;
+	table[0][0] = 0;
 
 	for (i = LE_TABLE_SIZE >> 1; i; i >>= 1) {
-		crc = (crc >> 1) ^ ((crc & 1) ? CRCPOLY_LE : 0);
+		crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
 		for (j = 0; j < LE_TABLE_SIZE; j += 2 * i)
-			crc32table_le[0][i + j] = crc ^ crc32table_le[0][j];
+			table[0][i + j] = crc ^ table[0][j];
 	}
 	for (i = 0; i < LE_TABLE_SIZE; i++) {
-		crc = crc32table_le[0][i];
-		for (j = 1; j < 8; j++) {
-			crc = crc32table_le[0][crc & 0xff] ^ (crc >> 8);
-			crc32table_le[j][i] = crc;
+		crc = table[0][i];
+		for (j = 1; j < LE_TABLE_ROWS; j++) {
+			crc = table[0][crc & 0xff] ^ (crc >> 8);
+			table[j][i] = crc;
 		}
 	}
 }
@@ -64,36 +69,32 @@ static void crc32init_be(void)
 	}
 	for (i = 0; i < BE_TABLE_SIZE; i++) {
 		crc = crc32table_be[0][i];
-		for (j = 1; j < 8; j++) {
+		for (j = 1; j < BE_TABLE_ROWS; j++) {
 			crc = crc32table_be[0][(crc >> 24) & 0xff] ^ (crc << 8);
 			crc32table_be[j][i] = crc;
 		}
 	}
 }
 
-static void output_table(uint32_t table[8][256], int len, char trans)
+static void output_table(const char *name, uint32_t (*table)[256],
+			 int rows, int len, const char *trans)
 {
 	int i, j;
 
-	for (j = 0 ; j < 8; j++) {
-		printf("static const u32 t%d_%ce[] = {", j, trans);
+	printf("static const u32 __cacheline_aligned %s[%d][256] = {",
+	       name, rows);
+	for (j = 0; j < rows; j++) {
+		printf("{");
 		for (i = 0; i < len - 1; i++) {
 			if ((i % ENTRIES_PER_LINE) == 0)
 				printf("\n");
-			printf("to%ce(0x%8.8xL),", trans, table[j][i]);
+			printf("%s(0x%8.8xL),", trans, table[j][i]);
 			if ((i % ENTRIES_PER_LINE) != (ENTRIES_PER_LINE - 1))
 				printf(" ");
 		}
-		printf("to%ce(0x%8.8xL)};\n\n", trans, table[j][len - 1]);
-
-		if (trans == 'l') {
-			if ((j+1)*8 >= CRC_LE_BITS)
-				break;
-		} else {
-			if ((j+1)*8 >= CRC_BE_BITS)
-				break;
-		}
+		printf("%s(0x%8.8xL)},\n", trans, table[j][len - 1]);
 	}
+	printf("};\n\n");
 }
 
 int main(int argc, char** argv)
@@ -109,13 +110,18 @@ int main(int argc, char** argv)
 	printf("\n");
 
 	if (CRC_LE_BITS > 1) {
-		crc32init_le();
-		output_table(crc32table_le, LE_TABLE_SIZE, 'l');
+		crc32init_le(crc32table_le, CRCPOLY_LE);
+		output_table("crc32table_le", crc32table_le,
+			     LE_TABLE_ROWS, LE_TABLE_SIZE, "tole");
+		crc32init_le(crc32ctable_le, CRC32C_POLY_LE);
+		output_table("crc32ctable_le", crc32ctable_le,
+			     LE_TABLE_ROWS, LE_TABLE_SIZE, "tole");
 	}
 
 	if (CRC_BE_BITS > 1) {
 		crc32init_be();
-		output_table(crc32table_be, BE_TABLE_SIZE, 'b');
+		output_table("crc32table_be", crc32table_be,
+			     BE_TABLE_ROWS, BE_TABLE_SIZE, "tobe");
 	}
 
 	return 0;
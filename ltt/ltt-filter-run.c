@@ -0,0 +1,287 @@
+/*
+ * LTT event filter interpreter.
+ *
+ * Runs the bytecode built by ltt-filter.c on the fields of an event, from
+ * the va_list of ltt_vtrace() or the payload of a specialized probe.  This
+ * is in the core rather than in the ltt-filter module because the
+ * serializers call it from the tracing fast path.
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ */
+
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+#include <linux/ltt-filter.h>
+#include <asm/unaligned.h>
+
+/*
+ * Called once when a filter is loaded, so that ltt_filter_run() does not
+ * have to check anything: every instruction must be reached with a known
+ * stack depth, the same along all paths, jumps only go forward and stay
+ * within the program, and the program ends with RET on a single value.
+ */
+int ltt_filter_verify(const struct ltt_filter *filter)
+{
+	signed char depth[LTT_FILTER_MAX_INSNS + 1];
+	const struct ltt_filter_insn *insn;
+	unsigned int pc, target, fed = 0;
+	int d;
+
+	if (!filter->nr_insns || filter->nr_insns > LTT_FILTER_MAX_INSNS
+	    || filter->nr_consts > LTT_FILTER_MAX_CONSTS
+	    || filter->nr_fields > LTT_FILTER_MAX_FIELDS
+	    || filter->nr_args > LTT_FILTER_MAX_ARGS)
+		return -EINVAL;
+
+	/* each field must be read from the va_list too */
+	for (pc = 0; pc < filter->nr_args; pc++) {
+		d = filter->args[pc].field;
+		if (d >= (int)filter->nr_fields)
+			return -EINVAL;
+		if (d >= 0)
+			fed |= 1U << d;
+	}
+	if (fed != (1U << filter->nr_fields) - 1)
+		return -EINVAL;
+	for (pc = 0; pc < filter->nr_fields; pc++)
+		switch (filter->fields[pc].size) {
+		case 1: case 2: case 4: case 8:
+			break;
+		default:
+			return -EINVAL;
+		}
+
+	memset(depth, -1, sizeof(depth));
+	depth[0] = 0;
+	for (pc = 0; pc < filter->nr_insns; pc++) {
+		insn = &filter->insns[pc];
+		d = depth[pc];
+		if (d < 0)
+			return -EINVAL;		/* unreachable */
+
+		switch (insn->op) {
+		case LTT_FILTER_RET:
+			if (d != 1)
+				return -EINVAL;
+			continue;		/* no fall through */
+		case LTT_FILTER_FIELD:
+			if (insn->arg >= filter->nr_fields)
+				return -EINVAL;
+			d++;
+			break;
+		case LTT_FILTER_CONST:
+			if (insn->arg >= filter->nr_consts)
+				return -EINVAL;
+			d++;
+			break;
+		case LTT_FILTER_PID:
+		case LTT_FILTER_TGID:
+		case LTT_FILTER_CPU:
+			d++;
+			break;
+		case LTT_FILTER_NOT:
+		case LTT_FILTER_BOOL:
+			if (d < 1)
+				return -EINVAL;
+			break;
+		case LTT_FILTER_AND:
+		case LTT_FILTER_EQ:
+		case LTT_FILTER_NE:
+		case LTT_FILTER_LT:
+		case LTT_FILTER_LE:
+		case LTT_FILTER_GT:
+		case LTT_FILTER_GE:
+			if (d < 2)
+				return -EINVAL;
+			d--;
+			break;
+		case LTT_FILTER_JZ:
+		case LTT_FILTER_JNZ:
+			if (d < 1)
+				return -EINVAL;
+			target = pc + 1 + insn->arg;
+			if (target >= filter->nr_insns)
+				return -EINVAL;
+			if (depth[target] < 0)
+				depth[target] = d;
+			else if (depth[target] != d)
+				return -EINVAL;
+			d--;
+			break;
+		default:
+			return -EINVAL;
+		}
+		if (d > LTT_FILTER_STACK)
+			return -EINVAL;
+		if (depth[pc + 1] < 0)
+			depth[pc + 1] = d;
+		else if (depth[pc + 1] != d)
+			return -EINVAL;
+	}
+	/* falling off the end was caught as depth[nr_insns] being set */
+	return depth[filter->nr_insns] < 0 ? 0 : -EINVAL;
+}
+EXPORT_SYMBOL_GPL(ltt_filter_verify);
+
+static notrace s64 ltt_filter_extend(u64 v, unsigned int size, int sign)
+{
+	unsigned int shift = 64 - (size << 3);
+
+	if (sign)
+		return (s64)(v << shift) >> shift;
+	return (v << shift) >> shift;
+}
+
+static notrace int ltt_filter_run(const struct ltt_filter *filter,
+				  const s64 *field)
+{
+	s64 stack[LTT_FILTER_STACK];
+	const struct ltt_filter_insn *insn = filter->insns;
+	int sp = -1;
+
+	for (;; insn++) {
+		switch (insn->op) {
+		case LTT_FILTER_RET:
+			return stack[sp] != 0;
+		case LTT_FILTER_FIELD:
+			stack[++sp] = field[insn->arg];
+			break;
+		case LTT_FILTER_CONST:
+			stack[++sp] = filter->consts[insn->arg];
+			break;
+		case LTT_FILTER_PID:
+			stack[++sp] = current->pid;
+			break;
+		case LTT_FILTER_TGID:
+			stack[++sp] = current->tgid;
+			break;
+		case LTT_FILTER_CPU:
+			stack[++sp] = raw_smp_processor_id();
+			break;
+		case LTT_FILTER_NOT:
+			stack[sp] = !stack[sp];
+			break;
+		case LTT_FILTER_BOOL:
+			stack[sp] = stack[sp] != 0;
+			break;
+		case LTT_FILTER_AND:
+			sp--;
+			stack[sp] &= stack[sp + 1];
+			break;
+		case LTT_FILTER_EQ:
+			sp--;
+			stack[sp] = stack[sp] == stack[sp + 1];
+			break;
+		case LTT_FILTER_NE:
+			sp--;
+			stack[sp] = stack[sp] != stack[sp + 1];
+			break;
+		case LTT_FILTER_LT:
+			sp--;
+			stack[sp] = stack[sp] < stack[sp + 1];
+			break;
+		case LTT_FILTER_LE:
+			sp--;
+			stack[sp] = stack[sp] <= stack[sp + 1];
+			break;
+		case LTT_FILTER_GT:
+			sp--;
+			stack[sp] = stack[sp] > stack[sp + 1];
+			break;
+		case LTT_FILTER_GE:
+			sp--;
+			stack[sp] = stack[sp] >= stack[sp + 1];
+			break;
+		case LTT_FILTER_JZ:
+			if (!stack[sp])
+				insn += insn->arg;
+			else
+				sp--;
+			break;
+		case LTT_FILTER_JNZ:
+			if (stack[sp])
+				insn += insn->arg;
+			else
+				sp--;
+			break;
+		}
+	}
+}
+
+/*
+ * Returns non-zero if the event whose marker arguments are in args is to
+ * be recorded.  args is left untouched for the serializer.
+ */
+notrace int ltt_filter_match_va(const struct ltt_filter *filter,
+				va_list *args)
+{
+	s64 field[LTT_FILTER_MAX_FIELDS];
+	const struct ltt_filter_arg *arg;
+	const struct ltt_filter_field *f;
+	va_list args_copy;
+	unsigned int i;
+	u64 v;
+
+	va_copy(args_copy, *args);
+	for (i = 0; i < filter->nr_args; i++) {
+		arg = &filter->args[i];
+		switch (arg->c_size) {
+		case 0:
+			v = (unsigned long)va_arg(args_copy, const char *);
+			break;
+		case 8:
+			v = va_arg(args_copy, u64);
+			break;
+		default:
+			/* char and short are promoted */
+			v = va_arg(args_copy, unsigned int);
+			break;
+		}
+		if (arg->field < 0)
+			continue;
+		f = &filter->fields[arg->field];
+		field[arg->field] = ltt_filter_extend(v, f->size, f->sign);
+	}
+	va_end(args_copy);
+
+	return ltt_filter_run(filter, field);
+}
+EXPORT_SYMBOL_GPL(ltt_filter_match_va);
+
+/*
+ * Same for the payload of a specialized probe, laid out as it is written
+ * to the trace.
+ */
+notrace int ltt_filter_match_data(const struct ltt_filter *filter,
+				  const void *data)
+{
+	s64 field[LTT_FILTER_MAX_FIELDS];
+	const struct ltt_filter_field *f;
+	const void *p;
+	unsigned int i;
+	u64 v;
+
+	for (i = 0; i < filter->nr_fields; i++) {
+		f = &filter->fields[i];
+		p = data + f->offset;
+		switch (f->size) {
+		case 1:
+			v = *(const u8 *)p;
+			break;
+		case 2:
+			v = get_unaligned((const u16 *)p);
+			break;
+		case 4:
+			v = get_unaligned((const u32 *)p);
+			break;
+		default:
+			v = get_unaligned((const u64 *)p);
+			break;
+		}
+		field[i] = ltt_filter_extend(v, f->size, f->sign);
+	}
+
+	return ltt_filter_run(filter, field);
+}
+EXPORT_SYMBOL_GPL(ltt_filter_match_data);
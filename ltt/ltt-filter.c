@@ -2,15 +2,39 @@
  * Copyright (C) 2008 Mathieu Desnoyers
  *
  * Dual LGPL v2.1/GPL v2 license.
+ *
+ * Event filters: writing
+ *
+ *   channel/marker expression
+ *
+ * to /debugfs/ltt/filter/event compiles expression against the fields of
+ * the marker's format and attaches it to the marker, whose events are then
+ * only recorded when it is true.  Writing the marker alone removes it.
+ * Expressions are made of the marker's numeric fields, the $pid, $tgid and
+ * $cpu of the current context, integer constants, the comparisons == != <
+ * <= > >=, a bitwise &, ! && || and parentheses, e.g.
+ *
+ *   kernel/sched_schedule prev_pid == 1234 || next_pid == 1234
+ *   kernel/irq_entry irq_id == 11 && !kernel_mode && $cpu == 1
+ *
+ * & binds tighter than the comparisons, so "flags & 4 == 4" does what it
+ * says.  Fields compare as the signed or unsigned value of the size they
+ * are recorded with.
  */
 
 #include <linux/module.h>
 #include <linux/debugfs.h>
 #include <linux/fs.h>
+#include <linux/ctype.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
 #include <linux/ltt-tracer.h>
+#include <linux/ltt-filter.h>
 #include <linux/mutex.h>
 
 #define LTT_FILTER_DIR	"filter"
+#define LTT_FILTER_EVENT_FILE	"event"
 
 /*
  * Protects the ltt_filter_dir allocation.
@@ -42,11 +66,540 @@ err_no_root:
 }
 EXPORT_SYMBOL_GPL(get_filter_root);
 
+/*
+ * An argument of the marker format: the word before its specifier is its
+ * name.  offset is its place in a specialized probe payload, or -1 after a
+ * string.
+ */
+struct filter_fmt_arg {
+	const char *name;
+	int len;
+	u8 c_size;		/* 0 for a string */
+	u8 size;		/* recorded size */
+	u8 sign;
+	int offset;
+};
+
+struct filter_parser {
+	const char *pos;
+	const char *error;
+	int depth;
+	struct filter_fmt_arg fmt_args[LTT_FILTER_MAX_ARGS];
+	unsigned int nr_fmt_args;
+	struct ltt_filter *filter;
+};
+
+static const char *filter_fmt_size(const char *fmt, u8 *size)
+{
+	switch (*fmt) {
+	case 'h':
+		*size = sizeof(short);
+		return fmt + 1;
+	case 'l':
+		if (fmt[1] == 'l') {
+			*size = sizeof(long long);
+			return fmt + 2;
+		}
+		*size = sizeof(long);
+		return fmt + 1;
+	case 'L':
+		*size = sizeof(long long);
+		return fmt + 1;
+	case 'z':
+	case 'Z':
+		*size = sizeof(size_t);
+		return fmt + 1;
+	case 't':
+		*size = sizeof(ptrdiff_t);
+		return fmt + 1;
+	default:
+		*size = sizeof(int);
+		return fmt;
+	}
+}
+
+/*
+ * Parses the %type (or #type when trace is set) at fmt into size and sign,
+ * size being 0 for a string.  Returns the conversion character, or NULL
+ * for what the serializer would handle but filters do not.
+ */
+static const char *filter_fmt_type(const char *fmt, int trace, u8 *size,
+				   u8 *sign)
+{
+	if (trace) {
+		if (*fmt == 'n')
+			return NULL;	/* network byte order */
+		if (*fmt == '1' || *fmt == '2' || *fmt == '4'
+		    || *fmt == '8') {
+			*size = *fmt - '0';
+			fmt++;
+		} else
+			fmt = filter_fmt_size(fmt, size);
+	} else {
+		while (*fmt == '-' || *fmt == '+' || *fmt == ' '
+		       || *fmt == '#' || *fmt == '0')
+			fmt++;
+		fmt = filter_fmt_size(fmt, size);
+	}
+
+	*sign = 0;
+	switch (*fmt) {
+	case 'c':
+		*size = sizeof(unsigned char);
+		break;
+	case 's':
+		*size = 0;
+		break;
+	case 'p':
+		*size = sizeof(void *);
+		break;
+	case 'd':
+	case 'i':
+		*sign = 1;
+		break;
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		break;
+	default:
+		return NULL;
+	}
+	return fmt;
+}
+
+/*
+ * Lists the arguments of fmt, stopping at the first one filters cannot
+ * step over.
+ */
+static void filter_parse_format(struct filter_parser *ps, const char *fmt)
+{
+	struct filter_fmt_arg *arg;
+	const char *name = NULL;
+	int len = 0, offset = 0;
+	u8 size = 0, sign = 0, c_size, c_sign;
+
+	for (; *fmt; fmt++) {
+		if (*fmt == '#') {
+			if (*++fmt == '#')
+				continue;
+			fmt = filter_fmt_type(fmt, 1, &size, &sign);
+			if (!fmt)
+				return;
+			continue;
+		}
+		if (*fmt == '%') {
+			if (*++fmt == '%')
+				continue;
+			fmt = filter_fmt_type(fmt, 0, &c_size, &c_sign);
+			if (!fmt || ps->nr_fmt_args == LTT_FILTER_MAX_ARGS)
+				return;
+			arg = &ps->fmt_args[ps->nr_fmt_args++];
+			arg->name = name;
+			arg->len = len;
+			arg->c_size = c_size;
+			if (!size) {
+				size = c_size;
+				sign = c_sign;
+			}
+			if (!c_size)
+				size = 0;
+			arg->size = size;
+			arg->sign = sign;
+			if (!size || offset < 0) {
+				arg->offset = -1;
+				offset = -1;
+			} else {
+				offset += ltt_align(offset, size);
+				arg->offset = offset;
+				offset += size;
+			}
+			name = NULL;
+			len = 0;
+			size = 0;
+			continue;
+		}
+		if (isalnum(*fmt) || *fmt == '_') {
+			if (!len || fmt[-1] == ' ')
+				name = fmt, len = 0;
+			len++;
+		} else if (*fmt != ' ')
+			len = 0;
+	}
+}
+
+static int filter_error(struct filter_parser *ps, const char *error)
+{
+	if (!ps->error)
+		ps->error = error;
+	return -EINVAL;
+}
+
+static int filter_emit(struct filter_parser *ps, u8 op, u8 arg)
+{
+	struct ltt_filter *filter = ps->filter;
+
+	if (filter->nr_insns == LTT_FILTER_MAX_INSNS)
+		return filter_error(ps, "expression too long");
+	filter->insns[filter->nr_insns].op = op;
+	filter->insns[filter->nr_insns].arg = arg;
+	filter->nr_insns++;
+	return 0;
+}
+
+static void filter_skip(struct filter_parser *ps)
+{
+	while (isspace(*ps->pos))
+		ps->pos++;
+}
+
+static int filter_match(struct filter_parser *ps, const char *token)
+{
+	size_t len = strlen(token);
+
+	filter_skip(ps);
+	if (strncmp(ps->pos, token, len))
+		return 0;
+	ps->pos += len;
+	return 1;
+}
+
+static int filter_const(struct filter_parser *ps, s64 value)
+{
+	struct ltt_filter *filter = ps->filter;
+	unsigned int i;
+
+	for (i = 0; i < filter->nr_consts; i++)
+		if (filter->consts[i] == value)
+			break;
+	if (i == filter->nr_consts) {
+		if (i == LTT_FILTER_MAX_CONSTS)
+			return filter_error(ps, "too many constants");
+		filter->consts[filter->nr_consts++] = value;
+	}
+	return filter_emit(ps, LTT_FILTER_CONST, i);
+}
+
+static int filter_field(struct filter_parser *ps, const char *name, int len)
+{
+	struct ltt_filter *filter = ps->filter;
+	struct filter_fmt_arg *arg;
+	struct ltt_filter_field *field;
+	unsigned int i;
+
+	for (i = 0; i < ps->nr_fmt_args; i++)
+		if (ps->fmt_args[i].len == len
+		    && !strncmp(ps->fmt_args[i].name, name, len))
+			break;
+	if (i == ps->nr_fmt_args)
+		return filter_error(ps, "unknown field");
+	arg = &ps->fmt_args[i];
+	if (!arg->size)
+		return filter_error(ps, "strings cannot be compared");
+	if (arg->offset < 0)
+		return filter_error(ps, "fields after a string cannot be used");
+
+	/* the va_list has to be walked up to this argument */
+	for (; filter->nr_args <= i; filter->nr_args++) {
+		filter->args[filter->nr_args].c_size =
+			ps->fmt_args[filter->nr_args].c_size;
+		filter->args[filter->nr_args].field = -1;
+	}
+	if (filter->args[i].field < 0) {
+		if (filter->nr_fields == LTT_FILTER_MAX_FIELDS)
+			return filter_error(ps, "too many fields");
+		field = &filter->fields[filter->nr_fields];
+		field->offset = arg->offset;
+		field->size = arg->size;
+		field->sign = arg->sign;
+		filter->args[i].field = filter->nr_fields++;
+	}
+	return filter_emit(ps, LTT_FILTER_FIELD, filter->args[i].field);
+}
+
+static int filter_parse_or(struct filter_parser *ps);
+
+/* operand := '(' or ')' | number | field | $pid | $tgid | $cpu */
+static int filter_parse_operand(struct filter_parser *ps)
+{
+	const char *start;
+	char *end;
+	s64 value;
+	int ret;
+
+	if (filter_match(ps, "(")) {
+		if (++ps->depth > LTT_FILTER_STACK)
+			return filter_error(ps, "too deeply nested");
+		ret = filter_parse_or(ps);
+		if (ret)
+			return ret;
+		if (!filter_match(ps, ")"))
+			return filter_error(ps, "')' expected");
+		ps->depth--;
+		return 0;
+	}
+	if (filter_match(ps, "$pid"))
+		return filter_emit(ps, LTT_FILTER_PID, 0);
+	if (filter_match(ps, "$tgid"))
+		return filter_emit(ps, LTT_FILTER_TGID, 0);
+	if (filter_match(ps, "$cpu"))
+		return filter_emit(ps, LTT_FILTER_CPU, 0);
+
+	start = ps->pos;
+	if (isdigit(*start) || (*start == '-' && isdigit(start[1]))) {
+		value = simple_strtoll(start, &end, 0);
+		ps->pos = end;
+		return filter_const(ps, value);
+	}
+	while (isalnum(*ps->pos) || *ps->pos == '_')
+		ps->pos++;
+	if (ps->pos == start)
+		return filter_error(ps, "operand expected");
+	return filter_field(ps, start, ps->pos - start);
+}
+
+/*
+ * term := '!'* operand
+ *
+ * A run of '!' is folded rather than parsed recursively, as it can be as
+ * long as the expression: an odd run is one NOT, an even one a BOOL.
+ */
+static int filter_parse_term(struct filter_parser *ps)
+{
+	unsigned int nots = 0;
+	int ret;
+
+	while (filter_match(ps, "!"))
+		nots++;
+	ret = filter_parse_operand(ps);
+	if (ret || !nots)
+		return ret;
+	return filter_emit(ps, nots & 1 ? LTT_FILTER_NOT : LTT_FILTER_BOOL, 0);
+}
+
+/* value := term ['&' term] */
+static int filter_parse_value(struct filter_parser *ps)
+{
+	int ret;
+
+	ret = filter_parse_term(ps);
+	if (ret)
+		return ret;
+	filter_skip(ps);
+	if (ps->pos[0] != '&' || ps->pos[1] == '&')
+		return 0;
+	ps->pos++;
+	ret = filter_parse_term(ps);
+	return ret ? ret : filter_emit(ps, LTT_FILTER_AND, 0);
+}
+
+static const struct {
+	const char *token;
+	u8 op;
+} filter_cmp_ops[] = {
+	/* two character operators first */
+	{ "==", LTT_FILTER_EQ },
+	{ "!=", LTT_FILTER_NE },
+	{ "<=", LTT_FILTER_LE },
+	{ ">=", LTT_FILTER_GE },
+	{ "<", LTT_FILTER_LT },
+	{ ">", LTT_FILTER_GT },
+};
+
+/* cmp := value [op value] */
+static int filter_parse_cmp(struct filter_parser *ps)
+{
+	int i, ret;
+
+	ret = filter_parse_value(ps);
+	if (ret)
+		return ret;
+	for (i = 0; i < ARRAY_SIZE(filter_cmp_ops); i++) {
+		if (!filter_match(ps, filter_cmp_ops[i].token))
+			continue;
+		ret = filter_parse_value(ps);
+		return ret ? ret : filter_emit(ps, filter_cmp_ops[i].op, 0);
+	}
+	return 0;
+}
+
+/*
+ * Short-circuit chains: each operand but the last is followed by a jump,
+ * taken with the operand as result, to the end of the chain.  There the
+ * result is made 0 or 1, like that of the C operators.
+ */
+static int filter_parse_chain(struct filter_parser *ps, const char *token,
+			      u8 op, int (*operand)(struct filter_parser *))
+{
+	struct ltt_filter *filter = ps->filter;
+	u8 jumps[LTT_FILTER_MAX_INSNS];
+	unsigned int i, nr_jumps = 0;
+	int ret;
+
+	ret = operand(ps);
+	while (!ret && filter_match(ps, token)) {
+		jumps[nr_jumps++] = filter->nr_insns;
+		ret = filter_emit(ps, op, 0);
+		if (!ret)
+			ret = operand(ps);
+	}
+	if (ret)
+		return ret;
+	if (!nr_jumps)
+		return 0;
+	for (i = 0; i < nr_jumps; i++)
+		filter->insns[jumps[i]].arg = filter->nr_insns - jumps[i] - 1;
+	return filter_emit(ps, LTT_FILTER_BOOL, 0);
+}
+
+/* and := cmp ('&&' cmp)* */
+static int filter_parse_and(struct filter_parser *ps)
+{
+	return filter_parse_chain(ps, "&&", LTT_FILTER_JZ, filter_parse_cmp);
+}
+
+/* or := and ('||' and)* */
+static int filter_parse_or(struct filter_parser *ps)
+{
+	return filter_parse_chain(ps, "||", LTT_FILTER_JNZ, filter_parse_and);
+}
+
+static struct ltt_filter *filter_compile(const char *channel,
+					 const char *name, const char *expr)
+{
+	struct filter_parser *ps;
+	struct ltt_filter *filter;
+	struct marker_iter iter;
+	int ret = -ENOENT;
+
+	ps = kzalloc(sizeof(*ps), GFP_KERNEL);
+	filter = kzalloc(sizeof(*filter), GFP_KERNEL);
+	if (!ps || !filter) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	ps->pos = expr;
+	ps->filter = filter;
+
+	marker_iter_reset(&iter);
+	marker_iter_start(&iter);
+	for (; iter.marker != NULL; marker_iter_next(&iter)) {
+		if (strcmp(iter.marker->channel, channel)
+		    || strcmp(iter.marker->name, name))
+			continue;
+		filter_parse_format(ps, iter.marker->format);
+		ret = filter_parse_or(ps);
+		if (!ret) {
+			filter_skip(ps);
+			if (*ps->pos)
+				ret = filter_error(ps, "syntax error");
+		}
+		if (!ret)
+			ret = filter_emit(ps, LTT_FILTER_RET, 0);
+		break;
+	}
+	marker_iter_stop(&iter);
+
+	if (ret == -ENOENT)
+		printk(KERN_INFO "ltt filter: no marker %s/%s\n",
+		       channel, name);
+	else if (ret)
+		printk(KERN_INFO "ltt filter: %s at \"%s\"\n", ps->error,
+		       ps->pos);
+	else {
+		/* a valid expression can still nest too deep for the stack */
+		ret = ltt_filter_verify(filter);
+		if (ret)
+			printk(KERN_INFO "ltt filter: expression too complex\n");
+	}
+end:
+	kfree(ps);
+	if (ret) {
+		kfree(filter);
+		return ERR_PTR(ret);
+	}
+	return filter;
+}
+
+static ssize_t filter_event_write(struct file *file,
+				  const char __user *user_buf,
+				  size_t count, loff_t *ppos)
+{
+	struct ltt_filter *filter = NULL;
+	char *buf, *channel, *name, *expr;
+	ssize_t ret;
+
+	if (count > PAGE_SIZE)
+		return -EINVAL;
+	buf = kmalloc(count + 1, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	ret = -EFAULT;
+	if (copy_from_user(buf, user_buf, count))
+		goto end;
+	buf[count] = '\0';
+
+	channel = strstrip(buf);
+	expr = channel;
+	while (*expr && !isspace(*expr))
+		expr++;
+	if (*expr)
+		*expr++ = '\0';
+	name = strchr(channel, '/');
+	ret = -EINVAL;
+	if (!name)
+		goto end;
+	*name++ = '\0';
+
+	if (*expr) {
+		filter = filter_compile(channel, name, expr);
+		if (IS_ERR(filter)) {
+			ret = PTR_ERR(filter);
+			goto end;
+		}
+	}
+	ret = ltt_marker_set_filter(channel, name, filter);
+	if (ret)
+		kfree(filter);
+	else
+		ret = count;
+end:
+	kfree(buf);
+	return ret;
+}
+
+static const struct file_operations ltt_filter_event_operations = {
+	.write = filter_event_write,
+};
+
+static struct dentry *ltt_filter_event_file;
+
+static int __init ltt_filter_init(void)
+{
+	struct dentry *filter_root;
+
+	filter_root = get_filter_root();
+	if (!filter_root)
+		return -ENOENT;
+	ltt_filter_event_file = debugfs_create_file(LTT_FILTER_EVENT_FILE,
+						    S_IWUSR, filter_root,
+						    NULL,
+						    &ltt_filter_event_operations);
+	if (IS_ERR(ltt_filter_event_file) || !ltt_filter_event_file) {
+		printk(KERN_ERR "ltt_filter_init: failed to create file %s\n",
+		       LTT_FILTER_EVENT_FILE);
+		return -EPERM;
+	}
+	return 0;
+}
+
 static void __exit ltt_filter_exit(void)
 {
+	debugfs_remove(ltt_filter_event_file);
 	debugfs_remove(ltt_filter_dir);
 }
 
+module_init(ltt_filter_init);
 module_exit(ltt_filter_exit);
 
 MODULE_LICENSE("GPL and additional rights");
@@ -104,6 +104,7 @@ int ltt_probe_unregister(struct ltt_available_probe *pdata)
 			if (ret)
 				goto end;
 			list_del(&amark->node);
+			kfree(amark->filter);
 			kmem_cache_free(markers_loaded_cachep, amark);
 		}
 	}
@@ -192,6 +193,7 @@ int ltt_marker_disconnect(const char *channel, const char *mname,
 		goto end;
 	else {
 		list_del(&pdata->node);
+		kfree(pdata->filter);
 		kmem_cache_free(markers_loaded_cachep, pdata);
 	}
 end:
@@ -200,6 +202,40 @@ end:
 }
 EXPORT_SYMBOL_GPL(ltt_marker_disconnect);
 
+/*
+ * Attach filter to marker "mname", whichever probe it is connected to,
+ * replacing any previous one.  A NULL filter records all events again.
+ * The filter belongs to the marker from then on and is freed when it is
+ * replaced or the marker is disconnected.
+ */
+int ltt_marker_set_filter(const char *channel, const char *mname,
+			  struct ltt_filter *filter)
+{
+	struct ltt_active_marker *pdata;
+	struct ltt_available_probe *probe;
+	struct ltt_filter *old;
+	int ret = -ENOENT;
+
+	mutex_lock(&probes_mutex);
+	list_for_each_entry(probe, &probes_registered_list, node) {
+		pdata = marker_get_private_data(channel, mname,
+						probe->probe_func, 0);
+		if (IS_ERR_OR_NULL(pdata))
+			continue;
+		old = pdata->filter;
+		rcu_assign_pointer(pdata->filter, filter);
+		if (old) {
+			synchronize_sched();
+			kfree(old);
+		}
+		ret = 0;
+		break;
+	}
+	mutex_unlock(&probes_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ltt_marker_set_filter);
+
 static void disconnect_all_markers(void)
 {
 	struct ltt_active_marker *pdata, *tmp;
@@ -208,6 +244,7 @@ static void disconnect_all_markers(void)
 		marker_probe_unregister_private_data(pdata->probe->probe_func,
 			pdata);
 		list_del(&pdata->node);
+		kfree(pdata->filter);
 		kmem_cache_free(markers_loaded_cachep, pdata);
 	}
 }
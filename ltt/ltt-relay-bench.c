@@ -0,0 +1,197 @@
+/*
+ * LTT relay benchmark.
+ *
+ * Writing a count N to /debugfs/ltt/relay_bench times N reservations with
+ * each of the three buffer concurrency schemes: the cmpxchg loop of the
+ * lockless relay, and the irq-off and spinlock + irq-off updates of the
+ * irqoff and locked relays.  Each takes a trace clock timestamp and
+ * updates the write offset and commit count of a per-cpu buffer, as the
+ * relays' fast paths do, so the three can be compared on one kernel
+ * whichever relay it was built with.
+ *
+ * If a trace is running with the ltt_bench/event marker enabled, N real
+ * events are then also written through the relay the kernel was built
+ * with.  Results are printed in events per second and trace clock ticks
+ * per event, which are CPU cycles on OMAP3.
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ */
+
+#include <linux/module.h>
+#include <linux/marker.h>
+#include <linux/uaccess.h>
+#include <linux/fs.h>
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/trace-clock.h>
+#include <linux/ltt-core.h>
+#include <linux/ltt-type-serializer.h>
+#include <asm/local.h>
+
+#define LTT_RELAY_BENCH_FILE	"relay_bench"
+#define BENCH_EVENT_SIZE	16	/* header and a 32-bit payload */
+
+DEFINE_MARKER(ltt_bench, event, "value %u");
+static struct dentry *ltt_bench_file;
+
+struct bench_buf {
+	local_t offset;
+	local_t commit;
+	long plain_offset;
+	long plain_commit;
+	spinlock_t lock;
+	u64 last_tsc;
+};
+
+static DEFINE_PER_CPU(struct bench_buf, bench_buf);
+
+static noinline void bench_lockless(struct bench_buf *b, unsigned long n)
+{
+	long o_old, o_new;
+	u64 tsc;
+
+	while (n--) {
+		do {
+			o_old = local_read(&b->offset);
+			tsc = trace_clock_read64();
+			o_new = o_old + BENCH_EVENT_SIZE;
+		} while (local_cmpxchg(&b->offset, o_old, o_new) != o_old);
+		b->last_tsc = tsc;
+		local_add(BENCH_EVENT_SIZE, &b->commit);
+	}
+}
+
+static noinline void bench_irqoff(struct bench_buf *b, unsigned long n)
+{
+	unsigned long flags;
+
+	while (n--) {
+		local_irq_save(flags);
+		b->last_tsc = trace_clock_read64();
+		b->plain_offset += BENCH_EVENT_SIZE;
+		b->plain_commit += BENCH_EVENT_SIZE;
+		local_irq_restore(flags);
+	}
+}
+
+static noinline void bench_locked(struct bench_buf *b, unsigned long n)
+{
+	unsigned long flags;
+
+	while (n--) {
+		spin_lock_irqsave(&b->lock, flags);
+		b->last_tsc = trace_clock_read64();
+		b->plain_offset += BENCH_EVENT_SIZE;
+		b->plain_commit += BENCH_EVENT_SIZE;
+		spin_unlock_irqrestore(&b->lock, flags);
+	}
+}
+
+static noinline void bench_relay(struct bench_buf *b, unsigned long n)
+{
+	struct marker *marker = &GET_MARKER(ltt_bench, event);
+	u32 value;
+
+	while (n--) {
+		value = n;
+		ltt_specialized_trace(marker, marker->single.probe_private,
+				      &value, sizeof(value), sizeof(value));
+	}
+}
+
+static void bench_run(const char *name,
+		      void (*fn)(struct bench_buf *, unsigned long),
+		      unsigned long n)
+{
+	struct bench_buf *b;
+	ktime_t start;
+	u64 ns, ticks;
+
+	b = &get_cpu_var(bench_buf);
+	start = ktime_get();
+	ticks = trace_clock_read64();
+	fn(b, n);
+	ticks = trace_clock_read64() - ticks;
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	put_cpu_var(bench_buf);
+
+	printk(KERN_INFO "LTT relay bench: %-8s %llu events/s, "
+	       "%llu ticks/event\n", name,
+	       div64_u64((u64)n * NSEC_PER_SEC, ns ? ns : 1),
+	       div64_u64(ticks, n));
+}
+
+static ssize_t bench_write(struct file *file, const char __user *user_buf,
+			   size_t count, loff_t *ppos)
+{
+	struct marker *marker = &GET_MARKER(ltt_bench, event);
+	char buf[16];
+	unsigned long n;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+	n = simple_strtoul(buf, NULL, 0);
+	if (!n)
+		return -EINVAL;
+
+	get_trace_clock();
+	printk(KERN_INFO "LTT relay bench: %lu events, trace clock at "
+	       "%llu Hz\n", n, (unsigned long long)trace_clock_frequency());
+	bench_run("lockless", bench_lockless, n);
+	bench_run("irqoff", bench_irqoff, n);
+	bench_run("locked", bench_locked, n);
+	if (ltt_traces.num_active_traces && _imv_read(marker->state))
+		bench_run("relay", bench_relay, n);
+	else
+		printk(KERN_INFO "LTT relay bench: start a trace with "
+		       "ltt_bench/event enabled to time the relay itself\n");
+	put_trace_clock();
+
+	return count;
+}
+
+static const struct file_operations ltt_bench_operations = {
+	.write = bench_write,
+};
+
+static int __init ltt_relay_bench_init(void)
+{
+	struct dentry *ltt_root_dentry;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu(bench_buf, cpu).lock);
+
+	ltt_root_dentry = get_ltt_root();
+	if (!ltt_root_dentry)
+		return -ENOENT;
+
+	ltt_bench_file = debugfs_create_file(LTT_RELAY_BENCH_FILE, S_IWUSR,
+					     ltt_root_dentry, NULL,
+					     &ltt_bench_operations);
+	if (IS_ERR(ltt_bench_file) || !ltt_bench_file) {
+		printk(KERN_ERR "ltt_relay_bench_init: failed to create "
+		       "file %s\n", LTT_RELAY_BENCH_FILE);
+		put_ltt_root();
+		return -EPERM;
+	}
+	return 0;
+}
+
+static void __exit ltt_relay_bench_exit(void)
+{
+	debugfs_remove(ltt_bench_file);
+	put_ltt_root();
+}
+
+module_init(ltt_relay_bench_init);
+module_exit(ltt_relay_bench_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_DESCRIPTION("Linux Trace Toolkit relay benchmark");
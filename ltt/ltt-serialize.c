@@ -804,6 +804,7 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 {
 	int largest_align, ret;
 	struct ltt_active_marker *pdata;
+	struct ltt_filter *filter;
 	uint16_t eID;
 	size_t data_size, slot_size;
 	unsigned int chan_index;
@@ -849,6 +850,13 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 		serialize_private = private_data->serialize_private;
 	}
 
+	/*
+	 * Run the marker's filter before computing anything for the event.
+	 */
+	filter = rcu_dereference(pdata->filter);
+	if (unlikely(filter) && !ltt_filter_match_va(filter, args))
+		goto end;
+
 	va_copy(args_copy, *args);
 	/*
 	 * Assumes event payload to start on largest_align alignment.
@@ -907,6 +915,7 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 		/* Out-of-order commit */
 		ltt_commit_slot(buf, chan, buf_offset, data_size, slot_size);
 	}
+end:
 	/*
 	 * asm volatile and "memory" clobber prevent the compiler from moving
 	 * instructions out of the ltt nesting count. This is required to ensure
@@ -17,6 +17,8 @@ void _ltt_specialized_trace(const struct marker *mdata, void *probe_data,
 		void *serialize_private, unsigned int data_size,
 		unsigned int largest_align)
 {
+	struct ltt_active_marker *pdata = probe_data;
+	struct ltt_filter *filter;
 	int ret;
 	uint16_t eID;
 	size_t slot_size;
@@ -46,6 +48,12 @@ void _ltt_specialized_trace(const struct marker *mdata, void *probe_data,
 	 * nesting count section.
 	 */
 	barrier();
+	if (likely(pdata)) {
+		filter = rcu_dereference(pdata->filter);
+		if (unlikely(filter)
+		    && !ltt_filter_match_data(filter, serialize_private))
+			goto end;
+	}
 	eID = mdata->event_id;
 	chan_index = mdata->channel_id;
 
@@ -95,6 +103,7 @@ void _ltt_specialized_trace(const struct marker *mdata, void *probe_data,
 		/* Out-of-order commit */
 		ltt_commit_slot(buf, chan, buf_offset, data_size, slot_size);
 	}
+end:
 	/*
 	 * asm volatile and "memory" clobber prevent the compiler from moving
 	 * instructions out of the ltt nesting count. This is required to ensure
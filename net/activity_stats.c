@@ -14,8 +14,15 @@
  * Author: Mike Chan (mike@android.com)
  */
 
+#include <linux/hash.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/suspend.h>
+#include <net/activity_stats.h>
 #include <net/net_namespace.h>
 
 /*
@@ -27,44 +34,197 @@
  */
 #define BUCKET_MAX 10
 
+/*
+ * Global transmissions are counted per cpu and summed when read, so the
+ * transmit path never writes a shared cache line unless it starts a new
+ * burst of activity.
+ */
+struct activity_cpu_stats {
+	unsigned long buckets[BUCKET_MAX];
+};
+
+static DEFINE_PER_CPU(struct activity_cpu_stats, activity_cpu_stats);
+
+/*
+ * Per uid and per interface breakdown.  Entries are looked up under RCU;
+ * those of an interface are freed when it is unregistered, those of a uid
+ * never.  Only the transmission that wins the cmpxchg on last may touch
+ * buckets, and winners are at least a second apart.
+ */
+struct activity_entry {
+	struct hlist_node link;
+	struct rcu_head rcu;
+	int key;
+	unsigned long last;
+	unsigned long buckets[BUCKET_MAX];
+	char name[IFNAMSIZ];
+};
+
+#define ACTIVITY_HASH_BITS 5
+#define ACTIVITY_HASH_SIZE (1 << ACTIVITY_HASH_BITS)
+
+static struct hlist_head uid_hash[ACTIVITY_HASH_SIZE];
+static struct hlist_head dev_hash[ACTIVITY_HASH_SIZE];
+static DEFINE_SPINLOCK(activity_lock);
+
 /* Track network activity frequency */
-static unsigned long activity_stats[BUCKET_MAX];
-static ktime_t last_transmit;
+static unsigned long last_transmit;
+static unsigned long suspend_offset;
 static ktime_t suspend_time;
-static DEFINE_SPINLOCK(activity_lock);
 
-void activity_stats_update(void)
+/* Milliseconds of monotonic time, counting the time spent suspended */
+static inline unsigned long activity_now(void)
+{
+	struct timespec ts;
+
+	ktime_get_ts(&ts);
+	return ts.tv_sec * MSEC_PER_SEC + ts.tv_nsec / NSEC_PER_MSEC +
+		suspend_offset;
+}
+
+/*
+ * Claim the transmission at now for last if it is at least a second
+ * after the previous one, and return its bucket or -1.
+ */
+static int activity_claim(unsigned long *last, unsigned long now)
 {
+	unsigned long prev = ACCESS_ONCE(*last);
+	unsigned long delta = now - prev;
 	int i;
+
+	if (delta < MSEC_PER_SEC)
+		return -1;
+
+	if (cmpxchg(last, prev, now) != prev)
+		return -1;
+
+	for (i = BUCKET_MAX - 1; i > 0; i--)
+		if (delta >= (MSEC_PER_SEC << i))
+			break;
+
+	return i;
+}
+
+static struct activity_entry *activity_find(struct hlist_head *hash, int key)
+{
+	struct activity_entry *entry;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(entry, pos,
+			&hash[hash_32(key, ACTIVITY_HASH_BITS)], link)
+		if (entry->key == key)
+			return entry;
+
+	return NULL;
+}
+
+static struct activity_entry *activity_create(struct hlist_head *hash,
+					int key, const char *name)
+{
+	struct activity_entry *entry;
 	unsigned long flags;
-	ktime_t now;
-	s64 delta;
 
 	spin_lock_irqsave(&activity_lock, flags);
-	now = ktime_get();
-	delta = ktime_to_ns(ktime_sub(now, last_transmit));
-
-	for (i = BUCKET_MAX - 1; i >= 0; i--) {
-		/*
-		 * Check if the time delta between network activity is within the
-		 * minimum bucket range.
-		 */
-		if (delta < (1000000000ULL << i))
-			continue;
-
-		activity_stats[i]++;
-		last_transmit = now;
-		break;
+
+	/* somebody may have beaten us to it */
+	entry = activity_find(hash, key);
+	if (entry)
+		goto out;
+
+	entry = kzalloc(sizeof(*entry), GFP_ATOMIC);
+	if (!entry)
+		goto out;
+
+	entry->key = key;
+	if (name)
+		strlcpy(entry->name, name, sizeof(entry->name));
+	hlist_add_head_rcu(&entry->link,
+			&hash[hash_32(key, ACTIVITY_HASH_BITS)]);
+out:
+	spin_unlock_irqrestore(&activity_lock, flags);
+	return entry;
+}
+
+static void activity_entry_update(struct hlist_head *hash, int key,
+				const char *name, unsigned long now)
+{
+	struct activity_entry *entry;
+	int i;
+
+	rcu_read_lock();
+	entry = activity_find(hash, key);
+	if (!entry)
+		entry = activity_create(hash, key, name);
+	if (entry) {
+		i = activity_claim(&entry->last, now);
+		if (i >= 0)
+			entry->buckets[i]++;
 	}
+	rcu_read_unlock();
+}
+
+void activity_stats_update(uid_t uid)
+{
+	struct activity_cpu_stats *stats;
+	unsigned long now = activity_now();
+	int i;
+
+	stats = &get_cpu_var(activity_cpu_stats);
+	i = activity_claim(&last_transmit, now);
+	if (i >= 0)
+		stats->buckets[i]++;
+	put_cpu_var(activity_cpu_stats);
+
+	activity_entry_update(uid_hash, uid, NULL, now);
+}
+
+void activity_stats_dev_update(struct net_device *dev)
+{
+	if (dev->flags & IFF_LOOPBACK)
+		return;
+
+	activity_entry_update(dev_hash, dev->ifindex, dev->name,
+			activity_now());
+}
+
+static void activity_entry_free(struct rcu_head *head)
+{
+	kfree(container_of(head, struct activity_entry, rcu));
+}
+
+static int activity_netdev_event(struct notifier_block *nb,
+					unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+	struct activity_entry *entry;
+	unsigned long flags;
+
+	if (event != NETDEV_UNREGISTER)
+		return NOTIFY_DONE;
+
+	spin_lock_irqsave(&activity_lock, flags);
+	entry = activity_find(dev_hash, dev->ifindex);
+	if (entry)
+		hlist_del_rcu(&entry->link);
 	spin_unlock_irqrestore(&activity_lock, flags);
+
+	if (entry)
+		call_rcu(&entry->rcu, activity_entry_free);
+	return NOTIFY_DONE;
 }
 
+static struct notifier_block activity_netdev_notifier_block = {
+	.notifier_call = activity_netdev_event,
+};
+
 static int activity_stats_read_proc(char *page, char **start, off_t off,
 					int count, int *eof, void *data)
 {
 	int i;
+	int cpu;
 	int len;
 	char *p = page;
+	unsigned long bucket;
 
 	/* Only print if offset is 0, or we have enough buffer space */
 	if (off || count < (30 * BUCKET_MAX + 22))
@@ -75,7 +235,11 @@ static int activity_stats_read_proc(char *page, char **start, off_t off,
 	p += len;
 
 	for (i = 0; i < BUCKET_MAX; i++) {
-		len = snprintf(p, count, "%15d %lu\n", 1 << i, activity_stats[i]);
+		bucket = 0;
+		for_each_possible_cpu(cpu)
+			bucket += per_cpu(activity_cpu_stats, cpu).buckets[i];
+
+		len = snprintf(p, count, "%15d %lu\n", 1 << i, bucket);
 		count -= len;
 		p += len;
 	}
@@ -84,9 +248,76 @@ static int activity_stats_read_proc(char *page, char **start, off_t off,
 	return p - page;
 }
 
+/*
+ * /proc/net/stat/activity_uid and activity_iface print one line per uid
+ * or interface, with the counts for each bucket in the order above.
+ */
+static void *activity_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	rcu_read_lock();
+	return *pos < ACTIVITY_HASH_SIZE ? pos : NULL;
+}
+
+static void *activity_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	return ++*pos < ACTIVITY_HASH_SIZE ? pos : NULL;
+}
+
+static void activity_seq_stop(struct seq_file *seq, void *v)
+{
+	rcu_read_unlock();
+}
+
+static int activity_seq_show(struct seq_file *seq, void *v)
+{
+	struct hlist_head *hash = seq->private;
+	struct activity_entry *entry;
+	struct hlist_node *pos;
+	int i;
+
+	hlist_for_each_entry_rcu(entry, pos, &hash[*(loff_t *)v], link) {
+		if (hash == dev_hash)
+			seq_printf(seq, "%-15s", entry->name);
+		else
+			seq_printf(seq, "%-15d", entry->key);
+		for (i = 0; i < BUCKET_MAX; i++)
+			seq_printf(seq, " %lu", entry->buckets[i]);
+		seq_putc(seq, '\n');
+	}
+
+	return 0;
+}
+
+static const struct seq_operations activity_seq_ops = {
+	.start = activity_seq_start,
+	.next = activity_seq_next,
+	.stop = activity_seq_stop,
+	.show = activity_seq_show,
+};
+
+static int activity_seq_open(struct inode *inode, struct file *file)
+{
+	int ret = seq_open(file, &activity_seq_ops);
+
+	if (!ret)
+		((struct seq_file *)file->private_data)->private =
+			PDE(inode)->data;
+	return ret;
+}
+
+static const struct file_operations activity_seq_fops = {
+	.owner = THIS_MODULE,
+	.open = activity_seq_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+
 static int activity_stats_notifier(struct notifier_block *nb,
 					unsigned long event, void *dummy)
 {
+	struct timeval tv;
+
 	switch (event) {
 		case PM_SUSPEND_PREPARE:
 			suspend_time = ktime_get_real();
@@ -94,7 +325,9 @@ static int activity_stats_notifier(struct notifier_block *nb,
 
 		case PM_POST_SUSPEND:
 			suspend_time = ktime_sub(ktime_get_real(), suspend_time);
-			last_transmit = ktime_sub(last_transmit, suspend_time);
+			tv = ktime_to_timeval(suspend_time);
+			suspend_offset += tv.tv_sec * MSEC_PER_SEC +
+				tv.tv_usec / USEC_PER_MSEC;
 	}
 
 	return 0;
@@ -109,8 +342,12 @@ static int  __init activity_stats_init(void)
 {
 	create_proc_read_entry("activity", S_IRUGO,
 			init_net.proc_net_stat, activity_stats_read_proc, NULL);
+	proc_create_data("activity_uid", S_IRUGO, init_net.proc_net_stat,
+			&activity_seq_fops, uid_hash);
+	proc_create_data("activity_iface", S_IRUGO, init_net.proc_net_stat,
+			&activity_seq_fops, dev_hash);
+	register_netdevice_notifier(&activity_netdev_notifier_block);
 	return register_pm_notifier(&activity_stats_notifier_block);
 }
 
 subsys_initcall(activity_stats_init);
-
@@ -128,6 +128,7 @@
 #include <linux/random.h>
 #include <trace/events/napi.h>
 #include <trace/net.h>
+#include <net/activity_stats.h>
 
 #include "net-sysfs.h"
 
@@ -1911,6 +1912,8 @@ int dev_queue_xmit(struct sk_buff *skb)
 	}
 
 gso:
+	activity_stats_dev_update(dev);
+
 	/* Disable soft irqs for various locks below. Also
 	 * stops preemption for RCU.
 	 */